@@ -0,0 +1,59 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+  std::atomic<uint64_t> allocations{0};
+
+  void* allocate(size_t size)
+  {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+      return ptr;
+    throw std::bad_alloc();
+  }
+}
+
+void* operator new(size_t size)
+{
+  return allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+uint64_t AllocationCounter::count()
+{
+  return allocations.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::report(benchmark::State &state, uint64_t countBefore)
+{
+  state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(count() - countBefore),
+                                                   benchmark::Counter::kAvgIterations);
+}
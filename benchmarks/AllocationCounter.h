@@ -0,0 +1,22 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+/**
+ * /brief Счетчик выделений памяти через глобальный operator new
+ *
+ * Считаются выделения всех потоков процесса, поэтому фоновые потоки (например, поток записи
+ * асинхронного логгера) тоже попадают в результат измерения.
+ */
+namespace AllocationCounter
+{
+  uint64_t count();
+
+  // Выводит среднее число выделений на одну итерацию бенчмарка в колонке allocs/op
+  void report(benchmark::State& state, uint64_t countBefore);
+}
+
+#endif
@@ -0,0 +1,56 @@
+#include "AllocationCounter.h"
+
+#include "Logger/Logger.h"
+
+#include <QLoggingCategory>
+
+#include <benchmark/benchmark.h>
+
+Q_LOGGING_CATEGORY(lcBenchmark, "benchmark")
+
+namespace
+{
+  const char logFile[] = "benchmark_logger.log";
+
+  // Время выдачи сообщения потоком, который логирует: вызов обработчика и запись (или постановка в очередь)
+  void logMessages(benchmark::State& state)
+  {
+    const uint64_t allocationsBefore = AllocationCounter::count();
+    int value = 0;
+    for (auto _ : state)
+      qCWarning(lcBenchmark) << "Server received request with value:" << ++value;
+    AllocationCounter::report(state, allocationsBefore);
+
+    // возвращаем логгер, которым пользуются остальные бенчмарки
+    Logger::setupLogging("benchmarks.log", QtWarningMsg);
+  }
+
+  Logger::AsyncSettings asyncSettings()
+  {
+    Logger::AsyncSettings settings;
+    settings.queueCapacity = 65536;
+    settings.overflowPolicy = Logger::OverflowPolicy::Block;
+    return settings;
+  }
+}
+
+static void BM_LoggerSync(benchmark::State& state)
+{
+  Logger::setupLogging(logFile, QtWarningMsg);
+  logMessages(state);
+}
+BENCHMARK(BM_LoggerSync);
+
+static void BM_LoggerAsync(benchmark::State& state)
+{
+  Logger::setupAsyncLogging(logFile, QtWarningMsg, asyncSettings());
+  logMessages(state);
+}
+BENCHMARK(BM_LoggerAsync);
+
+static void BM_LoggerAsyncBinary(benchmark::State& state)
+{
+  Logger::setupAsyncLogging(logFile, QtWarningMsg, asyncSettings(), LogRotationSettings(), LogFormat::Binary);
+  logMessages(state);
+}
+BENCHMARK(BM_LoggerAsyncBinary);
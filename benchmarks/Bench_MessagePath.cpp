@@ -0,0 +1,99 @@
+#include "AllocationCounter.h"
+#include "LoopbackConnection.h"
+
+#include "Client.h"
+#include "Server.h"
+#include "RabbitMQClient/InMemoryConnection.h"
+#include "protocol/Messages.pb.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+  std::shared_ptr<Client> createClient(const std::shared_ptr<LoopbackConnection>& connection)
+  {
+    return std::make_shared<Client>(connection, "localhost", 5672, "guest", "guest", 0, "/",
+                                    "exchange", "responseQueue", "requestQueue");
+  }
+}
+
+static void BM_ClientSendRequest(benchmark::State& state)
+{
+  auto connection = std::make_shared<LoopbackConnection>();
+  auto client = createClient(connection);
+
+  const uint64_t allocationsBefore = AllocationCounter::count();
+  int value = 0;
+  for (auto _ : state)
+    client->sendRequest(++value);
+  AllocationCounter::report(state, allocationsBefore);
+}
+BENCHMARK(BM_ClientSendRequest);
+
+static void BM_ClientGetResponse(benchmark::State& state)
+{
+  auto connection = std::make_shared<LoopbackConnection>();
+  auto client = createClient(connection);
+
+  TestTask::Messages::Response response;
+  response.set_id(client->getId().toString().toStdString());
+  response.set_res(84);
+  connection->setIncomingMessage(response.SerializeAsString());
+
+  // в каждую итерацию входит выделение конверта LoopbackConnection
+  const uint64_t allocationsBefore = AllocationCounter::count();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(client->getResponse(std::chrono::milliseconds(0)));
+  AllocationCounter::report(state, allocationsBefore);
+}
+BENCHMARK(BM_ClientGetResponse);
+
+static void BM_ServerProcessRequestResponseCycle(benchmark::State& state)
+{
+  auto connection = std::make_shared<LoopbackConnection>();
+  Server server(connection, "localhost", 5672, "guest", "guest", 0, "/",
+                "exchange", "responseQueue", "requestQueue");
+
+  TestTask::Messages::Request request;
+  request.set_id("{6f1c2b7e-94a0-4d3e-8a51-0c7f2d9b3e41}");
+  request.set_req(42);
+  connection->setIncomingMessage(request.SerializeAsString());
+
+  // в каждую итерацию входит выделение конверта LoopbackConnection
+  const uint64_t allocationsBefore = AllocationCounter::count();
+  for (auto _ : state)
+    server.processRequestResponseCycle(std::chrono::milliseconds(0));
+  AllocationCounter::report(state, allocationsBefore);
+
+  if (connection->getPublishedCount() != static_cast<uint64_t>(state.iterations()))
+    state.SkipWithError("Server did not publish a response for every request");
+}
+BENCHMARK(BM_ServerProcessRequestResponseCycle);
+
+// Полный цикл запроса через InMemoryBroker в одном потоке: публикация, маршрутизация, обработка сервером, ответ
+static void BM_InMemoryRoundTrip(benchmark::State& state)
+{
+  auto broker = InMemoryBroker::create();
+  Server server(InMemoryConnection::create(broker), "localhost", 5672, "guest", "guest", 0, "/",
+                "exchange", "responseQueue", "requestQueue");
+  Client client(InMemoryConnection::create(broker), "localhost", 5672, "guest", "guest", 0, "/",
+                "exchange", "responseQueue", "requestQueue", static_cast<ReplyMode>(state.range(0)));
+
+  const uint64_t allocationsBefore = AllocationCounter::count();
+  int value = 0;
+  for (auto _ : state)
+  {
+    client.sendRequest(++value);
+    server.processRequestResponseCycle(std::chrono::milliseconds(0));
+    if (!client.getResponse(std::chrono::milliseconds(0)).first)
+    {
+      state.SkipWithError("Client did not receive a response");
+      break;
+    }
+  }
+  AllocationCounter::report(state, allocationsBefore);
+}
+BENCHMARK(BM_InMemoryRoundTrip)
+    ->Arg(static_cast<int>(ReplyMode::SharedQueue))
+    ->Arg(static_cast<int>(ReplyMode::ExclusiveQueue))
+    ->Arg(static_cast<int>(ReplyMode::DirectReplyTo));
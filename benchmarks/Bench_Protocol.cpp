@@ -0,0 +1,83 @@
+#include "AllocationCounter.h"
+
+#include "protocol/Messages.pb.h"
+#include "RabbitMQClient/BytesView.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+  const char clientId[] = "{6f1c2b7e-94a0-4d3e-8a51-0c7f2d9b3e41}";
+
+  TestTask::Messages::Request makeRequest()
+  {
+    TestTask::Messages::Request request;
+    request.set_id(clientId);
+    request.set_req(42);
+    request.set_correlation_id("17");
+    return request;
+  }
+
+  TestTask::Messages::Response makeResponse()
+  {
+    TestTask::Messages::Response response;
+    response.set_id(clientId);
+    response.set_res(84);
+    response.set_correlation_id("17");
+    return response;
+  }
+
+  // Сериализация в переиспользуемый буфер, как при публикации запросов и ответов
+  template <typename Message>
+  void serialize(benchmark::State& state, const Message& message)
+  {
+    std::string buffer;
+    const uint64_t allocationsBefore = AllocationCounter::count();
+    for (auto _ : state)
+    {
+      const BytesView body = serializeToBuffer(message, buffer);
+      benchmark::DoNotOptimize(body.data);
+    }
+    AllocationCounter::report(state, allocationsBefore);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * buffer.size()));
+  }
+
+  // Разбор в новый объект на каждое сообщение, как в Client::getResponse и Server::prepareResponse
+  template <typename Message>
+  void parse(benchmark::State& state, const Message& message)
+  {
+    const std::string serialized = message.SerializeAsString();
+    const uint64_t allocationsBefore = AllocationCounter::count();
+    for (auto _ : state)
+    {
+      Message parsed;
+      benchmark::DoNotOptimize(parsed.ParseFromArray(serialized.data(), static_cast<int>(serialized.size())));
+    }
+    AllocationCounter::report(state, allocationsBefore);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * serialized.size()));
+  }
+}
+
+static void BM_RequestSerialize(benchmark::State& state)
+{
+  serialize(state, makeRequest());
+}
+BENCHMARK(BM_RequestSerialize);
+
+static void BM_RequestParse(benchmark::State& state)
+{
+  parse(state, makeRequest());
+}
+BENCHMARK(BM_RequestParse);
+
+static void BM_ResponseSerialize(benchmark::State& state)
+{
+  serialize(state, makeResponse());
+}
+BENCHMARK(BM_ResponseSerialize);
+
+static void BM_ResponseParse(benchmark::State& state)
+{
+  parse(state, makeResponse());
+}
+BENCHMARK(BM_ResponseParse);
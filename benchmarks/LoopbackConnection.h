@@ -0,0 +1,120 @@
+#ifndef LOOPBACKCONNECTION_H
+#define LOOPBACKCONNECTION_H
+
+#include "RabbitMQClient/IRabbitmqConnection.h"
+#include "RabbitMQClient/rabbitmqEntities.h"
+
+#include <string>
+
+/**
+ * /brief Соединение без брокера для измерения собственного кода Client и Server
+ *
+ * Публикация запоминает тело последнего сообщения, получение отдает заданное тело сообщения.
+ * Объекты брокера (канал, обменник, очереди) не создаются, как и в тестовых моках:
+ * Client и Server только передают их обратно в соединение.
+ */
+class LoopbackConnection : public IRabbitmqConnection
+{
+public:
+  class Envelope : public IRabbitmqEnvelope
+  {
+  public:
+    explicit Envelope(const std::string& message) : m_message(message) {}
+
+    amqp_envelope_t* get() override {return nullptr;}
+    amqp_channel_t getChannel() const override {return 1;}
+    uint64_t getDeliveryTag() const override {return 1;}
+    std::string getMessage() const override {return std::string(m_message);}
+    BytesView getMessageView() const override {return BytesView(m_message);}
+    std::string getReplyTo() const override {return std::string();}
+    std::string getCorrelationId() const override {return std::string();}
+  private:
+    const std::string& m_message;
+  };
+
+  // Тело, которое возвращают consumeMessage и timedConsumeMessage
+  void setIncomingMessage(const std::string& message) {m_incoming = message;}
+  const std::string& getLastPublished() const {return m_lastPublished;}
+  uint64_t getPublishedCount() const {return m_publishedCount;}
+
+  std::unique_ptr<RabbitmqSocket> openSocket(const std::string&, int) override {return nullptr;}
+  void login(const std::string&, const std::string&, int, const std::string&) override {}
+  std::unique_ptr<RabbitmqChannel> openChannel() override {return nullptr;}
+  std::unique_ptr<RabbitmqExchange> declareExchange(const RabbitmqChannel&, const std::string&,
+                                                    const std::string&) override {return nullptr;}
+  std::unique_ptr<RabbitmqQueue> declareQueue(const RabbitmqChannel&, const std::string&) override {return nullptr;}
+  std::unique_ptr<RabbitmqQueue> declareExclusiveQueue(const RabbitmqChannel&) override {return nullptr;}
+  std::unique_ptr<RabbitmqBind> bind(const RabbitmqChannel&, const RabbitmqQueue&, const RabbitmqExchange&,
+                                     const std::string&) override {return nullptr;}
+
+  void basicQos(const RabbitmqChannel&, uint16_t) override {}
+  void basicConsume(const RabbitmqChannel&, const RabbitmqQueue&, bool, bool) override {}
+  void consumeDirectReplyTo(const RabbitmqChannel&) override {}
+  void confirmSelect(const RabbitmqChannel&) override {}
+  size_t getUnconfirmedCount() const override {return 0;}
+
+  void publishMessage(const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&, BytesView message) override
+  {
+    store(message);
+  }
+  void publishMessage(const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&, BytesView message,
+                      const RabbitmqMessageProperties&) override
+  {
+    store(message);
+  }
+  void publishToQueue(const RabbitmqChannel&, const std::string&, BytesView message,
+                      const RabbitmqMessageProperties&) override
+  {
+    store(message);
+  }
+  void publishBatch(const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&,
+                    const std::vector<BatchMessage>& messages) override
+  {
+    for (const auto& message : messages)
+      store(message.body);
+  }
+  void publishMessage(const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&, BytesView message,
+                      const RabbitmqMessageProperties&, PublishConfirmCallback onConfirm) override
+  {
+    store(message);
+    if (onConfirm)
+      onConfirm(true);
+  }
+  void publishToQueue(const RabbitmqChannel&, const std::string&, BytesView message,
+                      const RabbitmqMessageProperties&, PublishConfirmCallback onConfirm) override
+  {
+    store(message);
+    if (onConfirm)
+      onConfirm(true);
+  }
+
+  void ack(const IRabbitmqEnvelope&) override {}
+  void reject(const IRabbitmqEnvelope&, bool) override {}
+
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessage() override
+  {
+    return consumeMessageInternal(nullptr);
+  }
+  std::unique_ptr<IRabbitmqEnvelope> timedConsumeMessage(std::chrono::milliseconds) override
+  {
+    return consumeMessageInternal(nullptr);
+  }
+protected:
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessageInternal(struct timeval*) override
+  {
+    return std::unique_ptr<IRabbitmqEnvelope>(new Envelope(m_incoming));
+  }
+private:
+  // емкость строки сохраняется между публикациями, копирование тела не выделяет память
+  void store(BytesView message)
+  {
+    m_lastPublished.assign(message.data, message.size);
+    ++m_publishedCount;
+  }
+
+  std::string m_incoming;
+  std::string m_lastPublished;
+  uint64_t m_publishedCount = 0;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#include "Logger/Logger.h"
+
+#include <benchmark/benchmark.h>
+
+int main(int argc, char** argv)
+{
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+
+  // сообщения info отсекаются в категориях, как в рабочей конфигурации; бенчмарки логгера ставят свой логгер
+  Logger::setupLogging("benchmarks.log", QtWarningMsg);
+  benchmark::RunSpecifiedBenchmarks();
+  Logger::shutdownLogging();
+  return 0;
+}
@@ -0,0 +1,201 @@
+#include "Client.h"
+#include "ClientSession.h"
+#include "Server.h"
+#include "RabbitMQClient/InMemoryConnection.h"
+#include "RabbitMQClient/IoThreadConnection.h"
+#include "Logger/Logger.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  std::unique_ptr<Server> createServer(std::shared_ptr<IRabbitmqConnection> connection)
+  {
+    return std::make_unique<Server>(connection,
+                                    "localhost", 5672,
+                                    "guest", "guest", 0, "/",
+                                    "test_exchange", "response_queue", "request_queue");
+  }
+
+  std::unique_ptr<Client> createClient(std::shared_ptr<IRabbitmqConnection> connection, ReplyMode replyMode)
+  {
+    return std::make_unique<Client>(connection,
+                                    "localhost", 5672,
+                                    "guest", "guest", 0, "/",
+                                    "test_exchange", "response_queue", "request_queue",
+                                    replyMode);
+  }
+}
+
+// Те же сценарии, что и в IntegrationTest, но без RabbitMQ: клиенты и серверы работают через InMemoryBroker
+class InMemoryIntegrationTest : public ::testing::TestWithParam<ReplyMode>
+{
+protected:
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtWarningMsg);
+  }
+
+  std::shared_ptr<InMemoryBroker> broker = InMemoryBroker::create();
+};
+
+TEST_P(InMemoryIntegrationTest, ClientsGetOwnResponses)
+{
+  const int clientCount = 4;
+  const int requestsPerClient = 200;
+
+  std::atomic<bool> running{true};
+  std::vector<std::thread> servers;
+  for (int i = 0; i < 2; ++i)
+    servers.emplace_back([this, &running]()
+                         {
+                           auto server = createServer(InMemoryConnection::create(broker));
+                           while (running)
+                             server->processRequestResponseCycle(std::chrono::milliseconds(10));
+                         });
+
+  std::vector<std::thread> clients;
+  for (int i = 0; i < clientCount; ++i)
+    clients.emplace_back([this, i]()
+                         {
+                           auto client = createClient(InMemoryConnection::create(broker), GetParam());
+                           std::vector<std::future<int>> results;
+                           for (int j = 0; j < requestsPerClient; ++j)
+                             results.push_back(client->sendRequestAsync(i * requestsPerClient + j));
+
+                           const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+                           while (client->getInFlightCount() != 0 && std::chrono::steady_clock::now() < deadline)
+                             client->getResponse(std::chrono::milliseconds(10));
+
+                           ASSERT_EQ(client->getInFlightCount(), 0u);
+                           for (int j = 0; j < requestsPerClient; ++j)
+                             EXPECT_EQ(results[j].get(), Server::generateResponseValue(i * requestsPerClient + j));
+                         });
+  for (auto& client : clients)
+    client.join();
+
+  running = false;
+  for (auto& server : servers)
+    server.join();
+
+  EXPECT_EQ(broker->getReadyCount("request_queue"), 0u);
+  EXPECT_EQ(broker->getUnackedCount("request_queue"), 0u);
+}
+
+TEST_P(InMemoryIntegrationTest, ClientsShareIoThreadConnection)
+{
+  const int clientCount = 32;
+  const int requestsPerClient = 20;
+
+  // клиенты и серверы не открывают своих соединений: все логические соединения идут через два потока ввода-вывода
+  auto serverIo = IoThreadConnection::create(InMemoryConnection::create(broker));
+  auto clientIo = IoThreadConnection::create(InMemoryConnection::create(broker));
+
+  std::atomic<bool> running{true};
+  std::vector<std::thread> servers;
+  for (int i = 0; i < 2; ++i)
+    servers.emplace_back([&serverIo, &running]()
+                         {
+                           auto server = createServer(serverIo->attach());
+                           while (running)
+                             server->processRequestResponseCycle(std::chrono::milliseconds(10));
+                         });
+
+  std::vector<std::thread> clients;
+  for (int i = 0; i < clientCount; ++i)
+    clients.emplace_back([this, &clientIo, i]()
+                         {
+                           auto client = createClient(clientIo->attach(), GetParam());
+                           std::vector<std::future<int>> results;
+                           for (int j = 0; j < requestsPerClient; ++j)
+                             results.push_back(client->sendRequestAsync(i * requestsPerClient + j));
+
+                           const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+                           while (client->getInFlightCount() != 0 && std::chrono::steady_clock::now() < deadline)
+                             client->getResponse(std::chrono::milliseconds(10));
+
+                           ASSERT_EQ(client->getInFlightCount(), 0u);
+                           for (int j = 0; j < requestsPerClient; ++j)
+                             EXPECT_EQ(results[j].get(), Server::generateResponseValue(i * requestsPerClient + j));
+                         });
+  for (auto& client : clients)
+    client.join();
+
+  running = false;
+  for (auto& server : servers)
+    server.join();
+
+  EXPECT_TRUE(serverIo->isRunning());
+  EXPECT_TRUE(clientIo->isRunning());
+}
+
+TEST_P(InMemoryIntegrationTest, ClientsShareSession)
+{
+  const int threadCount = 4;
+  const int clientsPerThread = 50;
+  const int requestsPerClient = 4;
+
+  // соединение, канал и подписка на ответы одни на всех клиентов, ответы раскладывает сессия
+  ClientSessionSettings settings;
+  settings.exchangeName = "test_exchange";
+  settings.responseQueueName = "response_queue";
+  settings.requestQueueName = "request_queue";
+  settings.replyMode = GetParam();
+  auto session = ClientSession::create(InMemoryConnection::create(broker), settings);
+
+  std::atomic<bool> running{true};
+  std::vector<std::thread> servers;
+  for (int i = 0; i < 2; ++i)
+    servers.emplace_back([this, &running]()
+                         {
+                           auto server = createServer(InMemoryConnection::create(broker));
+                           while (running)
+                             server->processRequestResponseCycle(std::chrono::milliseconds(10));
+                         });
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < threadCount; ++i)
+    threads.emplace_back([&session, i]()
+                         {
+                           std::vector<std::unique_ptr<Client>> clients;
+                           std::vector<std::future<int>> results;
+                           for (int c = 0; c < clientsPerThread; ++c)
+                           {
+                             clients.push_back(session->createClient());
+                             for (int j = 0; j < requestsPerClient; ++j)
+                               results.push_back(clients.back()->sendRequestAsync((i * clientsPerThread + c) * requestsPerClient + j));
+                           }
+
+                           const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+                           for (auto& client : clients)
+                             while (client->getInFlightCount() != 0 && std::chrono::steady_clock::now() < deadline)
+                               client->getResponse(std::chrono::milliseconds(10));
+
+                           for (int c = 0; c < clientsPerThread; ++c)
+                           {
+                             ASSERT_EQ(clients[c]->getInFlightCount(), 0u);
+                             for (int j = 0; j < requestsPerClient; ++j)
+                             {
+                               const int req = (i * clientsPerThread + c) * requestsPerClient + j;
+                               EXPECT_EQ(results[c * requestsPerClient + j].get(), Server::generateResponseValue(req));
+                             }
+                           }
+                         });
+  for (auto& thread : threads)
+    thread.join();
+
+  running = false;
+  for (auto& server : servers)
+    server.join();
+
+  EXPECT_EQ(session->getClientCount(), 0u);
+  EXPECT_EQ(broker->getReadyCount("request_queue"), 0u);
+  EXPECT_EQ(broker->getUnackedCount("request_queue"), 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(ReplyModes, InMemoryIntegrationTest,
+                         ::testing::Values(ReplyMode::SharedQueue, ReplyMode::ExclusiveQueue, ReplyMode::DirectReplyTo));
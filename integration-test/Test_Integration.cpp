@@ -1,35 +1,63 @@
 #include "Client.h"
 #include "Server.h"
+#include "ServerPool.h"
 #include "RabbitMQClient/RabbitmqConnection.h"
 #include "Logger/Logger.h"
+#include "AmqpBroker/AmqpBroker.h"
 
 #include <gtest/gtest.h>
 
+#include <cstdlib>
 #include <thread>
 
 namespace
 {
-  std::unique_ptr<Server> createServer(int heartbeat)
+  // Брокер тестов: внешний RabbitMQ из RABBITMQ_HOST/RABBITMQ_PORT или встроенный AmqpBroker
+  std::unique_ptr<AmqpBroker> embeddedBroker;
+  std::string brokerHost = "127.0.0.1";
+  int brokerPort = 5672;
+
+  void setupBroker()
+  {
+    const char* host = std::getenv("RABBITMQ_HOST");
+    if (host != nullptr && *host != '\0')
+    {
+      const char* port = std::getenv("RABBITMQ_PORT");
+      brokerHost = host;
+      brokerPort = port != nullptr ? std::atoi(port) : 5672;
+      return;
+    }
+    if (embeddedBroker)
+      return;
+    embeddedBroker = std::make_unique<AmqpBroker>("127.0.0.1", 0);
+    embeddedBroker->start();
+    brokerPort = embeddedBroker->getPort();
+  }
+
+  std::unique_ptr<Server> createServer(int heartbeat,
+                                       const ConnectionRecoverySettings& recovery = ConnectionRecoverySettings())
   {
-    return std::make_unique<Server>(RabbitmqConnection::create(),
-                                    "rabbitmq", 5672,
+    return std::make_unique<Server>(RabbitmqConnection::create(recovery),
+                                    brokerHost, brokerPort,
                                     "guest", "guest", heartbeat, "/",
                                     "test_exchange", "response_queue", "request_queue");
   }
 
 
-  std::unique_ptr<Client> createClient(int heartbeat)
+  std::unique_ptr<Client> createClient(int heartbeat, ReplyMode replyMode = ReplyMode::SharedQueue,
+                                       const ConnectionRecoverySettings& recovery = ConnectionRecoverySettings())
   {
-    return std::make_unique<Client>(RabbitmqConnection::create(),
-                                    "rabbitmq", 5672,
+    return std::make_unique<Client>(RabbitmqConnection::create(recovery),
+                                    brokerHost, brokerPort,
                                     "guest", "guest", heartbeat, "/",
-                                    "test_exchange", "response_queue", "request_queue");
+                                    "test_exchange", "response_queue", "request_queue",
+                                    replyMode);
   }
 
-  void runClient(int requestValue, const std::atomic<bool>& running)
+  void runClientWithReplyMode(int requestValue, const std::atomic<bool>& running, ReplyMode replyMode)
   {
     int expected = Server::generateResponseValue(requestValue);
-    auto client = createClient(0);
+    auto client = createClient(0, replyMode);
     client->sendRequest(requestValue);
 
     bool success = false;
@@ -47,6 +75,11 @@ namespace
     EXPECT_TRUE(success);
   }
 
+  void runClient(int requestValue, const std::atomic<bool>& running)
+  {
+    runClientWithReplyMode(requestValue, running, ReplyMode::SharedQueue);
+  }
+
   void runServer(const std::atomic<bool>& running)
   {
     auto server = createServer(0);
@@ -61,6 +94,7 @@ protected:
   static void SetUpTestSuite()
   {
     Logger::setupLogging("logs.txt", QtInfoMsg);
+    setupBroker();
   }
 };
 
@@ -257,3 +291,123 @@ TEST_F(IntegrationTest, ClientsSleep)
       client.join();
 }
 
+
+TEST_F(IntegrationTest, MixedReplyModeClients)
+{
+  const int clientCount = 5;
+  std::vector<std::thread> clients;
+  std::atomic<bool> running(true);
+
+  std::thread serverThread(runServer, std::ref(running));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  for (int i = 0; i < clientCount; ++i)
+  {
+    clients.emplace_back([i, &running]() { runClientWithReplyMode(i * 7, running, ReplyMode::ExclusiveQueue); });
+    clients.emplace_back([i, &running]() { runClientWithReplyMode(-i * 7, running, ReplyMode::SharedQueue); });
+    clients.emplace_back([i, &running]() { runClientWithReplyMode(i * 7 + 1, running, ReplyMode::DirectReplyTo); });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  running = false;
+
+  for (auto& client : clients)
+      client.join();
+
+  serverThread.join();
+}
+
+TEST_F(IntegrationTest, PipelinedRequests)
+{
+  const int requestCount = 100;
+  std::atomic<bool> running(true);
+
+  std::thread serverThread(runServer, std::ref(running));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto client = createClient(0, ReplyMode::DirectReplyTo);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < requestCount; ++i)
+    results.push_back(client->sendRequestAsync(i));
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (client->getInFlightCount() > 0 && std::chrono::steady_clock::now() < deadline)
+    client->getResponse(std::chrono::milliseconds(100));
+
+  running = false;
+  serverThread.join();
+
+  ASSERT_EQ(client->getInFlightCount(), 0u);
+  for (int i = 0; i < requestCount; ++i)
+    EXPECT_EQ(results[i].get(), Server::generateResponseValue(i));
+}
+
+TEST_F(IntegrationTest, ServerPoolWithMultipleClients)
+{
+  const int clientCount = 10;
+  std::vector<std::thread> clients;
+  std::atomic<bool> running(true);
+
+  ServerPool pool([]() { return createServer(0); }, 4, std::chrono::milliseconds(100));
+  pool.start();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  for (int i = 0; i < clientCount; ++i)
+    clients.emplace_back(runClient, i * 3, std::ref(running));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  running = false;
+
+  for (auto& client : clients)
+      client.join();
+
+  pool.stop();
+  pool.wait();
+}
+
+TEST_F(IntegrationTest, RecoversAfterBrokerDropsConnections)
+{
+  if (!embeddedBroker)
+    GTEST_SKIP() << "connections can be dropped only by the embedded broker";
+
+  ConnectionRecoverySettings recovery;
+  recovery.enabled = true;
+  recovery.initialDelay = std::chrono::milliseconds(20);
+  recovery.maxDelay = std::chrono::milliseconds(200);
+
+  for (ReplyMode replyMode : {ReplyMode::SharedQueue, ReplyMode::ExclusiveQueue})
+  {
+    std::atomic<bool> running(true);
+    std::thread serverThread([&running, &recovery]()
+    {
+      auto server = createServer(0, recovery);
+      while (running)
+        server->processRequestResponseCycle(std::chrono::milliseconds(50));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto client = createClient(0, replyMode, recovery);
+    auto requestResponse = [&client](int requestValue)
+    {
+      client->sendRequest(requestValue);
+      std::pair<bool, int> response(false, 0);
+      for (int attempt = 0; attempt < 20 && !response.first; ++attempt)
+        response = client->getResponse(std::chrono::milliseconds(100));
+      EXPECT_TRUE(response.first);
+      EXPECT_EQ(response.second, Server::generateResponseValue(requestValue));
+    };
+    requestResponse(1);
+
+    embeddedBroker->dropConnections();
+    // клиент замечает обрыв при ожидании ответа и восстанавливает подписку до следующего запроса
+    for (int i = 0; i < 5; ++i)
+      client->getResponse(std::chrono::milliseconds(100));
+    requestResponse(2);
+
+    running = false;
+    serverThread.join();
+  }
+}
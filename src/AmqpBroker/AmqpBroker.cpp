@@ -0,0 +1,140 @@
+#include "AmqpBroker.h"
+#include "AmqpSession.h"
+
+#include <QDebug>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+Q_LOGGING_CATEGORY(lcAmqpBroker, "amqpbroker")
+
+namespace
+{
+  const int acceptPollIntervalMs = 200;
+}
+
+AmqpBroker::AmqpBroker(const std::string &address, uint16_t port, const AmqpBrokerSettings &settings)
+  : m_address(address), m_port(port), m_settings(settings), m_broker(InMemoryBroker::create())
+{
+}
+
+AmqpBroker::~AmqpBroker()
+{
+  stop();
+}
+
+void AmqpBroker::start()
+{
+  if (m_running)
+    return;
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(m_port);
+  if (inet_pton(AF_INET, m_address.c_str(), &address.sin_addr) != 1)
+    throw std::runtime_error("AMQP broker: invalid address " + m_address);
+
+  m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (m_listenSocket < 0)
+    throw std::runtime_error(std::string("AMQP broker: failed to create socket: ") + strerror(errno));
+
+  int reuse = 1;
+  setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (bind(m_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(m_listenSocket, 64) != 0)
+  {
+    std::string errorMsg = "AMQP broker: failed to listen on " + m_address + ":" + std::to_string(m_port) +
+                           ": " + strerror(errno);
+    close(m_listenSocket);
+    m_listenSocket = -1;
+    qCCritical(lcAmqpBroker) << QString::fromStdString(errorMsg);
+    throw std::runtime_error(errorMsg);
+  }
+
+  socklen_t length = sizeof(address);
+  if (getsockname(m_listenSocket, reinterpret_cast<sockaddr*>(&address), &length) == 0)
+    m_port = ntohs(address.sin_port);
+
+  m_running = true;
+  m_thread = std::thread(&AmqpBroker::run, this);
+  qCInfo(lcAmqpBroker) << "AMQP broker listening on" << QString::fromStdString(m_address) << "port" << m_port;
+}
+
+void AmqpBroker::stop()
+{
+  if (!m_running.exchange(false))
+    return;
+  if (m_thread.joinable())
+    m_thread.join();
+  close(m_listenSocket);
+  m_listenSocket = -1;
+
+  std::lock_guard<std::mutex> lock(m_sessionsMutex);
+  // деструктор соединения обрывает его и дожидается потоков
+  m_sessions.clear();
+}
+
+void AmqpBroker::dropConnections()
+{
+  std::lock_guard<std::mutex> lock(m_sessionsMutex);
+  qCWarning(lcAmqpBroker) << "Dropping" << m_sessions.size() << "AMQP connections";
+  for (auto& session : m_sessions)
+    session->drop();
+}
+
+size_t AmqpBroker::getConnectionCount()
+{
+  std::lock_guard<std::mutex> lock(m_sessionsMutex);
+  size_t count = 0;
+  for (const auto& session : m_sessions)
+    if (!session->isFinished())
+      ++count;
+  return count;
+}
+
+void AmqpBroker::run()
+{
+  while (m_running)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_sessionsMutex);
+      collectFinishedSessions();
+    }
+
+    // ожидание ограничено, чтобы поток заметил остановку
+    pollfd listenFd{m_listenSocket, POLLIN, 0};
+    int ready = poll(&listenFd, 1, acceptPollIntervalMs);
+    if (ready <= 0)
+      continue;
+
+    int client = accept(m_listenSocket, nullptr, nullptr);
+    if (client < 0)
+      continue;
+    // мелкие кадры подтверждений и ответов не должны ждать алгоритма Нейгла
+    int noDelay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+    m_sessions.push_back(std::make_unique<AmqpSession>(*this, client));
+    m_sessions.back()->start();
+  }
+}
+
+void AmqpBroker::collectFinishedSessions()
+{
+  for (auto it = m_sessions.begin(); it != m_sessions.end();)
+  {
+    if ((*it)->isFinished())
+      it = m_sessions.erase(it);
+    else
+      ++it;
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef AMQPBROKER_H
+#define AMQPBROKER_H
+
+#include "RabbitMQClient/InMemoryBroker.h"
+
+#include <QLoggingCategory>
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+Q_DECLARE_LOGGING_CATEGORY(lcAmqpBroker)
+
+class AmqpSession;
+
+/**
+ * /brief Сбои, которые брокер вносит по счетчикам, а не случайно: один и тот же сценарий
+ *        воспроизводится при каждом запуске
+ */
+struct AmqpBrokerFaults
+{
+  // Оборвать соединение без ответа, получив N-ю публикацию брокера (0 - не обрывать)
+  uint64_t dropConnectionOnPublish = 0;
+  // Отвечать basic.nack на каждую N-ю публикацию в режиме подтверждений (0 - не отвечать)
+  uint64_t nackEveryNthPublish = 0;
+  // Задержка перед обработкой каждого кадра клиента
+  std::chrono::milliseconds frameDelay{0};
+};
+
+struct AmqpBrokerSettings
+{
+  // Пустой логин - принимаются любые учетные данные
+  std::string login = "guest";
+  std::string password = "guest";
+  // Интервал heartbeat, который брокер предлагает клиенту, в секундах
+  uint16_t heartbeat = 60;
+  AmqpBrokerFaults faults;
+};
+
+/**
+ * /brief Минимальный брокер AMQP 0-9-1 поверх TCP для интеграционных и нагрузочных тестов
+ *
+ * Поддерживает то, что использует RabbitmqConnection: соединение с аутентификацией PLAIN, каналы,
+ * прямые обменники, объявление и привязку очередей, basic.qos/consume/publish/deliver/ack/reject,
+ * basic.return для публикаций mandatory без получателя, confirm.select и direct reply-to.
+ * Маршрутизацию и очереди обслуживает InMemoryBroker. На каждое соединение два потока: чтение
+ * кадров клиента и отправка доставок. Сообщения всех каналов соединения доставляются на канал
+ * последней подписки, prefetch действует на соединение целиком.
+ */
+class AmqpBroker
+{
+public:
+  AmqpBroker(const std::string& address, uint16_t port, const AmqpBrokerSettings& settings = AmqpBrokerSettings());
+  ~AmqpBroker();
+
+  AmqpBroker(const AmqpBroker&) = delete;
+  AmqpBroker& operator=(const AmqpBroker&) = delete;
+
+  // Открывает сокет и запускает поток; бросает std::runtime_error, если адрес занят
+  void start();
+  // Закрывает все соединения и останавливает прием новых
+  void stop();
+
+  // Фактический порт, если при создании был передан 0
+  uint16_t getPort() const {return m_port;}
+  const std::shared_ptr<InMemoryBroker>& getBroker() const {return m_broker;}
+
+  // Обрывает все открытые соединения, как при перезапуске брокера. Очереди и сообщения сохраняются
+  void dropConnections();
+  size_t getConnectionCount();
+
+  // Номер очередной публикации брокера, для сбоев по счетчику
+  uint64_t nextPublishNumber() {return ++m_publishCount;}
+  const AmqpBrokerSettings& getSettings() const {return m_settings;}
+
+private:
+  void run();
+  // Удаляет завершившиеся соединения, вызывается под m_sessionsMutex
+  void collectFinishedSessions();
+
+  const std::string m_address;
+  uint16_t m_port;
+  const AmqpBrokerSettings m_settings;
+  std::shared_ptr<InMemoryBroker> m_broker;
+
+  int m_listenSocket = -1;
+  std::atomic<bool> m_running{false};
+  std::atomic<uint64_t> m_publishCount{0};
+  std::thread m_thread;
+
+  std::mutex m_sessionsMutex;
+  std::list<std::unique_ptr<AmqpSession>> m_sessions;
+};
+
+#endif
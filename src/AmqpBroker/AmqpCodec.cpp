@@ -0,0 +1,211 @@
+#include "AmqpCodec.h"
+
+#include <algorithm>
+
+namespace AmqpCodec
+{
+  const char* Reader::take(size_t count)
+  {
+    if (m_size - m_position < count)
+      throw FrameError("Truncated AMQP frame");
+    const char* result = m_data + m_position;
+    m_position += count;
+    m_bitIndex = 8;
+    return result;
+  }
+
+  uint8_t Reader::octet()
+  {
+    return static_cast<uint8_t>(*take(1));
+  }
+
+  uint16_t Reader::shortUint()
+  {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(take(2));
+    return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+  }
+
+  uint32_t Reader::longUint()
+  {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(take(4));
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+  }
+
+  uint64_t Reader::longLongUint()
+  {
+    const uint64_t high = longUint();
+    return (high << 32) | longUint();
+  }
+
+  std::string Reader::shortString()
+  {
+    const uint8_t size = octet();
+    return std::string(take(size), size);
+  }
+
+  std::string Reader::longString()
+  {
+    const uint32_t size = longUint();
+    return std::string(take(size), size);
+  }
+
+  bool Reader::bit()
+  {
+    if (m_bitIndex == 8)
+    {
+      m_bits = octet();
+      m_bitIndex = 0;
+    }
+    return (m_bits >> m_bitIndex++) & 1;
+  }
+
+  Writer &Writer::octet(uint8_t value)
+  {
+    m_data.push_back(static_cast<char>(value));
+    m_bitIndex = 8;
+    return *this;
+  }
+
+  Writer &Writer::shortUint(uint16_t value)
+  {
+    octet(static_cast<uint8_t>(value >> 8));
+    return octet(static_cast<uint8_t>(value));
+  }
+
+  Writer &Writer::longUint(uint32_t value)
+  {
+    shortUint(static_cast<uint16_t>(value >> 16));
+    return shortUint(static_cast<uint16_t>(value));
+  }
+
+  Writer &Writer::longLongUint(uint64_t value)
+  {
+    longUint(static_cast<uint32_t>(value >> 32));
+    return longUint(static_cast<uint32_t>(value));
+  }
+
+  Writer &Writer::shortString(const std::string &value)
+  {
+    if (value.size() > 255)
+      throw std::invalid_argument("AMQP short string is longer than 255 bytes");
+    octet(static_cast<uint8_t>(value.size()));
+    return raw(value);
+  }
+
+  Writer &Writer::longString(const std::string &value)
+  {
+    longUint(static_cast<uint32_t>(value.size()));
+    return raw(value);
+  }
+
+  Writer &Writer::bit(bool value)
+  {
+    if (m_bitIndex == 8)
+    {
+      m_bitsPosition = m_data.size();
+      m_data.push_back(0);
+      m_bitIndex = 0;
+    }
+    if (value)
+      m_data[m_bitsPosition] = static_cast<char>(m_data[m_bitsPosition] | (1 << m_bitIndex));
+    ++m_bitIndex;
+    return *this;
+  }
+
+  Writer &Writer::raw(const std::string &bytes)
+  {
+    m_data += bytes;
+    m_bitIndex = 8;
+    return *this;
+  }
+
+  std::string frame(uint8_t type, uint16_t channel, const std::string &payload)
+  {
+    Writer writer;
+    writer.octet(type).shortUint(channel).longUint(static_cast<uint32_t>(payload.size())).raw(payload).octet(frameEnd);
+    return writer.data();
+  }
+
+  std::string methodFrame(uint16_t channel, uint16_t classId, uint16_t method, const Writer &arguments)
+  {
+    Writer payload;
+    payload.shortUint(classId).shortUint(method).raw(arguments.data());
+    return frame(frameMethod, channel, payload.data());
+  }
+
+  std::string heartbeatFrame()
+  {
+    return frame(frameHeartbeat, 0, std::string());
+  }
+
+  std::string contentHeaderFrame(uint16_t channel, uint64_t bodySize, const BasicProperties &properties)
+  {
+    uint16_t flags = 0;
+    if (!properties.correlationId.empty())
+      flags |= flagCorrelationId;
+    if (!properties.replyTo.empty())
+      flags |= flagReplyTo;
+
+    Writer payload;
+    const uint16_t weight = 0;
+    payload.shortUint(classBasic).shortUint(weight).longLongUint(bodySize).shortUint(flags);
+    if (flags & flagCorrelationId)
+      payload.shortString(properties.correlationId);
+    if (flags & flagReplyTo)
+      payload.shortString(properties.replyTo);
+    return frame(frameHeader, channel, payload.data());
+  }
+
+  BasicProperties parseContentHeader(const std::string &payload, uint64_t &bodySize)
+  {
+    Reader reader(payload);
+    if (reader.shortUint() != classBasic)
+      throw FrameError("Content header for a class other than basic");
+    reader.shortUint(); // weight
+    bodySize = reader.longLongUint();
+
+    uint16_t flags = reader.shortUint();
+    if (flags & 1)
+      throw FrameError("Property flags continuation is not supported");
+
+    // свойства идут в порядке битов флагов от старшего к младшему
+    BasicProperties properties;
+    for (int bit = 15; bit >= 2; --bit)
+    {
+      if (!(flags & (1 << bit)))
+        continue;
+      switch (bit)
+      {
+      case 13: // headers
+        reader.skipTable();
+        break;
+      case 12: // delivery-mode
+      case 11: // priority
+        reader.octet();
+        break;
+      case 6: // timestamp
+        reader.longLongUint();
+        break;
+      case 10:
+        properties.correlationId = reader.shortString();
+        break;
+      case 9:
+        properties.replyTo = reader.shortString();
+        break;
+      default: // остальные свойства - короткие строки
+        reader.shortString();
+        break;
+      }
+    }
+    return properties;
+  }
+
+  std::string contentBodyFrames(uint16_t channel, const std::string &body, uint32_t frameMax)
+  {
+    const size_t chunkSize = frameMax > frameOverhead ? frameMax - frameOverhead : body.size();
+    std::string frames;
+    for (size_t offset = 0; offset < body.size(); offset += chunkSize)
+      frames += frame(frameBody, channel, body.substr(offset, std::min(chunkSize, body.size() - offset)));
+    return frames;
+  }
+}
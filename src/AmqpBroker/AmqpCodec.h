@@ -0,0 +1,131 @@
+#ifndef AMQPCODEC_H
+#define AMQPCODEC_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/**
+ * /brief Кодирование кадров AMQP 0-9-1 в объеме, нужном AmqpBroker
+ *
+ * Числа передаются в сетевом порядке байт. Поля-таблицы не разбираются, а пропускаются целиком:
+ * брокеру аргументы объявлений и свойства клиента не нужны.
+ */
+namespace AmqpCodec
+{
+  const char protocolHeader[] = {'A', 'M', 'Q', 'P', 0, 0, 9, 1};
+  const size_t protocolHeaderSize = sizeof(protocolHeader);
+
+  const uint8_t frameMethod = 1;
+  const uint8_t frameHeader = 2;
+  const uint8_t frameBody = 3;
+  const uint8_t frameHeartbeat = 8;
+  const uint8_t frameEnd = 0xCE;
+  // тип, канал, размер
+  const size_t frameHeaderSize = 7;
+  // заголовок кадра и завершающий байт
+  const size_t frameOverhead = frameHeaderSize + 1;
+
+  const uint32_t defaultFrameMax = 131072;
+
+  // Классы
+  const uint16_t classConnection = 10;
+  const uint16_t classChannel = 20;
+  const uint16_t classExchange = 40;
+  const uint16_t classQueue = 50;
+  const uint16_t classBasic = 60;
+  const uint16_t classConfirm = 85;
+
+  // Коды ответов
+  const uint16_t replySuccess = 200;
+  const uint16_t replyNoRoute = 312;
+  const uint16_t replyAccessRefused = 403;
+  const uint16_t replyNotFound = 404;
+  const uint16_t replyResourceLocked = 405;
+  const uint16_t replyPreconditionFailed = 406;
+  const uint16_t replyFrameError = 501;
+  const uint16_t replyCommandInvalid = 503;
+  const uint16_t replyChannelError = 504;
+  const uint16_t replyUnexpectedFrame = 505;
+  const uint16_t replyNotImplemented = 540;
+
+  // Флаги свойств basic
+  const uint16_t flagCorrelationId = 1 << 10;
+  const uint16_t flagReplyTo = 1 << 9;
+
+  // Ошибка разбора кадра: соединение закрывается с кодом replyFrameError
+  class FrameError : public std::runtime_error
+  {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  class Reader
+  {
+  public:
+    Reader(const char* data, size_t size) : m_data(data), m_size(size) {}
+    explicit Reader(const std::string& data) : m_data(data.data()), m_size(data.size()) {}
+    // Reader не владеет данными
+    explicit Reader(std::string&&) = delete;
+
+    uint8_t octet();
+    uint16_t shortUint();
+    uint32_t longUint();
+    uint64_t longLongUint();
+    std::string shortString();
+    std::string longString();
+    void skipTable() {longString();}
+    // Следующий бит упакованных битовых полей; подряд идущие биты делят один октет
+    bool bit();
+
+    bool atEnd() const {return m_position == m_size;}
+  private:
+    const char* take(size_t count);
+
+    const char* m_data;
+    size_t m_size;
+    size_t m_position = 0;
+    uint8_t m_bits = 0;
+    int m_bitIndex = 8;
+  };
+
+  class Writer
+  {
+  public:
+    Writer& octet(uint8_t value);
+    Writer& shortUint(uint16_t value);
+    Writer& longUint(uint32_t value);
+    Writer& longLongUint(uint64_t value);
+    Writer& shortString(const std::string& value);
+    Writer& longString(const std::string& value);
+    Writer& emptyTable() {return longUint(0);}
+    Writer& bit(bool value);
+    Writer& raw(const std::string& bytes);
+
+    const std::string& data() const {return m_data;}
+  private:
+    std::string m_data;
+    size_t m_bitsPosition = 0;
+    int m_bitIndex = 8;
+  };
+
+  // Свойства сообщения, которые переносит брокер
+  struct BasicProperties
+  {
+    std::string replyTo;
+    std::string correlationId;
+  };
+
+  std::string frame(uint8_t type, uint16_t channel, const std::string& payload);
+  std::string methodFrame(uint16_t channel, uint16_t classId, uint16_t method, const Writer& arguments = Writer());
+  std::string heartbeatFrame();
+
+  // Кадр заголовка содержимого класса basic
+  std::string contentHeaderFrame(uint16_t channel, uint64_t bodySize, const BasicProperties& properties);
+  // Разбирает полезную нагрузку кадра заголовка, остальные свойства пропускаются
+  BasicProperties parseContentHeader(const std::string& payload, uint64_t& bodySize);
+  // Тело сообщения, разбитое на кадры не больше frameMax
+  std::string contentBodyFrames(uint16_t channel, const std::string& body, uint32_t frameMax);
+}
+
+#endif
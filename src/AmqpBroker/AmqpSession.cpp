@@ -0,0 +1,640 @@
+#include "AmqpSession.h"
+#include "AmqpBroker.h"
+
+#include "RabbitMQClient/IRabbitmqConnection.h"
+
+#include <QDebug>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+using namespace AmqpCodec;
+
+namespace
+{
+  // как часто поток доставок проверяет остановку и необходимость heartbeat
+  const std::chrono::milliseconds deliveryPollInterval(100);
+  const uint16_t channelMax = 2047;
+}
+
+AmqpSession::AmqpSession(AmqpBroker &owner, int socket)
+  : m_owner(owner), m_broker(owner.getBroker()), m_connectionId(m_broker->attach()), m_socket(socket)
+{
+}
+
+AmqpSession::~AmqpSession()
+{
+  drop();
+  if (m_reader.joinable())
+    m_reader.join();
+  if (m_deliverer.joinable())
+    m_deliverer.join();
+  // неподтвержденные доставки возвращаются в очереди, как при обрыве соединения с RabbitMQ
+  m_broker->detach(m_connectionId);
+  close(m_socket);
+}
+
+void AmqpSession::start()
+{
+  m_running = true;
+  m_reader = std::thread(&AmqpSession::readLoop, this);
+  m_deliverer = std::thread(&AmqpSession::deliveryLoop, this);
+}
+
+void AmqpSession::drop()
+{
+  m_running = false;
+  shutdown(m_socket, SHUT_RDWR);
+}
+
+void AmqpSession::finish()
+{
+  drop();
+}
+
+void AmqpSession::readLoop()
+{
+  char header[protocolHeaderSize];
+  if (!readExact(header, sizeof(header)) || std::string(header, sizeof(header)) != std::string(protocolHeader, protocolHeaderSize))
+  {
+    // на неподдерживаемую версию протокола брокер отвечает своим заголовком и закрывает соединение
+    send(std::string(protocolHeader, protocolHeaderSize));
+    finish();
+    m_finished = true;
+    return;
+  }
+
+  Writer start;
+  Writer serverProperties;
+  serverProperties.shortString("product").octet('S').longString("rabbitmq-qt AmqpBroker");
+  start.octet(0).octet(9).longString(serverProperties.data()).longString("PLAIN").longString("en_US");
+  send(methodFrame(0, classConnection, 10, start));
+
+  while (m_running)
+  {
+    char frameHeaderBytes[frameHeaderSize];
+    if (!readExact(frameHeaderBytes, sizeof(frameHeaderBytes)))
+      break;
+    Reader headerReader(frameHeaderBytes, sizeof(frameHeaderBytes));
+    const uint8_t type = headerReader.octet();
+    const uint16_t channel = headerReader.shortUint();
+    const uint32_t size = headerReader.longUint();
+    if (size + frameOverhead > m_frameMax)
+    {
+      closeConnection(replyFrameError, "FRAME_ERROR - frame is larger than negotiated frame-max");
+      break;
+    }
+
+    std::string payload(size + 1, '\0');
+    if (!readExact(&payload[0], payload.size()))
+      break;
+    if (static_cast<uint8_t>(payload.back()) != frameEnd)
+    {
+      closeConnection(replyFrameError, "FRAME_ERROR - missing frame end");
+      break;
+    }
+    payload.pop_back();
+
+    const auto delay = m_owner.getSettings().faults.frameDelay;
+    if (delay.count() > 0)
+      std::this_thread::sleep_for(delay);
+
+    try
+    {
+      handleFrame(type, channel, payload);
+    }
+    catch (const FrameError& error)
+    {
+      closeConnection(replyFrameError, std::string("FRAME_ERROR - ") + error.what());
+    }
+  }
+
+  finish();
+  m_finished = true;
+  qCInfo(lcAmqpBroker) << "AMQP connection" << m_connectionId << "closed";
+}
+
+void AmqpSession::deliveryLoop()
+{
+  auto lastHeartbeat = std::chrono::steady_clock::now();
+  while (m_running)
+  {
+    InMemoryBroker::Delivery delivery;
+    if (m_broker->receive(m_connectionId, &deliveryPollInterval, delivery) && m_running)
+    {
+      const uint16_t channel = delivery.channel;
+      std::string consumerTag;
+      {
+        std::lock_guard<std::mutex> lock(m_consumerMutex);
+        auto tag = m_consumerTags.find(channel);
+        // канал закрылся после выдачи: неподтвержденное сообщение брокер уже вернул в очередь
+        if (tag == m_consumerTags.end())
+          continue;
+        consumerTag = tag->second;
+      }
+      const InMemoryMessage& message = *delivery.message;
+
+      Writer deliver;
+      const bool redelivered = false;
+      deliver.shortString(consumerTag).longLongUint(delivery.deliveryTag).bit(redelivered)
+             .shortString(std::string()).shortString(std::string());
+
+      BasicProperties properties;
+      properties.replyTo = message.replyTo;
+      properties.correlationId = message.correlationId;
+      send(methodFrame(channel, classBasic, 60, deliver) +
+           contentHeaderFrame(channel, message.body.size(), properties) +
+           contentBodyFrames(channel, message.body, m_frameMax));
+    }
+
+    // heartbeat отправляется вдвое чаще согласованного интервала, как это делает RabbitMQ
+    const uint16_t heartbeat = m_heartbeat;
+    const auto now = std::chrono::steady_clock::now();
+    if (heartbeat != 0 && now - lastHeartbeat >= std::chrono::milliseconds(heartbeat * 500))
+    {
+      send(heartbeatFrame());
+      lastHeartbeat = now;
+    }
+  }
+}
+
+bool AmqpSession::readExact(char *buffer, size_t size)
+{
+  size_t received = 0;
+  while (received < size)
+  {
+    ssize_t result = recv(m_socket, buffer + received, size - received, 0);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return false;
+    received += static_cast<size_t>(result);
+  }
+  return true;
+}
+
+void AmqpSession::send(const std::string &data)
+{
+  std::lock_guard<std::mutex> lock(m_writeMutex);
+  size_t sent = 0;
+  while (sent < data.size())
+  {
+    ssize_t result = ::send(m_socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result <= 0)
+    {
+      m_running = false;
+      return;
+    }
+    sent += static_cast<size_t>(result);
+  }
+}
+
+void AmqpSession::handleFrame(uint8_t type, uint16_t channel, const std::string &payload)
+{
+  if (type == frameHeartbeat)
+    return;
+  if (channel != 0 && m_channels.count(channel) && m_channels[channel].closing)
+  {
+    // после channel.close брокер отбрасывает все кадры канала, кроме закрытия
+    if (type != frameMethod)
+      return;
+    Reader reader(payload);
+    const uint16_t classId = reader.shortUint();
+    const uint16_t method = reader.shortUint();
+    if (classId != classChannel || (method != 40 && method != 41))
+      return;
+  }
+
+  try
+  {
+    if (type == frameMethod)
+      handleMethod(channel, payload);
+    else if (type == frameHeader)
+      handleContentHeader(channel, payload);
+    else if (type == frameBody)
+      handleContentBody(channel, payload);
+    else
+      closeConnection(replyFrameError, "FRAME_ERROR - unknown frame type " + std::to_string(type));
+  }
+  catch (const ChannelError& error)
+  {
+    m_publishInProgress = false;
+    closeChannel(channel, classBasic, 40, error);
+  }
+}
+
+void AmqpSession::handleMethod(uint16_t channel, const std::string &payload)
+{
+  Reader reader(payload);
+  const uint16_t classId = reader.shortUint();
+  const uint16_t method = reader.shortUint();
+
+  if (m_publishInProgress)
+  {
+    closeConnection(replyUnexpectedFrame, "UNEXPECTED_FRAME - expected content header", classId, method);
+    return;
+  }
+  if (classId == classConnection)
+  {
+    if (channel != 0)
+      closeConnection(replyCommandInvalid, "COMMAND_INVALID - connection method on a channel", classId, method);
+    else
+      handleConnectionMethod(method, reader);
+    return;
+  }
+  if (!m_opened)
+  {
+    closeConnection(replyChannelError, "CHANNEL_ERROR - connection is not open", classId, method);
+    return;
+  }
+  if (classId == classChannel)
+  {
+    handleChannelMethod(channel, method, reader);
+    return;
+  }
+  if (m_channels.count(channel) == 0)
+  {
+    closeConnection(replyChannelError, "CHANNEL_ERROR - channel " + std::to_string(channel) + " is not open",
+                    classId, method);
+    return;
+  }
+
+  try
+  {
+    if (classId == classExchange && method == 10)
+    {
+      reader.shortUint(); // reserved
+      const std::string exchange = reader.shortString();
+      const std::string exchangeType = reader.shortString();
+      reader.bit(); // passive
+      reader.bit(); // durable
+      reader.bit(); // auto-delete
+      reader.bit(); // internal
+      const bool noWait = reader.bit();
+      reader.skipTable();
+      try
+      {
+        m_broker->declareExchange(exchange, exchangeType);
+      }
+      catch (const std::invalid_argument& error)
+      {
+        throw ChannelError{replyCommandInvalid, std::string("COMMAND_INVALID - ") + error.what()};
+      }
+      if (!noWait)
+        send(methodFrame(channel, classExchange, 11));
+    }
+    else if (classId == classQueue && method == 10)
+    {
+      reader.shortUint(); // reserved
+      std::string queue = reader.shortString();
+      reader.bit(); // passive
+      reader.bit(); // durable
+      reader.bit(); // exclusive
+      reader.bit(); // auto-delete
+      const bool noWait = reader.bit();
+      reader.skipTable();
+      if (queue.empty())
+        queue = m_broker->declareExclusiveQueue(m_connectionId);
+      else
+        m_broker->declareQueue(queue);
+
+      if (!noWait)
+      {
+        Writer declareOk;
+        const uint32_t consumerCount = 0;
+        declareOk.shortString(queue).longUint(static_cast<uint32_t>(m_broker->getReadyCount(queue))).longUint(consumerCount);
+        send(methodFrame(channel, classQueue, 11, declareOk));
+      }
+    }
+    else if (classId == classQueue && method == 20)
+    {
+      reader.shortUint(); // reserved
+      const std::string queue = reader.shortString();
+      const std::string exchange = reader.shortString();
+      const std::string routingKey = reader.shortString();
+      const bool noWait = reader.bit();
+      reader.skipTable();
+      try
+      {
+        m_broker->bind(queue, exchange, routingKey);
+      }
+      catch (const std::runtime_error& error)
+      {
+        throw ChannelError{replyNotFound, std::string("NOT_FOUND - ") + error.what()};
+      }
+      if (!noWait)
+        send(methodFrame(channel, classQueue, 21));
+    }
+    else if (classId == classBasic)
+      handleBasicMethod(channel, method, reader);
+    else if (classId == classConfirm && method == 10)
+    {
+      const bool noWait = reader.bit();
+      m_channels[channel].confirmMode = true;
+      if (!noWait)
+        send(methodFrame(channel, classConfirm, 11));
+    }
+    else
+      closeConnection(replyNotImplemented, "NOT_IMPLEMENTED - method is not supported", classId, method);
+  }
+  catch (const ChannelError& error)
+  {
+    closeChannel(channel, classId, method, error);
+  }
+}
+
+void AmqpSession::handleConnectionMethod(uint16_t method, Reader &arguments)
+{
+  if (method == 11) // start-ok
+  {
+    arguments.skipTable(); // client-properties
+    const std::string mechanism = arguments.shortString();
+    const std::string response = arguments.longString();
+
+    // PLAIN: "\0login\0password"
+    const AmqpBrokerSettings& settings = m_owner.getSettings();
+    const std::string expected = std::string(1, '\0') + settings.login + std::string(1, '\0') + settings.password;
+    if (mechanism != "PLAIN" || (!settings.login.empty() && response != expected))
+    {
+      closeConnection(replyAccessRefused, "ACCESS_REFUSED - login was refused", classConnection, method);
+      return;
+    }
+
+    Writer tune;
+    tune.shortUint(channelMax).longUint(defaultFrameMax).shortUint(settings.heartbeat);
+    send(methodFrame(0, classConnection, 30, tune));
+  }
+  else if (method == 31) // tune-ok
+  {
+    arguments.shortUint(); // channel-max
+    const uint32_t frameMax = arguments.longUint();
+    if (frameMax != 0)
+      m_frameMax = frameMax;
+    m_heartbeat = arguments.shortUint();
+  }
+  else if (method == 40) // open
+  {
+    Writer openOk;
+    openOk.shortString(std::string()); // reserved
+    send(methodFrame(0, classConnection, 41, openOk));
+    m_opened = true;
+    qCInfo(lcAmqpBroker) << "AMQP connection" << m_connectionId << "opened";
+  }
+  else if (method == 50) // close
+  {
+    send(methodFrame(0, classConnection, 51));
+    finish();
+  }
+  else if (method == 51) // close-ok
+    finish();
+  else
+    closeConnection(replyNotImplemented, "NOT_IMPLEMENTED - connection method is not supported", classConnection, method);
+}
+
+void AmqpSession::handleChannelMethod(uint16_t channel, uint16_t method, Reader &)
+{
+  if (method == 10) // open
+  {
+    if (channel == 0 || channel > channelMax || m_channels.count(channel))
+    {
+      closeConnection(replyChannelError, "CHANNEL_ERROR - invalid channel " + std::to_string(channel),
+                      classChannel, method);
+      return;
+    }
+    m_channels[channel] = ChannelState();
+    Writer openOk;
+    openOk.longString(std::string()); // reserved
+    send(methodFrame(channel, classChannel, 11, openOk));
+  }
+  else if (method == 40) // close
+  {
+    releaseChannel(channel);
+    send(methodFrame(channel, classChannel, 41));
+  }
+  else if (method == 41) // close-ok
+    releaseChannel(channel);
+  else
+    closeConnection(replyNotImplemented, "NOT_IMPLEMENTED - channel method is not supported", classChannel, method);
+}
+
+void AmqpSession::handleBasicMethod(uint16_t channel, uint16_t method, Reader &arguments)
+{
+  if (method == 10) // qos
+  {
+    arguments.longUint(); // prefetch-size
+    const uint16_t prefetchCount = arguments.shortUint();
+    m_broker->setPrefetchCount(m_connectionId, prefetchCount);
+    send(methodFrame(channel, classBasic, 11));
+  }
+  else if (method == 20) // consume
+  {
+    arguments.shortUint(); // reserved
+    const std::string queue = arguments.shortString();
+    std::string consumerTag = arguments.shortString();
+    arguments.bit(); // no-local, RabbitMQ его тоже не поддерживает
+    const bool noAck = arguments.bit();
+    const bool exclusive = arguments.bit();
+    const bool noWait = arguments.bit();
+    arguments.skipTable();
+
+    if (queue == directReplyToQueue)
+    {
+      if (!noAck)
+        throw ChannelError{replyPreconditionFailed, "PRECONDITION_FAILED - reply consumer cannot acknowledge"};
+      m_broker->consumeDirectReplyTo(m_connectionId, channel);
+    }
+    else
+    {
+      if (!m_broker->hasQueue(queue))
+        throw ChannelError{replyNotFound, "NOT_FOUND - no queue '" + queue + "'"};
+      try
+      {
+        m_broker->consume(m_connectionId, queue, noAck, exclusive, channel);
+      }
+      catch (const std::runtime_error& error)
+      {
+        throw ChannelError{replyResourceLocked, std::string("RESOURCE_LOCKED - ") + error.what()};
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_consumerMutex);
+      if (consumerTag.empty())
+        consumerTag = "amq.ctag-" + std::to_string(m_nextConsumerTag++);
+      m_consumerTags[channel] = consumerTag;
+    }
+    if (!noWait)
+    {
+      Writer consumeOk;
+      consumeOk.shortString(consumerTag);
+      send(methodFrame(channel, classBasic, 21, consumeOk));
+    }
+  }
+  else if (method == 40) // publish
+  {
+    arguments.shortUint(); // reserved
+    m_publish = PendingPublish();
+    m_publish.channel = channel;
+    m_publish.exchange = arguments.shortString();
+    m_publish.routingKey = arguments.shortString();
+    m_publish.mandatory = arguments.bit();
+    if (arguments.bit()) // immediate
+    {
+      closeConnection(replyNotImplemented, "NOT_IMPLEMENTED - immediate=true", classBasic, method);
+      return;
+    }
+    m_publishInProgress = true;
+  }
+  else if (method == 80 || method == 90 || method == 120) // ack, reject, nack
+  {
+    const uint64_t deliveryTag = arguments.longLongUint();
+    bool multiple = false;
+    if (method != 90)
+      multiple = arguments.bit();
+    const bool requeue = method != 80 ? arguments.bit() : false;
+    if (multiple)
+    {
+      closeConnection(replyNotImplemented, "NOT_IMPLEMENTED - multiple acknowledgements", classBasic, method);
+      return;
+    }
+
+    try
+    {
+      if (method == 80)
+        m_broker->ack(m_connectionId, deliveryTag);
+      else
+        m_broker->reject(m_connectionId, deliveryTag, requeue);
+    }
+    catch (const std::runtime_error&)
+    {
+      throw ChannelError{replyPreconditionFailed, "PRECONDITION_FAILED - unknown delivery tag " + std::to_string(deliveryTag)};
+    }
+  }
+  else
+    closeConnection(replyNotImplemented, "NOT_IMPLEMENTED - basic method is not supported", classBasic, method);
+}
+
+void AmqpSession::handleContentHeader(uint16_t channel, const std::string &payload)
+{
+  if (!m_publishInProgress || m_publish.headerReceived || channel != m_publish.channel)
+  {
+    closeConnection(replyUnexpectedFrame, "UNEXPECTED_FRAME - content header without basic.publish");
+    return;
+  }
+  m_publish.properties = parseContentHeader(payload, m_publish.bodySize);
+  m_publish.headerReceived = true;
+  m_publish.body.reserve(m_publish.bodySize);
+  if (m_publish.bodySize == 0)
+    completePublish();
+}
+
+void AmqpSession::handleContentBody(uint16_t channel, const std::string &payload)
+{
+  if (!m_publishInProgress || !m_publish.headerReceived || channel != m_publish.channel)
+  {
+    closeConnection(replyUnexpectedFrame, "UNEXPECTED_FRAME - content body without header");
+    return;
+  }
+  m_publish.body += payload;
+  if (m_publish.body.size() > m_publish.bodySize)
+    throw FrameError("content body is larger than declared in the header");
+  if (m_publish.body.size() == m_publish.bodySize)
+    completePublish();
+}
+
+void AmqpSession::completePublish()
+{
+  m_publishInProgress = false;
+  const uint64_t number = m_owner.nextPublishNumber();
+  const AmqpBrokerFaults& faults = m_owner.getSettings().faults;
+  if (faults.dropConnectionOnPublish != 0 && number == faults.dropConnectionOnPublish)
+  {
+    qCWarning(lcAmqpBroker) << "Fault injection: dropping AMQP connection" << m_connectionId << "on publish" << number;
+    drop();
+    return;
+  }
+
+  const uint16_t channel = m_publish.channel;
+  auto message = std::make_shared<InMemoryMessage>();
+  message->body = std::move(m_publish.body);
+  message->correlationId = m_publish.properties.correlationId;
+  message->replyTo = m_publish.properties.replyTo;
+  if (message->replyTo == directReplyToQueue)
+  {
+    message->replyTo = m_broker->getDirectReplyAddress(m_connectionId, channel);
+    if (message->replyTo.empty())
+      throw ChannelError{replyPreconditionFailed, "PRECONDITION_FAILED - fast reply consumer does not exist"};
+  }
+
+  bool routed = false;
+  try
+  {
+    routed = m_broker->publish(m_publish.exchange, m_publish.routingKey, message);
+  }
+  catch (const std::runtime_error& error)
+  {
+    throw ChannelError{replyNotFound, std::string("NOT_FOUND - ") + error.what()};
+  }
+
+  if (m_publish.mandatory && !routed)
+  {
+    Writer basicReturn;
+    basicReturn.shortUint(replyNoRoute).shortString("NO_ROUTE").shortString(m_publish.exchange).shortString(m_publish.routingKey);
+    BasicProperties properties;
+    properties.correlationId = message->correlationId;
+    properties.replyTo = m_publish.properties.replyTo;
+    send(methodFrame(channel, classBasic, 50, basicReturn) +
+         contentHeaderFrame(channel, message->body.size(), properties) +
+         contentBodyFrames(channel, message->body, m_frameMax));
+  }
+
+  ChannelState& state = m_channels[channel];
+  if (!state.confirmMode)
+    return;
+
+  Writer confirm;
+  const bool multiple = false;
+  confirm.longLongUint(++state.publishCount).bit(multiple);
+  if (faults.nackEveryNthPublish != 0 && number % faults.nackEveryNthPublish == 0)
+  {
+    const bool requeue = false;
+    confirm.bit(requeue);
+    send(methodFrame(channel, classBasic, 120, confirm));
+  }
+  else
+    send(methodFrame(channel, classBasic, 80, confirm));
+}
+
+void AmqpSession::closeChannel(uint16_t channel, uint16_t classId, uint16_t method, const ChannelError &error)
+{
+  qCWarning(lcAmqpBroker) << "AMQP connection" << m_connectionId << "closes channel" << channel << ":"
+                          << QString::fromStdString(error.text);
+  m_channels[channel].closing = true;
+  Writer close;
+  close.shortUint(error.code).shortString(error.text).shortUint(classId).shortUint(method);
+  send(methodFrame(channel, classChannel, 40, close));
+}
+
+void AmqpSession::releaseChannel(uint16_t channel)
+{
+  m_channels.erase(channel);
+  {
+    std::lock_guard<std::mutex> lock(m_consumerMutex);
+    m_consumerTags.erase(channel);
+  }
+  m_broker->closeChannel(m_connectionId, channel);
+}
+
+void AmqpSession::closeConnection(uint16_t code, const std::string &text, uint16_t classId, uint16_t method)
+{
+  qCWarning(lcAmqpBroker) << "AMQP connection" << m_connectionId << "closed by broker:" << QString::fromStdString(text);
+  Writer close;
+  close.shortUint(code).shortString(text).shortUint(classId).shortUint(method);
+  send(methodFrame(0, classConnection, 50, close));
+  // ответ connection.close-ok не ждем: соединение все равно закрывается
+  finish();
+}
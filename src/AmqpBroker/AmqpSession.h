@@ -0,0 +1,105 @@
+#ifndef AMQPSESSION_H
+#define AMQPSESSION_H
+
+#include "AmqpCodec.h"
+#include "RabbitMQClient/InMemoryBroker.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class AmqpBroker;
+
+// Одно TCP-соединение AmqpBroker: разбор кадров клиента и отправка доставок
+class AmqpSession
+{
+public:
+  AmqpSession(AmqpBroker& owner, int socket);
+  ~AmqpSession();
+
+  AmqpSession(const AmqpSession&) = delete;
+  AmqpSession& operator=(const AmqpSession&) = delete;
+
+  void start();
+  // Обрывает соединение без закрывающих кадров
+  void drop();
+  bool isFinished() const {return m_finished;}
+
+private:
+  struct ChannelState
+  {
+    bool confirmMode = false;
+    uint64_t publishCount = 0;
+    bool closing = false; // брокер закрыл канал и ждет channel.close-ok
+  };
+
+  // Публикация, собираемая из кадров метода, заголовка и тела
+  struct PendingPublish
+  {
+    uint16_t channel = 0;
+    std::string exchange;
+    std::string routingKey;
+    bool mandatory = false;
+    bool headerReceived = false;
+    uint64_t bodySize = 0;
+    AmqpCodec::BasicProperties properties;
+    std::string body;
+  };
+
+  // Ошибка канала: брокер закрывает канал с кодом, соединение продолжает работать
+  struct ChannelError
+  {
+    uint16_t code;
+    std::string text;
+  };
+
+  void readLoop();
+  void deliveryLoop();
+
+  bool readExact(char* buffer, size_t size);
+  void send(const std::string& data);
+
+  void handleFrame(uint8_t type, uint16_t channel, const std::string& payload);
+  void handleMethod(uint16_t channel, const std::string& payload);
+  void handleConnectionMethod(uint16_t method, AmqpCodec::Reader& arguments);
+  void handleChannelMethod(uint16_t channel, uint16_t method, AmqpCodec::Reader& arguments);
+  void handleBasicMethod(uint16_t channel, uint16_t method, AmqpCodec::Reader& arguments);
+  void handleContentHeader(uint16_t channel, const std::string& payload);
+  void handleContentBody(uint16_t channel, const std::string& payload);
+  void completePublish();
+
+  void closeChannel(uint16_t channel, uint16_t classId, uint16_t method, const ChannelError& error);
+  // Забывает закрытый канал: подписки отменяются, неподтвержденные сообщения возвращаются в очереди
+  void releaseChannel(uint16_t channel);
+  void closeConnection(uint16_t code, const std::string& text, uint16_t classId = 0, uint16_t method = 0);
+  void finish();
+
+  AmqpBroker& m_owner;
+  std::shared_ptr<InMemoryBroker> m_broker;
+  const uint64_t m_connectionId;
+  const int m_socket;
+
+  std::mutex m_writeMutex;
+  std::atomic<bool> m_running{false};
+  std::atomic<bool> m_finished{false};
+  std::atomic<bool> m_opened{false}; // получен connection.open, можно доставлять сообщения
+  std::thread m_reader;
+  std::thread m_deliverer;
+
+  uint32_t m_frameMax = AmqpCodec::defaultFrameMax;
+  std::atomic<uint16_t> m_heartbeat{0};
+  std::map<uint16_t, ChannelState> m_channels;
+  PendingPublish m_publish;
+  bool m_publishInProgress = false;
+
+  // теги подписок открытых каналов: доставка закрытому каналу не отправляется
+  std::map<uint16_t, std::string> m_consumerTags;
+  std::mutex m_consumerMutex;
+  uint64_t m_nextConsumerTag = 1;
+};
+
+#endif
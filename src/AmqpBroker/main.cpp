@@ -0,0 +1,63 @@
+#include "AmqpBroker.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+#include <csignal>
+#include <stdexcept>
+
+namespace
+{
+  void quitOnSignal(int)
+  {
+    QCoreApplication::quit();
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Local AMQP 0-9-1 broker for tests");
+  parser.addHelpOption();
+
+  QCommandLineOption addressOption(QStringList() << "a" << "address", "Address to listen on.", "address", "127.0.0.1");
+  QCommandLineOption portOption(QStringList() << "p" << "port", "Port to listen on.", "port", "5672");
+  QCommandLineOption loginOption("login", "Accepted login, empty accepts any credentials.", "login", "guest");
+  QCommandLineOption passwordOption("password", "Accepted password.", "password", "guest");
+  QCommandLineOption heartbeatOption("heartbeat", "Heartbeat interval offered to clients, in seconds.", "seconds", "60");
+  QCommandLineOption dropOption("drop-on-publish", "Drop the connection that sends the N-th publish.", "N", "0");
+  QCommandLineOption nackOption("nack-every", "Answer basic.nack to every N-th confirmed publish.", "N", "0");
+  QCommandLineOption delayOption("frame-delay-ms", "Delay before handling every client frame.", "ms", "0");
+  parser.addOptions({addressOption, portOption, loginOption, passwordOption, heartbeatOption,
+                     dropOption, nackOption, delayOption});
+  parser.process(app);
+
+  AmqpBrokerSettings settings;
+  settings.login = parser.value(loginOption).toStdString();
+  settings.password = parser.value(passwordOption).toStdString();
+  settings.heartbeat = static_cast<uint16_t>(parser.value(heartbeatOption).toUInt());
+  settings.faults.dropConnectionOnPublish = parser.value(dropOption).toULongLong();
+  settings.faults.nackEveryNthPublish = parser.value(nackOption).toULongLong();
+  settings.faults.frameDelay = std::chrono::milliseconds(parser.value(delayOption).toUInt());
+
+  AmqpBroker broker(parser.value(addressOption).toStdString(),
+                    static_cast<uint16_t>(parser.value(portOption).toUInt()),
+                    settings);
+  try
+  {
+    broker.start();
+  }
+  catch (const std::runtime_error& error)
+  {
+    qCritical() << error.what();
+    return 1;
+  }
+
+  std::signal(SIGINT, quitOnSignal);
+  std::signal(SIGTERM, quitOnSignal);
+  const int result = app.exec();
+  broker.stop();
+  return result;
+}
@@ -27,6 +27,24 @@ public:
   QString getVhost() const { return m_settings.value("Connection/Vhost", "/").toString(); }
   void setVhost(const QString& vhost) { m_settings.setValue("Connection/Vhost", vhost); }
 
+  // Автоматическое переподключение к брокеру с восстановлением очередей, привязок и подписок
+  bool isAutoRecoveryEnabled() const { return m_settings.value("Connection/AutoRecovery", true).toBool(); }
+  void setAutoRecoveryEnabled(bool enabled) { m_settings.setValue("Connection/AutoRecovery", enabled); }
+
+  int getRecoveryInitialDelayMs() const { return m_settings.value("Connection/RecoveryInitialDelayMs", 100).toInt(); }
+  void setRecoveryInitialDelayMs(int delay) { m_settings.setValue("Connection/RecoveryInitialDelayMs", delay); }
+
+  int getRecoveryMaxDelayMs() const { return m_settings.value("Connection/RecoveryMaxDelayMs", 10000).toInt(); }
+  void setRecoveryMaxDelayMs(int delay) { m_settings.setValue("Connection/RecoveryMaxDelayMs", delay); }
+
+  // Число неудачных попыток подряд, после которого ошибка передается приложению (0 - без ограничения)
+  int getRecoveryMaxAttempts() const { return m_settings.value("Connection/RecoveryMaxAttempts", 0).toInt(); }
+  void setRecoveryMaxAttempts(int attempts) { m_settings.setValue("Connection/RecoveryMaxAttempts", attempts); }
+
+  // Сколько публикаций копится, пока соединение восстанавливается
+  int getPublishBufferSize() const { return m_settings.value("Connection/PublishBufferSize", 1000).toInt(); }
+  void setPublishBufferSize(int size) { m_settings.setValue("Connection/PublishBufferSize", size); }
+
   QString getExchangeName() const { return m_settings.value("Messaging/ExchangeName", "defaultExchange").toString(); }
   void setExchangeName(const QString& exchangeName) { m_settings.setValue("Messaging/ExchangeName", exchangeName); }
 
@@ -36,12 +54,99 @@ public:
   QString getResponseQueueName() const { return m_settings.value("Messaging/ResponseQueueName", "defaultResponseQueue").toString(); }
   void setResponseQueueName(const QString& responseQueueName) { m_settings.setValue("Messaging/ResponseQueueName", responseQueueName); }
 
+  // shared - общая очередь ответов, exclusive - собственная очередь ответов у каждого клиента,
+  // direct - прямые ответы через amq.rabbitmq.reply-to
+  QString getReplyMode() const { return m_settings.value("Messaging/ReplyMode", "shared").toString(); }
+  void setReplyMode(const QString& replyMode) { m_settings.setValue("Messaging/ReplyMode", replyMode); }
+
+  // Отметки времени в запросах и ответах для гистограмм этапов задержки
+  bool isLatencyTracingEnabled() const { return m_settings.value("Messaging/LatencyTracing", false).toBool(); }
+  void setLatencyTracingEnabled(bool enabled) { m_settings.setValue("Messaging/LatencyTracing", enabled); }
+
+  int getWorkerThreads() const { return m_settings.value("Server/WorkerThreads", 1).toInt(); }
+  void setWorkerThreads(int workerThreads) { m_settings.setValue("Server/WorkerThreads", workerThreads); }
+
+  int getPrefetchCount() const { return m_settings.value("Server/PrefetchCount", 10).toInt(); }
+  void setPrefetchCount(int prefetchCount) { m_settings.setValue("Server/PrefetchCount", prefetchCount); }
+
+  // Сколько запросов сервер обрабатывает и публикует одной пачкой, 1 - по одному
+  int getBatchSize() const { return m_settings.value("Server/BatchSize", 1).toInt(); }
+  void setBatchSize(int batchSize) { m_settings.setValue("Server/BatchSize", batchSize); }
+
+  bool isPublisherConfirmsEnabled() const { return m_settings.value("Server/PublisherConfirms", false).toBool(); }
+  void setPublisherConfirmsEnabled(bool enabled) { m_settings.setValue("Server/PublisherConfirms", enabled); }
+
+  // Рабочие потоки ждут запросы в epoll вместо опроса соединения с таймаутом
+  bool isEventLoopEnabled() const { return m_settings.value("Server/EventLoop", true).toBool(); }
+  void setEventLoopEnabled(bool enabled) { m_settings.setValue("Server/EventLoop", enabled); }
+
+  // Рабочие потоки сервера получают каналы одного соединения (ChannelPool) вместо своих соединений
+  bool isSharedConnectionEnabled() const { return m_settings.value("Server/SharedConnection", false).toBool(); }
+  void setSharedConnectionEnabled(bool enabled) { m_settings.setValue("Server/SharedConnection", enabled); }
+
+  // Общим соединением владеет отдельный поток ввода-вывода (IoThreadConnection), рабочие потоки передают ему команды
+  bool isIoThreadEnabled() const { return m_settings.value("Server/IoThread", false).toBool(); }
+  void setIoThreadEnabled(bool enabled) { m_settings.setValue("Server/IoThread", enabled); }
+
+  // Сколько публикаций канала общего соединения ждут подтверждения брокера, 0 - без ограничения
+  int getMaxUnconfirmedPerChannel() const { return m_settings.value("Server/MaxUnconfirmedPerChannel", 1000).toInt(); }
+  void setMaxUnconfirmedPerChannel(int maxUnconfirmed) { m_settings.setValue("Server/MaxUnconfirmedPerChannel", maxUnconfirmed); }
+
+  // HTTP-точка /metrics сервера в формате Prometheus
+  bool isMetricsEnabled() const { return m_settings.value("Metrics/Enabled", false).toBool(); }
+  void setMetricsEnabled(bool enabled) { m_settings.setValue("Metrics/Enabled", enabled); }
+
+  QString getMetricsAddress() const { return m_settings.value("Metrics/Address", "127.0.0.1").toString(); }
+  void setMetricsAddress(const QString& address) { m_settings.setValue("Metrics/Address", address); }
+
+  int getMetricsPort() const { return m_settings.value("Metrics/Port", 9464).toInt(); }
+  void setMetricsPort(int port) { m_settings.setValue("Metrics/Port", port); }
+
   bool isLoggingEnabled() const { return m_settings.value("Logging/Enabled", true).toBool(); }
   void setLoggingEnabled(bool enabled) { m_settings.setValue("Logging/Enabled", enabled); }
 
   QString getLogFilePath() const { return m_settings.value("Logging/FilePath", "logs.txt").toString(); }
   void setLogFilePath(const QString& logFilePath) { m_settings.setValue("Logging/FilePath", logFilePath); }
 
+  // Асинхронная запись лога отдельным потоком
+  bool isAsyncLoggingEnabled() const { return m_settings.value("Logging/Async", false).toBool(); }
+  void setAsyncLoggingEnabled(bool enabled) { m_settings.setValue("Logging/Async", enabled); }
+
+  int getLogQueueCapacity() const { return m_settings.value("Logging/QueueCapacity", 8192).toInt(); }
+  void setLogQueueCapacity(int capacity) { m_settings.setValue("Logging/QueueCapacity", capacity); }
+
+  int getLogFlushIntervalMs() const { return m_settings.value("Logging/FlushIntervalMs", 200).toInt(); }
+  void setLogFlushIntervalMs(int interval) { m_settings.setValue("Logging/FlushIntervalMs", interval); }
+
+  // drop, count, block - что делать при заполненной очереди асинхронного лога
+  QString getLogOverflowPolicy() const { return m_settings.value("Logging/OverflowPolicy", "count").toString(); }
+  void setLogOverflowPolicy(const QString& policy) { m_settings.setValue("Logging/OverflowPolicy", policy); }
+
+  // text, binary - двоичный лог читается утилитой logdecode
+  QString getLogFormat() const { return m_settings.value("Logging/Format", "text").toString(); }
+  void setLogFormat(const QString& format) { m_settings.setValue("Logging/Format", format); }
+
+  // Ротация файла лога: по размеру (0 - без ограничения) и по времени (0 - не ротировать)
+  int getLogMaxFileSizeKb() const { return m_settings.value("Logging/MaxFileSizeKb", 10240).toInt(); }
+  void setLogMaxFileSizeKb(int size) { m_settings.setValue("Logging/MaxFileSizeKb", size); }
+
+  int getLogRotationIntervalHours() const { return m_settings.value("Logging/RotationIntervalHours", 0).toInt(); }
+  void setLogRotationIntervalHours(int hours) { m_settings.setValue("Logging/RotationIntervalHours", hours); }
+
+  int getLogMaxArchivedFiles() const { return m_settings.value("Logging/MaxArchivedFiles", 5).toInt(); }
+  void setLogMaxArchivedFiles(int count) { m_settings.setValue("Logging/MaxArchivedFiles", count); }
+
+  bool isLogArchiveCompressionEnabled() const { return m_settings.value("Logging/CompressArchives", false).toBool(); }
+  void setLogArchiveCompressionEnabled(bool enabled) { m_settings.setValue("Logging/CompressArchives", enabled); }
+
+  // Дублирование лога в stderr
+  bool isConsoleLoggingEnabled() const { return m_settings.value("Logging/Console", false).toBool(); }
+  void setConsoleLoggingEnabled(bool enabled) { m_settings.setValue("Logging/Console", enabled); }
+
+  // Запись содержимого сообщений в лог (категория rabbitmq.trace)
+  bool isPayloadTraceEnabled() const { return m_settings.value("Logging/TracePayload", false).toBool(); }
+  void setPayloadTraceEnabled(bool enabled) { m_settings.setValue("Logging/TracePayload", enabled); }
+
   QtMsgType getLogLevel() const;
 
   void setLogLevel(QtMsgType logLevel);
@@ -0,0 +1,186 @@
+#include "BinaryLogFormat.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QtEndian>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char BinaryLogFormat::magic[8] = {'R', 'M', 'Q', 'B', 'L', 'O', 'G', '1'};
+
+namespace
+{
+const int recordFixedSize = 1 + 8 + 8 + 4 + 2 + 4;
+
+// тот же идентификатор, что выводит %{threadid} в текстовом формате
+uint64_t currentThreadId()
+{
+  thread_local const uint64_t threadId =
+#ifdef __linux__
+      static_cast<uint64_t>(syscall(SYS_gettid));
+#else
+      static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+  return threadId;
+}
+
+template <typename T>
+void append(QByteArray& out, T value)
+{
+  char bytes[sizeof(T)];
+  qToLittleEndian<T>(value, bytes);
+  out.append(bytes, static_cast<int>(sizeof(T)));
+}
+
+class Reader
+{
+public:
+  Reader(const QByteArray& data) : m_data(data) {}
+
+  bool atEnd() const {return m_pos >= m_data.size();}
+  bool startsWith(const char* bytes, int size) const
+  {
+    return m_data.size() - m_pos >= size && memcmp(m_data.constData() + m_pos, bytes, static_cast<size_t>(size)) == 0;
+  }
+  void skip(int size) {require(size); m_pos += size;}
+
+  template <typename T>
+  T read()
+  {
+    require(static_cast<int>(sizeof(T)));
+    T value = qFromLittleEndian<T>(m_data.constData() + m_pos);
+    m_pos += static_cast<int>(sizeof(T));
+    return value;
+  }
+
+  QByteArray readBytes(int size)
+  {
+    require(size);
+    QByteArray value(m_data.constData() + m_pos, size);
+    m_pos += size;
+    return value;
+  }
+
+private:
+  void require(int size) const
+  {
+    if (size < 0 || m_data.size() - m_pos < size)
+      throw std::runtime_error("Truncated binary log record at offset " + std::to_string(m_pos));
+  }
+
+  const QByteArray& m_data;
+  int m_pos = 0;
+};
+
+const char* levelLetter(QtMsgType type)
+{
+  switch (type)
+  {
+    case QtDebugMsg:
+      return "D";
+    case QtInfoMsg:
+      return "I";
+    case QtWarningMsg:
+      return "W";
+    case QtCriticalMsg:
+      return "C";
+    case QtFatalMsg:
+      return "F";
+  }
+  return "?";
+}
+}
+
+QByteArray BinaryLogFormat::fileHeader()
+{
+  const QByteArray appName = QCoreApplication::applicationName().toUtf8();
+  QByteArray header;
+  header.append(magic, static_cast<int>(sizeof(magic)));
+  append<quint64>(header, static_cast<quint64>(QDateTime::currentMSecsSinceEpoch()));
+  append<quint16>(header, static_cast<quint16>(appName.size()));
+  header.append(appName);
+  return header;
+}
+
+QByteArray BinaryLogFormat::encodeRecord(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+  const auto now = std::chrono::system_clock::now().time_since_epoch();
+  const char* file = context.file ? context.file : "";
+  const quint16 fileSize = static_cast<quint16>(std::min<size_t>(strlen(file), 0xFFFF));
+  const QByteArray text = message.toUtf8();
+
+  QByteArray record;
+  record.reserve(4 + recordFixedSize + fileSize + text.size());
+  append<quint32>(record, static_cast<quint32>(recordFixedSize + fileSize + text.size()));
+  append<quint8>(record, static_cast<quint8>(type));
+  append<quint64>(record, static_cast<quint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()));
+  append<quint64>(record, currentThreadId());
+  append<quint32>(record, static_cast<quint32>(context.line));
+  append<quint16>(record, fileSize);
+  append<quint32>(record, static_cast<quint32>(text.size()));
+  record.append(file, fileSize);
+  record.append(text);
+  return record;
+}
+
+QByteArray BinaryLogFormat::decode(const QByteArray &data)
+{
+  Reader reader(data);
+  if (!reader.startsWith(magic, static_cast<int>(sizeof(magic))))
+    throw std::runtime_error("Not a binary log: file header is missing");
+
+  QByteArray appName;
+  QByteArray text;
+  while (!reader.atEnd())
+  {
+    if (reader.startsWith(magic, static_cast<int>(sizeof(magic))))
+    {
+      reader.skip(static_cast<int>(sizeof(magic)));
+      const QDateTime started = QDateTime::fromMSecsSinceEpoch(static_cast<qint64>(reader.read<quint64>()));
+      appName = reader.readBytes(reader.read<quint16>());
+      text += "\nLog started at: ";
+      text += started.toString("dd.MM.yyyy hh:mm:ss.zzz").toUtf8();
+      text += "\nLog line format: [DIWCF]ddMMyyyy hh:mm:ss.zzz appname:threadid:file:line] msg\n";
+      continue;
+    }
+
+    const quint32 recordSize = reader.read<quint32>();
+    if (recordSize < static_cast<quint32>(recordFixedSize))
+      throw std::runtime_error("Corrupted binary log record: size " + std::to_string(recordSize));
+    const QtMsgType type = static_cast<QtMsgType>(reader.read<quint8>());
+    const qint64 timestampMs = static_cast<qint64>(reader.read<quint64>() / 1000000);
+    const quint64 threadId = reader.read<quint64>();
+    const quint32 line = reader.read<quint32>();
+    const quint16 fileSize = reader.read<quint16>();
+    const quint32 messageSize = reader.read<quint32>();
+    if (recordSize != static_cast<quint32>(recordFixedSize) + fileSize + messageSize)
+      throw std::runtime_error("Corrupted binary log record: inconsistent field sizes");
+
+    // сообщение уже в UTF-8 и копируется без преобразования
+    text += "[";
+    text += levelLetter(type);
+    text += QDateTime::fromMSecsSinceEpoch(timestampMs).toString("ddMMyyyy hh:mm:ss.zzz").toUtf8();
+    text += " ";
+    text += appName;
+    text += ":";
+    text += QByteArray::number(static_cast<qulonglong>(threadId));
+    text += ":";
+    text += reader.readBytes(fileSize);
+    text += ":";
+    text += QByteArray::number(line);
+    text += "] ";
+    text += reader.readBytes(static_cast<int>(messageSize));
+    text += "\n";
+  }
+  return text;
+}
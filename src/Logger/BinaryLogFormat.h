@@ -0,0 +1,44 @@
+#ifndef BINARYLOGFORMAT_H
+#define BINARYLOGFORMAT_H
+
+#include <QByteArray>
+#include <QString>
+
+// Формат файла лога
+enum class LogFormat
+{
+  Text,  // строки по шаблону qSetMessagePattern
+  Binary // записи BinaryLogFormat, в текст переводятся утилитой logdecode
+};
+
+/**
+ * /brief Двоичный формат лога
+ *
+ * В потоке-источнике не выполняется форматирование по шаблону и форматирование времени:
+ * запись содержит уровень, время, идентификатор потока, файл, строку и текст сообщения как есть.
+ * Все числа записываются в little-endian.
+ *
+ * Заголовок файла (пишется при каждом открытии файла):
+ *   magic[8] | uint64 время открытия, мс с начала эпохи | uint16 длина имени приложения | имя приложения
+ * Запись:
+ *   uint32 размер записи без этого поля | uint8 QtMsgType | uint64 время, нс с начала эпохи |
+ *   uint64 идентификатор потока | uint32 строка | uint16 длина имени файла | uint32 длина сообщения |
+ *   имя файла | сообщение в UTF-8
+ * Записи самодостаточны, поэтому каждый файл после ротации декодируется независимо.
+ */
+namespace BinaryLogFormat
+{
+  extern const char magic[8];
+
+  QByteArray fileHeader();
+  QByteArray encodeRecord(QtMsgType type, const QMessageLogContext& context, const QString& message);
+
+  /**
+   * /brief Переводит двоичный лог в текстовый формат [DIWCF]ddMMyyyy hh:mm:ss.zzz appname:threadid:file:line] msg
+   *
+   * Бросает std::runtime_error, если данные не являются двоичным логом или запись обрезана
+   */
+  QByteArray decode(const QByteArray& data);
+}
+
+#endif
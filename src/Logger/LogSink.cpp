@@ -0,0 +1,173 @@
+#include "LogSink.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include <cstdio>
+
+void ConsoleSink::write(const QByteArray &data)
+{
+  fwrite(data.constData(), 1, static_cast<size_t>(data.size()), stderr);
+}
+
+void ConsoleSink::flush()
+{
+  fflush(stderr);
+}
+
+RotatingFileSink::RotatingFileSink(const QString &filePath, const LogRotationSettings &settings, LogFormat format)
+  : m_filePath(filePath), m_stagingPath(filePath + ".rotating"), m_settings(settings), m_format(format),
+    m_file(filePath), m_rotationSize(settings.maxFileSize)
+{
+  archiveStagingFile();
+  open();
+}
+
+RotatingFileSink::~RotatingFileSink()
+{
+  if (m_compressor.joinable())
+    m_compressor.join();
+}
+
+void RotatingFileSink::open()
+{
+  m_openedAt = std::chrono::steady_clock::now();
+  const QIODevice::OpenMode mode = m_format == LogFormat::Text ? QIODevice::Append | QIODevice::Text : QIODevice::Append;
+  if (!m_file.open(mode))
+    return;
+  m_fileSize = m_file.size();
+
+  QByteArray data;
+  if (m_format == LogFormat::Binary)
+    data = BinaryLogFormat::fileHeader();
+  else
+  {
+    QString header = QString("\nLog started at: %1\n").arg(QDateTime::currentDateTime().toString("dd.MM.yyyy hh:mm:ss.zzz"));
+    header += "Log line format: [DIWCF]ddMMyyyy hh:mm:ss.zzz appname:threadid:file:line] msg\n";
+    data = header.toUtf8();
+  }
+  m_fileSize += m_file.write(data);
+  m_file.flush();
+}
+
+void RotatingFileSink::write(const QByteArray &data)
+{
+  if (needsRotation(data.size()))
+    rotate();
+  if (!m_file.isOpen())
+    return;
+
+  const qint64 written = m_file.write(data);
+  if (written > 0)
+    m_fileSize += written;
+}
+
+void RotatingFileSink::flush()
+{
+  if (m_file.isOpen())
+    m_file.flush();
+}
+
+bool RotatingFileSink::needsRotation(qint64 incomingSize) const
+{
+  if (!m_file.isOpen())
+    return false;
+  if (m_settings.maxFileSize > 0 && m_fileSize + incomingSize > m_rotationSize)
+    return true;
+  return m_settings.maxAge.count() > 0 && std::chrono::steady_clock::now() - m_openedAt >= m_settings.maxAge;
+}
+
+void RotatingFileSink::rotate()
+{
+  // архив прошлой ротации дописывается до того, как архивы сдвигаются
+  if (m_compressor.joinable())
+    m_compressor.join();
+  archiveStagingFile();
+
+  m_file.close();
+
+  bool rotated = true;
+  if (m_settings.maxArchivedFiles > 0)
+  {
+    // архивы меняются только после того, как текущий файл перемещен: иначе каждая неудачная
+    // попытка ротации удаляла бы еще один архив
+    rotated = QFile::rename(m_filePath, m_stagingPath);
+    if (rotated)
+    {
+      shiftArchives();
+      if (m_settings.compressArchives)
+      {
+        const QString source = m_stagingPath;
+        const QString destination = archiveName(1);
+        m_compressor = std::thread([source, destination]() { compressFile(source, destination); });
+      }
+      else
+        QFile::rename(m_stagingPath, archiveName(1));
+    }
+  }
+  else
+    rotated = QFile::remove(m_filePath);
+
+  open();
+  m_rotationSize = rotated ? m_settings.maxFileSize : m_fileSize + m_settings.maxFileSize;
+}
+
+void RotatingFileSink::archiveStagingFile()
+{
+  // каталог на месте промежуточного файла не трогается: ротация не удастся, а архивы останутся
+  if (!QFileInfo(m_stagingPath).isFile())
+    return;
+
+  // промежуточный файл старше текущего, поэтому становится самым новым архивом;
+  // сжатие выполняется сразу, поток сжатия в этот момент свободен
+  if (m_settings.maxArchivedFiles > 0)
+  {
+    shiftArchives();
+    const bool archived = m_settings.compressArchives ? compressFile(m_stagingPath, archiveName(1))
+                                                      : QFile::rename(m_stagingPath, archiveName(1));
+    if (archived)
+      return;
+  }
+  // иначе файл удаляется: оставшись, он не дал бы переместить текущий файл ни при одной ротации
+  QFile::remove(m_stagingPath);
+}
+
+void RotatingFileSink::shiftArchives()
+{
+  QFile::remove(archiveName(m_settings.maxArchivedFiles));
+  for (int i = m_settings.maxArchivedFiles - 1; i >= 1; --i)
+  {
+    if (QFile::exists(archiveName(i)))
+      QFile::rename(archiveName(i), archiveName(i + 1));
+  }
+}
+
+QString RotatingFileSink::archiveName(int index) const
+{
+  QString name = QString("%1.%2").arg(m_filePath).arg(index);
+  if (m_settings.compressArchives)
+    name += ".qz";
+  return name;
+}
+
+bool RotatingFileSink::compressFile(const QString &source, const QString &destination)
+{
+  QFile input(source);
+  if (!input.open(QIODevice::ReadOnly))
+    return false;
+  const QByteArray compressed = qCompress(input.readAll());
+  input.close();
+
+  QFile output(destination);
+  if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+  const bool written = output.write(compressed) == compressed.size();
+  output.close();
+
+  if (!written)
+  {
+    QFile::remove(destination);
+    return false;
+  }
+  return QFile::remove(source);
+}
@@ -0,0 +1,96 @@
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include "BinaryLogFormat.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <chrono>
+#include <thread>
+
+/**
+ * /brief Приемник строк лога
+ *
+ * Logger вызывает методы приемника под своей блокировкой, поэтому сами приемники
+ * не обязаны быть потокобезопасными.
+ */
+class LogSink
+{
+public:
+  virtual ~LogSink() = default;
+
+  // data содержит одну или несколько законченных строк в UTF-8
+  virtual void write(const QByteArray& data) = 0;
+  virtual void flush() = 0;
+};
+
+// Пишет лог в stderr
+class ConsoleSink : public LogSink
+{
+public:
+  void write(const QByteArray& data) override;
+  void flush() override;
+};
+
+// Параметры ротации файла лога
+struct LogRotationSettings
+{
+  qint64 maxFileSize = 0;           // байт, 0 - без ограничения
+  std::chrono::seconds maxAge{0};   // 0 - без ротации по времени
+  int maxArchivedFiles = 5;
+  bool compressArchives = false;
+};
+
+/**
+ * /brief Файл лога с ротацией по размеру и по времени
+ *
+ * При ротации текущий файл сначала переименовывается в <файл>.rotating, и только после этого
+ * старые архивы сдвигаются (<файл>.1 -> <файл>.2 ...), архивы сверх maxArchivedFiles удаляются,
+ * а перемещенный файл становится архивом <файл>.1. Если текущий файл переместить не удалось,
+ * архивы не меняются, запись продолжается в тот же файл, а следующая попытка ротации будет,
+ * когда файл вырастет еще на maxFileSize или пройдет maxAge.
+ *
+ * Сжатые архивы (qCompress) получают суффикс .qz и читаются через qUncompress. Сжатие выполняется
+ * в отдельном потоке, запись лога в новый файл его не ждет. Если архив сжать не удалось или процесс
+ * завершился во время ротации, несжатый файл остается под именем <файл>.rotating; при создании приемника
+ * и перед следующей ротацией он становится архивом <файл>.1, а если это не удалось - удаляется.
+ */
+class RotatingFileSink : public LogSink
+{
+public:
+  // format определяет заголовок, который пишется при открытии каждого файла
+  explicit RotatingFileSink(const QString& filePath, const LogRotationSettings& settings = LogRotationSettings(),
+                            LogFormat format = LogFormat::Text);
+  // Дожидается сжатия последнего архива
+  ~RotatingFileSink() override;
+
+  void write(const QByteArray& data) override;
+  void flush() override;
+
+  bool isOpen() const {return m_file.isOpen();}
+
+private:
+  void open();
+  bool needsRotation(qint64 incomingSize) const;
+  void rotate();
+  // Переносит в архивы <файл>.rotating, оставшийся после прошлой ротации
+  void archiveStagingFile();
+  void shiftArchives();
+  QString archiveName(int index) const;
+  static bool compressFile(const QString& source, const QString& destination);
+
+  const QString m_filePath;
+  const QString m_stagingPath; // текущий файл на время ротации
+  const LogRotationSettings m_settings;
+  const LogFormat m_format;
+  QFile m_file;
+  qint64 m_fileSize = 0;
+  // размер, после которого файл ротируется; после неудачной ротации увеличивается
+  qint64 m_rotationSize = 0;
+  std::chrono::steady_clock::time_point m_openedAt;
+  std::thread m_compressor;
+};
+
+#endif
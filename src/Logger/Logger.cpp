@@ -1,62 +1,313 @@
 #include "Logger.h"
 
 #include <QDebug>
-#include <QTime>
+#include <QLoggingCategory>
 
-std::unique_ptr<Logger> Logger::s_instance;
+#include <algorithm>
+#include <stdexcept>
 
-Logger::Logger(const QString &fileName, QtMsgType level)
+std::shared_ptr<Logger> Logger::s_instance;
+QString Logger::s_filterRules;
+
+namespace
 {
-  m_minLogLevel = level;
-  m_logFile = std::make_unique<QFile>(fileName);
-  if (m_logFile->open(QIODevice::Append | QIODevice::Text))
-  {
-    qInstallMessageHandler(&Logger::messageHandler);
-    QString pattern = "["
-                      "%{if-debug}D%{endif}"
-                      "%{if-info}I%{endif}"
-                      "%{if-warning}W%{endif}"
-                      "%{if-critical}C%{endif}"
-                      "%{if-fatal}F%{endif}"
-                      "%{time ddMMyyyy hh:mm:ss.zzz }"
-                      "%{appname}:%{threadid}:"
-                      "%{file}:%{line}] %{message}\n";
-    qSetMessagePattern(pattern);
+// статические объекты разрушаются в обратном порядке: обработчик снимается раньше, чем уничтожается логгер
+struct MessageHandlerGuard
+{
+  ~MessageHandlerGuard() { qInstallMessageHandler(nullptr); }
+} messageHandlerGuard;
+
+// размер, под который заранее выделяется буфер пачки асинхронного логгера
+const int writerBatchReserve = 64 * 1024;
+// сколько fatal ждет записи очереди: процесс все равно завершится, даже если приемник завис
+const std::chrono::milliseconds fatalDrainTimeout(2000);
+}
 
-    QTextStream out(m_logFile.get());
-    QString logFileCreated = QString("Log started at: %1\n").arg(QDateTime::currentDateTime().toString("dd.MM.yyyy hh:mm:ss.zzz"));
-    out << "\n" << logFileCreated;
-    out << "Log line format: [DIWCF]ddMMyyyy hh:mm:ss.zzz appname:threadid:file:line] msg\n";
-    m_logFile->flush();
-   }
+Logger::Logger(std::vector<std::unique_ptr<LogSink>> sinks, QtMsgType level, LogFormat format)
+  : m_minLogLevel(level), m_format(format), m_sinks(std::move(sinks))
+{
+}
+
+Logger::Logger(std::vector<std::unique_ptr<LogSink>> sinks, QtMsgType level, const AsyncSettings &settings,
+               LogFormat format)
+  : m_minLogLevel(level), m_format(format), m_sinks(std::move(sinks)), m_async(true), m_asyncSettings(settings),
+    m_queue(std::make_unique<RingBuffer<QByteArray>>(settings.queueCapacity))
+{
+  m_writer = std::thread(&Logger::runWriter, this);
 }
 
 Logger::~Logger()
 {
-  qInstallMessageHandler(nullptr);
-  m_logFile->close();
+  if (m_writer.joinable())
+  {
+    m_stopWriter = true;
+    m_writerWakeup.notify_one();
+    m_writer.join();
+  }
+
+  std::lock_guard<std::mutex> lock(m_sinkMutex);
+  for (auto& sink : m_sinks)
+    sink->flush();
+}
+
+void Logger::addSink(std::unique_ptr<LogSink> sink)
+{
+  std::lock_guard<std::mutex> lock(m_sinkMutex);
+  m_sinks.push_back(std::move(sink));
+}
+
+void Logger::install(std::shared_ptr<Logger> logger)
+{
+  s_filterRules = filterRulesForLevel(logger->m_minLogLevel);
+  QLoggingCategory::setFilterRules(s_filterRules);
+
+  QString pattern = "["
+                    "%{if-debug}D%{endif}"
+                    "%{if-info}I%{endif}"
+                    "%{if-warning}W%{endif}"
+                    "%{if-critical}C%{endif}"
+                    "%{if-fatal}F%{endif}"
+                    "%{time ddMMyyyy hh:mm:ss.zzz }"
+                    "%{appname}:%{threadid}:"
+                    "%{file}:%{line}] %{message}\n";
+  qSetMessagePattern(pattern);
+
+  // предыдущий логгер уничтожится, когда его отпустит последний пишущий в него поток
+  std::atomic_store(&s_instance, std::move(logger));
+  qInstallMessageHandler(&Logger::messageHandler);
 }
 
 void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
-  Logger *logger = s_instance.get();
-  if (!logger->m_logFile)
-    return;
-  if (logger->m_minLogLevel == QtFatalMsg && type != QtFatalMsg)
+  // копия удерживает логгер, даже если другой поток в это время его заменяет
+  std::shared_ptr<Logger> logger = std::atomic_load(&s_instance);
+  if (!logger)
     return;
-  if (logger->m_minLogLevel == QtCriticalMsg && (type > QtFatalMsg || type < QtCriticalMsg))
-    return;
-  if (logger->m_minLogLevel == QtWarningMsg && (type > QtFatalMsg || type < QtWarningMsg))
+  // уровень уже проверен категорией сообщения, см. filterRulesForLevel
+
+  // форматирование и кодирование остаются в потоке-источнике: шаблон содержит его идентификатор,
+  // а под блокировкой выполняется только запись готовых байтов. Двоичная запись не форматируется вовсе
+  QByteArray line = logger->m_format == LogFormat::Binary ? BinaryLogFormat::encodeRecord(type, context, msg)
+                                                          : qFormatLogMessage(type, context, msg).toUtf8();
+
+  if (logger->m_async)
+  {
+    if (type != QtFatalMsg)
+    {
+      logger->enqueue(std::move(line));
+      return;
+    }
+    // после fatal процесс завершится, поэтому такое сообщение пишется сразу, минуя очередь,
+    // но после сообщений, которые уже в ней стоят
+    logger->drainQueue(fatalDrainTimeout);
+  }
+
+  logger->writeToSinks(line, true);
+}
+
+void Logger::writeToSinks(const QByteArray &data, bool flush)
+{
+  std::lock_guard<std::mutex> lock(m_sinkMutex);
+  for (auto& sink : m_sinks)
+  {
+    if (!data.isEmpty())
+      sink->write(data);
+    if (flush)
+      sink->flush();
+  }
+}
+
+void Logger::enqueue(QByteArray &&line)
+{
+  if (m_queue->tryPush(std::move(line)))
+  {
+    ++m_enqueuedCount;
+    m_writerWakeup.notify_one();
     return;
-  if (logger->m_minLogLevel == QtInfoMsg && type == QtDebugMsg)
+  }
+
+  if (m_asyncSettings.overflowPolicy == OverflowPolicy::Block)
+  {
+    // поток записи будит ждущих после каждой разобранной пачки. Ожидание ограничено по времени,
+    // потому что пачка могла быть разобрана между неудачной попыткой и началом ожидания
+    ++m_progressWaiters;
+    {
+      std::unique_lock<std::mutex> lock(m_progressMutex);
+      while (!m_queue->tryPush(std::move(line)))
+      {
+        m_writerWakeup.notify_one();
+        m_progress.wait_for(lock, m_asyncSettings.flushInterval);
+      }
+    }
+    --m_progressWaiters;
+    ++m_enqueuedCount;
+    m_writerWakeup.notify_one();
+  }
+  else
+    ++m_droppedCount;
+}
+
+void Logger::drainQueue(std::chrono::milliseconds timeout)
+{
+  // очередь разбирает только поток записи, сам себя он не дождется
+  if (std::this_thread::get_id() == m_writer.get_id())
     return;
 
-  QTextStream out(logger->m_logFile.get());
-  out << qFormatLogMessage(type, context, msg);
-  logger->m_logFile->flush();
+  const uint64_t target = m_enqueuedCount;
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  ++m_progressWaiters;
+  {
+    std::unique_lock<std::mutex> lock(m_progressMutex);
+    while (m_writtenCount < target && std::chrono::steady_clock::now() < deadline)
+    {
+      m_writerWakeup.notify_one();
+      m_progress.wait_until(lock, std::min(deadline, std::chrono::steady_clock::now() + m_asyncSettings.flushInterval));
+    }
+  }
+  --m_progressWaiters;
+}
+
+void Logger::runWriter()
+{
+  auto lastFlush = std::chrono::steady_clock::now();
+  uint64_t reportedDropped = 0;
+  bool unflushed = false;
+  QByteArray line;
+  // буфер пачки переиспользуется между итерациями, чтобы не выделять память на каждую пачку
+  QByteArray batch;
+  batch.reserve(writerBatchReserve);
+
+  for (;;)
+  {
+    // флаг читается до разбора очереди: все, что положено до остановки, будет записано
+    const bool stopping = m_stopWriter;
+    batch.resize(0);
+    uint64_t popped = 0;
+    while (m_queue->tryPop(line))
+    {
+      batch += line;
+      ++popped;
+    }
+
+    const uint64_t dropped = m_droppedCount;
+    if (m_asyncSettings.overflowPolicy == OverflowPolicy::Count && dropped != reportedDropped)
+    {
+      const QString report = QString("Logger: %1 messages dropped, log queue is full").arg(static_cast<qulonglong>(dropped - reportedDropped));
+      if (m_format == LogFormat::Binary)
+        batch += BinaryLogFormat::encodeRecord(QtWarningMsg, QMessageLogContext(), report);
+      else
+        batch += (report + "\n").toUtf8();
+      reportedDropped = dropped;
+    }
+
+    const bool written = !batch.isEmpty();
+    unflushed = unflushed || written;
+    const auto now = std::chrono::steady_clock::now();
+    const bool flush = unflushed && (stopping || now - lastFlush >= m_asyncSettings.flushInterval);
+    if (written || flush)
+      writeToSinks(batch, flush);
+    if (flush)
+    {
+      lastFlush = now;
+      unflushed = false;
+    }
+    if (popped != 0)
+    {
+      m_writtenCount += popped;
+      if (m_progressWaiters != 0)
+      {
+        // под мьютексом, чтобы уведомление не пришло между проверкой ждущего и началом его ожидания
+        std::lock_guard<std::mutex> lock(m_progressMutex);
+        m_progress.notify_all();
+      }
+    }
+
+    if (stopping)
+      break;
+    if (!written)
+    {
+      std::unique_lock<std::mutex> lock(m_writerMutex);
+      m_writerWakeup.wait_for(lock, m_asyncSettings.flushInterval);
+    }
+  }
+}
+
+void Logger::setupLogging(const QString &filePath, QtMsgType level, const LogRotationSettings &rotation, LogFormat format)
+{
+  std::vector<std::unique_ptr<LogSink>> sinks;
+  sinks.push_back(std::make_unique<RotatingFileSink>(filePath, rotation, format));
+  install(std::make_shared<Logger>(std::move(sinks), level, format));
+}
+
+void Logger::setupAsyncLogging(const QString &filePath, QtMsgType level, const AsyncSettings &settings,
+                               const LogRotationSettings &rotation, LogFormat format)
+{
+  std::vector<std::unique_ptr<LogSink>> sinks;
+  sinks.push_back(std::make_unique<RotatingFileSink>(filePath, rotation, format));
+  install(std::make_shared<Logger>(std::move(sinks), level, settings, format));
+}
+
+void Logger::shutdownLogging()
+{
+  qInstallMessageHandler(nullptr);
+  std::atomic_store(&s_instance, std::shared_ptr<Logger>());
+}
+
+std::shared_ptr<Logger> Logger::instance()
+{
+  return std::atomic_load(&s_instance);
+}
+
+QString Logger::filterRulesForLevel(QtMsgType level)
+{
+  QString rules;
+  switch (level)
+  {
+    case QtFatalMsg:
+      rules += "*.critical=false\n";
+      // fall through
+    case QtCriticalMsg:
+      rules += "*.warning=false\n";
+      // fall through
+    case QtWarningMsg:
+      rules += "*.info=false\n";
+      // fall through
+    case QtInfoMsg:
+      rules += "*.debug=false\n";
+      break;
+    case QtDebugMsg:
+      break;
+  }
+  return rules;
+}
+
+void Logger::enableDebugCategory(const QString &category)
+{
+  // более позднее правило имеет приоритет над правилами уровня
+  s_filterRules += category + ".debug=true\n";
+  QLoggingCategory::setFilterRules(s_filterRules);
+}
+
+LogFormat Logger::formatFromString(const QString &format)
+{
+  const QString lower = format.toLower();
+  if (lower == "text")
+    return LogFormat::Text;
+  else if (lower == "binary")
+    return LogFormat::Binary;
+  else
+    throw std::invalid_argument("Unknown log format: " + format.toStdString());
 }
 
-void Logger::setupLogging(const QString &filePath, QtMsgType level)
+Logger::OverflowPolicy Logger::overflowPolicyFromString(const QString &policy)
 {
-  Logger::s_instance = std::make_unique<Logger>(filePath, level);
+  const QString lower = policy.toLower();
+  if (lower == "drop")
+    return OverflowPolicy::Drop;
+  else if (lower == "count")
+    return OverflowPolicy::Count;
+  else if (lower == "block")
+    return OverflowPolicy::Block;
+  else
+    throw std::invalid_argument("Unknown log overflow policy: " + policy.toStdString());
 }
@@ -1,24 +1,119 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include "LogSink.h"
+#include "RingBuffer.h"
+
 #include <QString>
-#include <QFile>
+#include <QByteArray>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 class Logger {
 public:
-  Logger(const QString &filePath, QtMsgType level);
+  // Что делать с сообщением, если очередь асинхронного логгера заполнена
+  enum class OverflowPolicy
+  {
+    Drop,  // отбросить молча
+    Count, // отбросить, а число отброшенных сообщений записать в лог
+    Block  // ждать, пока поток записи освободит место
+  };
+
+  struct AsyncSettings
+  {
+    size_t queueCapacity = 8192;
+    std::chrono::milliseconds flushInterval{200};
+    OverflowPolicy overflowPolicy = OverflowPolicy::Count;
+  };
+
+  // Синхронный логгер: каждое сообщение записывается и сбрасывается на диск в потоке, который его выдал
+  Logger(std::vector<std::unique_ptr<LogSink>> sinks, QtMsgType level, LogFormat format = LogFormat::Text);
+  /**
+   * /brief Асинхронный логгер
+   *
+   * Потоки только форматируют сообщение и кладут его в очередь. Отдельный поток забирает
+   * сообщения пачками, пишет их в приемники и сбрасывает приемники раз в flushInterval.
+   */
+  Logger(std::vector<std::unique_ptr<LogSink>> sinks, QtMsgType level, const AsyncSettings& settings,
+         LogFormat format = LogFormat::Text);
   ~Logger();
 
-  static void setupLogging(const QString &filePath, QtMsgType level);
+  // Добавляет приемник к работающему логгеру
+  void addSink(std::unique_ptr<LogSink> sink);
+
+  /**
+   * /brief Создает логгер с файлом filePath и устанавливает его обработчиком сообщений Qt
+   *
+   * Логгер можно заменить повторным вызовом в любой момент: потоки, которые пишут в старый
+   * логгер, удерживают его, пока не закончат запись.
+   */
+  static void setupLogging(const QString &filePath, QtMsgType level,
+                           const LogRotationSettings& rotation = LogRotationSettings(),
+                           LogFormat format = LogFormat::Text);
+  static void setupAsyncLogging(const QString &filePath, QtMsgType level, const AsyncSettings& settings,
+                                const LogRotationSettings& rotation = LogRotationSettings(),
+                                LogFormat format = LogFormat::Text);
+  // text, binary
+  static LogFormat formatFromString(const QString& format);
+  // Снимает обработчик и записывает накопленные сообщения
+  static void shutdownLogging();
+  static std::shared_ptr<Logger> instance();
+
+  // drop, count, block
+  static OverflowPolicy overflowPolicyFromString(const QString& policy);
+
+  /**
+   * /brief Правила QLoggingCategory для уровня логирования
+   *
+   * Сообщения ниже уровня отсекаются проверкой категории в qCInfo/qCDebug до того,
+   * как вычисляются аргументы, а не в обработчике после форматирования.
+   */
+  static QString filterRulesForLevel(QtMsgType level);
+  // Включает отладочные сообщения категории независимо от уровня, например "rabbitmq.trace"
+  static void enableDebugCategory(const QString& category);
+
+  uint64_t getDroppedCount() const {return m_droppedCount;}
 
-  static std::unique_ptr<Logger> s_instance;
 private:
+  static void install(std::shared_ptr<Logger> logger);
   static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
 
+  void writeToSinks(const QByteArray& data, bool flush);
+  void enqueue(QByteArray&& line);
+  // Ждет, пока поток записи запишет все, что уже положено в очередь, но не дольше timeout
+  void drainQueue(std::chrono::milliseconds timeout);
+  void runWriter();
+
+  // доступ только через std::atomic_load/std::atomic_store
+  static std::shared_ptr<Logger> s_instance;
+  static QString s_filterRules;
+
   QtMsgType m_minLogLevel;
-  std::unique_ptr<QFile> m_logFile;
+  const LogFormat m_format;
+  std::vector<std::unique_ptr<LogSink>> m_sinks;
+  std::mutex m_sinkMutex; // запись в приемники из нескольких потоков
+
+  const bool m_async = false;
+  const AsyncSettings m_asyncSettings;
+  // строка кодируется в UTF-8 в потоке-источнике, поток записи только склеивает готовые байты
+  std::unique_ptr<RingBuffer<QByteArray>> m_queue;
+  std::thread m_writer;
+  std::atomic<bool> m_stopWriter{false};
+  std::mutex m_writerMutex;
+  std::condition_variable m_writerWakeup;
+  std::atomic<uint64_t> m_droppedCount{0};
+  // очередь освободилась или записана: будит писателей, ждущих места (OverflowPolicy::Block), и drainQueue
+  std::mutex m_progressMutex;
+  std::condition_variable m_progress;
+  std::atomic<int> m_progressWaiters{0};
+  std::atomic<uint64_t> m_enqueuedCount{0};
+  std::atomic<uint64_t> m_writtenCount{0};
 };
 
 #endif
@@ -0,0 +1,100 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * /brief Ограниченная очередь без блокировок: много писателей, один читатель
+ *
+ * Кольцевой буфер с порядковым номером в каждой ячейке (схема Д. Вьюкова). Писатели
+ * занимают ячейку через compare_exchange на общей позиции записи, читатель единственный
+ * и двигает позицию чтения без атомарных операций чтения-модификации-записи.
+ * Емкость округляется вверх до степени двойки.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+  explicit RingBuffer(size_t capacity)
+    : m_mask(roundUpToPowerOfTwo(capacity) - 1), m_cells(new Cell[m_mask + 1])
+  {
+    for (size_t i = 0; i <= m_mask; ++i)
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  RingBuffer(const RingBuffer&) = delete;
+  RingBuffer& operator=(const RingBuffer&) = delete;
+
+  // false, если очередь заполнена; в этом случае value не изменяется
+  bool tryPush(T&& value)
+  {
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Cell& cell = m_cells[pos & m_mask];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0)
+      {
+        if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          cell.value = std::move(value);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+        return false;
+      else
+        pos = m_enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Вызывается только из потока читателя. false, если очередь пуста
+  bool tryPop(T& value)
+  {
+    const size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    Cell& cell = m_cells[pos & m_mask];
+    const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence != pos + 1)
+      return false;
+
+    value = std::move(cell.value);
+    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+    m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  size_t capacity() const {return m_mask + 1;}
+
+private:
+  static size_t roundUpToPowerOfTwo(size_t value)
+  {
+    size_t result = 2;
+    while (result < value)
+      result <<= 1;
+    return result;
+  }
+
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  static const size_t cacheLineSize = 64;
+
+  const size_t m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+  // позиции записи и чтения разнесены по разным кэш-линиям, чтобы писатели не мешали читателю
+  char m_padding0[cacheLineSize];
+  std::atomic<size_t> m_enqueuePos{0};
+  char m_padding1[cacheLineSize];
+  std::atomic<size_t> m_dequeuePos{0};
+  char m_padding2[cacheLineSize];
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "BinaryLogFormat.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QFile>
+
+#include <cstdio>
+#include <stdexcept>
+
+// Переводит двоичные файлы лога (Logging/Format=binary) в текстовый формат и выводит их в stdout
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Decodes binary log files into the text log format");
+  parser.addHelpOption();
+  parser.addPositionalArgument("files", "Binary log files, archives with the .qz suffix are decompressed.");
+
+  parser.process(app);
+  const QStringList files = parser.positionalArguments();
+  if (files.isEmpty())
+    parser.showHelp(1);
+
+  int result = 0;
+  for (const QString& fileName : files)
+  {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      qCritical() << "Failed to open log file:" << fileName;
+      result = 1;
+      continue;
+    }
+
+    QByteArray data = file.readAll();
+    if (fileName.endsWith(".qz"))
+      data = qUncompress(data);
+
+    try
+    {
+      const QByteArray text = BinaryLogFormat::decode(data);
+      fwrite(text.constData(), 1, static_cast<size_t>(text.size()), stdout);
+    }
+    catch (const std::exception& e)
+    {
+      qCritical() << "Failed to decode" << fileName << ":" << e.what();
+      result = 1;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,55 @@
+#ifndef BYTESVIEW_H
+#define BYTESVIEW_H
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/**
+ * /brief Невладеющая ссылка на непрерывный блок байт (указатель и длина)
+ *
+ * Действительна, пока жив владелец данных: конверт сообщения, строка или буфер соединения.
+ */
+struct BytesView
+{
+  BytesView() = default;
+  BytesView(const char* data, size_t size) : data(data), size(size) {}
+  BytesView(const std::string& str) : data(str.data()), size(str.size()) {}
+
+  bool empty() const {return size == 0;}
+  std::string toString() const {return data ? std::string(data, size) : std::string();}
+
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+// Сравнение по содержимому
+inline bool operator==(const BytesView& lhs, const BytesView& rhs)
+{
+  return lhs.size == rhs.size && (lhs.size == 0 || std::memcmp(lhs.data, rhs.data, lhs.size) == 0);
+}
+
+inline bool operator!=(const BytesView& lhs, const BytesView& rhs)
+{
+  return !(lhs == rhs);
+}
+
+/**
+ * /brief Сериализует protobuf сообщение в буфер вызывающего
+ *
+ * Буфер переиспользуется между вызовами, поэтому, когда его емкость достигла размера самого
+ * большого сообщения, сериализация не выделяет память. Результат действителен до следующего
+ * изменения буфера.
+ */
+template <typename Message>
+BytesView serializeToBuffer(const Message& message, std::string& buffer)
+{
+  const size_t size = message.ByteSizeLong();
+  buffer.resize(size);
+  if (size != 0 && !message.SerializeToArray(&buffer[0], static_cast<int>(size)))
+    throw std::runtime_error("Failed to serialize message");
+  return BytesView(buffer);
+}
+
+#endif
@@ -0,0 +1,460 @@
+#include "ChannelPool.h"
+#include "LoggingCategories.h"
+
+#include <QDebug>
+
+#include <sys/time.h>
+
+#include <stdexcept>
+
+/**
+ * /brief Канал пула, который Client и Server используют как отдельное соединение
+ *
+ * Сокета и логина у канала нет, openChannel выдает его единственный канал. Остальные вызовы выполняются
+ * на соединении пула под его мьютексом и только из потока, получившего канал.
+ */
+class PooledChannel : public IRabbitmqConnection
+{
+public:
+  PooledChannel(std::shared_ptr<ChannelPool> pool, std::shared_ptr<ChannelPool::ChannelState> state,
+                amqp_channel_t channel, std::thread::id owner)
+    : m_pool(std::move(pool)), m_state(std::move(state)), m_channel(channel), m_owner(owner)
+  {
+  }
+
+  ~PooledChannel() override
+  {
+    m_pool->release(m_channel);
+  }
+
+  std::unique_ptr<RabbitmqSocket> openSocket(const std::string&, int) override
+  {
+    return nullptr;
+  }
+
+  void login(const std::string&, const std::string&, int, const std::string&) override
+  {
+  }
+
+  std::unique_ptr<RabbitmqChannel> openChannel() override
+  {
+    auto lock = lockOwned();
+    if (m_channelIssued)
+      throw std::logic_error("Pooled channel " + std::to_string(m_channel) + " is already open");
+    m_channelIssued = true;
+    // канал закрывает пул, когда его освобождают
+    return std::make_unique<RabbitmqChannel>(shared_from_this(), m_channel);
+  }
+
+  std::unique_ptr<RabbitmqExchange> declareExchange(const RabbitmqChannel& channel, const std::string& exchangeName,
+                                                    const std::string& exchangeType) override
+  {
+    auto lock = lockOwned(channel);
+    auto exchange = connection().declareExchange(pooledChannel(), exchangeName, exchangeType);
+    m_pool->wakeReader();
+    return exchange;
+  }
+
+  std::unique_ptr<RabbitmqQueue> declareQueue(const RabbitmqChannel& channel, const std::string& queueName) override
+  {
+    auto lock = lockOwned(channel);
+    auto queue = connection().declareQueue(pooledChannel(), queueName);
+    m_pool->wakeReader();
+    return queue;
+  }
+
+  std::unique_ptr<RabbitmqQueue> declareExclusiveQueue(const RabbitmqChannel& channel) override
+  {
+    auto lock = lockOwned(channel);
+    auto queue = connection().declareExclusiveQueue(pooledChannel());
+    m_pool->wakeReader();
+    return queue;
+  }
+
+  std::unique_ptr<RabbitmqBind> bind(const RabbitmqChannel& channel, const RabbitmqQueue& queue,
+                                     const RabbitmqExchange& exchange, const std::string& bindingKey) override
+  {
+    auto lock = lockOwned(channel);
+    auto binding = connection().bind(pooledChannel(), queue, exchange, bindingKey);
+    m_pool->wakeReader();
+    return binding;
+  }
+
+  void basicQos(const RabbitmqChannel& channel, uint16_t prefetchCount) override
+  {
+    auto lock = lockOwned(channel);
+    m_state->dirty = true;
+    connection().basicQos(pooledChannel(), prefetchCount);
+    m_pool->wakeReader();
+  }
+
+  void basicConsume(const RabbitmqChannel& channel, const RabbitmqQueue& queue, bool noAsk, bool exclusive) override
+  {
+    auto lock = lockOwned(channel);
+    m_state->dirty = true;
+    connection().basicConsume(pooledChannel(), queue, noAsk, exclusive);
+    m_pool->wakeReader();
+  }
+
+  void consumeDirectReplyTo(const RabbitmqChannel& channel) override
+  {
+    auto lock = lockOwned(channel);
+    m_state->dirty = true;
+    connection().consumeDirectReplyTo(pooledChannel());
+    m_pool->wakeReader();
+  }
+
+  void confirmSelect(const RabbitmqChannel& channel) override
+  {
+    auto lock = lockOwned(channel);
+    m_state->dirty = true;
+    connection().confirmSelect(pooledChannel());
+    m_pool->wakeReader();
+  }
+
+  size_t getUnconfirmedCount() const override
+  {
+    std::lock_guard<std::mutex> lock(m_pool->m_mutex);
+    return m_state->unconfirmed;
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message) override
+  {
+    auto lock = lockOwned(channel);
+    connection().publishMessage(pooledChannel(), exchange, binding, message);
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties) override
+  {
+    auto lock = lockOwned(channel);
+    connection().publishMessage(pooledChannel(), exchange, binding, message, properties);
+  }
+
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties) override
+  {
+    auto lock = lockOwned(channel);
+    connection().publishToQueue(pooledChannel(), queueName, message, properties);
+  }
+
+  void publishBatch(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                    const RabbitmqBind& binding, const std::vector<BatchMessage>& messages) override
+  {
+    auto lock = lockOwned(channel);
+    connection().publishBatch(pooledChannel(), exchange, binding, messages);
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override
+  {
+    auto lock = lockOwned(channel);
+    waitForCredit(lock);
+    auto tracked = trackConfirm(std::move(onConfirm));
+    try
+    {
+      connection().publishMessage(pooledChannel(), exchange, binding, message, properties, tracked);
+    }
+    catch (const std::exception&)
+    {
+      // неотправленную публикацию брокер не подтвердит
+      --m_state->unconfirmed;
+      throw;
+    }
+  }
+
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override
+  {
+    auto lock = lockOwned(channel);
+    waitForCredit(lock);
+    auto tracked = trackConfirm(std::move(onConfirm));
+    try
+    {
+      connection().publishToQueue(pooledChannel(), queueName, message, properties, tracked);
+    }
+    catch (const std::exception&)
+    {
+      --m_state->unconfirmed;
+      throw;
+    }
+  }
+
+  void ack(const IRabbitmqEnvelope& envelope) override
+  {
+    auto lock = lockOwned();
+    connection().ack(envelope);
+  }
+
+  void reject(const IRabbitmqEnvelope& envelope, bool requeue) override
+  {
+    auto lock = lockOwned();
+    connection().reject(envelope, requeue);
+  }
+
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessage() override
+  {
+    return consumeMessageInternal(nullptr);
+  }
+
+  std::unique_ptr<IRabbitmqEnvelope> timedConsumeMessage(std::chrono::milliseconds timeoutMillis) override
+  {
+    struct timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeoutMillis.count() / 1000);
+    timeout.tv_usec = static_cast<suseconds_t>((timeoutMillis.count() % 1000) * 1000);
+    return consumeMessageInternal(&timeout);
+  }
+
+  // дескриптора у канала нет: кадры соединения читает тот поток пула, который сейчас ждет сообщений
+  bool hasBufferedFrames() const override
+  {
+    std::lock_guard<std::mutex> lock(m_pool->m_mutex);
+    return !m_state->inbox.empty() || !m_state->confirmations.empty();
+  }
+
+protected:
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessageInternal(struct timeval* timeout) override
+  {
+    runConfirmations();
+
+    const auto deadline = timeout ? std::chrono::steady_clock::now() + std::chrono::seconds(timeout->tv_sec) +
+                                    std::chrono::microseconds(timeout->tv_usec)
+                                  : std::chrono::steady_clock::time_point::max();
+    auto lock = lockOwned();
+    bool attempted = false;
+    while (true)
+    {
+      if (!m_state->inbox.empty())
+      {
+        auto envelope = std::move(m_state->inbox.front());
+        m_state->inbox.pop_front();
+        return envelope;
+      }
+      // как и librabbitmq, вместо сообщения получение может вернуть обработанные подтверждения
+      if (!m_state->confirmations.empty())
+        break;
+      if (attempted && std::chrono::steady_clock::now() >= deadline)
+        break;
+
+      m_pool->waitForFrames(lock, deadline);
+      attempted = true;
+    }
+    lock.unlock();
+    runConfirmations();
+    return nullptr;
+  }
+
+private:
+  std::unique_lock<std::mutex> lockOwned() const
+  {
+    if (std::this_thread::get_id() != m_owner)
+      throw std::logic_error("Pooled channel " + std::to_string(m_channel) + " is used outside its thread");
+    return std::unique_lock<std::mutex>(m_pool->m_mutex);
+  }
+
+  std::unique_lock<std::mutex> lockOwned(const RabbitmqChannel& channel) const
+  {
+    if (channel.getId() != m_channel)
+      throw std::invalid_argument("Channel " + std::to_string(channel.getId()) + " does not belong to pooled channel " +
+                                  std::to_string(m_channel));
+    return lockOwned();
+  }
+
+  IRabbitmqConnection& connection() const {return *m_pool->m_connection;}
+  const RabbitmqChannel& pooledChannel() const {return *m_state->channel;}
+
+  // Пока у канала исчерпан лимит неподтвержденных публикаций, читает кадры соединения
+  void waitForCredit(std::unique_lock<std::mutex>& lock)
+  {
+    const size_t limit = m_pool->m_settings.maxUnconfirmedPerChannel;
+    if (limit == 0)
+      return;
+
+    const auto deadline = std::chrono::steady_clock::now() + m_pool->m_settings.flowControlTimeout;
+    while (m_state->unconfirmed >= limit)
+    {
+      if (std::chrono::steady_clock::now() >= deadline)
+      {
+        std::string errorMsg = "Channel " + std::to_string(m_channel) + ": broker did not confirm " +
+                               std::to_string(m_state->unconfirmed) + " publishes in time";
+        qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+        throw std::runtime_error(errorMsg);
+      }
+      m_pool->waitForFrames(lock, deadline);
+    }
+  }
+
+  // Подтверждение приходит тому потоку, который читает соединение, а выполняется в потоке канала
+  PublishConfirmCallback trackConfirm(PublishConfirmCallback onConfirm)
+  {
+    ++m_state->unconfirmed;
+    std::weak_ptr<ChannelPool::ChannelState> weakState = m_state;
+    return [weakState, onConfirm](bool acked)
+    {
+      auto state = weakState.lock();
+      if (!state)
+        return;
+      --state->unconfirmed;
+      state->confirmations.emplace_back(onConfirm, acked);
+    };
+  }
+
+  void runConfirmations()
+  {
+    std::vector<std::pair<PublishConfirmCallback, bool>> confirmations;
+    {
+      auto lock = lockOwned();
+      confirmations.swap(m_state->confirmations);
+    }
+    for (auto& confirmation : confirmations)
+      if (confirmation.first)
+        confirmation.first(confirmation.second);
+  }
+
+  std::shared_ptr<ChannelPool> m_pool;
+  std::shared_ptr<ChannelPool::ChannelState> m_state;
+  const amqp_channel_t m_channel;
+  const std::thread::id m_owner;
+  bool m_channelIssued = false;
+};
+
+ChannelPool::ChannelPool(Private, std::shared_ptr<IRabbitmqConnection> connection, const ChannelPoolSettings& settings)
+  : m_connection(std::move(connection)), m_settings(settings), m_reader(true)
+{
+}
+
+ChannelPool::~ChannelPool()
+{
+  // каналы закрываются на брокере раньше, чем пул отпустит соединение
+  m_idle.clear();
+  m_channels.clear();
+}
+
+std::shared_ptr<ChannelPool> ChannelPool::create(std::shared_ptr<IRabbitmqConnection> connection,
+                                                 const ChannelPoolSettings& settings)
+{
+  if (!connection)
+    throw std::invalid_argument("ChannelPool: nullptr connection");
+  return std::make_shared<ChannelPool>(Private(), std::move(connection), settings);
+}
+
+std::shared_ptr<IRabbitmqConnection> ChannelPool::checkout()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const std::thread::id owner = std::this_thread::get_id();
+  auto lease = m_leases.find(owner);
+  if (lease != m_leases.end())
+  {
+    auto existing = lease->second.lock();
+    if (existing)
+      return existing;
+    m_leases.erase(lease);
+  }
+
+  std::shared_ptr<ChannelState> state;
+  amqp_channel_t channel = 0;
+  if (!m_idle.empty())
+  {
+    channel = m_idle.back();
+    m_idle.pop_back();
+    state = m_channels.at(channel);
+  }
+  else
+  {
+    if (m_settings.maxChannels != 0 && m_channels.size() >= m_settings.maxChannels)
+    {
+      std::string errorMsg = "ChannelPool: all " + std::to_string(m_settings.maxChannels) + " channels are checked out";
+      qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+      throw std::runtime_error(errorMsg);
+    }
+    state = std::make_shared<ChannelState>();
+    state->channel = m_connection->openChannel();
+    wakeReader();
+    channel = state->channel->getId();
+    m_channels[channel] = state;
+  }
+  state->leased = true;
+
+  auto pooled = std::make_shared<PooledChannel>(shared_from_this(), state, channel, owner);
+  m_leases[owner] = pooled;
+  qCInfo(lcRabbitmq) << "Channel" << channel << "checked out from pool," << m_channels.size() << "channels open";
+  return pooled;
+}
+
+size_t ChannelPool::getOpenChannelCount() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_channels.size();
+}
+
+size_t ChannelPool::getIdleChannelCount() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_idle.size();
+}
+
+void ChannelPool::waitForFrames(std::unique_lock<std::mutex>& lock, std::chrono::steady_clock::time_point deadline)
+{
+  m_reader.waitForFrames(*m_connection, lock, deadline,
+                         [this](std::unique_ptr<IRabbitmqEnvelope> envelope) { route(std::move(envelope)); });
+}
+
+void ChannelPool::route(std::unique_ptr<IRabbitmqEnvelope> envelope)
+{
+  auto state = m_channels.find(envelope->getChannel());
+  if (state == m_channels.end() || !state->second->leased)
+  {
+    // неподтвержденное сообщение брокер вернет в очередь при закрытии канала
+    qCWarning(lcRabbitmq) << "Dropped delivery" << envelope->getDeliveryTag() << "for released channel"
+                          << envelope->getChannel();
+    return;
+  }
+  state->second->inbox.push_back(std::move(envelope));
+}
+
+void ChannelPool::wakeReader()
+{
+  m_reader.wake();
+}
+
+void ChannelPool::release(amqp_channel_t channel)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto lease = m_leases.begin(); lease != m_leases.end();)
+  {
+    if (lease->second.expired())
+      lease = m_leases.erase(lease);
+    else
+      ++lease;
+  }
+
+  auto it = m_channels.find(channel);
+  if (it == m_channels.end())
+    return;
+  std::shared_ptr<ChannelState> state = it->second;
+  state->leased = false;
+  state->inbox.clear();
+  state->confirmations.clear();
+
+  if (!state->dirty)
+  {
+    m_idle.push_back(channel);
+    return;
+  }
+
+  // подписки и режим подтверждений остаются на канале до его закрытия, поэтому такой канал не переиспользуется
+  m_channels.erase(it);
+  try
+  {
+    state->channel.reset();
+  }
+  catch (const std::exception& e)
+  {
+    qCWarning(lcRabbitmq) << "Failed to close pooled channel" << channel << ":" << e.what();
+  }
+  wakeReader();
+  qCInfo(lcRabbitmq) << "Pooled channel" << channel << "closed," << m_channels.size() << "channels open";
+}
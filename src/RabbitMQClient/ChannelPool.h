@@ -0,0 +1,99 @@
+#ifndef CHANNELPOOL_H
+#define CHANNELPOOL_H
+
+#include "IRabbitmqConnection.h"
+#include "rabbitmqEntities.h"
+#include "SharedReader.h"
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class PooledChannel;
+
+struct ChannelPoolSettings
+{
+  // Сколько каналов пул открывает на соединении, 0 - сколько разрешит брокер (channel_max)
+  size_t maxChannels = 0;
+  // Сколько публикаций канала может ждать подтверждения брокера, 0 - без ограничения.
+  // Поток, исчерпавший лимит, ждет подтверждений, а не копит публикации в сокете соединения
+  size_t maxUnconfirmedPerChannel = 0;
+  // Сколько публикация ждет освобождения лимита, прежде чем завершиться ошибкой
+  std::chrono::milliseconds flowControlTimeout{30000};
+};
+
+/**
+ * /brief Каналы одного соединения RabbitMQ для нескольких потоков
+ *
+ * AMQP мультиплексирует каналы в одном TCP соединении, поэтому потокам не нужны свои сокет и логин:
+ * checkout() выдает потоку канал, оформленный как отдельное IRabbitmqConnection, и Client или Server
+ * работают с ним как с обычным соединением. Канал закреплен за потоком, который его получил:
+ * повторный checkout() в том же потоке возвращает тот же канал, а вызов его методов из другого потока
+ * завершается std::logic_error.
+ *
+ * Соединение librabbitmq не потокобезопасно, поэтому обращения каналов к нему выполняются под мьютексом пула.
+ * Кадры из сокета читает один поток за раз и раскладывает сообщения по каналам, остальные ждут
+ * сообщений своего канала, не занимая соединение. Подтверждения публикаций выполняются в потоке канала.
+ *
+ * Освобожденный канал без подписок и режима подтверждений возвращается в пул и выдается снова,
+ * остальные закрываются на брокере, а их номера соединение выдает повторно.
+ * Соединение передается в пул после openSocket и login и дальше используется только через пул.
+ */
+class ChannelPool : public std::enable_shared_from_this<ChannelPool>
+{
+  class Private;
+public:
+  ChannelPool(Private, std::shared_ptr<IRabbitmqConnection> connection, const ChannelPoolSettings& settings);
+  ~ChannelPool();
+
+  ChannelPool(const ChannelPool&) = delete;
+  ChannelPool& operator=(const ChannelPool&) = delete;
+
+  static std::shared_ptr<ChannelPool> create(std::shared_ptr<IRabbitmqConnection> connection,
+                                             const ChannelPoolSettings& settings = ChannelPoolSettings());
+
+  // Канал текущего потока. Пока он жив, другие потоки его не получат
+  std::shared_ptr<IRabbitmqConnection> checkout();
+
+  size_t getOpenChannelCount() const;
+  size_t getIdleChannelCount() const;
+private:
+  friend class PooledChannel;
+
+  struct ChannelState
+  {
+    std::unique_ptr<RabbitmqChannel> channel;
+    std::deque<std::unique_ptr<IRabbitmqEnvelope>> inbox;
+    // подтверждения публикаций, которые выполнит поток канала
+    std::vector<std::pair<PublishConfirmCallback, bool>> confirmations;
+    size_t unconfirmed = 0;
+    // на канале есть подписки или режим подтверждений: другому потоку его отдавать нельзя
+    bool dirty = false;
+    bool leased = false;
+  };
+
+  // Читает кадры соединения сам или ждет, пока их разложит по каналам другой поток
+  void waitForFrames(std::unique_lock<std::mutex>& lock, std::chrono::steady_clock::time_point deadline);
+  // Кладет сообщение в очередь его канала
+  void route(std::unique_ptr<IRabbitmqEnvelope> envelope);
+  // Будит поток, который ждет кадров соединения, чтобы освободить его для других каналов
+  void wakeReader();
+  void release(amqp_channel_t channel);
+
+  std::shared_ptr<IRabbitmqConnection> m_connection;
+  const ChannelPoolSettings m_settings;
+
+  mutable std::mutex m_mutex;
+  SharedReader m_reader;
+  std::map<amqp_channel_t, std::shared_ptr<ChannelState>> m_channels;
+  std::vector<amqp_channel_t> m_idle;
+  std::map<std::thread::id, std::weak_ptr<PooledChannel>> m_leases;
+
+  struct Private{ explicit Private() = default; };
+};
+
+#endif
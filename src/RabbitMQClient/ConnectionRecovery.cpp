@@ -0,0 +1,200 @@
+#include "ConnectionRecovery.h"
+
+#include <algorithm>
+#include <set>
+
+RecoveryBackoff::RecoveryBackoff(const ConnectionRecoverySettings &settings)
+  : m_settings(settings), m_random(std::random_device()())
+{
+}
+
+std::chrono::milliseconds RecoveryBackoff::nextDelay()
+{
+  ++m_failures;
+  double delay = static_cast<double>(m_settings.initialDelay.count());
+  const double maxDelay = static_cast<double>(m_settings.maxDelay.count());
+  for (unsigned i = 1; i < m_failures && delay < maxDelay; ++i)
+    delay *= m_settings.backoffMultiplier;
+  delay = std::min(delay, maxDelay);
+
+  const double jitter = std::max(0.0, std::min(m_settings.jitter, 1.0));
+  std::uniform_real_distribution<double> distribution(0.0, jitter);
+  delay *= 1.0 - distribution(m_random);
+  return std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(delay));
+}
+
+void RecordedTopology::recordChannel(uint16_t channel)
+{
+  Entry entry;
+  entry.kind = Kind::Channel;
+  entry.channel = channel;
+  record(entry);
+}
+
+void RecordedTopology::recordExchange(uint16_t channel, const std::string &exchangeName, const std::string &exchangeType)
+{
+  Entry entry;
+  entry.kind = Kind::Exchange;
+  entry.channel = channel;
+  entry.name = exchangeName;
+  entry.argument = exchangeType;
+  record(entry);
+}
+
+void RecordedTopology::recordQueue(uint16_t channel, const std::string &queueName)
+{
+  Entry entry;
+  entry.kind = Kind::Queue;
+  entry.channel = channel;
+  entry.name = queueName;
+  record(entry);
+}
+
+void RecordedTopology::recordExclusiveQueue(uint16_t channel, const std::string &queueName)
+{
+  Entry entry;
+  entry.kind = Kind::ExclusiveQueue;
+  entry.channel = channel;
+  entry.name = queueName;
+  record(entry);
+}
+
+void RecordedTopology::recordBind(uint16_t channel, const std::string &queueName, const std::string &exchangeName,
+                                  const std::string &bindingKey)
+{
+  Entry entry;
+  entry.kind = Kind::Bind;
+  entry.channel = channel;
+  entry.name = queueName;
+  entry.argument = exchangeName;
+  entry.bindingKey = bindingKey;
+  record(entry);
+}
+
+void RecordedTopology::recordQos(uint16_t channel, uint16_t prefetchCount)
+{
+  Entry entry;
+  entry.kind = Kind::Qos;
+  entry.channel = channel;
+  entry.prefetchCount = prefetchCount;
+  record(entry);
+}
+
+void RecordedTopology::recordConsume(uint16_t channel, const std::string &queueName, bool noAck, bool exclusive)
+{
+  Entry entry;
+  entry.kind = Kind::Consume;
+  entry.channel = channel;
+  entry.name = queueName;
+  entry.noAck = noAck;
+  entry.exclusive = exclusive;
+  record(entry);
+}
+
+void RecordedTopology::recordDirectReplyTo(uint16_t channel)
+{
+  Entry entry;
+  entry.kind = Kind::DirectReplyTo;
+  entry.channel = channel;
+  record(entry);
+}
+
+void RecordedTopology::recordConfirmSelect(uint16_t channel)
+{
+  Entry entry;
+  entry.kind = Kind::ConfirmSelect;
+  entry.channel = channel;
+  record(entry);
+}
+
+void RecordedTopology::forgetChannel(uint16_t channel)
+{
+  // эксклюзивные очереди канала принадлежат его владельцу и вместе с привязками больше не нужны
+  std::set<std::string> exclusiveQueues;
+  for (const auto& entry : m_entries)
+    if (entry.kind == Kind::ExclusiveQueue && entry.channel == channel)
+      exclusiveQueues.insert(entry.name);
+
+  auto channelState = [channel, &exclusiveQueues](const Entry& entry)
+  {
+    if (entry.kind == Kind::Bind || entry.kind == Kind::ExclusiveQueue)
+      return exclusiveQueues.count(entry.name) != 0;
+    return entry.channel == channel &&
+           (entry.kind == Kind::Channel || entry.kind == Kind::Qos || entry.kind == Kind::Consume ||
+            entry.kind == Kind::DirectReplyTo || entry.kind == Kind::ConfirmSelect);
+  };
+  m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), channelState), m_entries.end());
+  for (const auto& queueName : exclusiveQueues)
+    m_queueNames.erase(queueName);
+}
+
+bool RecordedTopology::hasChannel(uint16_t channel) const
+{
+  return std::any_of(m_entries.begin(), m_entries.end(), [channel](const Entry& entry)
+  {
+    return entry.kind == Kind::Channel && entry.channel == channel;
+  });
+}
+
+std::vector<RecordedTopology::Entry> RecordedTopology::replayOrder() const
+{
+  std::vector<Entry> order;
+  order.reserve(m_entries.size());
+  for (const auto& entry : m_entries)
+    if (entry.kind == Kind::Channel)
+      order.push_back(entry);
+  for (const auto& entry : m_entries)
+    if (entry.kind != Kind::Channel)
+      order.push_back(entry);
+  return order;
+}
+
+void RecordedTopology::renameQueue(const std::string &originalName, const std::string &currentName)
+{
+  if (originalName == currentName)
+    m_queueNames.erase(originalName);
+  else
+    m_queueNames[originalName] = currentName;
+}
+
+const std::string& RecordedTopology::resolveQueueName(const std::string &queueName) const
+{
+  auto it = m_queueNames.find(queueName);
+  return it != m_queueNames.end() ? it->second : queueName;
+}
+
+bool RecordedTopology::sameRecord(const Entry &left, const Entry &right)
+{
+  if (left.kind != right.kind)
+    return false;
+  switch (left.kind)
+  {
+  case Kind::Channel:
+  case Kind::Qos:
+  case Kind::DirectReplyTo:
+  case Kind::ConfirmSelect:
+    return left.channel == right.channel;
+  case Kind::Exchange:
+  case Kind::Queue:
+  case Kind::ExclusiveQueue:
+    return left.name == right.name;
+  case Kind::Bind:
+    return left.name == right.name && left.argument == right.argument && left.bindingKey == right.bindingKey;
+  case Kind::Consume:
+    // каждая подписка - отдельный подписчик, они уходят вместе с каналом
+    return false;
+  }
+  return false;
+}
+
+void RecordedTopology::record(const Entry &entry)
+{
+  auto it = std::find_if(m_entries.begin(), m_entries.end(), [&entry](const Entry& recorded)
+  {
+    return sameRecord(recorded, entry);
+  });
+  if (it != m_entries.end())
+    *it = entry;
+  else
+    m_entries.push_back(entry);
+}
@@ -0,0 +1,120 @@
+#ifndef CONNECTIONRECOVERY_H
+#define CONNECTIONRECOVERY_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Настройки автоматического восстановления соединения RabbitmqConnection
+struct ConnectionRecoverySettings
+{
+  bool enabled = false;
+  // Пауза перед второй попыткой; первая попытка выполняется сразу после обрыва
+  std::chrono::milliseconds initialDelay{100};
+  std::chrono::milliseconds maxDelay{10000};
+  double backoffMultiplier = 2.0;
+  // Доля паузы, которая выбирается случайно: клиенты, потерявшие брокер одновременно,
+  // не переподключаются одной волной
+  double jitter = 0.5;
+  // Число неудачных попыток подряд, после которого вызов бросает исключение (0 - без ограничения)
+  unsigned maxAttempts = 0;
+  // Сколько публикаций соединение накапливает, пока восстанавливается
+  size_t publishBufferCapacity = 1000;
+};
+
+/**
+ * /brief Экспоненциально растущая пауза между попытками переподключения со случайной составляющей
+ *
+ * Пауза n-й неудачной попытки: min(initialDelay * multiplier^(n-1), maxDelay), из которой
+ * случайно вычитается до jitter ее доли.
+ */
+class RecoveryBackoff
+{
+public:
+  explicit RecoveryBackoff(const ConnectionRecoverySettings& settings);
+
+  // Пауза после очередной неудачной попытки
+  std::chrono::milliseconds nextDelay();
+  void reset() {m_failures = 0;}
+  unsigned getFailures() const {return m_failures;}
+private:
+  ConnectionRecoverySettings m_settings;
+  unsigned m_failures = 0;
+  std::mt19937 m_random;
+};
+
+/**
+ * /brief Топология соединения, которую нужно восстановить после переподключения
+ *
+ * Записи хранятся в порядке объявления. Каналы восстанавливаются первыми, затем остальные
+ * записи по порядку, поэтому обменники, очереди и привязки закрытого канала объявляются
+ * заново на любом открытом канале. Очереди с именем от брокера после переподключения
+ * получают новые имена: исходное имя переводится в текущее через resolveQueueName.
+ * Повторное объявление той же сущности (вид, имя, ключ привязки; для настроек канала - номер канала)
+ * заменяет запись на прежнем месте, поэтому топология не растет от повторных объявлений клиентов.
+ */
+class RecordedTopology
+{
+public:
+  enum class Kind
+  {
+    Channel,
+    Exchange,
+    Queue,
+    ExclusiveQueue,
+    Bind,
+    Qos,
+    Consume,
+    DirectReplyTo,
+    ConfirmSelect
+  };
+
+  struct Entry
+  {
+    Kind kind = Kind::Channel;
+    uint16_t channel = 0;
+    // обменник (Exchange, Bind) или исходное имя очереди
+    std::string name;
+    // тип обменника (Exchange) или обменник привязки (Bind)
+    std::string argument;
+    std::string bindingKey;
+    uint16_t prefetchCount = 0;
+    bool noAck = false;
+    bool exclusive = false;
+  };
+
+  void recordChannel(uint16_t channel);
+  void recordExchange(uint16_t channel, const std::string& exchangeName, const std::string& exchangeType);
+  void recordQueue(uint16_t channel, const std::string& queueName);
+  void recordExclusiveQueue(uint16_t channel, const std::string& queueName);
+  void recordBind(uint16_t channel, const std::string& queueName, const std::string& exchangeName,
+                  const std::string& bindingKey);
+  void recordQos(uint16_t channel, uint16_t prefetchCount);
+  void recordConsume(uint16_t channel, const std::string& queueName, bool noAck, bool exclusive);
+  void recordDirectReplyTo(uint16_t channel);
+  void recordConfirmSelect(uint16_t channel);
+
+  // Канал закрыт: его подписки, настройки и эксклюзивные очереди с их привязками не восстанавливаются,
+  // остальные объявления остаются
+  void forgetChannel(uint16_t channel);
+  bool hasChannel(uint16_t channel) const;
+
+  // Записи в порядке восстановления
+  std::vector<Entry> replayOrder() const;
+  const std::vector<Entry>& getEntries() const {return m_entries;}
+
+  // Брокер выдал очереди с исходным именем originalName новое имя
+  void renameQueue(const std::string& originalName, const std::string& currentName);
+  const std::string& resolveQueueName(const std::string& queueName) const;
+private:
+  static bool sameRecord(const Entry& left, const Entry& right);
+  void record(const Entry& entry);
+
+  std::vector<Entry> m_entries;
+  std::map<std::string, std::string> m_queueNames; // исходное имя -> текущее
+};
+
+#endif
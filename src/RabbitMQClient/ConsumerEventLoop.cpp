@@ -0,0 +1,232 @@
+#include "ConsumerEventLoop.h"
+#include "LoggingCategories.h"
+
+#include <QDebug>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+const size_t ConsumerEventLoop::maxFramesPerWakeup;
+
+namespace
+{
+  const int maxEventsPerWait = 16;
+
+  class DispatchGuard
+  {
+  public:
+    explicit DispatchGuard(bool& dispatching) : m_dispatching(dispatching) {m_dispatching = true;}
+    ~DispatchGuard() {m_dispatching = false;}
+  private:
+    bool& m_dispatching;
+  };
+}
+
+ConsumerEventLoop::ConsumerEventLoop(std::chrono::milliseconds pollInterval)
+  : m_pollInterval(pollInterval)
+{
+  if (m_pollInterval.count() <= 0)
+    throw std::invalid_argument("ConsumerEventLoop: poll interval must be positive");
+
+  m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epollFd < 0)
+    throw std::runtime_error(std::string("ConsumerEventLoop: failed to create epoll: ") + strerror(errno));
+
+  m_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeupFd < 0)
+  {
+    std::string errorMsg = std::string("ConsumerEventLoop: failed to create eventfd: ") + strerror(errno);
+    close(m_epollFd);
+    throw std::runtime_error(errorMsg);
+  }
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeupFd, &event);
+}
+
+ConsumerEventLoop::~ConsumerEventLoop()
+{
+  close(m_wakeupFd);
+  close(m_epollFd);
+}
+
+void ConsumerEventLoop::addConnection(std::shared_ptr<IRabbitmqConnection> connection, DeliveryHandler handler)
+{
+  if (!connection)
+    throw std::invalid_argument("ConsumerEventLoop: nullptr connection");
+  if (!handler)
+    throw std::invalid_argument("ConsumerEventLoop: empty delivery handler");
+
+  auto registration = std::make_unique<Registration>();
+  registration->connection = std::move(connection);
+  registration->handler = std::move(handler);
+  m_registrations.push_back(std::move(registration));
+  registerDescriptors();
+}
+
+void ConsumerEventLoop::removeConnection(const IRabbitmqConnection &connection)
+{
+  for (auto& registration : m_registrations)
+  {
+    if (registration->connection.get() != &connection || registration->removed)
+      continue;
+    registration->removed = true;
+    if (registration->fd >= 0)
+      epoll_ctl(m_epollFd, EPOLL_CTL_DEL, registration->fd, nullptr);
+    registration->fd = -1;
+  }
+  // во время обработки события указатели на регистрации еще нужны циклу
+  if (!m_dispatching)
+    eraseRemoved();
+}
+
+size_t ConsumerEventLoop::runOnce(std::chrono::milliseconds timeout)
+{
+  const int timeoutMs = static_cast<int>(std::max<std::chrono::milliseconds::rep>(
+                                           0, std::min<std::chrono::milliseconds::rep>(timeout.count(), INT_MAX)));
+  return processEvents(timeoutMs);
+}
+
+void ConsumerEventLoop::run()
+{
+  qCInfo(lcRabbitmq) << "Consumer event loop started with" << m_registrations.size() << "connections";
+  while (!m_stopped)
+    processEvents(-1);
+  qCInfo(lcRabbitmq) << "Consumer event loop stopped";
+}
+
+void ConsumerEventLoop::stop()
+{
+  m_stopped = true;
+  eventfd_write(m_wakeupFd, 1);
+}
+
+size_t ConsumerEventLoop::drain(IRabbitmqConnection &connection, const DeliveryHandler &handler, size_t maxFrames)
+{
+  size_t delivered = 0;
+  for (size_t frame = 0; frame < maxFrames; ++frame)
+  {
+    auto envelope = connection.timedConsumeMessage(std::chrono::milliseconds(0));
+    if (envelope)
+    {
+      ++delivered;
+      handler(std::move(envelope));
+    }
+    // вместо сообщения пришел служебный кадр (подтверждение публикации, heartbeat) или кадров больше нет
+    else if (!connection.hasBufferedFrames())
+      break;
+  }
+  return delivered;
+}
+
+size_t ConsumerEventLoop::processEvents(int timeoutMs)
+{
+  registerDescriptors();
+
+  bool hasBuffered = false;
+  bool hasUnwatched = false;
+  for (const auto& registration : m_registrations)
+  {
+    hasBuffered = hasBuffered || registration->connection->hasBufferedFrames();
+    hasUnwatched = hasUnwatched || registration->fd < 0;
+  }
+  if (hasBuffered || m_stopped)
+    timeoutMs = 0;
+  else if (hasUnwatched && (timeoutMs < 0 || timeoutMs > m_pollInterval.count()))
+    timeoutMs = static_cast<int>(m_pollInterval.count());
+
+  epoll_event events[maxEventsPerWait];
+  int count = epoll_wait(m_epollFd, events, maxEventsPerWait, timeoutMs);
+  if (count < 0)
+  {
+    if (errno == EINTR)
+      return 0;
+    std::string errorMsg = std::string("ConsumerEventLoop: epoll_wait failed: ") + strerror(errno);
+    qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+    throw std::runtime_error(errorMsg);
+  }
+
+  std::vector<Registration*> ready;
+  for (int i = 0; i < count; ++i)
+  {
+    if (!events[i].data.ptr)
+    {
+      eventfd_t value = 0;
+      eventfd_read(m_wakeupFd, &value);
+      continue;
+    }
+    ready.push_back(static_cast<Registration*>(events[i].data.ptr));
+  }
+  // кадры в буфере соединения и соединения без дескриптора обслуживаются без события epoll
+  for (const auto& registration : m_registrations)
+    if (std::find(ready.begin(), ready.end(), registration.get()) == ready.end() &&
+        (registration->fd < 0 || registration->connection->hasBufferedFrames()))
+      ready.push_back(registration.get());
+
+  size_t delivered = 0;
+  {
+    DispatchGuard guard(m_dispatching);
+    for (Registration* registration : ready)
+    {
+      if (registration->removed)
+        continue;
+      // обработчик может удалить регистрацию, поэтому соединение удерживается на время разбора
+      auto connection = registration->connection;
+      delivered += drain(*connection, registration->handler, maxFramesPerWakeup);
+    }
+  }
+  eraseRemoved();
+  return delivered;
+}
+
+void ConsumerEventLoop::registerDescriptors()
+{
+  for (auto& registration : m_registrations)
+  {
+    if (registration->removed)
+      continue;
+    const int fd = registration->connection->getReadableFd();
+    const uint64_t generation = registration->connection->getConnectionGeneration();
+    if (fd == registration->fd && generation == registration->generation)
+      continue;
+
+    registration->generation = generation;
+    if (fd >= 0)
+    {
+      // закрытый при переподключении сокет epoll забывает сам, а новый может получить тот же номер,
+      // поэтому дескриптор добавляется заново и при смене поколения соединения
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.ptr = registration.get();
+      if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0 &&
+          (errno != EEXIST || epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &event) != 0))
+      {
+        // соединение опрашивается как соединение без дескриптора, добавление повторяется при следующей проверке
+        qCWarning(lcRabbitmq) << "Failed to watch connection descriptor" << fd << ":" << strerror(errno);
+        registration->fd = -1;
+        continue;
+      }
+    }
+    qCInfo(lcRabbitmq) << "Consumer event loop watches descriptor" << fd << "instead of" << registration->fd
+                       << "connection generation:" << generation;
+    registration->fd = fd;
+  }
+}
+
+void ConsumerEventLoop::eraseRemoved()
+{
+  m_registrations.erase(std::remove_if(m_registrations.begin(), m_registrations.end(),
+                                       [](const std::unique_ptr<Registration>& registration)
+                                       {
+                                         return registration->removed;
+                                       }),
+                        m_registrations.end());
+}
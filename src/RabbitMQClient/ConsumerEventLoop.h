@@ -0,0 +1,87 @@
+#ifndef CONSUMEREVENTLOOP_H
+#define CONSUMEREVENTLOOP_H
+
+#include "IRabbitmqConnection.h"
+#include "rabbitmqEntities.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using DeliveryHandler = std::function<void(std::unique_ptr<IRabbitmqEnvelope> envelope)>;
+
+/**
+ * /brief Цикл событий на epoll, который передает сообщения соединений обработчикам
+ *
+ * Поток спит в epoll_wait, пока на дескрипторах соединений (IRabbitmqConnection::getReadableFd) нет кадров,
+ * и забирает сообщения сразу после их прихода, поэтому простой не тратит процессор, а задержка
+ * не зависит от интервала опроса. Heartbeat брокера тоже будит цикл, и librabbitmq отвечает на него
+ * при разборе кадров без отдельного таймера.
+ * Соединения без дескриптора (не поддерживают ожидание или восстанавливаются) опрашиваются раз в pollInterval.
+ *
+ * Соединения не потокобезопасны: addConnection, removeConnection и обработчики вызываются только
+ * в потоке цикла или до его запуска. Из другого потока можно вызывать только stop().
+ */
+class ConsumerEventLoop
+{
+public:
+  // Сколько кадров одного соединения разбирается за пробуждение, прежде чем цикл перейдет к остальным
+  static const size_t maxFramesPerWakeup = 64;
+
+  explicit ConsumerEventLoop(std::chrono::milliseconds pollInterval = std::chrono::milliseconds(100));
+  ~ConsumerEventLoop();
+
+  ConsumerEventLoop(const ConsumerEventLoop&) = delete;
+  ConsumerEventLoop& operator=(const ConsumerEventLoop&) = delete;
+
+  void addConnection(std::shared_ptr<IRabbitmqConnection> connection, DeliveryHandler handler);
+  void removeConnection(const IRabbitmqConnection& connection);
+
+  /**
+   * /brief Ждет события не дольше timeout и обрабатывает пришедшие сообщения
+   *
+   * /return Число сообщений, переданных обработчикам
+   */
+  size_t runOnce(std::chrono::milliseconds timeout);
+  // Обрабатывает события до вызова stop(). Исключения обработчиков и соединений прерывают цикл
+  void run();
+  // Останавливает run(), повторно запустить цикл нельзя
+  void stop();
+  bool isStopped() const {return m_stopped;}
+
+  /**
+   * /brief Забирает у соединения уже пришедшие сообщения без ожидания и передает их обработчику
+   *
+   * Разбирает не больше maxFrames кадров. Если после этого connection.hasBufferedFrames(),
+   * остальное нужно забрать, не дожидаясь готовности дескриптора.
+   *
+   * /return Число сообщений, переданных обработчику
+   */
+  static size_t drain(IRabbitmqConnection& connection, const DeliveryHandler& handler, size_t maxFrames);
+private:
+  struct Registration
+  {
+    std::shared_ptr<IRabbitmqConnection> connection;
+    DeliveryHandler handler;
+    int fd = -1;
+    uint64_t generation = 0;
+    bool removed = false;
+  };
+
+  size_t processEvents(int timeoutMs);
+  // Добавляет в epoll дескрипторы соединений, которые изменились или переподключились с прошлой проверки
+  void registerDescriptors();
+  void eraseRemoved();
+
+  const std::chrono::milliseconds m_pollInterval;
+  int m_epollFd = -1;
+  // eventfd, которым stop() будит поток цикла
+  int m_wakeupFd = -1;
+  std::atomic<bool> m_stopped{false};
+  bool m_dispatching = false;
+  std::vector<std::unique_ptr<Registration>> m_registrations;
+};
+
+#endif
@@ -1,9 +1,15 @@
 #ifndef IRABBITMQCONNECTION_H
 #define IRABBITMQCONNECTION_H
 
+#include "BytesView.h"
+
 #include <memory>
 #include <string>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
 
 class RabbitmqSocket;
 class RabbitmqChannel;
@@ -12,6 +18,43 @@ class RabbitmqQueue;
 class RabbitmqBind;
 class IRabbitmqEnvelope;
 
+// Псевдо-очередь RabbitMQ для прямых ответов (direct reply-to), объявлять её не нужно
+const char directReplyToQueue[] = "amq.rabbitmq.reply-to";
+
+// Свойства AMQP сообщения, пустые значения не передаются
+struct RabbitmqMessageProperties
+{
+  std::string replyTo;
+  std::string correlationId;
+};
+
+// Сообщение пачки publishBatch, properties == nullptr - сообщение без свойств
+struct BatchMessage
+{
+  BatchMessage() = default;
+  BatchMessage(BytesView body, const RabbitmqMessageProperties* properties = nullptr)
+    : body(body), properties(properties) {}
+
+  BytesView body;
+  const RabbitmqMessageProperties* properties = nullptr;
+};
+
+// Пачка отправлена не полностью: первые publishedCount сообщений уже переданы брокеру
+class BatchPublishError : public std::runtime_error
+{
+public:
+  BatchPublishError(const std::string& message, size_t publishedCount)
+    : std::runtime_error(message), m_publishedCount(publishedCount) {}
+
+  size_t getPublishedCount() const {return m_publishedCount;}
+private:
+  size_t m_publishedCount;
+};
+
+// Результат подтверждения публикации: true - брокер принял сообщение (basic.ack),
+// false - отклонил (basic.nack) или канал закрылся раньше, чем пришло подтверждение
+using PublishConfirmCallback = std::function<void(bool acked)>;
+
 class IRabbitmqConnection : public std::enable_shared_from_this<IRabbitmqConnection>
 {
 public:
@@ -23,26 +66,69 @@ public:
                        int heartbeatInSeconds, const std::string& vhost) = 0;
 
   virtual std::unique_ptr<RabbitmqChannel> openChannel() = 0;
+  // Закрывает канал на брокере, вызывается из ~RabbitmqChannel. Номер канала можно выдать снова
+  virtual void closeChannel(uint16_t channel) {(void)channel;}
 
   virtual std::unique_ptr<RabbitmqExchange> declareExchange(const RabbitmqChannel& channel,
                                                             const std::string& exchangeName,
                                                             const std::string& exchangeType) = 0;
 
   virtual std::unique_ptr<RabbitmqQueue> declareQueue(const RabbitmqChannel& channel, const std::string& queueName) = 0;
+  virtual std::unique_ptr<RabbitmqQueue> declareExclusiveQueue(const RabbitmqChannel& channel) = 0;
 
   virtual std::unique_ptr<RabbitmqBind> bind(const RabbitmqChannel &channel, const RabbitmqQueue &queue,
                                              const RabbitmqExchange &exchange, const std::string &bindingKey) = 0;
 
+  // Ограничивает число неподтвержденных сообщений, которые брокер отдает подписчикам канала.
+  // Имеет смысл только для подписки с подтверждениями (noAsk = false)
+  virtual void basicQos(const RabbitmqChannel &channel, uint16_t prefetchCount) = 0;
   virtual void basicConsume(const RabbitmqChannel &channel, const RabbitmqQueue &queue, bool noAsk, bool exclusive) = 0;
+  // Подписка на directReplyToQueue. Должна быть выполнена до публикации запросов на том же канале
+  virtual void consumeDirectReplyTo(const RabbitmqChannel &channel) = 0;
 
+  // Включает на канале режим подтверждений публикаций (confirm.select). Подтверждения приходят
+  // асинхронно и обрабатываются при получении сообщений (consumeMessage, timedConsumeMessage)
+  virtual void confirmSelect(const RabbitmqChannel& channel) = 0;
+  virtual size_t getUnconfirmedCount() const = 0;
+
+  virtual void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                              const RabbitmqBind& binding, BytesView message) = 0;
   virtual void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
-                              const RabbitmqBind& binding, std::string message) = 0;
+                              const RabbitmqBind& binding, BytesView message,
+                              const RabbitmqMessageProperties& properties) = 0;
+  virtual void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                              const RabbitmqMessageProperties& properties) = 0;
+  // Публикует пачку сообщений с одним ключом маршрутизации, имена обменника и ключа готовятся один раз.
+  // При ошибке бросает BatchPublishError с числом уже отправленных сообщений
+  virtual void publishBatch(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                            const RabbitmqBind& binding, const std::vector<BatchMessage>& messages) = 0;
+  // Публикация на канале в режиме подтверждений, onConfirm вызывается при получении подтверждения
+  virtual void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                              const RabbitmqBind& binding, BytesView message,
+                              const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) = 0;
+  virtual void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                              const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) = 0;
 
   virtual void ack(const IRabbitmqEnvelope &envelope) = 0;
-  virtual void reject(const IRabbitmqEnvelope &envelope) = 0;
+  // при requeue = false брокер отбрасывает сообщение (или отправляет в dead-letter обменник)
+  virtual void reject(const IRabbitmqEnvelope &envelope, bool requeue) = 0;
 
   virtual std::unique_ptr<IRabbitmqEnvelope> consumeMessage() = 0;
   virtual std::unique_ptr<IRabbitmqEnvelope> timedConsumeMessage(std::chrono::milliseconds timeoutMillis) = 0;
+
+  /**
+   * /brief Дескриптор для ожидания сообщений через epoll/poll/QSocketNotifier
+   *
+   * Дескриптор становится читаемым, когда соединению пришли кадры, после этого их забирают
+   * timedConsumeMessage с нулевым таймаутом. -1 - соединение не поддерживает ожидание по дескриптору
+   * (или сейчас восстанавливается), тогда сообщения нужно получать с таймаутом.
+   * После переподключения дескриптор меняется.
+   */
+  virtual int getReadableFd() const {return -1;}
+  // Номер подключения, растет при каждом переподключении: новый сокет может получить номер прежнего дескриптора
+  virtual uint64_t getConnectionGeneration() const {return 0;}
+  // Соединение уже прочитало кадры в свой буфер: дескриптор о них не сообщит, их нужно забрать сразу
+  virtual bool hasBufferedFrames() const {return false;}
 protected:
   virtual std::unique_ptr<IRabbitmqEnvelope> consumeMessageInternal(struct timeval* timeout) = 0;
 };
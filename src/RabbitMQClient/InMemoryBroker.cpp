@@ -0,0 +1,468 @@
+#include "InMemoryBroker.h"
+#include "IRabbitmqConnection.h"
+#include "LoggingCategories.h"
+
+#include <QDebug>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+std::shared_ptr<InMemoryBroker> InMemoryBroker::create()
+{
+  return std::make_shared<InMemoryBroker>();
+}
+
+InMemoryBroker::~InMemoryBroker()
+{
+  for (const auto& entry : m_connections)
+    if (entry.second->notificationFd >= 0)
+      close(entry.second->notificationFd);
+}
+
+uint64_t InMemoryBroker::attach()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const uint64_t connectionId = m_nextConnectionId++;
+  m_connections[connectionId].reset(new Connection());
+  return connectionId;
+}
+
+void InMemoryBroker::detach(uint64_t connectionId)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_connections.find(connectionId);
+  if (it == m_connections.end())
+    return;
+  std::unique_ptr<Connection> state = std::move(it->second);
+  m_connections.erase(it);
+  if (state->notificationFd >= 0)
+    close(state->notificationFd);
+
+  for (const auto& address : state->directReplyAddresses)
+    m_directReplyAddresses.erase(address.second);
+  for (const auto& queueName : state->exclusiveQueues)
+    deleteQueue(queueName);
+
+  std::vector<std::string> affectedQueues;
+  for (auto& entry : m_queues)
+  {
+    auto& subscriptions = entry.second.subscriptions;
+    auto removed = std::remove_if(subscriptions.begin(), subscriptions.end(),
+                                  [connectionId](const Subscription& subscription)
+                                  {
+                                    return subscription.connectionId == connectionId;
+                                  });
+    if (removed != subscriptions.end())
+    {
+      subscriptions.erase(removed, subscriptions.end());
+      entry.second.exclusiveConsumer = false;
+    }
+  }
+
+  // неподтвержденные сообщения возвращаются в начало очередей в исходном порядке
+  for (auto unacked = state->unacked.rbegin(); unacked != state->unacked.rend(); ++unacked)
+  {
+    auto queueIt = m_queues.find(unacked->second.queueName);
+    if (queueIt == m_queues.end())
+      continue;
+    --queueIt->second.unacked;
+    queueIt->second.ready.push_front(unacked->second.message);
+    affectedQueues.push_back(unacked->second.queueName);
+  }
+
+  std::sort(affectedQueues.begin(), affectedQueues.end());
+  affectedQueues.erase(std::unique(affectedQueues.begin(), affectedQueues.end()), affectedQueues.end());
+  for (const auto& queueName : affectedQueues)
+    dispatch(queueName, m_queues[queueName]);
+}
+
+void InMemoryBroker::closeChannel(uint64_t connectionId, uint16_t channel)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_connections.find(connectionId);
+  if (it == m_connections.end())
+    return;
+  Connection& state = *it->second;
+
+  for (auto& entry : m_queues)
+  {
+    auto& subscriptions = entry.second.subscriptions;
+    auto removed = std::remove_if(subscriptions.begin(), subscriptions.end(),
+                                  [connectionId, channel](const Subscription& subscription)
+                                  {
+                                    return subscription.connectionId == connectionId && subscription.channel == channel;
+                                  });
+    if (removed != subscriptions.end())
+    {
+      subscriptions.erase(removed, subscriptions.end());
+      entry.second.exclusiveConsumer = false;
+    }
+  }
+  auto replyAddress = state.directReplyAddresses.find(channel);
+  if (replyAddress != state.directReplyAddresses.end())
+  {
+    m_directReplyAddresses.erase(replyAddress->second);
+    state.directReplyAddresses.erase(replyAddress);
+  }
+
+  // невыданные доставки канала отбрасываются, неподтвержденные из них вернутся в очереди ниже
+  state.inbox.erase(std::remove_if(state.inbox.begin(), state.inbox.end(),
+                                   [channel](const Delivery& delivery) { return delivery.channel == channel; }),
+                    state.inbox.end());
+  if (state.inbox.empty() && state.notificationFd >= 0)
+  {
+    eventfd_t value = 0;
+    eventfd_read(state.notificationFd, &value);
+  }
+
+  std::vector<std::string> affectedQueues;
+  for (auto unacked = state.unacked.rbegin(); unacked != state.unacked.rend(); ++unacked)
+  {
+    if (unacked->second.channel != channel)
+      continue;
+    auto queueIt = m_queues.find(unacked->second.queueName);
+    if (queueIt == m_queues.end())
+      continue;
+    --queueIt->second.unacked;
+    queueIt->second.ready.push_front(unacked->second.message);
+    affectedQueues.push_back(unacked->second.queueName);
+  }
+  for (auto unacked = state.unacked.begin(); unacked != state.unacked.end();)
+  {
+    if (unacked->second.channel == channel)
+      unacked = state.unacked.erase(unacked);
+    else
+      ++unacked;
+  }
+
+  std::sort(affectedQueues.begin(), affectedQueues.end());
+  affectedQueues.erase(std::unique(affectedQueues.begin(), affectedQueues.end()), affectedQueues.end());
+  for (const auto& queueName : affectedQueues)
+    dispatch(queueName, m_queues[queueName]);
+}
+
+void InMemoryBroker::declareExchange(const std::string &exchangeName, const std::string &exchangeType)
+{
+  if (exchangeType != "direct")
+    throw std::invalid_argument("In-memory broker supports only direct exchanges: " + exchangeType);
+  if (exchangeName.empty())
+    throw std::invalid_argument("Default exchange can not be declared");
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_exchanges[exchangeName];
+}
+
+void InMemoryBroker::declareQueue(const std::string &queueName)
+{
+  if (queueName.empty())
+    throw std::invalid_argument("Queue name is empty");
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_queues[queueName];
+}
+
+std::string InMemoryBroker::declareExclusiveQueue(uint64_t connectionId)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::string queueName = "amq.gen-" + std::to_string(m_nextQueueId++);
+  m_queues[queueName].owner = connectionId;
+  connection(connectionId).exclusiveQueues.push_back(queueName);
+  return queueName;
+}
+
+void InMemoryBroker::bind(const std::string &queueName, const std::string &exchangeName, const std::string &bindingKey)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  queue(queueName);
+  auto exchange = m_exchanges.find(exchangeName);
+  if (exchange == m_exchanges.end())
+    throw std::runtime_error("Exchange not found: " + exchangeName);
+
+  auto& queues = exchange->second[bindingKey];
+  if (std::find(queues.begin(), queues.end(), queueName) == queues.end())
+    queues.push_back(queueName);
+}
+
+void InMemoryBroker::setPrefetchCount(uint64_t connectionId, uint16_t prefetchCount)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  connection(connectionId).prefetchCount = prefetchCount;
+}
+
+void InMemoryBroker::consume(uint64_t connectionId, const std::string &queueName, bool noAck, bool exclusive,
+                             uint16_t channel)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  connection(connectionId);
+  Queue& target = queue(queueName);
+  if (target.owner != 0 && target.owner != connectionId)
+    throw std::runtime_error("Queue is exclusive to another connection: " + queueName);
+  if (target.exclusiveConsumer || (exclusive && !target.subscriptions.empty()))
+    throw std::runtime_error("Queue already has an exclusive consumer: " + queueName);
+
+  Subscription subscription;
+  subscription.connectionId = connectionId;
+  subscription.channel = channel;
+  subscription.noAck = noAck;
+  target.subscriptions.push_back(subscription);
+  target.exclusiveConsumer = exclusive;
+  dispatch(queueName, target);
+}
+
+std::string InMemoryBroker::consumeDirectReplyTo(uint64_t connectionId, uint16_t channel)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Connection& state = connection(connectionId);
+  std::string& address = state.directReplyAddresses[channel];
+  if (address.empty())
+  {
+    address = std::string(directReplyToQueue) + ".in-memory-" + std::to_string(connectionId) + "-"
+              + std::to_string(channel);
+    m_directReplyAddresses[address] = std::make_pair(connectionId, channel);
+  }
+  return address;
+}
+
+std::string InMemoryBroker::getDirectReplyAddress(uint64_t connectionId, uint16_t channel) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto& addresses = connection(connectionId).directReplyAddresses;
+  auto it = addresses.find(channel);
+  return it == addresses.end() ? std::string() : it->second;
+}
+
+bool InMemoryBroker::publish(const std::string &exchangeName, const std::string &routingKey,
+                             std::shared_ptr<const InMemoryMessage> message)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (exchangeName.empty())
+  {
+    auto replyAddress = m_directReplyAddresses.find(routingKey);
+    if (replyAddress != m_directReplyAddresses.end())
+    {
+      Connection& state = *m_connections.at(replyAddress->second.first);
+      deliver(state, replyAddress->second.second, std::move(message));
+      return true;
+    }
+
+    auto queueIt = m_queues.find(routingKey);
+    if (queueIt == m_queues.end())
+    {
+      qCDebug(lcRabbitmq) << "In-memory broker dropped unroutable message for queue:" << QString::fromStdString(routingKey);
+      return false;
+    }
+    enqueue(routingKey, queueIt->second, std::move(message));
+    return true;
+  }
+
+  auto exchange = m_exchanges.find(exchangeName);
+  if (exchange == m_exchanges.end())
+    throw std::runtime_error("Exchange not found: " + exchangeName);
+
+  auto binding = exchange->second.find(routingKey);
+  if (binding == exchange->second.end())
+  {
+    qCDebug(lcRabbitmq) << "In-memory broker dropped unroutable message with key:" << QString::fromStdString(routingKey);
+    return false;
+  }
+  bool routed = false;
+  for (const auto& queueName : binding->second)
+  {
+    auto queueIt = m_queues.find(queueName);
+    if (queueIt != m_queues.end())
+    {
+      enqueue(queueName, queueIt->second, message);
+      routed = true;
+    }
+  }
+  return routed;
+}
+
+void InMemoryBroker::ack(uint64_t connectionId, uint64_t deliveryTag)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Connection& state = connection(connectionId);
+  auto it = state.unacked.find(deliveryTag);
+  if (it == state.unacked.end())
+    throw std::runtime_error("Unknown delivery tag: " + std::to_string(deliveryTag));
+
+  const std::string queueName = std::move(it->second.queueName);
+  state.unacked.erase(it);
+
+  auto queueIt = m_queues.find(queueName);
+  if (queueIt != m_queues.end())
+  {
+    --queueIt->second.unacked;
+    dispatch(queueName, queueIt->second);
+  }
+}
+
+void InMemoryBroker::reject(uint64_t connectionId, uint64_t deliveryTag, bool requeue)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Connection& state = connection(connectionId);
+  auto it = state.unacked.find(deliveryTag);
+  if (it == state.unacked.end())
+    throw std::runtime_error("Unknown delivery tag: " + std::to_string(deliveryTag));
+
+  Unacked unacked = std::move(it->second);
+  state.unacked.erase(it);
+
+  auto queueIt = m_queues.find(unacked.queueName);
+  if (queueIt == m_queues.end())
+    return;
+  --queueIt->second.unacked;
+  if (requeue)
+    queueIt->second.ready.push_front(std::move(unacked.message));
+  dispatch(unacked.queueName, queueIt->second);
+}
+
+bool InMemoryBroker::receive(uint64_t connectionId, const std::chrono::milliseconds* timeout, Delivery &delivery)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Connection& state = connection(connectionId);
+  auto ready = [&state]() { return !state.inbox.empty(); };
+  if (!timeout)
+    state.inboxChanged.wait(lock, ready);
+  else if (!state.inboxChanged.wait_for(lock, *timeout, ready))
+    return false;
+
+  delivery = std::move(state.inbox.front());
+  state.inbox.pop_front();
+  if (state.inbox.empty() && state.notificationFd >= 0)
+  {
+    // сбрасывает счетчик eventfd: дескриптор перестает быть читаемым
+    eventfd_t value = 0;
+    eventfd_read(state.notificationFd, &value);
+  }
+  return true;
+}
+
+int InMemoryBroker::getNotificationFd(uint64_t connectionId)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Connection& state = connection(connectionId);
+  if (state.notificationFd < 0)
+  {
+    state.notificationFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (state.notificationFd < 0)
+      throw std::runtime_error("Failed to create notification eventfd for in-memory connection " +
+                               std::to_string(connectionId));
+    if (!state.inbox.empty())
+      eventfd_write(state.notificationFd, 1);
+  }
+  return state.notificationFd;
+}
+
+bool InMemoryBroker::hasQueue(const std::string &queueName) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_queues.count(queueName) != 0;
+}
+
+size_t InMemoryBroker::getReadyCount(const std::string &queueName) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_queues.find(queueName);
+  return it != m_queues.end() ? it->second.ready.size() : 0;
+}
+
+size_t InMemoryBroker::getUnackedCount(const std::string &queueName) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_queues.find(queueName);
+  return it != m_queues.end() ? it->second.unacked : 0;
+}
+
+InMemoryBroker::Connection &InMemoryBroker::connection(uint64_t connectionId)
+{
+  auto it = m_connections.find(connectionId);
+  if (it == m_connections.end())
+    throw std::runtime_error("In-memory connection is closed: " + std::to_string(connectionId));
+  return *it->second;
+}
+
+const InMemoryBroker::Connection &InMemoryBroker::connection(uint64_t connectionId) const
+{
+  auto it = m_connections.find(connectionId);
+  if (it == m_connections.end())
+    throw std::runtime_error("In-memory connection is closed: " + std::to_string(connectionId));
+  return *it->second;
+}
+
+InMemoryBroker::Queue &InMemoryBroker::queue(const std::string &queueName)
+{
+  auto it = m_queues.find(queueName);
+  if (it == m_queues.end())
+    throw std::runtime_error("Queue not found: " + queueName);
+  return it->second;
+}
+
+void InMemoryBroker::enqueue(const std::string &queueName, Queue &queue, std::shared_ptr<const InMemoryMessage> message)
+{
+  queue.ready.push_back(std::move(message));
+  dispatch(queueName, queue);
+}
+
+void InMemoryBroker::dispatch(const std::string &queueName, Queue &queue)
+{
+  while (!queue.ready.empty() && !queue.subscriptions.empty())
+  {
+    // следующий по кругу подписчик, у которого не исчерпан prefetch
+    const size_t count = queue.subscriptions.size();
+    Subscription* subscriber = nullptr;
+    for (size_t i = 0; i < count && !subscriber; ++i)
+    {
+      Subscription& candidate = queue.subscriptions[(queue.nextSubscription + i) % count];
+      const Connection& state = *m_connections.at(candidate.connectionId);
+      if (candidate.noAck || state.prefetchCount == 0 || state.unacked.size() < state.prefetchCount)
+      {
+        subscriber = &candidate;
+        queue.nextSubscription = (queue.nextSubscription + i + 1) % count;
+      }
+    }
+    if (!subscriber)
+      return;
+
+    std::shared_ptr<const InMemoryMessage> message = std::move(queue.ready.front());
+    queue.ready.pop_front();
+
+    Connection& state = *m_connections.at(subscriber->connectionId);
+    if (!subscriber->noAck)
+    {
+      Unacked unacked;
+      unacked.queueName = queueName;
+      unacked.channel = subscriber->channel;
+      unacked.message = message;
+      state.unacked.emplace(state.nextDeliveryTag, std::move(unacked));
+      ++queue.unacked;
+    }
+    deliver(state, subscriber->channel, std::move(message));
+  }
+}
+
+void InMemoryBroker::deliver(Connection &connection, uint16_t channel, std::shared_ptr<const InMemoryMessage> message)
+{
+  Delivery delivery;
+  delivery.deliveryTag = connection.nextDeliveryTag++;
+  delivery.channel = channel;
+  delivery.message = std::move(message);
+  connection.inbox.push_back(std::move(delivery));
+  connection.inboxChanged.notify_one();
+  if (connection.inbox.size() == 1 && connection.notificationFd >= 0)
+    eventfd_write(connection.notificationFd, 1);
+}
+
+void InMemoryBroker::deleteQueue(const std::string &queueName)
+{
+  m_queues.erase(queueName);
+  for (auto& exchange : m_exchanges)
+    for (auto& binding : exchange.second)
+    {
+      auto& queues = binding.second;
+      queues.erase(std::remove(queues.begin(), queues.end(), queueName), queues.end());
+    }
+}
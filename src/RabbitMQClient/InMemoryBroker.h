@@ -0,0 +1,145 @@
+#ifndef INMEMORYBROKER_H
+#define INMEMORYBROKER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Сообщение в очередях InMemoryBroker, тело не копируется при возврате в очередь
+struct InMemoryMessage
+{
+  std::string body;
+  std::string replyTo;
+  std::string correlationId;
+};
+
+/**
+ * /brief Брокер сообщений внутри процесса
+ *
+ * Поддерживает прямые (direct) обменники, обменник по умолчанию (маршрутизация по имени очереди),
+ * эксклюзивные очереди, подтверждения, возврат сообщений в очередь, ограничение неподтвержденных
+ * сообщений (prefetch) и прямые ответы (direct reply-to). Сообщения очереди раздаются подписчикам
+ * по кругу. Потокобезопасен: соединения разных потоков работают с одним брокером.
+ *
+ * Соединения к брокеру создаются через InMemoryConnection. Доставка помечается каналом подписки,
+ * но prefetch действует на соединение целиком.
+ */
+class InMemoryBroker
+{
+public:
+  struct Delivery
+  {
+    uint64_t deliveryTag = 0;
+    // канал соединения, на котором оформлена подписка
+    uint16_t channel = 1;
+    std::shared_ptr<const InMemoryMessage> message;
+  };
+
+  static std::shared_ptr<InMemoryBroker> create();
+
+  InMemoryBroker() = default;
+  ~InMemoryBroker();
+  InMemoryBroker(const InMemoryBroker&) = delete;
+  InMemoryBroker& operator=(const InMemoryBroker&) = delete;
+
+  uint64_t attach();
+  // Неподтвержденные сообщения соединения возвращаются в очереди, эксклюзивные очереди удаляются
+  void detach(uint64_t connectionId);
+  // Отменяет подписки канала и возвращает в очереди его неподтвержденные сообщения
+  void closeChannel(uint64_t connectionId, uint16_t channel);
+
+  void declareExchange(const std::string& exchangeName, const std::string& exchangeType);
+  void declareQueue(const std::string& queueName);
+  // Очередь с именем, которое выдает брокер, удаляется вместе с соединением
+  std::string declareExclusiveQueue(uint64_t connectionId);
+  void bind(const std::string& queueName, const std::string& exchangeName, const std::string& bindingKey);
+
+  void setPrefetchCount(uint64_t connectionId, uint16_t prefetchCount);
+  void consume(uint64_t connectionId, const std::string& queueName, bool noAck, bool exclusive, uint16_t channel = 1);
+  // Возвращает адрес, который подставляется в reply_to запросов соединения
+  std::string consumeDirectReplyTo(uint64_t connectionId, uint16_t channel = 1);
+  std::string getDirectReplyAddress(uint64_t connectionId, uint16_t channel = 1) const;
+
+  // Пустое имя обменника - обменник по умолчанию. Сообщения без получателя отбрасываются, тогда возвращается false
+  bool publish(const std::string& exchangeName, const std::string& routingKey,
+               std::shared_ptr<const InMemoryMessage> message);
+
+  void ack(uint64_t connectionId, uint64_t deliveryTag);
+  void reject(uint64_t connectionId, uint64_t deliveryTag, bool requeue);
+
+  // Ждет доставку не дольше timeout, при timeout == nullptr ждет без ограничения
+  bool receive(uint64_t connectionId, const std::chrono::milliseconds* timeout, Delivery& delivery);
+  // eventfd, который читаем, пока у соединения есть неполученные доставки. Создается при первом вызове
+  int getNotificationFd(uint64_t connectionId);
+
+  bool hasQueue(const std::string& queueName) const;
+  // Число сообщений очереди, еще не отданных подписчикам
+  size_t getReadyCount(const std::string& queueName) const;
+  // Число отданных, но не подтвержденных сообщений очереди
+  size_t getUnackedCount(const std::string& queueName) const;
+private:
+  struct Subscription
+  {
+    uint64_t connectionId = 0;
+    uint16_t channel = 1;
+    bool noAck = false;
+  };
+
+  struct Queue
+  {
+    std::deque<std::shared_ptr<const InMemoryMessage>> ready;
+    std::vector<Subscription> subscriptions;
+    size_t nextSubscription = 0;
+    bool exclusiveConsumer = false;
+    uint64_t owner = 0; // соединение эксклюзивной очереди
+    size_t unacked = 0;
+  };
+
+  struct Unacked
+  {
+    std::string queueName;
+    uint16_t channel = 1;
+    std::shared_ptr<const InMemoryMessage> message;
+  };
+
+  struct Connection
+  {
+    std::deque<Delivery> inbox;
+    std::map<uint64_t, Unacked> unacked;
+    uint16_t prefetchCount = 0; // 0 - без ограничения
+    uint64_t nextDeliveryTag = 1;
+    // канал -> адрес ответа: у каждого канала свой адрес, как у RabbitMQ
+    std::map<uint16_t, std::string> directReplyAddresses;
+    std::vector<std::string> exclusiveQueues;
+    std::condition_variable inboxChanged;
+    int notificationFd = -1;
+  };
+
+  Connection& connection(uint64_t connectionId);
+  const Connection& connection(uint64_t connectionId) const;
+  Queue& queue(const std::string& queueName);
+
+  void enqueue(const std::string& queueName, Queue& queue, std::shared_ptr<const InMemoryMessage> message);
+  void dispatch(const std::string& queueName, Queue& queue);
+  void deliver(Connection& connection, uint16_t channel, std::shared_ptr<const InMemoryMessage> message);
+  void deleteQueue(const std::string& queueName);
+
+  mutable std::mutex m_mutex;
+  uint64_t m_nextConnectionId = 1;
+  uint64_t m_nextQueueId = 1;
+  std::unordered_map<uint64_t, std::unique_ptr<Connection>> m_connections;
+  std::unordered_map<std::string, Queue> m_queues;
+  // обменник -> ключ маршрутизации -> очереди
+  std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>> m_exchanges;
+  std::unordered_map<std::string, std::pair<uint64_t, uint16_t>> m_directReplyAddresses;
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "InMemoryConnection.h"
+#include "LoggingCategories.h"
+
+#include <QDebug>
+
+#include <stdexcept>
+
+InMemoryConnection::InMemoryConnection(Private, std::shared_ptr<InMemoryBroker> broker)
+  : m_broker(std::move(broker)), m_connectionId(m_broker->attach())
+{
+}
+
+InMemoryConnection::~InMemoryConnection()
+{
+  m_broker->detach(m_connectionId);
+  // как и при закрытии канала RabbitMQ, неподтвержденные публикации считаются не доставленными
+  std::vector<PublishConfirmCallback> callbacks;
+  callbacks.swap(m_pendingConfirms);
+  for (auto& callback : callbacks)
+    if (callback)
+      callback(false);
+}
+
+std::shared_ptr<InMemoryConnection> InMemoryConnection::create(std::shared_ptr<InMemoryBroker> broker)
+{
+  if (!broker)
+    throw std::invalid_argument("In-memory connection requires a broker");
+  return std::make_shared<InMemoryConnection>(Private(), std::move(broker));
+}
+
+std::shared_ptr<IRabbitmqConnection> InMemoryConnection::share()
+{
+  return shared_from_this();
+}
+
+std::unique_ptr<RabbitmqSocket> InMemoryConnection::openSocket(const std::string &host, int port)
+{
+  qCInfo(lcRabbitmq) << "In-memory connection" << m_connectionId << "ignores host:" << QString::fromStdString(host) << "port:" << port;
+  return nullptr;
+}
+
+void InMemoryConnection::login(const std::string &, const std::string &, int, const std::string &)
+{
+}
+
+std::unique_ptr<RabbitmqChannel> InMemoryConnection::openChannel()
+{
+  const bool closeOnBroker = true;
+  return std::make_unique<RabbitmqChannel>(share(), m_freeChannelId++, closeOnBroker);
+}
+
+void InMemoryConnection::closeChannel(uint16_t channel)
+{
+  m_broker->closeChannel(m_connectionId, channel);
+}
+
+std::unique_ptr<RabbitmqExchange> InMemoryConnection::declareExchange(const RabbitmqChannel &channel,
+                                                                      const std::string &exchangeName,
+                                                                      const std::string &exchangeType)
+{
+  m_broker->declareExchange(exchangeName, exchangeType);
+  return std::make_unique<RabbitmqExchange>(share(), channel.getId(), exchangeName);
+}
+
+std::unique_ptr<RabbitmqQueue> InMemoryConnection::declareQueue(const RabbitmqChannel &channel, const std::string &queueName)
+{
+  m_broker->declareQueue(queueName);
+  return std::make_unique<RabbitmqQueue>(share(), channel.getId(), queueName);
+}
+
+std::unique_ptr<RabbitmqQueue> InMemoryConnection::declareExclusiveQueue(const RabbitmqChannel &channel)
+{
+  return std::make_unique<RabbitmqQueue>(share(), channel.getId(), m_broker->declareExclusiveQueue(m_connectionId));
+}
+
+std::unique_ptr<RabbitmqBind> InMemoryConnection::bind(const RabbitmqChannel &channel, const RabbitmqQueue &queue,
+                                                       const RabbitmqExchange &exchange, const std::string &bindingKey)
+{
+  m_broker->bind(queue.getName(), exchange.getName(), bindingKey);
+  return std::make_unique<RabbitmqBind>(share(), channel.getId(), queue.getName(), exchange.getName(), bindingKey);
+}
+
+void InMemoryConnection::basicQos(const RabbitmqChannel &, uint16_t prefetchCount)
+{
+  m_broker->setPrefetchCount(m_connectionId, prefetchCount);
+}
+
+void InMemoryConnection::basicConsume(const RabbitmqChannel &channel, const RabbitmqQueue &queue, bool noAsk, bool exclusive)
+{
+  m_broker->consume(m_connectionId, queue.getName(), noAsk, exclusive, channel.getId());
+}
+
+void InMemoryConnection::consumeDirectReplyTo(const RabbitmqChannel &channel)
+{
+  m_broker->consumeDirectReplyTo(m_connectionId, channel.getId());
+}
+
+void InMemoryConnection::confirmSelect(const RabbitmqChannel &)
+{
+  m_confirmMode = true;
+}
+
+size_t InMemoryConnection::getUnconfirmedCount() const
+{
+  return m_pendingConfirms.size();
+}
+
+void InMemoryConnection::publishMessage(const RabbitmqChannel &channel, const RabbitmqExchange &exchange,
+                                        const RabbitmqBind &binding, BytesView message)
+{
+  publish(channel, exchange.getName(), binding.getBindingKey(), message);
+}
+
+void InMemoryConnection::publishMessage(const RabbitmqChannel &channel, const RabbitmqExchange &exchange,
+                                        const RabbitmqBind &binding, BytesView message,
+                                        const RabbitmqMessageProperties &properties)
+{
+  publish(channel, exchange.getName(), binding.getBindingKey(), message, &properties);
+}
+
+void InMemoryConnection::publishToQueue(const RabbitmqChannel &channel, const std::string &queueName,
+                                        BytesView message, const RabbitmqMessageProperties &properties)
+{
+  publish(channel, "", queueName, message, &properties);
+}
+
+void InMemoryConnection::publishBatch(const RabbitmqChannel &channel, const RabbitmqExchange &exchange,
+                                      const RabbitmqBind &binding, const std::vector<BatchMessage> &messages)
+{
+  size_t published = 0;
+  try
+  {
+    for (const auto& message : messages)
+    {
+      publish(channel, exchange.getName(), binding.getBindingKey(), message.body, message.properties);
+      ++published;
+    }
+  }
+  catch (const std::exception& e)
+  {
+    throw BatchPublishError(e.what(), published);
+  }
+}
+
+void InMemoryConnection::publishMessage(const RabbitmqChannel &channel, const RabbitmqExchange &exchange,
+                                        const RabbitmqBind &binding, BytesView message,
+                                        const RabbitmqMessageProperties &properties, PublishConfirmCallback onConfirm)
+{
+  publish(channel, exchange.getName(), binding.getBindingKey(), message, &properties, std::move(onConfirm));
+}
+
+void InMemoryConnection::publishToQueue(const RabbitmqChannel &channel, const std::string &queueName,
+                                        BytesView message, const RabbitmqMessageProperties &properties,
+                                        PublishConfirmCallback onConfirm)
+{
+  publish(channel, "", queueName, message, &properties, std::move(onConfirm));
+}
+
+void InMemoryConnection::publish(const RabbitmqChannel &channel, const std::string &exchangeName,
+                                 const std::string &routingKey, BytesView message,
+                                 const RabbitmqMessageProperties *properties, PublishConfirmCallback onConfirm)
+{
+  if (onConfirm && !m_confirmMode)
+    throw std::logic_error("Publish with confirmation on a channel without confirm mode");
+
+  auto stored = std::make_shared<InMemoryMessage>();
+  stored->body.assign(message.data, message.size);
+  if (properties)
+  {
+    stored->correlationId = properties->correlationId;
+    // как и RabbitMQ, брокер подставляет вместо псевдо-очереди адрес ответа этого канала
+    if (properties->replyTo == directReplyToQueue)
+    {
+      stored->replyTo = m_broker->getDirectReplyAddress(m_connectionId, channel.getId());
+      if (stored->replyTo.empty())
+        throw std::runtime_error("Publish with direct reply-to before consumeDirectReplyTo");
+    }
+    else
+      stored->replyTo = properties->replyTo;
+  }
+
+  m_broker->publish(exchangeName, routingKey, std::move(stored));
+  if (m_confirmMode)
+    m_pendingConfirms.push_back(std::move(onConfirm));
+  qCDebug(lcRabbitmqTrace) << "In-memory connection" << m_connectionId << "published message:"
+                           << QString::fromUtf8(message.data, static_cast<int>(message.size));
+}
+
+void InMemoryConnection::deliverConfirms()
+{
+  // обработчики могут публиковать снова, поэтому сначала забираем их
+  std::vector<PublishConfirmCallback> callbacks;
+  callbacks.swap(m_pendingConfirms);
+  for (auto& callback : callbacks)
+    if (callback)
+      callback(true);
+}
+
+void InMemoryConnection::ack(const IRabbitmqEnvelope &envelope)
+{
+  m_broker->ack(m_connectionId, envelope.getDeliveryTag());
+}
+
+void InMemoryConnection::reject(const IRabbitmqEnvelope &envelope, bool requeue)
+{
+  m_broker->reject(m_connectionId, envelope.getDeliveryTag(), requeue);
+}
+
+std::unique_ptr<IRabbitmqEnvelope> InMemoryConnection::consumeMessage()
+{
+  return consumeMessageInternal(nullptr);
+}
+
+std::unique_ptr<IRabbitmqEnvelope> InMemoryConnection::timedConsumeMessage(std::chrono::milliseconds timeoutMillis)
+{
+  std::chrono::seconds seconds = std::chrono::duration_cast<std::chrono::seconds>(timeoutMillis);
+  std::chrono::microseconds microseconds = timeoutMillis - seconds;
+
+  struct timeval timeout;
+  timeout.tv_sec = seconds.count();
+  timeout.tv_usec = microseconds.count();
+
+  return consumeMessageInternal(&timeout);
+}
+
+int InMemoryConnection::getReadableFd() const
+{
+  return m_broker->getNotificationFd(m_connectionId);
+}
+
+std::unique_ptr<IRabbitmqEnvelope> InMemoryConnection::consumeMessageInternal(struct timeval *timeout)
+{
+  deliverConfirms();
+
+  std::chrono::milliseconds timeoutMillis(0);
+  if (timeout)
+    timeoutMillis = std::chrono::seconds(timeout->tv_sec) +
+                    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::microseconds(timeout->tv_usec));
+
+  InMemoryBroker::Delivery delivery;
+  if (!m_broker->receive(m_connectionId, timeout ? &timeoutMillis : nullptr, delivery))
+    return nullptr;
+  const amqp_channel_t channel = delivery.channel;
+  return std::make_unique<InMemoryEnvelope>(channel, std::move(delivery));
+}
+
+InMemoryEnvelope::InMemoryEnvelope(amqp_channel_t channel, InMemoryBroker::Delivery delivery)
+  : m_channel(channel), m_delivery(std::move(delivery))
+{
+}
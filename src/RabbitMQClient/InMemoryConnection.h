@@ -0,0 +1,118 @@
+#ifndef INMEMORYCONNECTION_H
+#define INMEMORYCONNECTION_H
+
+#include "IRabbitmqConnection.h"
+#include "InMemoryBroker.h"
+#include "rabbitmqEntities.h"
+
+/**
+ * /brief Соединение с InMemoryBroker
+ *
+ * Позволяет запускать Client и Server без RabbitMQ и сети: для нагрузочных тестов и профилирования
+ * собственного кода. Как и RabbitmqConnection, не потокобезопасно: каждому потоку нужно свое соединение.
+ * Сокет не создается (openSocket возвращает nullptr), хост, порт и учетные данные не проверяются.
+ */
+class InMemoryConnection : public IRabbitmqConnection
+{
+  class Private;
+public:
+  InMemoryConnection(Private, std::shared_ptr<InMemoryBroker> broker);
+  ~InMemoryConnection() override;
+
+  InMemoryConnection(const InMemoryConnection&) = delete;
+  InMemoryConnection& operator=(const InMemoryConnection&) = delete;
+
+  static std::shared_ptr<InMemoryConnection> create(std::shared_ptr<InMemoryBroker> broker);
+  std::shared_ptr<IRabbitmqConnection> share();
+
+  std::unique_ptr<RabbitmqSocket> openSocket(const std::string &host, int port) override;
+
+  void login(const std::string &login, const std::string &password,
+             int heartbeatInSeconds, const std::string& vhost) override;
+
+  std::unique_ptr<RabbitmqChannel> openChannel() override;
+  // Отменяет подписки канала, его неподтвержденные сообщения возвращаются в очереди
+  void closeChannel(uint16_t channel) override;
+
+  std::unique_ptr<RabbitmqExchange> declareExchange(const RabbitmqChannel& channel,
+                                                    const std::string& exchangeName,
+                                                    const std::string& exchangeType) override;
+
+  std::unique_ptr<RabbitmqQueue> declareQueue(const RabbitmqChannel& channel,
+                                              const std::string& queueName) override;
+  std::unique_ptr<RabbitmqQueue> declareExclusiveQueue(const RabbitmqChannel& channel) override;
+
+  std::unique_ptr<RabbitmqBind> bind(const RabbitmqChannel &channel, const RabbitmqQueue &queue,
+                                     const RabbitmqExchange &exchange, const std::string &bindingKey) override;
+
+  void basicQos(const RabbitmqChannel &channel, uint16_t prefetchCount) override;
+  void basicConsume(const RabbitmqChannel &channel, const RabbitmqQueue &queue, bool noAsk, bool exclusive) override;
+  void consumeDirectReplyTo(const RabbitmqChannel &channel) override;
+
+  // Брокер подтверждает каждую публикацию, подтверждения приходят при следующем получении сообщения
+  void confirmSelect(const RabbitmqChannel& channel) override;
+  size_t getUnconfirmedCount() const override;
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message) override;
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties) override;
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties) override;
+  void publishBatch(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                    const RabbitmqBind& binding, const std::vector<BatchMessage>& messages) override;
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override;
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override;
+
+  void ack(const IRabbitmqEnvelope &envelope) override;
+  void reject(const IRabbitmqEnvelope &envelope, bool requeue) override;
+
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessage() override;
+  std::unique_ptr<IRabbitmqEnvelope> timedConsumeMessage(std::chrono::milliseconds timeoutMillis) override;
+
+  // eventfd брокера, читаемый, пока соединению есть доставки
+  int getReadableFd() const override;
+  // подтверждения публикаций выдаются при получении сообщений, дескриптор о них не сообщает
+  bool hasBufferedFrames() const override {return !m_pendingConfirms.empty();}
+
+protected:
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessageInternal(struct timeval* timeout) override;
+
+private:
+  void publish(const RabbitmqChannel& channel, const std::string& exchangeName, const std::string& routingKey,
+               BytesView message, const RabbitmqMessageProperties* properties = nullptr,
+               PublishConfirmCallback onConfirm = PublishConfirmCallback());
+  void deliverConfirms();
+
+  std::shared_ptr<InMemoryBroker> m_broker;
+  const uint64_t m_connectionId;
+  amqp_channel_t m_freeChannelId = 1;
+  bool m_confirmMode = false;
+  std::vector<PublishConfirmCallback> m_pendingConfirms;
+
+  struct Private{ explicit Private() = default; };
+};
+
+// Конверт сообщения InMemoryBroker
+class InMemoryEnvelope : public IRabbitmqEnvelope
+{
+public:
+  InMemoryEnvelope(amqp_channel_t channel, InMemoryBroker::Delivery delivery);
+
+  amqp_envelope_t* get() override {return nullptr;}
+  amqp_channel_t getChannel() const override {return m_channel;}
+  uint64_t getDeliveryTag() const override {return m_delivery.deliveryTag;}
+  std::string getMessage() const override {return m_delivery.message->body;}
+  BytesView getMessageView() const override {return BytesView(m_delivery.message->body);}
+  std::string getReplyTo() const override {return m_delivery.message->replyTo;}
+  std::string getCorrelationId() const override {return m_delivery.message->correlationId;}
+private:
+  amqp_channel_t m_channel;
+  InMemoryBroker::Delivery m_delivery;
+};
+
+#endif
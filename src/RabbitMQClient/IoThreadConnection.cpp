@@ -0,0 +1,816 @@
+#include "IoThreadConnection.h"
+#include "LoggingCategories.h"
+#include "SharedReader.h"
+
+#include <QDebug>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+namespace
+{
+  // Сколько команд и кадров поток ввода-вывода обрабатывает подряд, прежде чем перейти к другой работе
+  const size_t maxCommandsPerPass = 256;
+  const size_t maxFramesPerPass = 64;
+  // Сколько раз отправитель пробует добавить команду в заполненную очередь, прежде чем уснуть
+  const size_t submitSpinAttempts = 64;
+
+  // Сообщение, которое подтверждает или отклоняет поток ввода-вывода: конверт получателя к этому времени
+  // может быть уже удален, поэтому команда хранит только номер канала и доставки
+  class DeliveryReference : public IRabbitmqEnvelope
+  {
+  public:
+    DeliveryReference(amqp_channel_t channel, uint64_t deliveryTag) : m_channel(channel), m_deliveryTag(deliveryTag) {}
+
+    amqp_envelope_t* get() override {return nullptr;}
+    amqp_channel_t getChannel() const override {return m_channel;}
+    uint64_t getDeliveryTag() const override {return m_deliveryTag;}
+    std::string getMessage() const override {return std::string();}
+    BytesView getMessageView() const override {return BytesView();}
+    std::string getReplyTo() const override {return std::string();}
+    std::string getCorrelationId() const override {return std::string();}
+  private:
+    amqp_channel_t m_channel;
+    uint64_t m_deliveryTag;
+  };
+
+  template <typename Result>
+  void fulfil(std::promise<Result>& promise, const std::function<Result()>& operation)
+  {
+    promise.set_value(operation());
+  }
+
+  void fulfil(std::promise<void>& promise, const std::function<void()>& operation)
+  {
+    operation();
+    promise.set_value();
+  }
+}
+
+/**
+ * /brief Логическое соединение IoThreadConnection
+ *
+ * Используется одним потоком за раз, как и остальные реализации IRabbitmqConnection.
+ * Каналы закрываются на брокере при удалении RabbitmqChannel или вместе с логическим соединением.
+ */
+class IoThreadEndpoint : public IRabbitmqConnection
+{
+  using EndpointState = IoThreadConnection::EndpointState;
+public:
+  explicit IoThreadEndpoint(std::shared_ptr<IoThreadConnection> io)
+    : m_io(std::move(io)), m_state(std::make_shared<EndpointState>())
+  {
+  }
+
+  ~IoThreadEndpoint() override
+  {
+    if (!m_io->isRunning())
+      return;
+    auto io = m_io.get();
+    auto state = m_state;
+    IoThreadConnection::Command command;
+    command.run = [io, state]() { io->detach(state); };
+    try
+    {
+      m_io->submit(std::move(command));
+    }
+    catch (const std::exception& e)
+    {
+      qCWarning(lcRabbitmq) << "Failed to detach from I/O thread connection:" << e.what();
+    }
+  }
+
+  std::unique_ptr<RabbitmqSocket> openSocket(const std::string&, int) override
+  {
+    return nullptr;
+  }
+
+  void login(const std::string&, const std::string&, int, const std::string&) override
+  {
+  }
+
+  std::unique_ptr<RabbitmqChannel> openChannel() override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t channel = io->call<amqp_channel_t>([io, state]()
+    {
+      IoThreadConnection::ChannelEntry entry;
+      entry.channel = io->m_connection->openChannel();
+      entry.endpoint = state;
+      const amqp_channel_t id = entry.channel->getId();
+      io->m_channels[id] = std::move(entry);
+      return id;
+    });
+    const bool closeOnBroker = true;
+    return std::make_unique<RabbitmqChannel>(shared_from_this(), channel, closeOnBroker);
+  }
+
+  void closeChannel(uint16_t channel) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    IoThreadConnection::Command command;
+    command.run = [io, state, channel]()
+    {
+      auto entry = io->m_channels.find(channel);
+      if (entry != io->m_channels.end() && entry->second.endpoint == state)
+        io->m_channels.erase(entry);
+    };
+    // вызывается из ~RabbitmqChannel, исключение наружу выпускать нельзя
+    try
+    {
+      m_io->submit(std::move(command));
+    }
+    catch (const std::exception& e)
+    {
+      qCWarning(lcRabbitmq) << "Failed to close channel" << channel << ":" << e.what();
+    }
+  }
+
+  std::unique_ptr<RabbitmqExchange> declareExchange(const RabbitmqChannel& channel, const std::string& exchangeName,
+                                                    const std::string& exchangeType) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    return io->call<std::unique_ptr<RabbitmqExchange>>([io, state, id, exchangeName, exchangeType]()
+    {
+      return io->m_connection->declareExchange(io->channelOf(id, state), exchangeName, exchangeType);
+    });
+  }
+
+  std::unique_ptr<RabbitmqQueue> declareQueue(const RabbitmqChannel& channel, const std::string& queueName) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    return io->call<std::unique_ptr<RabbitmqQueue>>([io, state, id, queueName]()
+    {
+      return io->m_connection->declareQueue(io->channelOf(id, state), queueName);
+    });
+  }
+
+  std::unique_ptr<RabbitmqQueue> declareExclusiveQueue(const RabbitmqChannel& channel) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    return io->call<std::unique_ptr<RabbitmqQueue>>([io, state, id]()
+    {
+      return io->m_connection->declareExclusiveQueue(io->channelOf(id, state));
+    });
+  }
+
+  std::unique_ptr<RabbitmqBind> bind(const RabbitmqChannel& channel, const RabbitmqQueue& queue,
+                                     const RabbitmqExchange& exchange, const std::string& bindingKey) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    return io->call<std::unique_ptr<RabbitmqBind>>([io, state, id, &queue, &exchange, bindingKey]()
+    {
+      return io->m_connection->bind(io->channelOf(id, state), queue, exchange, bindingKey);
+    });
+  }
+
+  void basicQos(const RabbitmqChannel& channel, uint16_t prefetchCount) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    io->call<void>([io, state, id, prefetchCount]()
+    {
+      io->m_connection->basicQos(io->channelOf(id, state), prefetchCount);
+    });
+  }
+
+  void basicConsume(const RabbitmqChannel& channel, const RabbitmqQueue& queue, bool noAsk, bool exclusive) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    io->call<void>([io, state, id, &queue, noAsk, exclusive]()
+    {
+      io->m_connection->basicConsume(io->channelOf(id, state), queue, noAsk, exclusive);
+    });
+  }
+
+  void consumeDirectReplyTo(const RabbitmqChannel& channel) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    io->call<void>([io, state, id]()
+    {
+      io->m_connection->consumeDirectReplyTo(io->channelOf(id, state));
+    });
+  }
+
+  void confirmSelect(const RabbitmqChannel& channel) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    io->call<void>([io, state, id]()
+    {
+      io->m_connection->confirmSelect(io->channelOf(id, state));
+    });
+  }
+
+  size_t getUnconfirmedCount() const override
+  {
+    return m_state->unconfirmed;
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message) override
+  {
+    publish(channel.getId(), exchange.getName(), binding.getBindingKey(), message, nullptr, PublishConfirmCallback());
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties) override
+  {
+    publish(channel.getId(), exchange.getName(), binding.getBindingKey(), message, &properties,
+            PublishConfirmCallback());
+  }
+
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties) override
+  {
+    publishToQueue(channel.getId(), queueName, message, properties, PublishConfirmCallback());
+  }
+
+  void publishBatch(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                    const RabbitmqBind& binding, const std::vector<BatchMessage>& messages) override
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    const amqp_channel_t id = channel.getId();
+    const std::string exchangeName = exchange.getName();
+    const std::string bindingKey = binding.getBindingKey();
+    auto bodies = std::make_shared<std::vector<std::string>>();
+    auto properties = std::make_shared<std::vector<std::unique_ptr<RabbitmqMessageProperties>>>();
+    bodies->reserve(messages.size());
+    properties->reserve(messages.size());
+    for (const auto& message : messages)
+    {
+      bodies->emplace_back(message.body.data, message.body.size);
+      properties->push_back(message.properties ? std::make_unique<RabbitmqMessageProperties>(*message.properties)
+                                               : nullptr);
+    }
+
+    submitPublish([io, state, id, exchangeName, bindingKey, bodies, properties]()
+    {
+      RabbitmqExchange exchange(io->m_connection, id, exchangeName);
+      RabbitmqBind binding(io->m_connection, id, std::string(), exchangeName, bindingKey);
+      std::vector<BatchMessage> batch;
+      batch.reserve(bodies->size());
+      for (size_t i = 0; i < bodies->size(); ++i)
+        batch.emplace_back((*bodies)[i], (*properties)[i].get());
+      io->m_connection->publishBatch(io->channelOf(id, state), exchange, binding, batch);
+    });
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override
+  {
+    publish(channel.getId(), exchange.getName(), binding.getBindingKey(), message, &properties, std::move(onConfirm));
+  }
+
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override
+  {
+    publishToQueue(channel.getId(), queueName, message, properties, std::move(onConfirm));
+  }
+
+  void ack(const IRabbitmqEnvelope& envelope) override
+  {
+    auto io = m_io.get();
+    auto reference = deliveryReference(envelope);
+    submitPublish([io, reference]() { io->m_connection->ack(*reference); });
+  }
+
+  void reject(const IRabbitmqEnvelope& envelope, bool requeue) override
+  {
+    auto io = m_io.get();
+    auto reference = deliveryReference(envelope);
+    submitPublish([io, reference, requeue]() { io->m_connection->reject(*reference, requeue); });
+  }
+
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessage() override
+  {
+    return consumeMessageInternal(nullptr);
+  }
+
+  std::unique_ptr<IRabbitmqEnvelope> timedConsumeMessage(std::chrono::milliseconds timeoutMillis) override
+  {
+    struct timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeoutMillis.count() / 1000);
+    timeout.tv_usec = static_cast<suseconds_t>((timeoutMillis.count() % 1000) * 1000);
+    return consumeMessageInternal(&timeout);
+  }
+
+  // eventfd логического соединения, читаемый, пока поток ввода-вывода передал ему сообщения
+  int getReadableFd() const override {return m_state->eventFd;}
+  bool hasBufferedFrames() const override {return !m_state->inbox.empty();}
+
+protected:
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessageInternal(struct timeval* timeout) override
+  {
+    const auto deadline = timeout ? std::chrono::steady_clock::now() + std::chrono::seconds(timeout->tv_sec) +
+                                    std::chrono::microseconds(timeout->tv_usec)
+                                  : std::chrono::steady_clock::time_point::max();
+    bool attempted = false;
+    while (true)
+    {
+      IoThreadConnection::Incoming incoming;
+      if (!m_state->inbox.tryPop(incoming))
+      {
+        // eventfd сбрасывается до повторной проверки очереди, иначе сигнал о новом элементе потеряется
+        eventfd_t value = 0;
+        eventfd_read(m_state->eventFd, &value);
+        if (!m_state->inbox.tryPop(incoming))
+        {
+          if (!m_io->isRunning())
+            throw std::runtime_error("I/O thread connection is stopped: " + m_io->getError());
+          if (attempted && std::chrono::steady_clock::now() >= deadline)
+            return nullptr;
+
+          const auto remaining = std::min<std::chrono::milliseconds::rep>(remainingUntil(deadline).count(), INT_MAX);
+          pollfd descriptor{m_state->eventFd, POLLIN, 0};
+          poll(&descriptor, 1, static_cast<int>(remaining));
+          attempted = true;
+          continue;
+        }
+      }
+
+      if (!incoming.error.empty())
+        throw std::runtime_error(incoming.error);
+      if (incoming.envelope)
+        return std::move(incoming.envelope);
+      // как и librabbitmq, вместо сообщения получение может вернуть обработанное подтверждение публикации
+      if (incoming.onConfirm)
+        incoming.onConfirm(incoming.acked);
+      return nullptr;
+    }
+  }
+
+private:
+  void publish(amqp_channel_t id, const std::string& exchangeName, const std::string& bindingKey, BytesView message,
+               const RabbitmqMessageProperties* properties, PublishConfirmCallback onConfirm)
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    // тело копируется один раз: команда и ее копии в std::function разделяют его
+    auto body = std::make_shared<const std::string>(message.data, message.size);
+    auto messageProperties = properties ? std::make_shared<const RabbitmqMessageProperties>(*properties) : nullptr;
+    auto confirm = trackConfirm(std::move(onConfirm));
+    submitPublish([io, state, id, exchangeName, bindingKey, body, messageProperties, confirm]()
+    {
+      RabbitmqExchange exchange(io->m_connection, id, exchangeName);
+      RabbitmqBind binding(io->m_connection, id, std::string(), exchangeName, bindingKey);
+      const RabbitmqChannel& channel = io->channelOf(id, state);
+      if (confirm)
+      {
+        io->m_connection->publishMessage(channel, exchange, binding, BytesView(*body),
+                                         messageProperties ? *messageProperties : RabbitmqMessageProperties(), confirm);
+      }
+      else if (messageProperties)
+        io->m_connection->publishMessage(channel, exchange, binding, BytesView(*body), *messageProperties);
+      else
+        io->m_connection->publishMessage(channel, exchange, binding, BytesView(*body));
+    }, confirm);
+  }
+
+  void publishToQueue(amqp_channel_t id, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm)
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    auto body = std::make_shared<const std::string>(message.data, message.size);
+    auto messageProperties = std::make_shared<const RabbitmqMessageProperties>(properties);
+    auto confirm = trackConfirm(std::move(onConfirm));
+    submitPublish([io, state, id, queueName, body, messageProperties, confirm]()
+    {
+      const RabbitmqChannel& channel = io->channelOf(id, state);
+      if (confirm)
+        io->m_connection->publishToQueue(channel, queueName, BytesView(*body), *messageProperties, confirm);
+      else
+        io->m_connection->publishToQueue(channel, queueName, BytesView(*body), *messageProperties);
+    }, confirm);
+  }
+
+  // Подтверждение приходит в поток ввода-вывода, а выполняется при получении сообщений логическим соединением
+  PublishConfirmCallback trackConfirm(PublishConfirmCallback onConfirm)
+  {
+    if (!onConfirm)
+      return PublishConfirmCallback();
+    ++m_state->unconfirmed;
+    auto io = m_io.get();
+    auto state = m_state;
+    return [io, state, onConfirm](bool acked)
+    {
+      --state->unconfirmed;
+      IoThreadConnection::Incoming incoming;
+      incoming.onConfirm = onConfirm;
+      incoming.acked = acked;
+      io->deliver(state, std::move(incoming));
+    };
+  }
+
+  /**
+   * /brief Передает потоку ввода-вывода команду без ожидания результата
+   *
+   * Ошибка команды возвращается исключением из следующего получения сообщения. Если публикация
+   * не отправлена из-за ошибки или остановки потока, ее обработчик подтверждения получает false.
+   */
+  void submitPublish(std::function<void()> operation, PublishConfirmCallback confirm = PublishConfirmCallback())
+  {
+    auto io = m_io.get();
+    auto state = m_state;
+    IoThreadConnection::Command command;
+    command.run = [io, state, operation = std::move(operation), confirm]()
+    {
+      try
+      {
+        operation();
+      }
+      catch (const std::exception& e)
+      {
+        qCWarning(lcRabbitmq) << "Command of I/O thread connection failed:" << e.what();
+        IoThreadConnection::Incoming incoming;
+        incoming.error = e.what();
+        io->deliver(state, std::move(incoming));
+        // неотправленную публикацию брокер не подтвердит
+        if (confirm)
+          confirm(false);
+      }
+    };
+    command.cancel = [confirm](std::exception_ptr)
+    {
+      if (confirm)
+        confirm(false);
+    };
+    try
+    {
+      m_io->submit(std::move(command));
+    }
+    catch (const std::exception&)
+    {
+      // публикацию не приняли: об этом сообщает исключение, а не обработчик подтверждения
+      if (confirm)
+        --state->unconfirmed;
+      throw;
+    }
+  }
+
+  static std::shared_ptr<IRabbitmqEnvelope> deliveryReference(const IRabbitmqEnvelope& envelope)
+  {
+    // номер подключения нужен RabbitmqConnection, чтобы не подтверждать доставки, полученные до переподключения
+    const RabbitmqEnvelope* rabbitmqEnvelope = dynamic_cast<const RabbitmqEnvelope*>(&envelope);
+    if (!rabbitmqEnvelope)
+      return std::make_shared<DeliveryReference>(envelope.getChannel(), envelope.getDeliveryTag());
+
+    auto reference = std::make_shared<RabbitmqEnvelope>();
+    reference->get()->channel = envelope.getChannel();
+    reference->get()->delivery_tag = envelope.getDeliveryTag();
+    reference->setConnectionGeneration(rabbitmqEnvelope->getConnectionGeneration());
+    return reference;
+  }
+
+  std::shared_ptr<IoThreadConnection> m_io;
+  std::shared_ptr<EndpointState> m_state;
+};
+
+IoThreadConnection::EndpointState::EndpointState()
+{
+  eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (eventFd < 0)
+    throw std::runtime_error(std::string("IoThreadConnection: failed to create eventfd: ") + strerror(errno));
+}
+
+IoThreadConnection::EndpointState::~EndpointState()
+{
+  close(eventFd);
+}
+
+IoThreadConnection::IoThreadConnection(Private, std::shared_ptr<IRabbitmqConnection> connection,
+                                       const IoThreadSettings& settings)
+  : m_connection(std::move(connection)), m_settings(settings), m_commands(settings.commandQueueCapacity)
+{
+  m_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeupFd < 0)
+    throw std::runtime_error(std::string("IoThreadConnection: failed to create eventfd: ") + strerror(errno));
+  m_ioThread = std::thread([this]() { run(); });
+}
+
+IoThreadConnection::~IoThreadConnection()
+{
+  stop();
+  if (m_ioThread.joinable())
+    m_ioThread.join();
+  // соединение отклоняет оставшиеся публикации через обработчики, которым еще нужны поля объекта
+  m_connection.reset();
+  signalEndpoints();
+  close(m_wakeupFd);
+}
+
+std::shared_ptr<IoThreadConnection> IoThreadConnection::create(std::shared_ptr<IRabbitmqConnection> connection,
+                                                               const IoThreadSettings& settings)
+{
+  if (!connection)
+    throw std::invalid_argument("IoThreadConnection: nullptr connection");
+  if (settings.idleWakeupInterval.count() <= 0)
+    throw std::invalid_argument("IoThreadConnection: idle wakeup interval must be positive");
+  return std::make_shared<IoThreadConnection>(Private(), std::move(connection), settings);
+}
+
+std::shared_ptr<IRabbitmqConnection> IoThreadConnection::attach()
+{
+  if (!isRunning())
+    throw std::runtime_error("I/O thread connection is stopped: " + getError());
+  return std::make_shared<IoThreadEndpoint>(shared_from_this());
+}
+
+void IoThreadConnection::stop()
+{
+  m_stopRequested = true;
+  eventfd_write(m_wakeupFd, 1);
+}
+
+std::string IoThreadConnection::getError() const
+{
+  std::lock_guard<std::mutex> lock(m_errorMutex);
+  return m_error;
+}
+
+void IoThreadConnection::run()
+{
+  qCInfo(lcRabbitmq) << "I/O thread connection started";
+  std::string error;
+  try
+  {
+    while (!m_stopRequested)
+    {
+      executeCommands();
+      signalEndpoints();
+      waitForFrames();
+      readFrames();
+      signalEndpoints();
+    }
+  }
+  catch (const std::exception& e)
+  {
+    error = e.what();
+    qCCritical(lcRabbitmq) << "I/O thread connection failed:" << e.what();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_error = error.empty() ? "stopped" : error;
+  }
+  // логические соединения узнают об остановке при следующем получении сообщения
+  std::vector<std::shared_ptr<EndpointState>> endpoints;
+  for (const auto& entry : m_channels)
+    if (std::find(endpoints.begin(), endpoints.end(), entry.second.endpoint) == endpoints.end())
+      endpoints.push_back(entry.second.endpoint);
+  // при закрытии каналов ожидающие подтверждения публикации отклоняются, о них тоже нужно сообщить
+  m_channels.clear();
+  for (const auto& endpoint : endpoints)
+  {
+    Incoming incoming;
+    incoming.error = "I/O thread connection is stopped: " + (error.empty() ? std::string("stopped") : error);
+    deliver(endpoint, std::move(incoming));
+  }
+  signalEndpoints();
+
+  std::lock_guard<std::mutex> lock(m_shutdownMutex);
+  m_running = false;
+  cancelCommands(std::make_exception_ptr(std::runtime_error("I/O thread connection is stopped")));
+  qCInfo(lcRabbitmq) << "I/O thread connection stopped";
+}
+
+void IoThreadConnection::submit(Command command)
+{
+  if (!isRunning())
+    throw std::runtime_error("I/O thread connection is stopped: " + getError());
+
+  if (!m_commands.tryPush(std::move(command)))
+    waitForSpace(command);
+  ++m_queuedCommands;
+  if (m_ioSleeping)
+    eventfd_write(m_wakeupFd, 1);
+
+  // поток мог остановиться раньше, чем выбрал команду: теперь очередь разбирают отправители
+  if (!m_running)
+  {
+    std::lock_guard<std::mutex> lock(m_shutdownMutex);
+    cancelCommands(std::make_exception_ptr(std::runtime_error("I/O thread connection is stopped")));
+  }
+}
+
+void IoThreadConnection::waitForSpace(Command &command)
+{
+  // поток ввода-вывода не успевает: обычно место освобождается за один его проход, поэтому сначала
+  // отправитель пробует недолго, а затем засыпает до выборки команд
+  for (size_t attempt = 0; attempt < submitSpinAttempts; ++attempt)
+  {
+    eventfd_write(m_wakeupFd, 1);
+    if (!m_running)
+      throw std::runtime_error("I/O thread connection is stopped: " + getError());
+    std::this_thread::yield();
+    if (m_commands.tryPush(std::move(command)))
+      return;
+  }
+
+  std::unique_lock<std::mutex> lock(m_spaceMutex);
+  ++m_blockedSenders;
+  // парный барьер в notifySenders: либо отправитель увидит освободившееся место, либо поток ввода-вывода - отправителя
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (!m_commands.tryPush(std::move(command)))
+  {
+    if (!m_running)
+    {
+      --m_blockedSenders;
+      throw std::runtime_error("I/O thread connection is stopped: " + getError());
+    }
+    eventfd_write(m_wakeupFd, 1);
+    m_spaceAvailable.wait_for(lock, m_settings.idleWakeupInterval);
+  }
+  --m_blockedSenders;
+}
+
+void IoThreadConnection::notifySenders()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_blockedSenders == 0)
+    return;
+  // мьютекс не дает уведомлению проскочить между проверкой очереди отправителем и его засыпанием
+  {
+    std::lock_guard<std::mutex> lock(m_spaceMutex);
+  }
+  m_spaceAvailable.notify_all();
+}
+
+template <typename Result>
+Result IoThreadConnection::call(std::function<Result()> operation)
+{
+  if (std::this_thread::get_id() == m_ioThread.get_id())
+    throw std::logic_error("IoThreadConnection: synchronous call from the I/O thread");
+
+  auto promise = std::make_shared<std::promise<Result>>();
+  auto result = promise->get_future();
+  Command command;
+  command.run = [promise, operation]()
+  {
+    try
+    {
+      fulfil(*promise, operation);
+    }
+    catch (...)
+    {
+      promise->set_exception(std::current_exception());
+    }
+  };
+  command.cancel = [promise](std::exception_ptr error) { promise->set_exception(error); };
+  submit(std::move(command));
+  return result.get();
+}
+
+size_t IoThreadConnection::executeCommands()
+{
+  size_t executed = 0;
+  Command command;
+  while (executed < maxCommandsPerPass && m_commands.tryPop(command))
+  {
+    --m_queuedCommands;
+    ++executed;
+    command.run();
+    command = Command();
+  }
+  if (executed > 0)
+    notifySenders();
+  return executed;
+}
+
+void IoThreadConnection::waitForFrames()
+{
+  if (m_connection->hasBufferedFrames())
+    return;
+
+  // команда, добавленная после этой проверки, увидит m_ioSleeping и разбудит поток
+  m_ioSleeping = true;
+  if (m_queuedCommands > 0 || m_stopRequested)
+  {
+    m_ioSleeping = false;
+    return;
+  }
+
+  const int fd = m_connection->getReadableFd();
+  // соединение без дескриптора (восстанавливается) ждет кадров короткими отрезками, чтобы не задерживать команды
+  const auto interval = fd < 0 ? std::min(m_settings.idleWakeupInterval, SharedReader::pollSlice)
+                               : m_settings.idleWakeupInterval;
+  pollfd descriptors[2] = {{m_wakeupFd, POLLIN, 0}, {fd, POLLIN, 0}};
+  const int ready = poll(descriptors, fd < 0 ? 1 : 2, static_cast<int>(interval.count()));
+  m_ioSleeping = false;
+  if (ready > 0 && (descriptors[0].revents & POLLIN))
+  {
+    eventfd_t value = 0;
+    eventfd_read(m_wakeupFd, &value);
+  }
+}
+
+void IoThreadConnection::readFrames()
+{
+  // чтение с нулевым таймаутом также отправляет heartbeat, когда подошло его время
+  for (size_t frame = 0; frame < maxFramesPerPass; ++frame)
+  {
+    auto envelope = m_connection->timedConsumeMessage(std::chrono::milliseconds(0));
+    if (envelope)
+    {
+      auto entry = m_channels.find(envelope->getChannel());
+      if (entry == m_channels.end())
+      {
+        // неподтвержденное сообщение брокер вернет в очередь при закрытии канала
+        qCWarning(lcRabbitmq) << "Dropped delivery" << envelope->getDeliveryTag() << "for closed channel"
+                              << envelope->getChannel();
+        continue;
+      }
+      Incoming incoming;
+      incoming.envelope = std::move(envelope);
+      deliver(entry->second.endpoint, std::move(incoming));
+    }
+    else if (!m_connection->hasBufferedFrames())
+      break;
+  }
+}
+
+void IoThreadConnection::deliver(const std::shared_ptr<EndpointState>& endpoint, Incoming incoming)
+{
+  endpoint->inbox.push(std::move(incoming));
+  if (!endpoint->signalPending)
+  {
+    endpoint->signalPending = true;
+    m_signalled.push_back(endpoint);
+  }
+}
+
+void IoThreadConnection::signalEndpoints()
+{
+  // один eventfd_write на логическое соединение за проход, а не на каждое сообщение
+  for (const auto& endpoint : m_signalled)
+  {
+    endpoint->signalPending = false;
+    eventfd_write(endpoint->eventFd, 1);
+  }
+  m_signalled.clear();
+}
+
+const RabbitmqChannel& IoThreadConnection::channelOf(amqp_channel_t channel,
+                                                     const std::shared_ptr<EndpointState>& endpoint) const
+{
+  auto entry = m_channels.find(channel);
+  if (entry == m_channels.end() || entry->second.endpoint != endpoint)
+    throw std::invalid_argument("Channel " + std::to_string(channel) + " is not open on this connection");
+  return *entry->second.channel;
+}
+
+void IoThreadConnection::detach(const std::shared_ptr<EndpointState>& endpoint)
+{
+  for (auto entry = m_channels.begin(); entry != m_channels.end();)
+  {
+    if (entry->second.endpoint == endpoint)
+      entry = m_channels.erase(entry);
+    else
+      ++entry;
+  }
+}
+
+void IoThreadConnection::cancelCommands(std::exception_ptr error)
+{
+  Command command;
+  while (m_commands.tryPop(command))
+  {
+    --m_queuedCommands;
+    if (command.cancel)
+      command.cancel(error);
+    command = Command();
+  }
+  // отклоненные публикации передаются логическим соединениям так же, как подтверждения брокера
+  signalEndpoints();
+  // уснувшие отправители узнают об остановке
+  notifySenders();
+}
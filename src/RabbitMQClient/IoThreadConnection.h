@@ -0,0 +1,158 @@
+#ifndef IOTHREADCONNECTION_H
+#define IOTHREADCONNECTION_H
+
+#include "IRabbitmqConnection.h"
+#include "rabbitmqEntities.h"
+#include "SpscQueue.h"
+#include "Logger/RingBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class IoThreadEndpoint;
+
+struct IoThreadSettings
+{
+  // Сколько команд может ждать поток ввода-вывода. Когда очередь заполнена, отправитель ждет
+  size_t commandQueueCapacity = 4096;
+  // Как часто поток ввода-вывода просыпается без кадров и команд, чтобы librabbitmq отправлял heartbeat
+  std::chrono::milliseconds idleWakeupInterval{100};
+};
+
+/**
+ * /brief Соединение RabbitMQ, которым владеет отдельный поток ввода-вывода
+ *
+ * Состояние librabbitmq не потокобезопасно, поэтому сокет читает и пишет только поток ввода-вывода.
+ * attach() выдает логическое соединение (IRabbitmqConnection) для одного потока: Client и Server работают
+ * с ним без изменений, а сотни логических соединений делят один сокет и логин.
+ *
+ * Логические соединения передают команды через общую очередь без блокировок (много писателей, один читатель).
+ * Публикации, ack и reject не ждут выполнения, тело сообщения копируется. Объявления, подписки и открытие каналов
+ * ждут ответа брокера. Сообщения и подтверждения публикаций поток ввода-вывода кладет в очередь логического
+ * соединения (один писатель, один читатель) и будит его через eventfd, который возвращает getReadableFd(),
+ * поэтому логические соединения работают с ConsumerEventLoop и QtConsumerNotifier.
+ *
+ * Ошибка команды без ожидания (например, публикации) возвращается исключением из следующего получения
+ * сообщения на этом логическом соединении. После ошибки самого соединения поток ввода-вывода останавливается,
+ * и все логические соединения получают исключение.
+ * Соединение передается после openSocket и login и дальше используется только потоком ввода-вывода.
+ */
+class IoThreadConnection : public std::enable_shared_from_this<IoThreadConnection>
+{
+  class Private;
+public:
+  IoThreadConnection(Private, std::shared_ptr<IRabbitmqConnection> connection, const IoThreadSettings& settings);
+  ~IoThreadConnection();
+
+  IoThreadConnection(const IoThreadConnection&) = delete;
+  IoThreadConnection& operator=(const IoThreadConnection&) = delete;
+
+  // Запускает поток ввода-вывода
+  static std::shared_ptr<IoThreadConnection> create(std::shared_ptr<IRabbitmqConnection> connection,
+                                                    const IoThreadSettings& settings = IoThreadSettings());
+
+  // Логическое соединение для одного потока. Пока оно живо, поток ввода-вывода не останавливается
+  std::shared_ptr<IRabbitmqConnection> attach();
+
+  // Останавливает поток ввода-вывода, ожидающие команды завершаются исключением
+  void stop();
+  bool isRunning() const {return m_running && !m_stopRequested;}
+  // Причина остановки после ошибки соединения, пустая строка при штатной остановке
+  std::string getError() const;
+private:
+  friend class IoThreadEndpoint;
+
+  struct Command
+  {
+    std::function<void()> run;
+    // поток ввода-вывода остановился раньше, чем выполнил команду
+    std::function<void(std::exception_ptr error)> cancel;
+  };
+
+  // Что поток ввода-вывода передает логическому соединению
+  struct Incoming
+  {
+    std::unique_ptr<IRabbitmqEnvelope> envelope;
+    PublishConfirmCallback onConfirm;
+    bool acked = false;
+    std::string error;
+  };
+
+  struct EndpointState
+  {
+    EndpointState();
+    ~EndpointState();
+
+    SpscQueue<Incoming> inbox;
+    int eventFd = -1;
+    std::atomic<size_t> unconfirmed{0};
+    // в очередь добавлены элементы, о которых eventfd еще не сообщил (только поток ввода-вывода)
+    bool signalPending = false;
+  };
+
+  struct ChannelEntry
+  {
+    std::unique_ptr<RabbitmqChannel> channel;
+    std::shared_ptr<EndpointState> endpoint;
+  };
+
+  void run();
+  void submit(Command command);
+  // Ждет места в заполненной очереди команд и добавляет команду
+  void waitForSpace(Command& command);
+  // Будит отправителей, ждущих места в очереди команд
+  void notifySenders();
+  // Выполняет команду в потоке ввода-вывода и возвращает ее результат
+  template <typename Result>
+  Result call(std::function<Result()> operation);
+
+  size_t executeCommands();
+  void waitForFrames();
+  void readFrames();
+  // Вызывается только из потока ввода-вывода
+  void deliver(const std::shared_ptr<EndpointState>& endpoint, Incoming incoming);
+  void signalEndpoints();
+  const RabbitmqChannel& channelOf(amqp_channel_t channel, const std::shared_ptr<EndpointState>& endpoint) const;
+  void detach(const std::shared_ptr<EndpointState>& endpoint);
+  void cancelCommands(std::exception_ptr error);
+
+  std::shared_ptr<IRabbitmqConnection> m_connection;
+  const IoThreadSettings m_settings;
+
+  RingBuffer<Command> m_commands;
+  // команды в очереди: писатель увеличивает после добавления, поток ввода-вывода уменьшает после выборки
+  std::atomic<long> m_queuedCommands{0};
+  // поток ввода-вывода собирается уснуть в poll, добавившему команду нужно его разбудить
+  std::atomic<bool> m_ioSleeping{false};
+  int m_wakeupFd = -1;
+  // отправители, уснувшие на заполненной очереди; поток ввода-вывода будит их, когда выбирает команды
+  std::mutex m_spaceMutex;
+  std::condition_variable m_spaceAvailable;
+  std::atomic<size_t> m_blockedSenders{0};
+
+  std::atomic<bool> m_running{true};
+  std::atomic<bool> m_stopRequested{false};
+  mutable std::mutex m_errorMutex;
+  std::string m_error;
+  // после остановки потока ввода-вывода очередь команд разбирают отправители под этим мьютексом
+  std::mutex m_shutdownMutex;
+
+  // Состояние потока ввода-вывода
+  std::map<amqp_channel_t, ChannelEntry> m_channels;
+  std::vector<std::shared_ptr<EndpointState>> m_signalled;
+
+  std::thread m_ioThread;
+
+  struct Private{ explicit Private() = default; };
+};
+
+#endif
@@ -0,0 +1,4 @@
+#include "LoggingCategories.h"
+
+Q_LOGGING_CATEGORY(lcRabbitmq, "rabbitmq")
+Q_LOGGING_CATEGORY(lcRabbitmqTrace, "rabbitmq.trace", QtWarningMsg)
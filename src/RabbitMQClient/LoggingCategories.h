@@ -0,0 +1,12 @@
+#ifndef LOGGINGCATEGORIES_H
+#define LOGGINGCATEGORIES_H
+
+#include <QLoggingCategory>
+
+// Сообщения библиотеки работы с брокером
+Q_DECLARE_LOGGING_CATEGORY(lcRabbitmq)
+// Содержимое опубликованных и полученных сообщений. Выключена по умолчанию,
+// включается правилом "rabbitmq.trace.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(lcRabbitmqTrace)
+
+#endif
@@ -0,0 +1,168 @@
+#include "Metrics.h"
+
+#include <algorithm>
+
+namespace
+{
+// каждая степень двойки делится на 2^subBucketBits интервалов
+const unsigned subBucketBits = 5;
+const uint64_t subBucketCount = uint64_t(1) << subBucketBits;
+
+unsigned highestBit(uint64_t value)
+{
+  unsigned bit = 0;
+  while (value >>= 1)
+    ++bit;
+  return bit;
+}
+
+std::atomic<size_t> nextStripe{0};
+}
+
+const size_t MetricCounter::stripeCount;
+const uint64_t LatencyHistogram::maxTrackableValue;
+
+size_t MetricCounter::stripeIndex()
+{
+  // потоки получают ячейки по кругу при первом обращении
+  thread_local const size_t index = nextStripe.fetch_add(1, std::memory_order_relaxed) % stripeCount;
+  return index;
+}
+
+uint64_t MetricCounter::value() const
+{
+  uint64_t result = 0;
+  for (const auto& stripe : m_stripes)
+    result += stripe.value.load(std::memory_order_relaxed);
+  return result;
+}
+
+LatencyHistogram::LatencyHistogram()
+  : m_buckets(new std::atomic<uint64_t>[bucketCount()])
+{
+  for (size_t i = 0; i < bucketCount(); ++i)
+    m_buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+  m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  m_sum.increment(value);
+
+  uint64_t max = m_max.load(std::memory_order_relaxed);
+  while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    ;
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+  HistogramSnapshot result;
+  result.buckets.resize(bucketCount());
+  for (size_t i = 0; i < bucketCount(); ++i)
+  {
+    result.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    result.count += result.buckets[i];
+  }
+  result.sum = m_sum.value();
+  result.max = m_max.load(std::memory_order_relaxed);
+  return result;
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value)
+{
+  if (value > maxTrackableValue)
+    value = maxTrackableValue;
+  if (value < subBucketCount)
+    return static_cast<size_t>(value);
+
+  const unsigned exponent = highestBit(value);
+  const unsigned shift = exponent - subBucketBits;
+  const uint64_t mantissa = (value >> shift) - subBucketCount;
+  return static_cast<size_t>(subBucketCount + shift * subBucketCount + mantissa);
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(size_t index)
+{
+  if (index < subBucketCount)
+    return index;
+
+  const uint64_t shift = (index - subBucketCount) / subBucketCount;
+  const uint64_t mantissa = (index - subBucketCount) % subBucketCount;
+  return (subBucketCount + mantissa) << shift;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index)
+{
+  if (index < subBucketCount)
+    return index;
+
+  const uint64_t shift = (index - subBucketCount) / subBucketCount;
+  return bucketLowerBound(index) + (uint64_t(1) << shift) - 1;
+}
+
+size_t LatencyHistogram::bucketCount()
+{
+  return bucketIndex(maxTrackableValue) + 1;
+}
+
+uint64_t HistogramSnapshot::valueAtPercentile(double percentile) const
+{
+  if (count == 0)
+    return 0;
+
+  uint64_t threshold = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count) + 0.5);
+  if (threshold == 0)
+    threshold = 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i)
+  {
+    seen += buckets[i];
+    if (seen >= threshold)
+      return std::min(LatencyHistogram::bucketUpperBound(i), max);
+  }
+  return max;
+}
+
+uint64_t HistogramSnapshot::countAtOrBelow(uint64_t value) const
+{
+  uint64_t result = 0;
+  for (size_t i = 0; i < buckets.size() && LatencyHistogram::bucketUpperBound(i) <= value; ++i)
+    result += buckets[i];
+  return result;
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricCounter &MetricsRegistry::counter(const std::string &name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto& counter = m_counters[name];
+  if (!counter)
+    counter = std::make_unique<MetricCounter>();
+  return *counter;
+}
+
+LatencyHistogram &MetricsRegistry::histogram(const std::string &name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto& histogram = m_histograms[name];
+  if (!histogram)
+    histogram = std::make_unique<LatencyHistogram>();
+  return *histogram;
+}
+
+MetricsRegistry::Snapshot MetricsRegistry::snapshot() const
+{
+  Snapshot result;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto& counter : m_counters)
+    result.counters[counter.first] = counter.second->value();
+  for (const auto& histogram : m_histograms)
+    result.histograms[histogram.first] = histogram.second->snapshot();
+  return result;
+}
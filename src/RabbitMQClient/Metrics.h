@@ -0,0 +1,128 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * /brief Счетчик, увеличиваемый из многих потоков
+ *
+ * Значение разбито на несколько ячеек в разных кэш-линиях, каждый поток увеличивает свою ячейку,
+ * поэтому потоки не соревнуются за одну кэш-линию. value() складывает ячейки.
+ */
+class MetricCounter
+{
+public:
+  void increment(uint64_t value = 1)
+  {
+    m_stripes[stripeIndex()].value.fetch_add(value, std::memory_order_relaxed);
+  }
+  uint64_t value() const;
+
+private:
+  static size_t stripeIndex();
+
+  static const size_t stripeCount = 16;
+  static const size_t cacheLineSize = 64;
+
+  struct Stripe
+  {
+    std::atomic<uint64_t> value{0};
+    char padding[cacheLineSize - sizeof(std::atomic<uint64_t>)];
+  };
+  Stripe m_stripes[stripeCount];
+};
+
+// Снимок гистограммы: число значений по интервалам LatencyHistogram
+struct HistogramSnapshot
+{
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+  std::vector<uint64_t> buckets;
+
+  // Значение, не меньше которого percentile процентов наблюдений (верхняя граница интервала)
+  uint64_t valueAtPercentile(double percentile) const;
+  // Число наблюдений со значением не больше value
+  uint64_t countAtOrBelow(uint64_t value) const;
+};
+
+/**
+ * /brief Гистограмма с логарифмически-линейными интервалами (как в HdrHistogram)
+ *
+ * Каждая степень двойки делится на 32 равных интервала, поэтому относительная погрешность
+ * значения не превышает 1/32 во всем диапазоне. Значения больше maxTrackableValue попадают
+ * в последний интервал. Запись - одна атомарная операция над интервалом без блокировок.
+ */
+class LatencyHistogram
+{
+public:
+  static const uint64_t maxTrackableValue = (uint64_t(1) << 36) - 1;
+
+  LatencyHistogram();
+
+  void record(uint64_t value);
+  HistogramSnapshot snapshot() const;
+
+  static size_t bucketIndex(uint64_t value);
+  static uint64_t bucketLowerBound(size_t index);
+  static uint64_t bucketUpperBound(size_t index);
+  static size_t bucketCount();
+
+private:
+  std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+  MetricCounter m_sum;
+  std::atomic<uint64_t> m_max{0};
+};
+
+/**
+ * /brief Реестр именованных метрик процесса
+ *
+ * Метрика создается при первом обращении по имени. Ссылки на метрики остаются действительными
+ * все время жизни реестра, поэтому их получают один раз и сохраняют, а не ищут по имени на каждом событии.
+ * Имена следуют соглашениям Prometheus: *_total для счетчиков, единица измерения в суффиксе гистограмм.
+ */
+class MetricsRegistry
+{
+public:
+  struct Snapshot
+  {
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, HistogramSnapshot> histograms;
+  };
+
+  static MetricsRegistry& instance();
+
+  MetricCounter& counter(const std::string& name);
+  LatencyHistogram& histogram(const std::string& name);
+
+  Snapshot snapshot() const;
+
+private:
+  mutable std::mutex m_mutex;
+  std::map<std::string, std::unique_ptr<MetricCounter>> m_counters;
+  std::map<std::string, std::unique_ptr<LatencyHistogram>> m_histograms;
+};
+
+// Микросекунды, прошедшие с момента start
+inline uint64_t elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - start).count());
+}
+
+// Текущее время в микросекундах от начала эпохи; в отличие от steady_clock сравнимо между процессами
+inline uint64_t wallClockMicroseconds()
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "PublisherConfirms.h"
+#include "LoggingCategories.h"
+#include "Metrics.h"
+
+#include <QDebug>
+
+#include <vector>
+
+void PublisherConfirms::enable(amqp_channel_t channel)
+{
+  m_channels[channel] = ChannelState();
+}
+
+bool PublisherConfirms::isEnabled(amqp_channel_t channel) const
+{
+  return m_channels.count(channel) != 0;
+}
+
+uint64_t PublisherConfirms::registerPublish(amqp_channel_t channel, PublishConfirmCallback callback)
+{
+  ChannelState& state = m_channels.at(channel);
+  uint64_t deliveryTag = state.nextDeliveryTag++;
+  state.unconfirmed.emplace(deliveryTag, std::move(callback));
+  return deliveryTag;
+}
+
+void PublisherConfirms::handleAck(amqp_channel_t channel, uint64_t deliveryTag, bool multiple)
+{
+  complete(channel, deliveryTag, multiple, true);
+}
+
+void PublisherConfirms::handleNack(amqp_channel_t channel, uint64_t deliveryTag, bool multiple)
+{
+  qCWarning(lcRabbitmq) << "Broker nacked publish" << deliveryTag << "on channel:" << channel << "multiple:" << multiple;
+  complete(channel, deliveryTag, multiple, false);
+}
+
+void PublisherConfirms::failAll()
+{
+  // обработчики могут публиковать снова, поэтому сначала забираем их из состояния
+  std::vector<PublishConfirmCallback> callbacks;
+  for (auto& channel : m_channels)
+  {
+    for (auto& unconfirmed : channel.second.unconfirmed)
+      callbacks.push_back(std::move(unconfirmed.second));
+    channel.second.unconfirmed.clear();
+  }
+
+  for (auto& callback : callbacks)
+    if (callback)
+      callback(false);
+}
+
+void PublisherConfirms::forgetChannel(amqp_channel_t channel)
+{
+  auto it = m_channels.find(channel);
+  if (it == m_channels.end())
+    return;
+
+  std::vector<PublishConfirmCallback> callbacks;
+  for (auto& unconfirmed : it->second.unconfirmed)
+    callbacks.push_back(std::move(unconfirmed.second));
+  m_channels.erase(it);
+
+  for (auto& callback : callbacks)
+    if (callback)
+      callback(false);
+}
+
+size_t PublisherConfirms::getUnconfirmedCount() const
+{
+  size_t count = 0;
+  for (const auto& channel : m_channels)
+    count += channel.second.unconfirmed.size();
+  return count;
+}
+
+void PublisherConfirms::complete(amqp_channel_t channel, uint64_t deliveryTag, bool multiple, bool acked)
+{
+  auto it = m_channels.find(channel);
+  if (it == m_channels.end())
+  {
+    qCWarning(lcRabbitmq) << "Confirmation for channel without confirm mode:" << channel;
+    return;
+  }
+
+  auto& unconfirmed = it->second.unconfirmed;
+  auto first = multiple ? unconfirmed.begin() : unconfirmed.find(deliveryTag);
+  auto last = multiple ? unconfirmed.upper_bound(deliveryTag) : first;
+  if (!multiple && last != unconfirmed.end())
+    ++last;
+
+  std::vector<PublishConfirmCallback> callbacks;
+  for (auto current = first; current != last; ++current)
+    callbacks.push_back(std::move(current->second));
+  unconfirmed.erase(first, last);
+
+  static MetricCounter& confirmed = MetricsRegistry::instance().counter("rabbitmq_publish_confirms_total");
+  static MetricCounter& nacked = MetricsRegistry::instance().counter("rabbitmq_publish_nacks_total");
+  (acked ? confirmed : nacked).increment(callbacks.size());
+
+  for (auto& callback : callbacks)
+    if (callback)
+      callback(acked);
+}
@@ -0,0 +1,46 @@
+#ifndef PUBLISHERCONFIRMS_H
+#define PUBLISHERCONFIRMS_H
+
+#include "IRabbitmqConnection.h"
+
+#include <amqp.h>
+
+#include <map>
+
+/**
+ * /brief Учет публикаций, ожидающих подтверждения брокером (publisher confirms)
+ *
+ * После confirm.select брокер нумерует публикации канала с единицы и подтверждает их
+ * кадрами basic.ack/basic.nack. Флаг multiple подтверждает сразу все публикации с номером
+ * не больше указанного, поэтому ожидающие публикации хранятся упорядоченно по номеру.
+ * Класс не потокобезопасен, как и само соединение.
+ */
+class PublisherConfirms
+{
+public:
+  void enable(amqp_channel_t channel);
+  bool isEnabled(amqp_channel_t channel) const;
+
+  // Регистрирует отправленную публикацию канала и возвращает её номер (delivery tag)
+  uint64_t registerPublish(amqp_channel_t channel, PublishConfirmCallback callback);
+
+  void handleAck(amqp_channel_t channel, uint64_t deliveryTag, bool multiple);
+  void handleNack(amqp_channel_t channel, uint64_t deliveryTag, bool multiple);
+  // Соединение закрыто, подтверждений не будет: ожидающие публикации всех каналов считаются отклоненными
+  void failAll();
+  // Канал закрыт: его ожидающие публикации отклоняются, а номер канала можно открыть снова без режима подтверждений
+  void forgetChannel(amqp_channel_t channel);
+
+  size_t getUnconfirmedCount() const;
+private:
+  void complete(amqp_channel_t channel, uint64_t deliveryTag, bool multiple, bool acked);
+
+  struct ChannelState
+  {
+    uint64_t nextDeliveryTag = 1;
+    std::map<uint64_t, PublishConfirmCallback> unconfirmed;
+  };
+  std::map<amqp_channel_t, ChannelState> m_channels;
+};
+
+#endif
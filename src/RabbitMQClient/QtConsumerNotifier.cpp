@@ -0,0 +1,87 @@
+#include "QtConsumerNotifier.h"
+#include "LoggingCategories.h"
+
+#include <QDebug>
+
+#include <stdexcept>
+
+QtConsumerNotifier::QtConsumerNotifier(std::shared_ptr<IRabbitmqConnection> connection, DeliveryHandler handler,
+                                       ErrorHandler errorHandler, std::chrono::milliseconds pollInterval)
+  : m_connection(connection), m_handler(handler), m_errorHandler(errorHandler), m_pollInterval(pollInterval)
+{
+  if (!m_connection)
+    throw std::invalid_argument("QtConsumerNotifier: nullptr connection");
+  if (!m_handler)
+    throw std::invalid_argument("QtConsumerNotifier: empty delivery handler");
+
+  m_timer.setSingleShot(true);
+  QObject::connect(&m_timer, &QTimer::timeout, [this]() { processMessages(); });
+  watchDescriptor();
+}
+
+QtConsumerNotifier::~QtConsumerNotifier()
+{
+  m_timer.stop();
+  m_notifier.reset();
+}
+
+void QtConsumerNotifier::processMessages()
+{
+  if (!m_active)
+    return;
+
+  // пока сообщения разбираются, уведомления о том же дескрипторе не нужны
+  if (m_notifier)
+    m_notifier->setEnabled(false);
+  try
+  {
+    ConsumerEventLoop::drain(*m_connection, m_handler, ConsumerEventLoop::maxFramesPerWakeup);
+  }
+  catch (const std::exception& e)
+  {
+    qCCritical(lcRabbitmq) << "Stopped receiving messages:" << e.what();
+    m_active = false;
+    releaseNotifier();
+    if (m_errorHandler)
+      m_errorHandler(e.what());
+    return;
+  }
+  watchDescriptor();
+}
+
+void QtConsumerNotifier::watchDescriptor()
+{
+  const int fd = m_connection->getReadableFd();
+  if (fd < 0)
+    releaseNotifier();
+  else if (!m_notifier || m_notifier->socket() != fd)
+  {
+    releaseNotifier();
+    m_notifier = std::make_unique<QSocketNotifier>(fd, QSocketNotifier::Read);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    QObject::connect(m_notifier.get(),
+                     QOverload<QSocketDescriptor, QSocketNotifier::Type>::of(&QSocketNotifier::activated),
+                     [this]() { processMessages(); });
+#else
+    QObject::connect(m_notifier.get(), &QSocketNotifier::activated, [this]() { processMessages(); });
+#endif
+  }
+  else
+    m_notifier->setEnabled(true);
+
+  if (fd < 0)
+    m_timer.start(static_cast<int>(m_pollInterval.count()));
+  else if (m_connection->hasBufferedFrames())
+    m_timer.start(0);
+  else
+    m_timer.stop();
+}
+
+void QtConsumerNotifier::releaseNotifier()
+{
+  if (!m_notifier)
+    return;
+  // уведомитель может быть источником обрабатываемого сигнала, удалять его сразу нельзя
+  m_notifier->setEnabled(false);
+  m_notifier.release()->deleteLater();
+}
@@ -0,0 +1,53 @@
+#ifndef QTCONSUMERNOTIFIER_H
+#define QTCONSUMERNOTIFIER_H
+
+#include "ConsumerEventLoop.h"
+
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <chrono>
+#include <memory>
+
+/**
+ * /brief Получение сообщений соединения в цикле событий Qt
+ *
+ * QSocketNotifier следит за дескриптором соединения, и пришедшие сообщения передаются обработчику
+ * в потоке, которому принадлежит объект (обычно потоке интерфейса), без отдельного потока и опроса.
+ * Соединение без дескриптора (восстанавливается или не поддерживает ожидание) опрашивается по таймеру
+ * раз в pollInterval. Соединение используется только из потока объекта.
+ *
+ * Qt не пропускает исключения через цикл событий, поэтому ошибка соединения или обработчика
+ * передается в errorHandler, после чего получение сообщений останавливается.
+ */
+class QtConsumerNotifier
+{
+public:
+  using ErrorHandler = std::function<void(const std::string& error)>;
+
+  QtConsumerNotifier(std::shared_ptr<IRabbitmqConnection> connection, DeliveryHandler handler,
+                     ErrorHandler errorHandler,
+                     std::chrono::milliseconds pollInterval = std::chrono::milliseconds(100));
+  ~QtConsumerNotifier();
+
+  QtConsumerNotifier(const QtConsumerNotifier&) = delete;
+  QtConsumerNotifier& operator=(const QtConsumerNotifier&) = delete;
+
+  bool isActive() const {return m_active;}
+private:
+  void processMessages();
+  // Следит за текущим дескриптором соединения: после переподключения он меняется
+  void watchDescriptor();
+  void releaseNotifier();
+
+  std::shared_ptr<IRabbitmqConnection> m_connection;
+  DeliveryHandler m_handler;
+  ErrorHandler m_errorHandler;
+  const std::chrono::milliseconds m_pollInterval;
+  bool m_active = true;
+  std::unique_ptr<QSocketNotifier> m_notifier;
+  // опрос соединения без дескриптора и разбор кадров, уже прочитанных в буфер соединения
+  QTimer m_timer;
+};
+
+#endif
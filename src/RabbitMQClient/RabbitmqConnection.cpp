@@ -1,39 +1,81 @@
 #include "RabbitmqConnection.h"
 #include "rabbitmqEntities.h"
 #include "validation.h"
+#include "LoggingCategories.h"
+#include "Metrics.h"
 
 #include <QDebug>
 
-RabbitmqConnection::RabbitmqConnection(Private)
-  :m_connection(amqp_new_connection())
+#include <thread>
+
+namespace
+{
+  // Метрики общие для всех соединений процесса, ссылки получаются из реестра один раз
+  struct ConnectionMetrics
+  {
+    MetricCounter& publishedMessages = MetricsRegistry::instance().counter("rabbitmq_published_messages_total");
+    MetricCounter& publishedBytes = MetricsRegistry::instance().counter("rabbitmq_published_bytes_total");
+    MetricCounter& publishErrors = MetricsRegistry::instance().counter("rabbitmq_publish_errors_total");
+    LatencyHistogram& publishDuration = MetricsRegistry::instance().histogram("rabbitmq_publish_duration_microseconds");
+    MetricCounter& consumedMessages = MetricsRegistry::instance().counter("rabbitmq_consumed_messages_total");
+    MetricCounter& consumedBytes = MetricsRegistry::instance().counter("rabbitmq_consumed_bytes_total");
+    MetricCounter& consumeTimeouts = MetricsRegistry::instance().counter("rabbitmq_consume_timeouts_total");
+    MetricCounter& acks = MetricsRegistry::instance().counter("rabbitmq_acks_total");
+    MetricCounter& rejects = MetricsRegistry::instance().counter("rabbitmq_rejects_total");
+    MetricCounter& requeues = MetricsRegistry::instance().counter("rabbitmq_requeues_total");
+    MetricCounter& reconnects = MetricsRegistry::instance().counter("rabbitmq_reconnects_total");
+    MetricCounter& reconnectFailures = MetricsRegistry::instance().counter("rabbitmq_reconnect_failures_total");
+    MetricCounter& bufferedPublishes = MetricsRegistry::instance().counter("rabbitmq_buffered_publishes_total");
+  };
+
+  ConnectionMetrics& metrics()
+  {
+    static ConnectionMetrics connectionMetrics;
+    return connectionMetrics;
+  }
+}
+
+RabbitmqConnection::RabbitmqConnection(Private, const ConnectionRecoverySettings& recovery)
+  :m_connection(amqp_new_connection()), m_recovery(recovery), m_backoff(recovery)
 {
   if (!m_connection)
   {
     std::string msg("Failed to create AMQP connection");
-    qCritical() << QString::fromStdString(msg);
+    qCCritical(lcRabbitmq) << QString::fromStdString(msg);
     throw std::runtime_error(msg);
   }
   else
-    qInfo() << "Connection is open";
+    qCInfo(lcRabbitmq) << "Connection is open";
 }
 
 RabbitmqConnection::~RabbitmqConnection()
 {
-  amqp_rpc_reply_t repl = amqp_connection_close(m_connection, AMQP_REPLY_SUCCESS);
-  std::string msg = validation(repl, "Error closing connection");
-  if (msg.empty())
-    qInfo() << "Connection is closed";
+  // оборванное соединение закрывать уже нечем
+  if (!m_recovering)
+  {
+    amqp_rpc_reply_t repl = amqp_connection_close(m_connection, AMQP_REPLY_SUCCESS);
+    std::string msg = validation(repl, "Error closing connection");
+    if (msg.empty())
+      qCInfo(lcRabbitmq) << "Connection is closed";
+  }
+  if (!m_publishBuffer.empty())
+    qCWarning(lcRabbitmq) << "Connection is destroyed with" << m_publishBuffer.size() << "unsent publishes";
 
   int status = amqp_destroy_connection(m_connection);
   if (status != AMQP_STATUS_OK)
-    qCritical() << "Error destroying connection: " << amqp_error_string2(status);
+    qCCritical(lcRabbitmq) << "Error destroying connection: " << amqp_error_string2(status);
   else
-    qInfo() << "Connection is destroyed";
+    qCInfo(lcRabbitmq) << "Connection is destroyed";
 }
 
 std::shared_ptr<RabbitmqConnection> RabbitmqConnection::create()
 {
-  return std::make_shared<RabbitmqConnection>(Private());
+  return create(ConnectionRecoverySettings());
+}
+
+std::shared_ptr<RabbitmqConnection> RabbitmqConnection::create(const ConnectionRecoverySettings &recovery)
+{
+  return std::make_shared<RabbitmqConnection>(Private(), recovery);
 }
 
 std::shared_ptr<IRabbitmqConnection> RabbitmqConnection::share()
@@ -43,122 +85,430 @@ std::shared_ptr<IRabbitmqConnection> RabbitmqConnection::share()
 
 std::unique_ptr<RabbitmqSocket> RabbitmqConnection::openSocket(const std::string &host, int port)
 {
+  m_host = host;
+  m_port = port;
   return std::make_unique<RabbitmqSocket>(m_connection, host, port);
 }
 
 void RabbitmqConnection::login(const std::string &login, const std::string &password,
                                int heartbeatInSeconds, const std::string& vhost)
 {
-  auto repl = amqp_login(m_connection, vhost.c_str(), AMQP_DEFAULT_MAX_CHANNELS,
-                         AMQP_DEFAULT_FRAME_SIZE, heartbeatInSeconds,
-                         AMQP_SASL_METHOD_PLAIN, login.c_str(), password.c_str());
-  std::string msg = validation(repl, "Error login for user: " + login);
+  m_login = login;
+  m_password = password;
+  m_heartbeat = heartbeatInSeconds;
+  m_vhost = vhost;
+  loginOnBroker();
+}
+
+void RabbitmqConnection::loginOnBroker()
+{
+  auto repl = amqp_login(m_connection, m_vhost.c_str(), AMQP_DEFAULT_MAX_CHANNELS,
+                         AMQP_DEFAULT_FRAME_SIZE, m_heartbeat,
+                         AMQP_SASL_METHOD_PLAIN, m_login.c_str(), m_password.c_str());
+  std::string msg = validation(repl, "Error login for user: " + m_login);
   if (!msg.empty())
     throw std::runtime_error(msg);
   else
-    qInfo() << "Login has occurred for user: " << QString::fromStdString(login);
+    qCInfo(lcRabbitmq) << "Login has occurred for user: " << QString::fromStdString(m_login);
 }
 
 std::unique_ptr<RabbitmqChannel> RabbitmqConnection::openChannel()
 {
-  auto res = std::make_unique<RabbitmqChannel>(share(), m_connection, m_freeChannelId);
-  ++m_freeChannelId;
+  const amqp_channel_t channel = allocateChannelId();
+  try
+  {
+    openChannelOnBroker(channel);
+  }
+  catch (const std::exception&)
+  {
+    m_freeChannelIds.insert(channel);
+    throw;
+  }
+  const bool closeOnBroker = true;
+  auto res = std::make_unique<RabbitmqChannel>(share(), channel, closeOnBroker);
+  m_topology.recordChannel(channel);
   return res;
 }
 
+amqp_channel_t RabbitmqConnection::allocateChannelId()
+{
+  if (!m_freeChannelIds.empty())
+  {
+    const amqp_channel_t channel = *m_freeChannelIds.begin();
+    m_freeChannelIds.erase(m_freeChannelIds.begin());
+    return channel;
+  }
+
+  // 0 - брокер не ограничивает число каналов, номер канала при этом 16-битный
+  const int channelMax = amqp_get_channel_max(m_connection);
+  const int maxChannelId = channelMax > 0 ? channelMax : 65535;
+  if (m_freeChannelId == 0 || m_freeChannelId > maxChannelId)
+  {
+    std::string errorMsg = "No free channel ids: all " + std::to_string(maxChannelId) + " channels are open";
+    qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+    throw std::runtime_error(errorMsg);
+  }
+  return m_freeChannelId++;
+}
+
+void RabbitmqConnection::openChannelOnBroker(amqp_channel_t channel)
+{
+  amqp_channel_open(m_connection, channel);
+  auto repl = amqp_get_rpc_reply(m_connection);
+  std::string msg = validation(repl, "Error opening channel: " + std::to_string(channel));
+  if (!msg.empty())
+    throw std::runtime_error(msg);
+  else
+    qCInfo(lcRabbitmq) << "Channel opened successfully: " << channel;
+}
+
+void RabbitmqConnection::closeChannel(amqp_channel_t channel)
+{
+  m_topology.forgetChannel(channel);
+  // во время восстановления канала на брокере нет
+  if (!m_recovering)
+  {
+    auto repl = amqp_channel_close(m_connection, channel, AMQP_REPLY_SUCCESS);
+    std::string msg = validation(repl, "Error closing channel: " + std::to_string(channel));
+    if (msg.empty())
+      qCInfo(lcRabbitmq) << "Channel closed successfully: " << channel;
+  }
+  // номер освобождается после channel.close-ok: до него брокер считает канал открытым
+  m_freeChannelIds.insert(channel);
+  m_confirms.forgetChannel(channel);
+}
+
 std::unique_ptr<RabbitmqExchange> RabbitmqConnection::declareExchange(const RabbitmqChannel& channel,
                                                                       const std::string& exchangeName,
                                                                       const std::string& exchangeType)
 {
-  return std::make_unique<RabbitmqExchange>(share(), m_connection, channel.getId(), exchangeName, exchangeType);
+  auto exchange = std::make_unique<RabbitmqExchange>(share(), m_connection, channel.getId(), exchangeName, exchangeType);
+  m_topology.recordExchange(channel.getId(), exchangeName, exchangeType);
+  return exchange;
 }
 
 std::unique_ptr<RabbitmqQueue> RabbitmqConnection::declareQueue(const RabbitmqChannel &channel, const std::string &queueName)
 {
-  return std::make_unique<RabbitmqQueue>(share(), m_connection, channel.getId(), queueName);
+  auto queue = std::make_unique<RabbitmqQueue>(share(), m_connection, channel.getId(), queueName);
+  m_topology.recordQueue(channel.getId(), queueName);
+  return queue;
+}
+
+std::unique_ptr<RabbitmqQueue> RabbitmqConnection::declareExclusiveQueue(const RabbitmqChannel &channel)
+{
+  auto queue = std::make_unique<RabbitmqQueue>(share(), m_connection, channel.getId());
+  m_topology.recordExclusiveQueue(channel.getId(), queue->getName());
+  return queue;
 }
 
 std::unique_ptr<RabbitmqBind> RabbitmqConnection::bind(const RabbitmqChannel &channel, const RabbitmqQueue &queue,
                                                        const RabbitmqExchange &exchange, const std::string &bindingKey)
 {
-  return std::make_unique<RabbitmqBind>(share(), m_connection, channel.getId(), queue.getName(),
-                                        exchange.getName(), bindingKey);
+  auto binding = std::make_unique<RabbitmqBind>(share(), m_connection, channel.getId(),
+                                                m_topology.resolveQueueName(queue.getName()),
+                                                exchange.getName(), bindingKey);
+  m_topology.recordBind(channel.getId(), queue.getName(), exchange.getName(), bindingKey);
+  return binding;
+}
+
+void RabbitmqConnection::basicQos(const RabbitmqChannel &channel, uint16_t prefetchCount)
+{
+  basicQosOnBroker(channel.getId(), prefetchCount);
+  m_topology.recordQos(channel.getId(), prefetchCount);
+}
+
+void RabbitmqConnection::basicQosOnBroker(amqp_channel_t channel, uint16_t prefetchCount)
+{
+  const uint32_t prefetchSize = 0; // ограничение по размеру сообщений брокер не поддерживает
+  const bool global = false; // при false ограничение действует на каждого подписчика канала отдельно
+  amqp_basic_qos(m_connection, channel, prefetchSize, prefetchCount, global);
+  auto repl = amqp_get_rpc_reply(m_connection);
+  std::string msg = validation(repl, "Error setting prefetch count on channel: " + std::to_string(channel));
+  if (!msg.empty())
+    throw std::runtime_error(msg);
+  else
+    qCInfo(lcRabbitmq) << "Prefetch count" << prefetchCount << "set on channel:" << channel;
 }
 
 void RabbitmqConnection::basicConsume(const RabbitmqChannel &channel, const RabbitmqQueue &queue, bool noAsk, bool exclusive)
 {
-  qInfo() << "Preparing to consume from queue:" << QString::fromStdString(queue.getName())
-          << "on channel:" << channel.getId()
+  basicConsumeOnBroker(channel.getId(), m_topology.resolveQueueName(queue.getName()), noAsk, exclusive);
+  m_topology.recordConsume(channel.getId(), queue.getName(), noAsk, exclusive);
+}
+
+void RabbitmqConnection::basicConsumeOnBroker(amqp_channel_t channel, const std::string &queueName, bool noAsk, bool exclusive)
+{
+  qCInfo(lcRabbitmq) << "Preparing to consume from queue:" << QString::fromStdString(queueName)
+          << "on channel:" << channel
           << "with noAsk:" << noAsk
           << "and exclusive:" << exclusive;
 
   const amqp_bytes_t emptyTag = amqp_empty_bytes;
   const amqp_table_t emptyArgs = amqp_empty_table;
   const bool noLocal = true; // запрещает клиенту получать сообщения, которые он отправил сам
-  amqp_basic_consume(m_connection, channel.getId(),
-                     amqp_cstring_bytes(queue.getName().c_str()),
+  amqp_basic_consume(m_connection, channel,
+                     amqp_cstring_bytes(queueName.c_str()),
                      emptyTag, noLocal, noAsk, exclusive, emptyArgs);
   auto repl = amqp_get_rpc_reply(m_connection);
-  std::string msg = validation(repl, "Error consuming from queue: " + queue.getName());
+  std::string msg = validation(repl, "Error consuming from queue: " + queueName);
   if (!msg.empty())
   {
     throw std::runtime_error(msg);
   }
   else
-    qInfo() << "Successfully started consuming from queue: " << QString::fromStdString(queue.getName());
+    qCInfo(lcRabbitmq) << "Successfully started consuming from queue: " << QString::fromStdString(queueName);
+}
+
+void RabbitmqConnection::consumeDirectReplyTo(const RabbitmqChannel &channel)
+{
+  consumeDirectReplyToOnBroker(channel.getId());
+  m_topology.recordDirectReplyTo(channel.getId());
+}
+
+void RabbitmqConnection::consumeDirectReplyToOnBroker(amqp_channel_t channel)
+{
+  qCInfo(lcRabbitmq) << "Preparing to consume direct replies on channel:" << channel;
+
+  const amqp_bytes_t emptyTag = amqp_empty_bytes;
+  const amqp_table_t emptyArgs = amqp_empty_table;
+  const bool noLocal = false;
+  const bool noAsk = true; // брокер принимает подписку на direct reply-to только без подтверждений
+  const bool exclusive = false;
+  amqp_basic_consume(m_connection, channel,
+                     amqp_cstring_bytes(directReplyToQueue),
+                     emptyTag, noLocal, noAsk, exclusive, emptyArgs);
+  auto repl = amqp_get_rpc_reply(m_connection);
+  std::string msg = validation(repl, "Error consuming direct replies on channel: " + std::to_string(channel));
+  if (!msg.empty())
+    throw std::runtime_error(msg);
+  else
+    qCInfo(lcRabbitmq) << "Successfully started consuming direct replies on channel:" << channel;
+}
+
+void RabbitmqConnection::confirmSelect(const RabbitmqChannel &channel)
+{
+  confirmSelectOnBroker(channel.getId());
+  m_topology.recordConfirmSelect(channel.getId());
+}
+
+void RabbitmqConnection::confirmSelectOnBroker(amqp_channel_t channel)
+{
+  amqp_confirm_select(m_connection, channel);
+  auto repl = amqp_get_rpc_reply(m_connection);
+  std::string msg = validation(repl, "Error enabling publisher confirms on channel: " + std::to_string(channel));
+  if (!msg.empty())
+    throw std::runtime_error(msg);
+
+  // нумерация публикаций канала начинается заново, в том числе после переподключения
+  m_confirms.enable(channel);
+  qCInfo(lcRabbitmq) << "Publisher confirms enabled on channel:" << channel;
+}
+
+size_t RabbitmqConnection::getUnconfirmedCount() const
+{
+  return m_confirms.getUnconfirmedCount();
 }
 
 void RabbitmqConnection::publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
-                                        const RabbitmqBind& binding, std::string message)
+                                        const RabbitmqBind& binding, BytesView message)
+{
+  publish(channel.getId(), exchange.getName(), binding.getBindingKey(), message);
+}
+
+void RabbitmqConnection::publishMessage(const RabbitmqChannel &channel, const RabbitmqExchange &exchange,
+                                        const RabbitmqBind &binding, BytesView message,
+                                        const RabbitmqMessageProperties &properties)
+{
+  publish(channel.getId(), exchange.getName(), binding.getBindingKey(), message, &properties);
+}
+
+void RabbitmqConnection::publishToQueue(const RabbitmqChannel &channel, const std::string &queueName, BytesView message,
+                                        const RabbitmqMessageProperties &properties)
+{
+  const std::string defaultExchange; // обменник по умолчанию маршрутизирует сообщение в очередь с именем ключа
+  publish(channel.getId(), defaultExchange, queueName, message, &properties);
+}
+
+void RabbitmqConnection::publishMessage(const RabbitmqChannel &channel, const RabbitmqExchange &exchange,
+                                        const RabbitmqBind &binding, BytesView message,
+                                        const RabbitmqMessageProperties &properties, PublishConfirmCallback onConfirm)
+{
+  publish(channel.getId(), exchange.getName(), binding.getBindingKey(), message, &properties, std::move(onConfirm));
+}
+
+void RabbitmqConnection::publishToQueue(const RabbitmqChannel &channel, const std::string &queueName, BytesView message,
+                                        const RabbitmqMessageProperties &properties, PublishConfirmCallback onConfirm)
 {
+  const std::string defaultExchange;
+  publish(channel.getId(), defaultExchange, queueName, message, &properties, std::move(onConfirm));
+}
+
+void RabbitmqConnection::publishBatch(const RabbitmqChannel &channel, const RabbitmqExchange &exchange,
+                                      const RabbitmqBind &binding, const std::vector<BatchMessage> &messages)
+{
+  if (messages.empty())
+    return;
+
+  // имена строятся один раз на всю пачку
+  const amqp_bytes_t exchangeBytes = amqp_cstring_bytes(exchange.getName().c_str());
+  const amqp_bytes_t routingKeyBytes = amqp_cstring_bytes(binding.getBindingKey().c_str());
+
+  size_t published = 0;
+  try
+  {
+    for (const auto& message : messages)
+    {
+      publish(channel.getId(), exchangeBytes, routingKeyBytes, message.body, message.properties, PublishConfirmCallback());
+      ++published;
+    }
+  }
+  catch (const std::exception& e)
+  {
+    throw BatchPublishError(e.what(), published);
+  }
+  qCInfo(lcRabbitmq) << "Successfully published batch of" << messages.size() << "messages on channel:" << channel.getId();
+}
+
+void RabbitmqConnection::publish(amqp_channel_t channel, const std::string &exchangeName,
+                                 const std::string &routingKey, BytesView message,
+                                 const RabbitmqMessageProperties* properties, PublishConfirmCallback onConfirm)
+{
+  publish(channel, amqp_cstring_bytes(exchangeName.c_str()), amqp_cstring_bytes(routingKey.c_str()),
+          message, properties, std::move(onConfirm));
+}
+
+void RabbitmqConnection::publish(amqp_channel_t channel, amqp_bytes_t exchangeName, amqp_bytes_t routingKey,
+                                 BytesView message, const RabbitmqMessageProperties *properties,
+                                 PublishConfirmCallback onConfirm)
+{
+  // в режиме подтверждений брокер нумерует все публикации канала, поэтому учитывается каждая,
+  // даже если обработчик подтверждения не передан
+  const bool confirmMode = m_confirms.isEnabled(channel);
+  if (onConfirm && !confirmMode)
+  {
+    std::string errorMsg = "Publisher confirms are not enabled on channel: " + std::to_string(channel);
+    qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+    throw std::runtime_error(errorMsg);
+  }
+
+  if (m_recovering)
+  {
+    // попытка переподключения без ожидания, если подошло ее время
+    const auto now = std::chrono::steady_clock::now();
+    if (!recover(&now))
+    {
+      bufferPublish(channel, exchangeName, routingKey, message, properties, std::move(onConfirm));
+      return;
+    }
+  }
+
   const bool mandatory = true;
   const bool immediate = false;
 
+  // обменник по умолчанию маршрутизирует по имени очереди, а очередь с именем от брокера после переподключения
+  // называется иначе. Имя переводится при каждой отправке, в буфере остается исходное
+  amqp_bytes_t brokerRoutingKey = routingKey;
+  std::string resolvedQueueName;
+  if (exchangeName.len == 0)
+  {
+    const std::string queueName(static_cast<const char*>(routingKey.bytes), routingKey.len);
+    resolvedQueueName = m_topology.resolveQueueName(queueName);
+    brokerRoutingKey = amqp_cstring_bytes(resolvedQueueName.c_str());
+  }
+
   amqp_bytes_t bytes;
-  bytes.bytes = const_cast<char*>(message.c_str());
-  bytes.len = message.size();
+  bytes.bytes = const_cast<char*>(message.data);
+  bytes.len = message.size;
 
-  int status = amqp_basic_publish(m_connection, channel.getId(),
-                     amqp_cstring_bytes(exchange.getName().c_str()),
-                     amqp_cstring_bytes(binding.getBindingKey().c_str()),
-                     mandatory, immediate, nullptr,
+  amqp_basic_properties_t amqpProperties;
+  amqpProperties._flags = 0;
+  if (properties && !properties->replyTo.empty())
+  {
+    amqpProperties._flags |= AMQP_BASIC_REPLY_TO_FLAG;
+    // очередь ответов с именем от брокера после переподключения называется иначе
+    amqpProperties.reply_to = amqp_cstring_bytes(m_topology.resolveQueueName(properties->replyTo).c_str());
+  }
+  if (properties && !properties->correlationId.empty())
+  {
+    amqpProperties._flags |= AMQP_BASIC_CORRELATION_ID_FLAG;
+    amqpProperties.correlation_id = amqp_cstring_bytes(properties->correlationId.c_str());
+  }
+
+  const auto publishStart = std::chrono::steady_clock::now();
+  int status = amqp_basic_publish(m_connection, channel,
+                     exchangeName,
+                     brokerRoutingKey,
+                     mandatory, immediate, amqpProperties._flags ? &amqpProperties : nullptr,
                      bytes);
+  metrics().publishDuration.record(elapsedMicroseconds(publishStart));
+  // неотправленную публикацию брокер не нумерует
+  if (confirmMode && status == AMQP_STATUS_OK)
+    m_confirms.registerPublish(channel, std::move(onConfirm));
+
   if (status != AMQP_STATUS_OK)
   {
     std::string errorMsg = "Error publish message: ";
     errorMsg += amqp_error_string2(status);
-    qCritical() << QString::fromStdString(errorMsg);
-    throw std::runtime_error(errorMsg);
+    qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+    metrics().publishErrors.increment();
+    if (!m_recovery.enabled)
+      throw std::runtime_error(errorMsg);
+
+    startRecovery(errorMsg);
+    bufferPublish(channel, exchangeName, routingKey, message, properties, std::move(onConfirm));
   }
   else
-    qInfo() << "Successfully publish message:" << QString::fromStdString(message);
+  {
+    metrics().publishedMessages.increment();
+    metrics().publishedBytes.increment(message.size);
+    qCInfo(lcRabbitmq) << "Successfully publish message of" << message.size << "bytes on channel:" << channel;
+    // тело сообщения переводится в QString только при включенной трассировке
+    qCDebug(lcRabbitmqTrace) << "Published message:" << QString::fromUtf8(message.data, static_cast<int>(message.size));
+  }
 }
 
 void RabbitmqConnection::ack(const IRabbitmqEnvelope& envelope)
 {
+  if (isStaleDelivery(envelope))
+    return;
+
   const bool multipleAsk = false;
   int status = amqp_basic_ack(m_connection, envelope.getChannel(), envelope.getDeliveryTag(), multipleAsk);
   if (status != 0)
   {
     std::string errorMsg = "Failed to ack";
-    qCritical() << QString::fromStdString(errorMsg);
-    throw std::runtime_error(errorMsg);
+    qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+    if (!m_recovery.enabled)
+      throw std::runtime_error(errorMsg);
+    // брокер вернет неподтвержденное сообщение в очередь
+    startRecovery(errorMsg);
   }
   else
-    qInfo() << "Successfully ack";
+  {
+    metrics().acks.increment();
+    qCInfo(lcRabbitmq) << "Successfully ack";
+  }
 }
 
-void RabbitmqConnection::reject(const IRabbitmqEnvelope &envelope)
+void RabbitmqConnection::reject(const IRabbitmqEnvelope &envelope, bool requeue)
 {
-  const bool requeue = true;
+  if (isStaleDelivery(envelope))
+    return;
+
   int status = amqp_basic_reject(m_connection, envelope.getChannel(), envelope.getDeliveryTag(), requeue);
   if (status != 0)
   {
     std::string errorMsg = "Failed to reject";
-    qCritical() << QString::fromStdString(errorMsg);
-    throw std::runtime_error(errorMsg);
+    qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+    if (!m_recovery.enabled)
+      throw std::runtime_error(errorMsg);
+    startRecovery(errorMsg);
+    return;
   }
-    qInfo() << "Successfully reject";
+  metrics().rejects.increment();
+  if (requeue)
+    metrics().requeues.increment();
+  qCInfo(lcRabbitmq) << "Successfully reject";
 }
 
 std::unique_ptr<IRabbitmqEnvelope> RabbitmqConnection::consumeMessage()
@@ -178,25 +528,280 @@ std::unique_ptr<IRabbitmqEnvelope> RabbitmqConnection::timedConsumeMessage(std::
   return consumeMessageInternal(&timeout);
 }
 
+int RabbitmqConnection::getReadableFd() const
+{
+  if (m_recovering || !m_connection)
+    return -1;
+  return amqp_get_sockfd(m_connection);
+}
+
+bool RabbitmqConnection::hasBufferedFrames() const
+{
+  if (m_recovering || !m_connection)
+    return false;
+  // кадры, разобранные при ожидании ответа на синхронный метод, и непрочитанный остаток буфера сокета
+  return amqp_frames_enqueued(m_connection) || amqp_data_in_buffer(m_connection);
+}
+
 std::unique_ptr<IRabbitmqEnvelope> RabbitmqConnection::consumeMessageInternal(struct timeval* timeout)
 {
+  if (m_recovering)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout ? timeout->tv_sec : 0) +
+                          std::chrono::microseconds(timeout ? timeout->tv_usec : 0);
+    // таймаут уже потрачен на ожидание восстановления
+    if (!recover(timeout ? &deadline : nullptr) || timeout)
+      return nullptr;
+  }
+
   auto envelope = std::make_unique<RabbitmqEnvelope>();
-  amqp_maybe_release_buffers(m_connection);
+  envelope->setConnectionGeneration(m_generation);
+  // буферы соединения освобождаются только после того, как в них что-то прочитали:
+  // при простое каждый таймаут иначе освобождал бы и заново выделял страницы пула
+  if (m_buffersUsed)
+  {
+    amqp_maybe_release_buffers(m_connection);
+    m_buffersUsed = false;
+  }
 
   int unusedFlag = 0;
   auto repl = amqp_consume_message(m_connection, envelope->get(), timeout, unusedFlag);
 
   if (repl.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION && repl.library_error == AMQP_STATUS_TIMEOUT)
   {
-    qInfo() << "Timeout occurred while waiting for a message.";
+    // нулевой таймаут - опрос без ожидания при пакетной обработке, он истекает на каждой пачке и таймаутом не считается
+    if (timeout && (timeout->tv_sec != 0 || timeout->tv_usec != 0))
+    {
+      metrics().consumeTimeouts.increment();
+      qCDebug(lcRabbitmq) << "Timeout occurred while waiting for a message.";
+    }
+    return nullptr;
+  }
+  m_buffersUsed = true;
+
+  if (repl.reply_type != AMQP_RESPONSE_NORMAL)
+  {
+    std::string errorMsg;
+    bool connectionLost = false;
+    // вместо сообщения пришел другой кадр: подтверждение публикации, возврат сообщения или закрытие канала
+    if (repl.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION && repl.library_error == AMQP_STATUS_UNEXPECTED_STATE)
+      errorMsg = validationAfterConsumeMessage(m_connection, repl, "Failed consume message", &m_confirms, &connectionLost);
+    else
+    {
+      errorMsg = validation(repl, "Failed consume message");
+      // ошибка сокета, пропущенные heartbeat или connection.close от брокера
+      connectionLost = repl.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION ||
+                       (repl.reply_type == AMQP_RESPONSE_SERVER_EXCEPTION && repl.reply.id == AMQP_CONNECTION_CLOSE_METHOD);
+    }
+    if (!errorMsg.empty())
+    {
+      if (connectionLost && m_recovery.enabled)
+      {
+        startRecovery(errorMsg);
+        // без таймаута ожидание продолжается до восстановления и первого сообщения
+        return timeout ? nullptr : consumeMessageInternal(timeout);
+      }
+      // закрытие одного канала уже учтено при разборе кадра, остальные каналы живы
+      if (connectionLost)
+        m_confirms.failAll();
+      throw std::runtime_error(errorMsg);
+    }
     return nullptr;
   }
 
-  std::string errorMsg = validationAfterConsumeMessage(m_connection, repl, "Failed consume message");
-  if (!errorMsg.empty())
+  BytesView message = envelope->getMessageView();
+  metrics().consumedMessages.increment();
+  metrics().consumedBytes.increment(message.size);
+  qCInfo(lcRabbitmq) << "Successfully consumed message of" << message.size << "bytes";
+  qCDebug(lcRabbitmqTrace) << "Consumed message:" << QString::fromUtf8(message.data, static_cast<int>(message.size));
+
+  return envelope;
+}
+
+bool RabbitmqConnection::isStaleDelivery(const IRabbitmqEnvelope &envelope) const
+{
+  const RabbitmqEnvelope* rabbitmqEnvelope = dynamic_cast<const RabbitmqEnvelope*>(&envelope);
+  if (!m_recovering && (!rabbitmqEnvelope || rabbitmqEnvelope->getConnectionGeneration() == m_generation))
+    return false;
+
+  qCWarning(lcRabbitmq) << "Delivery" << envelope.getDeliveryTag()
+                        << "was received before reconnection and is not acknowledged, the broker has requeued it";
+  return true;
+}
+
+void RabbitmqConnection::startRecovery(const std::string &reason)
+{
+  if (m_recovering)
+    return;
+
+  qCWarning(lcRabbitmq) << "Connection to" << QString::fromStdString(m_host) << "port" << m_port << "is lost:"
+                        << QString::fromStdString(reason) << "- starting recovery";
+  m_recovering = true;
+  ++m_generation;
+  m_nextRecoveryAttempt = std::chrono::steady_clock::now();
+  // подтверждений публикаций прежнего подключения уже не будет
+  m_confirms.failAll();
+}
+
+bool RabbitmqConnection::recover(const std::chrono::steady_clock::time_point *deadline)
+{
+  while (m_recovering)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= m_nextRecoveryAttempt)
+    {
+      try
+      {
+        reconnect();
+        m_recovering = false;
+        qCInfo(lcRabbitmq) << "Connection recovered after" << m_backoff.getFailures() + 1 << "attempts,"
+                           << m_publishBuffer.size() << "buffered publishes to send";
+        m_backoff.reset();
+        metrics().reconnects.increment();
+        flushPublishBuffer();
+        continue;
+      }
+      catch (const std::exception& e)
+      {
+        metrics().reconnectFailures.increment();
+        const std::chrono::milliseconds delay = m_backoff.nextDelay();
+        m_nextRecoveryAttempt = std::chrono::steady_clock::now() + delay;
+        qCWarning(lcRabbitmq) << "Reconnection attempt" << m_backoff.getFailures() << "failed:" << e.what()
+                              << "- next attempt in" << delay.count() << "ms";
+        if (m_recovery.maxAttempts != 0 && m_backoff.getFailures() >= m_recovery.maxAttempts)
+        {
+          std::string errorMsg = "Connection recovery failed after " + std::to_string(m_backoff.getFailures()) +
+                                 " attempts: " + e.what();
+          m_backoff.reset();
+          qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+          throw std::runtime_error(errorMsg);
+        }
+      }
+      continue;
+    }
+
+    if (deadline && *deadline <= now)
+      return false;
+    std::this_thread::sleep_until(deadline ? std::min(*deadline, m_nextRecoveryAttempt) : m_nextRecoveryAttempt);
+  }
+  return true;
+}
+
+void RabbitmqConnection::reconnect()
+{
+  // состояние librabbitmq после обрыва или неудачной попытки не переиспользуется
+  amqp_destroy_connection(m_connection);
+  m_connection = amqp_new_connection();
+  if (!m_connection)
+    throw std::runtime_error("Failed to create AMQP connection");
+  m_buffersUsed = true;
+
+  // сокет принадлежит состоянию соединения и закрывается вместе с ним
+  RabbitmqSocket socket(m_connection, m_host, m_port);
+  loginOnBroker();
+  replayTopology();
+}
+
+void RabbitmqConnection::replayTopology()
+{
+  const std::vector<RecordedTopology::Entry> entries = m_topology.replayOrder();
+  // объявления закрытых каналов выполняются на первом открытом
+  amqp_channel_t anyChannel = 0;
+  for (const auto& entry : entries)
+    if (entry.kind == RecordedTopology::Kind::Channel && anyChannel == 0)
+      anyChannel = entry.channel;
+
+  for (const auto& entry : entries)
+  {
+    const amqp_channel_t channel = m_topology.hasChannel(entry.channel) ? entry.channel : anyChannel;
+    switch (entry.kind)
+    {
+    case RecordedTopology::Kind::Channel:
+      openChannelOnBroker(entry.channel);
+      break;
+    case RecordedTopology::Kind::Exchange:
+      if (channel != 0)
+        RabbitmqExchange(share(), m_connection, channel, entry.name, entry.argument);
+      break;
+    case RecordedTopology::Kind::Queue:
+      if (channel != 0)
+        RabbitmqQueue(share(), m_connection, channel, entry.name);
+      break;
+    case RecordedTopology::Kind::ExclusiveQueue:
+      if (channel != 0)
+      {
+        RabbitmqQueue queue(share(), m_connection, channel);
+        m_topology.renameQueue(entry.name, queue.getName());
+      }
+      break;
+    case RecordedTopology::Kind::Bind:
+      if (channel != 0)
+        RabbitmqBind(share(), m_connection, channel, m_topology.resolveQueueName(entry.name), entry.argument,
+                     entry.bindingKey);
+      break;
+    case RecordedTopology::Kind::Qos:
+      basicQosOnBroker(entry.channel, entry.prefetchCount);
+      break;
+    case RecordedTopology::Kind::Consume:
+      basicConsumeOnBroker(entry.channel, m_topology.resolveQueueName(entry.name), entry.noAck, entry.exclusive);
+      break;
+    case RecordedTopology::Kind::DirectReplyTo:
+      consumeDirectReplyToOnBroker(entry.channel);
+      break;
+    case RecordedTopology::Kind::ConfirmSelect:
+      confirmSelectOnBroker(entry.channel);
+      break;
+    }
+  }
+  qCInfo(lcRabbitmq) << "Topology replayed:" << entries.size() << "entries";
+}
+
+void RabbitmqConnection::bufferPublish(amqp_channel_t channel, amqp_bytes_t exchangeName, amqp_bytes_t routingKey,
+                                       BytesView message, const RabbitmqMessageProperties *properties,
+                                       PublishConfirmCallback onConfirm)
+{
+  if (m_publishBuffer.size() >= m_recovery.publishBufferCapacity)
+  {
+    std::string errorMsg = "Publish buffer is full while the connection is recovering: " +
+                           std::to_string(m_publishBuffer.size()) + " messages";
+    qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
     throw std::runtime_error(errorMsg);
+  }
+
+  BufferedPublish pending;
+  pending.channel = channel;
+  pending.exchangeName.assign(static_cast<const char*>(exchangeName.bytes), exchangeName.len);
+  pending.routingKey.assign(static_cast<const char*>(routingKey.bytes), routingKey.len);
+  pending.message.assign(message.data, message.size);
+  pending.hasProperties = properties != nullptr;
+  if (properties)
+    pending.properties = *properties;
+  pending.onConfirm = std::move(onConfirm);
+  metrics().bufferedPublishes.increment();
+
+  // публикация, которая не ушла при отправке буфера, возвращается в его начало
+  if (m_flushingBuffer)
+    m_publishBuffer.push_front(std::move(pending));
   else
-    qInfo() << "Successfully consumed message:" << QString::fromStdString(envelope->getMessage());
+    m_publishBuffer.push_back(std::move(pending));
+}
 
-  return envelope;
+void RabbitmqConnection::flushPublishBuffer()
+{
+  // флаг снимается и при исключении из publish, иначе следующие буферизованные публикации шли бы в начало буфера
+  struct FlushingGuard
+  {
+    bool& flushing;
+    ~FlushingGuard() {flushing = false;}
+  } guard{m_flushingBuffer};
+
+  m_flushingBuffer = true;
+  while (!m_publishBuffer.empty() && !m_recovering)
+  {
+    BufferedPublish pending = std::move(m_publishBuffer.front());
+    m_publishBuffer.pop_front();
+    publish(pending.channel, amqp_cstring_bytes(pending.exchangeName.c_str()),
+            amqp_cstring_bytes(pending.routingKey.c_str()), BytesView(pending.message),
+            pending.hasProperties ? &pending.properties : nullptr, std::move(pending.onConfirm));
+  }
 }
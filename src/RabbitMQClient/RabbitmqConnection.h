@@ -2,14 +2,31 @@
 #define RABBITMQCONNECTION_H
 
 #include "IRabbitmqConnection.h"
+#include "PublisherConfirms.h"
+#include "ConnectionRecovery.h"
 
 #include <amqp.h>
 
+#include <deque>
+#include <set>
+
+/**
+ * /brief Соединение с RabbitMQ через librabbitmq
+ *
+ * При включенном восстановлении (ConnectionRecoverySettings::enabled) обрыв соединения не приводит
+ * к исключению. Соединение переподключается с растущей паузой и заново объявляет записанную
+ * топологию: каналы, обменники, очереди, привязки, qos, подписки и режим подтверждений.
+ * Пока соединение восстанавливается:
+ * - публикации копируются в ограниченный буфер и отправляются после восстановления;
+ * - получение сообщений ждет восстановления не дольше своего таймаута;
+ * - подтверждения доставок прежнего подключения не отправляются: брокер уже вернул эти сообщения в очереди;
+ * - ожидающие подтверждения публикации считаются отклоненными.
+ */
 class RabbitmqConnection : public IRabbitmqConnection
 {
   class Private;
 public:
-  RabbitmqConnection(Private);
+  RabbitmqConnection(Private, const ConnectionRecoverySettings& recovery);
   virtual ~RabbitmqConnection();
 
   RabbitmqConnection (const RabbitmqConnection &) = delete;
@@ -19,6 +36,7 @@ public:
   RabbitmqConnection & operator=(RabbitmqConnection &&) = default;
 
   static std::shared_ptr<RabbitmqConnection> create();
+  static std::shared_ptr<RabbitmqConnection> create(const ConnectionRecoverySettings& recovery);
   std::shared_ptr<IRabbitmqConnection> share();
 
   std::unique_ptr<RabbitmqSocket> openSocket(const std::string &host, int port) override;
@@ -34,27 +52,121 @@ public:
 
   std::unique_ptr<RabbitmqQueue> declareQueue(const RabbitmqChannel& channel,
                                               const std::string& queueName) override;
+  std::unique_ptr<RabbitmqQueue> declareExclusiveQueue(const RabbitmqChannel& channel) override;
 
   std::unique_ptr<RabbitmqBind> bind(const RabbitmqChannel &channel, const RabbitmqQueue &queue,
                                      const RabbitmqExchange &exchange, const std::string &bindingKey) override;
 
+  void basicQos(const RabbitmqChannel &channel, uint16_t prefetchCount) override;
   void basicConsume(const RabbitmqChannel &channel, const RabbitmqQueue &queue, bool noAsk, bool exclusive) override;
+  void consumeDirectReplyTo(const RabbitmqChannel &channel) override;
 
+  void confirmSelect(const RabbitmqChannel& channel) override;
+  size_t getUnconfirmedCount() const override;
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message) override;
   void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
-                      const RabbitmqBind& binding, std::string message) override;
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties) override;
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties) override;
+  void publishBatch(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                    const RabbitmqBind& binding, const std::vector<BatchMessage>& messages) override;
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override;
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm) override;
 
   void ack(const IRabbitmqEnvelope &envelope) override;
-  void reject(const IRabbitmqEnvelope &envelope) override;
+  void reject(const IRabbitmqEnvelope &envelope, bool requeue) override;
 
   std::unique_ptr<IRabbitmqEnvelope> consumeMessage() override;
   std::unique_ptr<IRabbitmqEnvelope> timedConsumeMessage(std::chrono::milliseconds timeoutMillis) override;
 
+  // Сокет соединения; пока соединение восстанавливается, -1
+  int getReadableFd() const override;
+  uint64_t getConnectionGeneration() const override {return m_generation;}
+  bool hasBufferedFrames() const override;
+
+  // Закрывает канал и исключает его из восстанавливаемой топологии, номер канала выдается снова
+  void closeChannel(amqp_channel_t channel) override;
+
+  bool isRecovering() const {return m_recovering;}
+  size_t getBufferedPublishCount() const {return m_publishBuffer.size();}
+
 protected:
   std::unique_ptr<IRabbitmqEnvelope> consumeMessageInternal(struct timeval* timeout) override;
 
 private:
+  // Публикация, отложенная до восстановления соединения
+  struct BufferedPublish
+  {
+    amqp_channel_t channel = 0;
+    std::string exchangeName;
+    // для обменника по умолчанию - исходное имя очереди, текущее подставляется при отправке
+    std::string routingKey;
+    std::string message;
+    bool hasProperties = false;
+    RabbitmqMessageProperties properties;
+    PublishConfirmCallback onConfirm;
+  };
+
+  // Наименьший свободный номер канала в пределах channel_max, согласованного при входе
+  amqp_channel_t allocateChannelId();
+  void loginOnBroker();
+  void openChannelOnBroker(amqp_channel_t channel);
+  void basicQosOnBroker(amqp_channel_t channel, uint16_t prefetchCount);
+  void basicConsumeOnBroker(amqp_channel_t channel, const std::string& queueName, bool noAsk, bool exclusive);
+  void consumeDirectReplyToOnBroker(amqp_channel_t channel);
+  void confirmSelectOnBroker(amqp_channel_t channel);
+
+  // Запоминает обрыв и переводит соединение в режим восстановления
+  void startRecovery(const std::string& reason);
+  // Пытается восстановить соединение, ожидая не дольше deadline (nullptr - до восстановления).
+  // Бросает std::runtime_error после maxAttempts неудачных попыток подряд
+  bool recover(const std::chrono::steady_clock::time_point* deadline);
+  void reconnect();
+  void replayTopology();
+  void bufferPublish(amqp_channel_t channel, amqp_bytes_t exchangeName, amqp_bytes_t routingKey,
+                     BytesView message, const RabbitmqMessageProperties* properties,
+                     PublishConfirmCallback onConfirm);
+  void flushPublishBuffer();
+  // Подтверждение доставки, полученной до переподключения, отправлять нельзя
+  bool isStaleDelivery(const IRabbitmqEnvelope& envelope) const;
+
+  void publish(amqp_channel_t channel, const std::string& exchangeName,
+               const std::string& routingKey, BytesView message,
+               const RabbitmqMessageProperties* properties = nullptr,
+               PublishConfirmCallback onConfirm = PublishConfirmCallback());
+  void publish(amqp_channel_t channel, amqp_bytes_t exchangeName, amqp_bytes_t routingKey,
+               BytesView message, const RabbitmqMessageProperties* properties,
+               PublishConfirmCallback onConfirm);
+
   amqp_connection_state_t m_connection = nullptr;
   amqp_channel_t m_freeChannelId = 1;
+  // номера закрытых каналов меньше m_freeChannelId
+  std::set<amqp_channel_t> m_freeChannelIds;
+  PublisherConfirms m_confirms;
+  bool m_buffersUsed = true;
+
+  // Параметры подключения, нужные для переподключения
+  std::string m_host;
+  int m_port = 0;
+  std::string m_login;
+  std::string m_password;
+  int m_heartbeat = 0;
+  std::string m_vhost;
+
+  const ConnectionRecoverySettings m_recovery;
+  RecordedTopology m_topology;
+  RecoveryBackoff m_backoff;
+  bool m_recovering = false;
+  bool m_flushingBuffer = false;
+  uint64_t m_generation = 0;
+  std::chrono::steady_clock::time_point m_nextRecoveryAttempt;
+  std::deque<BufferedPublish> m_publishBuffer;
 
   struct Private{ explicit Private() = default; };
 };
@@ -0,0 +1,113 @@
+#include "SharedReader.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+const size_t SharedReader::maxFramesPerPump;
+const std::chrono::milliseconds SharedReader::pollSlice(10);
+
+namespace
+{
+  class ReaderGuard
+  {
+  public:
+    ReaderGuard(bool& readerActive, std::condition_variable& changed)
+      : m_readerActive(readerActive), m_changed(changed)
+    {
+      m_readerActive = true;
+    }
+    ~ReaderGuard()
+    {
+      m_readerActive = false;
+      m_changed.notify_all();
+    }
+  private:
+    bool& m_readerActive;
+    std::condition_variable& m_changed;
+  };
+}
+
+std::chrono::milliseconds remainingUntil(std::chrono::steady_clock::time_point deadline)
+{
+  const auto now = std::chrono::steady_clock::now();
+  if (deadline <= now)
+    return std::chrono::milliseconds(0);
+  return std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+}
+
+SharedReader::SharedReader(bool wakeable)
+{
+  if (!wakeable)
+    return;
+  m_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_wakeupFd < 0)
+    throw std::runtime_error(std::string("SharedReader: failed to create eventfd: ") + strerror(errno));
+}
+
+SharedReader::~SharedReader()
+{
+  if (m_wakeupFd >= 0)
+    close(m_wakeupFd);
+}
+
+void SharedReader::waitForFrames(IRabbitmqConnection& connection, std::unique_lock<std::mutex>& lock,
+                                 std::chrono::steady_clock::time_point deadline, const Router& route)
+{
+  if (!m_readerActive)
+    pump(connection, lock, deadline, route);
+  else if (deadline == std::chrono::steady_clock::time_point::max())
+    m_changed.wait(lock);
+  else
+    m_changed.wait_until(lock, deadline);
+}
+
+void SharedReader::wake()
+{
+  if (m_readerActive && m_wakeupFd >= 0)
+    eventfd_write(m_wakeupFd, 1);
+}
+
+void SharedReader::pump(IRabbitmqConnection& connection, std::unique_lock<std::mutex>& lock,
+                        std::chrono::steady_clock::time_point deadline, const Router& route)
+{
+  ReaderGuard guard(m_readerActive, m_changed);
+
+  const int fd = connection.getReadableFd();
+  if (fd < 0)
+  {
+    auto envelope = connection.timedConsumeMessage(std::min(remainingUntil(deadline), pollSlice));
+    if (envelope)
+      route(std::move(envelope));
+  }
+  else if (!connection.hasBufferedFrames())
+  {
+    // пока читатель ждет сокет, остальные потоки публикуют и подтверждают сообщения
+    const auto timeout = std::min<std::chrono::milliseconds::rep>(remainingUntil(deadline).count(), INT_MAX);
+    pollfd descriptors[2] = {{fd, POLLIN, 0}, {m_wakeupFd, POLLIN, 0}};
+    lock.unlock();
+    const int ready = poll(descriptors, m_wakeupFd < 0 ? 1 : 2, static_cast<int>(timeout));
+    if (ready > 0 && m_wakeupFd >= 0 && (descriptors[1].revents & POLLIN))
+    {
+      eventfd_t value = 0;
+      eventfd_read(m_wakeupFd, &value);
+    }
+    lock.lock();
+  }
+
+  for (size_t frame = 0; frame < maxFramesPerPump; ++frame)
+  {
+    auto envelope = connection.timedConsumeMessage(std::chrono::milliseconds(0));
+    if (envelope)
+      route(std::move(envelope));
+    else if (!connection.hasBufferedFrames())
+      break;
+  }
+}
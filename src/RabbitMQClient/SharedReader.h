@@ -0,0 +1,61 @@
+#ifndef SHAREDREADER_H
+#define SHAREDREADER_H
+
+#include "IRabbitmqConnection.h"
+#include "rabbitmqEntities.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Сколько осталось до deadline, ноль если он уже прошел
+std::chrono::milliseconds remainingUntil(std::chrono::steady_clock::time_point deadline);
+
+/**
+ * /brief Чтение соединения, которым пользуются несколько потоков (ChannelPool, ClientSession)
+ *
+ * Соединение librabbitmq не потокобезопасно: владелец обращается к нему под своим мьютексом, а кадры читает
+ * один поток за раз. Поток, которому нужны кадры, становится читателем, если соединение никто не читает,
+ * иначе ждет, пока читатель разложит кадры, и проверяет, не пришло ли ему сообщение.
+ * Читатель отпускает мьютекс на время ожидания сокета, чтобы остальные потоки публиковали и подтверждали
+ * сообщения, и разбирает не больше maxFramesPerPump кадров за пробуждение.
+ */
+class SharedReader
+{
+public:
+  using Router = std::function<void(std::unique_ptr<IRabbitmqEnvelope> envelope)>;
+
+  // Сколько кадров читатель разбирает за одно пробуждение, прежде чем отдать соединение другим потокам
+  static const size_t maxFramesPerPump = 64;
+  // Соединение без дескриптора читается под мьютексом, поэтому ожидание кадров делится на короткие отрезки
+  static const std::chrono::milliseconds pollSlice;
+
+  // wakeable - читателя, ждущего сокет, можно разбудить через wake()
+  explicit SharedReader(bool wakeable = false);
+  ~SharedReader();
+
+  SharedReader(const SharedReader&) = delete;
+  SharedReader& operator=(const SharedReader&) = delete;
+
+  /**
+   * /brief Ждет кадров соединения не дольше deadline
+   *
+   * Если соединение никто не читает, читает его сам и передает сообщения в route под мьютексом владельца,
+   * иначе ждет окончания чтения другим потоком. lock - захваченный мьютекс владельца соединения.
+   */
+  void waitForFrames(IRabbitmqConnection& connection, std::unique_lock<std::mutex>& lock,
+                     std::chrono::steady_clock::time_point deadline, const Router& route);
+  // Прерывает ожидание сокета читателем, чтобы соединение освободилось для других потоков. Вызывается под мьютексом
+  void wake();
+private:
+  void pump(IRabbitmqConnection& connection, std::unique_lock<std::mutex>& lock,
+            std::chrono::steady_clock::time_point deadline, const Router& route);
+
+  std::condition_variable m_changed;
+  bool m_readerActive = false;
+  int m_wakeupFd = -1;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+/**
+ * /brief Неограниченная очередь без блокировок: один писатель, один читатель
+ *
+ * Односвязный список с фиктивным первым узлом: писатель добавляет узлы в хвост, читатель
+ * снимает их с головы, и каждый из них меняет только свой конец списка. Переполниться очередь
+ * не может, поэтому медленный читатель не задерживает писателя.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+  SpscQueue() : m_head(new Node()), m_tail(m_head) {}
+
+  ~SpscQueue()
+  {
+    while (m_head)
+    {
+      Node* next = m_head->next.load(std::memory_order_relaxed);
+      delete m_head;
+      m_head = next;
+    }
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Вызывается только из потока писателя
+  void push(T&& value)
+  {
+    Node* node = new Node();
+    node->value = std::move(value);
+    m_tail->next.store(node, std::memory_order_release);
+    m_tail = node;
+  }
+
+  // Вызывается только из потока читателя. false, если очередь пуста
+  bool tryPop(T& value)
+  {
+    Node* next = m_head->next.load(std::memory_order_acquire);
+    if (!next)
+      return false;
+    value = std::move(next->value);
+    delete m_head;
+    m_head = next;
+    return true;
+  }
+
+  // Вызывается только из потока читателя
+  bool empty() const {return m_head->next.load(std::memory_order_acquire) == nullptr;}
+
+private:
+  struct Node
+  {
+    std::atomic<Node*> next{nullptr};
+    T value;
+  };
+
+  // голова принадлежит читателю, хвост - писателю
+  Node* m_head;
+  Node* m_tail;
+};
+
+#endif
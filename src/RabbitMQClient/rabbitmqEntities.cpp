@@ -1,59 +1,153 @@
 #include "rabbitmqEntities.h"
 #include "validation.h"
+#include "LoggingCategories.h"
 
 #include <QDebug>
 
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+  /**
+   * /brief Общий запас свободных блоков памяти под RabbitmqEnvelope
+   *
+   * Конверты обычно создаются в потоке чтения, а удаляются в потоках обработки: без общего запаса
+   * список потока чтения никогда бы не пополнялся, а списки обработчиков лежали бы заполненными.
+   * Потоки обмениваются с запасом пачками, поэтому мьютекс берется не на каждый конверт.
+   */
+  class EnvelopeDepot
+  {
+  public:
+    // Переносит в blocks до count блоков и возвращает их число
+    size_t take(void** blocks, size_t count)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const size_t taken = std::min(count, m_blocks.size());
+      std::copy(m_blocks.end() - taken, m_blocks.end(), blocks);
+      m_blocks.resize(m_blocks.size() - taken);
+      return taken;
+    }
+
+    // Принимает count блоков, не поместившиеся возвращает в кучу
+    void give(void* const* blocks, size_t count)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (m_blocks.size() < maxBlocks)
+          m_blocks.push_back(blocks[i]);
+        else
+          ::operator delete(blocks[i]);
+      }
+    }
+  private:
+    static const size_t maxBlocks = 1024;
+    std::mutex m_mutex;
+    std::vector<void*> m_blocks;
+  };
+
+  // Запас не уничтожается: конверты могут удаляться при завершении потоков после статических деструкторов
+  EnvelopeDepot& envelopeDepot()
+  {
+    static EnvelopeDepot* depot = new EnvelopeDepot;
+    return *depot;
+  }
+
+  /**
+   * /brief Список свободных блоков памяти под RabbitmqEnvelope, свой у каждого потока
+   *
+   * Пустой список берет пачку блоков из общего запаса, переполненный отдает пачку в запас.
+   * При завершении потока блоки возвращаются в запас, а конверты, удаляемые после этого
+   * (например, из деструкторов других thread_local объектов), освобождаются через кучу.
+   */
+  class EnvelopeFreeList
+  {
+  public:
+    ~EnvelopeFreeList()
+    {
+      envelopeDepot().give(m_blocks, m_count);
+      m_count = 0;
+      m_destroyed = true;
+    }
+
+    void* pop()
+    {
+      if (m_destroyed)
+        return nullptr;
+      if (m_count == 0)
+        m_count = envelopeDepot().take(m_blocks, transferBlocks);
+      return m_count > 0 ? m_blocks[--m_count] : nullptr;
+    }
+
+    bool push(void* block)
+    {
+      if (m_destroyed)
+        return false;
+      if (m_count == maxBlocks)
+      {
+        m_count -= transferBlocks;
+        envelopeDepot().give(m_blocks + m_count, transferBlocks);
+      }
+      m_blocks[m_count++] = block;
+      return true;
+    }
+  private:
+    // больше, чем prefetch одного канала, конвертов одновременно обычно не живет
+    static const size_t maxBlocks = 64;
+    static const size_t transferBlocks = maxBlocks / 2;
+    void* m_blocks[maxBlocks];
+    size_t m_count = 0;
+    bool m_destroyed = false;
+  };
+
+  thread_local EnvelopeFreeList envelopeFreeList;
+}
+
 RabbitmqSocket::RabbitmqSocket(amqp_connection_state_t connection, const std::string &host, int port)
   : m_socket(amqp_tcp_socket_new(connection))
 {
   if (!m_socket)
   {
     std::string msg = "Failed to create TCP socket for host: " + host + " on port: " + std::to_string(port);
-    qCritical() << QString::fromStdString(msg);
+    qCCritical(lcRabbitmq) << QString::fromStdString(msg);
     throw std::runtime_error(msg);
   }
   else
   {
-    qInfo() << "Creating TCP socket for host: " << QString::fromStdString(host) << " on port: " << port;
+    qCInfo(lcRabbitmq) << "Creating TCP socket for host: " << QString::fromStdString(host) << " on port: " << port;
     int status = amqp_socket_open(m_socket, host.c_str(), port);
     if (status != AMQP_STATUS_OK)
     {
       std::string msg = "Failed to open TCP socket for host: " + host + " on port: " + std::to_string(port);
       msg += amqp_error_string2(status);
-      qCritical() << QString::fromStdString(msg);
+      qCCritical(lcRabbitmq) << QString::fromStdString(msg);
       throw std::runtime_error(msg);
     }
     else
-      qInfo() << "TCP socket opened successfully for host: " << QString::fromStdString(host) << " on port: " << port;
+      qCInfo(lcRabbitmq) << "TCP socket opened successfully for host: " << QString::fromStdString(host) << " on port: " << port;
   }
 }
 
-RabbitmqChannel::RabbitmqChannel(std::shared_ptr<IRabbitmqConnection> connection,
-                amqp_connection_state_t amqpConnection, amqp_channel_t channel)
-  : m_connection(connection), m_AmqpConnection(amqpConnection), m_channel(channel)
+RabbitmqChannel::RabbitmqChannel(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel,
+                                 bool closeOnBroker)
+  : m_connection(connection), m_closeOnBroker(closeOnBroker), m_channel(channel)
 {
-  amqp_channel_open(m_AmqpConnection, m_channel);
-  auto repl = amqp_get_rpc_reply(m_AmqpConnection);
-  std::string msg = validation(repl, "Error opening channel: " + std::to_string(m_channel));
-  if (!msg.empty())
-    throw std::runtime_error(msg);
-  else
-    qInfo() << "Channel opened successfully: " << m_channel;
 }
 
 RabbitmqChannel::~RabbitmqChannel()
 {
+  if (!m_closeOnBroker)
+    return;
+
   auto shared = m_connection.lock();
   if (shared)
-  {
-    auto repl = amqp_channel_close(m_AmqpConnection, m_channel, AMQP_REPLY_SUCCESS);
-    std::string msg = validation(repl, "Error closing channel: " + std::to_string(m_channel));
-    if (msg.empty())
-      qInfo() << "Channel closed successfully: " << m_channel;
-  }
+    shared->closeChannel(m_channel);
   else
   {
-    qCritical() << "Error closing channel" << m_channel << ": undefined connection";
+    qCCritical(lcRabbitmq) << "Error closing channel" << m_channel << ": undefined connection";
   }
 }
 
@@ -61,7 +155,7 @@ RabbitmqExchange::RabbitmqExchange(std::shared_ptr<IRabbitmqConnection> connecti
                                    amqp_channel_t channel, const std::string& exchangeName, const std::string& exchangeType)
   : m_connection(connection), m_AmqpConnection(amqpConnection), m_channel(channel), m_ExchangeName(exchangeName)
 {
-  qInfo() << "Declaring exchange: " << QString::fromStdString(m_ExchangeName)
+  qCInfo(lcRabbitmq) << "Declaring exchange: " << QString::fromStdString(m_ExchangeName)
           << " of type: " << QString::fromStdString(exchangeType)
           << " on channel: " << m_channel;
 
@@ -80,13 +174,19 @@ RabbitmqExchange::RabbitmqExchange(std::shared_ptr<IRabbitmqConnection> connecti
   if (!msg.empty())
     throw std::runtime_error(msg);
   else
-    qInfo() << "Successfully declared exchange: " << QString::fromStdString(m_ExchangeName);
+    qCInfo(lcRabbitmq) << "Successfully declared exchange: " << QString::fromStdString(m_ExchangeName);
+}
+
+RabbitmqExchange::RabbitmqExchange(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel,
+                                   const std::string &exchangeName)
+  : m_connection(connection), m_channel(channel), m_ExchangeName(exchangeName)
+{
 }
 
 RabbitmqExchange::~RabbitmqExchange()
 {
   /*
-  qInfo() << "Deleting exchange:" << QString::fromStdString(m_ExchangeName) << "on channel:" << m_channel;
+  qCInfo(lcRabbitmq) << "Deleting exchange:" << QString::fromStdString(m_ExchangeName) << "on channel:" << m_channel;
 
   auto shared = m_connection.lock();
   if (shared)
@@ -96,11 +196,11 @@ RabbitmqExchange::~RabbitmqExchange()
     auto repl = amqp_get_rpc_reply(m_AmqpConnection);
     std::string msg = validation(repl, "Error deleting exchange: " + m_ExchangeName);
     if (msg.empty())
-      qInfo() << "Successfully deleted exchange:" << QString::fromStdString(m_ExchangeName);
+      qCInfo(lcRabbitmq) << "Successfully deleted exchange:" << QString::fromStdString(m_ExchangeName);
   }
   else
   {
-    qCritical() << "Error deleting exchange: " << QString::fromStdString(m_ExchangeName) << ": undefined connection";
+    qCCritical(lcRabbitmq) << "Error deleting exchange: " << QString::fromStdString(m_ExchangeName) << ": undefined connection";
   }
   */
 }
@@ -109,23 +209,49 @@ RabbitmqQueue::RabbitmqQueue(std::shared_ptr<IRabbitmqConnection> connection, am
                              amqp_channel_t channel, const std::string& queueName)
   : m_connection(connection), m_AmqpConnection(amqpConnection), m_channel(channel), m_QueueName(queueName)
 {
-  qInfo() << "Declaring queue: " << QString::fromStdString(m_QueueName) << " on channel: " << m_channel;
+  qCInfo(lcRabbitmq) << "Declaring queue: " << QString::fromStdString(m_QueueName) << " on channel: " << m_channel;
 
-  const bool existenceCheck = false; // при true будет проверка на существование очереди без её создания
   const bool durable = true; // при true очередь сохранится после перезагрузки брокера
-  const bool autoDelete = true; // при true очередь будет удалена, автоматически
   const bool exclusive = false; // при true не будет доступа для подключения у других клиентов
+  const bool autoDelete = true; // при true очередь будет удалена, автоматически
+  declare(durable, exclusive, autoDelete);
+}
+
+RabbitmqQueue::RabbitmqQueue(std::shared_ptr<IRabbitmqConnection> connection, amqp_connection_state_t amqpConnection,
+                             amqp_channel_t channel)
+  : m_connection(connection), m_AmqpConnection(amqpConnection), m_channel(channel)
+{
+  qCInfo(lcRabbitmq) << "Declaring server-named exclusive queue on channel: " << m_channel;
+
+  const bool durable = false; // очередь живет не дольше соединения, сохранять её нет смысла
+  const bool exclusive = true;
+  const bool autoDelete = true;
+  declare(durable, exclusive, autoDelete);
+}
+
+RabbitmqQueue::RabbitmqQueue(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel,
+                             const std::string &queueName)
+  : m_connection(connection), m_channel(channel), m_QueueName(queueName)
+{
+}
+
+void RabbitmqQueue::declare(bool durable, bool exclusive, bool autoDelete)
+{
+  const bool existenceCheck = false; // при true будет проверка на существование очереди без её создания
   const amqp_table_t emptyArgs = amqp_empty_table;
 
-  amqp_queue_declare(m_AmqpConnection, m_channel,
-                     amqp_cstring_bytes(m_QueueName.c_str()),
-                     existenceCheck, durable, exclusive, autoDelete, emptyArgs);
+  // при пустом имени имя очереди сгенерирует брокер
+  amqp_queue_declare_ok_t* declared = amqp_queue_declare(m_AmqpConnection, m_channel,
+                                                         amqp_cstring_bytes(m_QueueName.c_str()),
+                                                         existenceCheck, durable, exclusive, autoDelete, emptyArgs);
   auto repl = amqp_get_rpc_reply(m_AmqpConnection);
   std::string msg = validation(repl, "Error declaring queue: " + m_QueueName);
   if (!msg.empty())
     throw std::runtime_error(msg);
-  else
-    qInfo() << "Successfully declared queue: " << QString::fromStdString(m_QueueName);
+
+  if (m_QueueName.empty() && declared)
+    m_QueueName.assign(static_cast<const char*>(declared->queue.bytes), declared->queue.len);
+  qCInfo(lcRabbitmq) << "Successfully declared queue: " << QString::fromStdString(m_QueueName);
 }
 
 RabbitmqQueue::~RabbitmqQueue()
@@ -134,7 +260,7 @@ RabbitmqQueue::~RabbitmqQueue()
   auto shared = m_connection.lock();
   if (shared)
   {
-    qInfo() << "Deleting queue: " << QString::fromStdString(m_QueueName) << "on channel: " << m_channel;
+    qCInfo(lcRabbitmq) << "Deleting queue: " << QString::fromStdString(m_QueueName) << "on channel: " << m_channel;
 
     const bool onlyUnused = true; // Если установлено в true, очередь будет удалена только в том случае, если она не используется
     const bool onlyEmpty = true; // Если установлено в true, очередь может быть удалена только в том случае, если она пуста
@@ -142,11 +268,11 @@ RabbitmqQueue::~RabbitmqQueue()
     auto repl = amqp_get_rpc_reply(m_AmqpConnection);
     std::string msg = validation(repl, "Error deleting queue: " + m_QueueName);
     if (msg.empty())
-      qInfo() << "Successfully deleted queue:" << QString::fromStdString(m_QueueName);
+      qCInfo(lcRabbitmq) << "Successfully deleted queue:" << QString::fromStdString(m_QueueName);
   }
   else
   {
-    qCritical() << "Error deleting queue: " << QString::fromStdString(m_QueueName) << ": undefined connection";
+    qCCritical(lcRabbitmq) << "Error deleting queue: " << QString::fromStdString(m_QueueName) << ": undefined connection";
   }
   */
 }
@@ -157,7 +283,7 @@ RabbitmqBind::RabbitmqBind(std::shared_ptr<IRabbitmqConnection> connection, amqp
   : m_connection(connection), m_AmqpConnection(amqpConnection), m_channel(channel), m_QueueName(queueName),
     m_ExchangeName(exchangeName), m_BindingKey(bindingKey)
 {
-  qInfo() << "Binding queue: " << QString::fromStdString(m_QueueName)
+  qCInfo(lcRabbitmq) << "Binding queue: " << QString::fromStdString(m_QueueName)
           << " to exchange: " << QString::fromStdString(m_ExchangeName)
           << " with binding key: " << QString::fromStdString(m_BindingKey)
           << " on channel: " << m_channel;
@@ -174,13 +300,20 @@ RabbitmqBind::RabbitmqBind(std::shared_ptr<IRabbitmqConnection> connection, amqp
   if (!msg.empty())
     throw std::runtime_error(msg);
   else
-    qInfo() << "Successfully bound queue: " << QString::fromStdString(m_QueueName);
+    qCInfo(lcRabbitmq) << "Successfully bound queue: " << QString::fromStdString(m_QueueName);
+}
+
+RabbitmqBind::RabbitmqBind(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel,
+                           const std::string &queueName, const std::string &exchangeName, const std::string &bindingKey)
+  : m_connection(connection), m_channel(channel), m_QueueName(queueName),
+    m_ExchangeName(exchangeName), m_BindingKey(bindingKey)
+{
 }
 
 RabbitmqBind::~RabbitmqBind()
 {
   /*
-  qInfo() << "Unbinding queue: " << QString::fromStdString(m_QueueName)
+  qCInfo(lcRabbitmq) << "Unbinding queue: " << QString::fromStdString(m_QueueName)
           << " from exchange: " << QString::fromStdString(m_ExchangeName)
           << " with binding key: " << QString::fromStdString(m_BindingKey)
           << " on channel: " << m_channel;
@@ -198,15 +331,34 @@ RabbitmqBind::~RabbitmqBind()
     auto repl = amqp_get_rpc_reply(m_AmqpConnection);
     std::string msg = validation(repl, "Error unbinding: " + m_QueueName);
     if (msg.empty())
-      qInfo() << "Successfully unbound queue: " << QString::fromStdString(m_QueueName);
+      qCInfo(lcRabbitmq) << "Successfully unbound queue: " << QString::fromStdString(m_QueueName);
   }
   else
   {
-    qCritical() << "Error unbinding: undefined connection";
+    qCCritical(lcRabbitmq) << "Error unbinding: undefined connection";
   }
   */
 }
 
+void* RabbitmqEnvelope::operator new(size_t size)
+{
+  if (size == sizeof(RabbitmqEnvelope))
+  {
+    void* block = envelopeFreeList.pop();
+    if (block)
+      return block;
+  }
+  return ::operator new(size);
+}
+
+void RabbitmqEnvelope::operator delete(void* ptr, size_t size)
+{
+  if (!ptr)
+    return;
+  if (size != sizeof(RabbitmqEnvelope) || !envelopeFreeList.push(ptr))
+    ::operator delete(ptr);
+}
+
 RabbitmqEnvelope::~RabbitmqEnvelope()
 {
   amqp_destroy_envelope(&m_envelope);
@@ -219,3 +371,26 @@ std::string RabbitmqEnvelope::getMessage() const
 
   return std::string(static_cast<const char*>(m_envelope.message.body.bytes), m_envelope.message.body.len);
 }
+
+BytesView RabbitmqEnvelope::getMessageView() const
+{
+  return BytesView(static_cast<const char*>(m_envelope.message.body.bytes), m_envelope.message.body.len);
+}
+
+std::string RabbitmqEnvelope::getReplyTo() const
+{
+  const amqp_basic_properties_t& properties = m_envelope.message.properties;
+  if (!(properties._flags & AMQP_BASIC_REPLY_TO_FLAG) || properties.reply_to.bytes == nullptr)
+    return "";
+
+  return std::string(static_cast<const char*>(properties.reply_to.bytes), properties.reply_to.len);
+}
+
+std::string RabbitmqEnvelope::getCorrelationId() const
+{
+  const amqp_basic_properties_t& properties = m_envelope.message.properties;
+  if (!(properties._flags & AMQP_BASIC_CORRELATION_ID_FLAG) || properties.correlation_id.bytes == nullptr)
+    return "";
+
+  return std::string(static_cast<const char*>(properties.correlation_id.bytes), properties.correlation_id.len);
+}
@@ -2,11 +2,11 @@
 #define RABBITMQENTITIES_H
 
 #include "IRabbitmqConnection.h"
+#include "BytesView.h"
 
 #include <amqp.h>
 #include <amqp_tcp_socket.h>
 
-
 class RabbitmqSocket
 {
 public:
@@ -22,8 +22,10 @@ private:
 class RabbitmqChannel
 {
 public:
-  RabbitmqChannel(std::shared_ptr<IRabbitmqConnection> connection,
-                  amqp_connection_state_t amqpConnection, amqp_channel_t channel);
+  // Канал, уже открытый соединением. При closeOnBroker деструктор закрывает его через
+  // IRabbitmqConnection::closeChannel: после переподключения у соединения другое состояние librabbitmq,
+  // а номер канала тот же. Без closeOnBroker канал закрывает его владелец (например, ChannelPool).
+  RabbitmqChannel(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel, bool closeOnBroker = false);
   ~RabbitmqChannel();
 
   amqp_channel_t getId() const {return m_channel;}
@@ -32,7 +34,7 @@ public:
   RabbitmqChannel& operator=(const RabbitmqChannel&) = delete;
 private:
   std::weak_ptr<IRabbitmqConnection> m_connection;
-  amqp_connection_state_t m_AmqpConnection = nullptr;
+  const bool m_closeOnBroker = false;
   amqp_channel_t m_channel;
 };
 
@@ -41,12 +43,14 @@ class RabbitmqExchange
 public:
   RabbitmqExchange(std::shared_ptr<IRabbitmqConnection> connection, amqp_connection_state_t amqpConnection,
                    amqp_channel_t channel, const std::string& exchangeName, const std::string& exchangeType);
+  // Описывает уже объявленный обменник, к брокеру не обращается.
+  RabbitmqExchange(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel, const std::string& exchangeName);
   ~RabbitmqExchange();
 
   RabbitmqExchange(const RabbitmqChannel&) = delete;
   RabbitmqExchange& operator=(const RabbitmqChannel&) = delete;
 
-  std::string getName() const {return m_ExchangeName;}
+  const std::string& getName() const {return m_ExchangeName;}
 private:
   std::weak_ptr<IRabbitmqConnection> m_connection;
   amqp_connection_state_t m_AmqpConnection = nullptr;
@@ -59,13 +63,20 @@ class RabbitmqQueue
 public:
   RabbitmqQueue(std::shared_ptr<IRabbitmqConnection> connection, amqp_connection_state_t amqpConnection,
                 amqp_channel_t channel, const std::string& queueName);
+  // Эксклюзивная очередь с именем, которое выдает брокер. Удаляется вместе с соединением.
+  RabbitmqQueue(std::shared_ptr<IRabbitmqConnection> connection, amqp_connection_state_t amqpConnection,
+                amqp_channel_t channel);
+  // Описывает уже объявленную очередь, к брокеру не обращается.
+  RabbitmqQueue(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel, const std::string& queueName);
   ~RabbitmqQueue();
 
   RabbitmqQueue(const RabbitmqChannel&) = delete;
   RabbitmqQueue& operator=(const RabbitmqChannel&) = delete;
 
-  std::string getName() const {return m_QueueName;}
+  const std::string& getName() const {return m_QueueName;}
 private:
+  void declare(bool durable, bool exclusive, bool autoDelete);
+
   std::weak_ptr<IRabbitmqConnection> m_connection;
   amqp_connection_state_t m_AmqpConnection = nullptr;
   amqp_channel_t m_channel;
@@ -78,12 +89,15 @@ public:
   RabbitmqBind(std::shared_ptr<IRabbitmqConnection> connection, amqp_connection_state_t amqpConnection,
                amqp_channel_t channel, const std::string& queueName,
                const std::string& exchangeName, const std::string& bindingKey);
+  // Описывает уже созданную привязку, к брокеру не обращается.
+  RabbitmqBind(std::shared_ptr<IRabbitmqConnection> connection, amqp_channel_t channel, const std::string& queueName,
+               const std::string& exchangeName, const std::string& bindingKey);
   ~RabbitmqBind();
 
   RabbitmqBind(const RabbitmqChannel&) = delete;
   RabbitmqBind& operator=(const RabbitmqChannel&) = delete;
 
-  std::string getBindingKey() const {return m_BindingKey;}
+  const std::string& getBindingKey() const {return m_BindingKey;}
 private:
   std::weak_ptr<IRabbitmqConnection> m_connection;
   amqp_connection_state_t m_AmqpConnection = nullptr;
@@ -103,6 +117,12 @@ public:
   virtual amqp_channel_t getChannel() const = 0;
   virtual uint64_t getDeliveryTag() const = 0;
   virtual std::string getMessage() const = 0;
+  // Тело сообщения без копирования, действительно пока жив конверт
+  virtual BytesView getMessageView() const = 0;
+  // Значение свойства reply_to, пустая строка если свойство не задано
+  virtual std::string getReplyTo() const = 0;
+  // Значение свойства correlation_id, пустая строка если свойство не задано
+  virtual std::string getCorrelationId() const = 0;
 };
 
 class RabbitmqEnvelope : public IRabbitmqEnvelope
@@ -111,6 +131,11 @@ public:
   RabbitmqEnvelope() = default;
   ~RabbitmqEnvelope();
 
+  // Конверт создается на каждое ожидание сообщения, в том числе на каждый таймаут, поэтому
+  // память под конверты переиспользуется через пул потока, а не берется из кучи каждый раз
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
   RabbitmqEnvelope(const RabbitmqEnvelope&) = delete;
   RabbitmqEnvelope& operator=(const RabbitmqEnvelope&) = delete;
 
@@ -118,8 +143,17 @@ public:
   amqp_channel_t getChannel() const override {return m_envelope.channel;}
   uint64_t getDeliveryTag() const override {return m_envelope.delivery_tag;}
   std::string getMessage() const override;
+  BytesView getMessageView() const override;
+  std::string getReplyTo() const override;
+  std::string getCorrelationId() const override;
+
+  // Номер подключения RabbitmqConnection, в котором получено сообщение. Номер доставки
+  // действителен только в нем: после переподключения брокер нумерует доставки заново
+  void setConnectionGeneration(uint64_t generation) {m_connectionGeneration = generation;}
+  uint64_t getConnectionGeneration() const {return m_connectionGeneration;}
 private:
-  amqp_envelope_t m_envelope;
+  amqp_envelope_t m_envelope{}; // обнуление нужно, если amqp_consume_message не заполнил конверт
+  uint64_t m_connectionGeneration = 0;
 };
 
 #endif
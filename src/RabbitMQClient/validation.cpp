@@ -1,4 +1,6 @@
 #include "validation.h"
+#include "PublisherConfirms.h"
+#include "LoggingCategories.h"
 
 #include <QString>
 #include <QDebug>
@@ -49,11 +51,12 @@ std::string validation(const amqp_rpc_reply_t& reply, const std::string &context
     errorMsg += "unknown RPC reply type";
   }
 
-  qCritical() << QString::fromStdString(errorMsg);
+  qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
   return errorMsg;
 }
 
-std::string validationAfterConsumeMessage(amqp_connection_state_t connection, const amqp_rpc_reply_t& reply, const std::string &context)
+std::string validationAfterConsumeMessage(amqp_connection_state_t connection, const amqp_rpc_reply_t& reply, const std::string &context,
+                                          PublisherConfirms* confirms, bool* connectionLost)
 {
   amqp_frame_t frame;
   if (AMQP_RESPONSE_NORMAL != reply.reply_type)
@@ -66,7 +69,9 @@ std::string validationAfterConsumeMessage(amqp_connection_state_t connection, co
       if (AMQP_STATUS_OK != status)
       {
         std::string errorMsg = context + ": failed to wait for the next frame: " + amqp_error_string2(status);
-        qCritical() << QString::fromStdString(errorMsg);
+        qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+        if (connectionLost)
+          *connectionLost = true;
         return errorMsg;
       }
 
@@ -74,14 +79,14 @@ std::string validationAfterConsumeMessage(amqp_connection_state_t connection, co
       {
         if (frame.payload.method.id == AMQP_BASIC_RETURN_METHOD)
         {
-          qWarning() << QString::fromStdString(context) + ": the message was returned back";
+          qCWarning(lcRabbitmq) << QString::fromStdString(context) + ": the message was returned back";
           amqp_message_t message;
           auto ret = amqp_read_message(connection, frame.channel, &message, 0);
           amqp_destroy_message(&message);
           if (AMQP_RESPONSE_NORMAL != ret.reply_type)
           {
             std::string errorMsg = context + ": failed to read returned message";
-            qCritical() << QString::fromStdString(errorMsg);
+            qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
             return errorMsg;
           }
         }
@@ -89,22 +94,45 @@ std::string validationAfterConsumeMessage(amqp_connection_state_t connection, co
         else if (frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD)
         {
           std::string errorMsg = context + ": channel closed";
-          qCritical() << QString::fromStdString(errorMsg);
+          qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+          // подтверждений закрытого канала не будет, публикации остальных каналов продолжают их ждать
+          if (confirms)
+            confirms->forgetChannel(frame.channel);
           return errorMsg;
         }
 
         else if (frame.payload.method.id == AMQP_CONNECTION_CLOSE_METHOD)
         {
           std::string errorMsg = context + ": connection closed";
-          qCritical() << QString::fromStdString(errorMsg);
+          qCCritical(lcRabbitmq) << QString::fromStdString(errorMsg);
+          if (connectionLost)
+            *connectionLost = true;
           return errorMsg;
         }
 
-        else if (frame.payload.method.id != AMQP_BASIC_ACK_METHOD)
+        else if (frame.payload.method.id == AMQP_BASIC_ACK_METHOD)
+        {
+          if (confirms)
+          {
+            amqp_basic_ack_t* ack = reinterpret_cast<amqp_basic_ack_t*>(frame.payload.method.decoded);
+            confirms->handleAck(frame.channel, ack->delivery_tag, ack->multiple);
+          }
+        }
+
+        else if (frame.payload.method.id == AMQP_BASIC_NACK_METHOD)
+        {
+          if (confirms)
+          {
+            amqp_basic_nack_t* nack = reinterpret_cast<amqp_basic_nack_t*>(frame.payload.method.decoded);
+            confirms->handleNack(frame.channel, nack->delivery_tag, nack->multiple);
+          }
+        }
+
+        else
         {
           std::ostringstream oss;
           oss << context << ": unexpected method was received, id:" << std::hex << "0x" << frame.payload.method.id;
-          qCritical() << QString::fromStdString(oss.str());
+          qCCritical(lcRabbitmq) << QString::fromStdString(oss.str());
           return oss.str();
         }
       }
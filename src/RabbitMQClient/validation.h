@@ -5,6 +5,8 @@
 
 #include <string>
 
+class PublisherConfirms;
+
 /**
  * /brief Валидирует rpc reply
  *
@@ -23,11 +25,14 @@ std::string validation(const amqp_rpc_reply_t& reply, const std::string &context
  * /connection Объект соединения.
  * /param reply RPC ответ.
  * /param context Строка, которая описывает контекст вызова, будет предварять сообщение в случае ошибки.
+ * /param confirms Учет публикаций, которому передаются пришедшие basic.ack и basic.nack. Если nullptr, они игнорируются.
+ * /param connectionLost Если не nullptr, получает true, когда ошибка означает потерю соединения, а не только канала.
  *
  * Выводит сообщение об ошибках и предупреждения в лог.
  *
  * /return Строка, содержащая сообщение об ошибке. Пустая строка, если ошибок нет.
  */
-std::string validationAfterConsumeMessage(amqp_connection_state_t connection, const amqp_rpc_reply_t& reply, const std::string &context);
+std::string validationAfterConsumeMessage(amqp_connection_state_t connection, const amqp_rpc_reply_t& reply, const std::string &context,
+                                          PublisherConfirms* confirms = nullptr, bool* connectionLost = nullptr);
 
 #endif
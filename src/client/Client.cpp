@@ -1,17 +1,67 @@
 #include "Client.h"
 
 #include "protocol/Messages.pb.h"
+#include "RabbitMQClient/Metrics.h"
 
 #include <QDebug>
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
+
+Q_LOGGING_CATEGORY(lcClient, "client")
+
+const std::chrono::milliseconds Client::defaultRequestTimeout(30000);
+
+namespace
+{
+  struct ClientMetrics
+  {
+    MetricCounter& requests = MetricsRegistry::instance().counter("client_requests_total");
+    MetricCounter& responses = MetricsRegistry::instance().counter("client_responses_total");
+    MetricCounter& foreignResponses = MetricsRegistry::instance().counter("client_foreign_responses_total");
+    MetricCounter& requestTimeouts = MetricsRegistry::instance().counter("client_request_timeouts_total");
+    // от отправки запроса до получения ответа на него
+    LatencyHistogram& rpcLatency = MetricsRegistry::instance().histogram("client_rpc_latency_microseconds");
+
+    // этапы запроса по отметкам времени в сообщениях, см. Client::setLatencyTracingEnabled
+    LatencyHistogram& clientQueue = MetricsRegistry::instance().histogram("rpc_client_queue_microseconds");
+    LatencyHistogram& brokerTransit = MetricsRegistry::instance().histogram("rpc_broker_transit_microseconds");
+    LatencyHistogram& serverProcessing = MetricsRegistry::instance().histogram("rpc_server_processing_microseconds");
+    LatencyHistogram& returnTrip = MetricsRegistry::instance().histogram("rpc_return_trip_microseconds");
+  };
+
+  ClientMetrics& metrics()
+  {
+    static ClientMetrics clientMetrics;
+    return clientMetrics;
+  }
+
+  // при расхождении часов разных машин разность может оказаться отрицательной
+  uint64_t stageDuration(uint64_t from, uint64_t to)
+  {
+    return to > from ? to - from : 0;
+  }
+
+  void recordStageLatencies(const TestTask::Messages::Response& response, uint64_t receivedAtUs)
+  {
+    if (!response.has_client_send_time_us() || !response.has_server_send_time_us())
+      return;
+
+    metrics().clientQueue.record(stageDuration(response.client_create_time_us(), response.client_send_time_us()));
+    metrics().brokerTransit.record(stageDuration(response.client_send_time_us(), response.server_receive_time_us()));
+    metrics().serverProcessing.record(stageDuration(response.server_receive_time_us(), response.server_send_time_us()));
+    metrics().returnTrip.record(stageDuration(response.server_send_time_us(), receivedAtUs));
+  }
+}
 
 Client::Client(std::shared_ptr<IRabbitmqConnection> connection, const std::string& host, int port,
                const std::string& login, const std::string& password,
                int heartbeat, const std::string &vhost,
                const std::string& exchangeName,
-               const std::string& responseQueueName, const std::string& requestQueueName)
-  : m_connection(connection)
+               const std::string& responseQueueName, const std::string& requestQueueName,
+               ReplyMode replyMode)
+  : m_connection(connection), m_replyMode(replyMode)
 {
   m_id = QUuid::createUuid();
   m_socket = m_connection->openSocket(host, port);
@@ -19,63 +69,255 @@ Client::Client(std::shared_ptr<IRabbitmqConnection> connection, const std::strin
   m_channel = m_connection->openChannel();
 
   m_exchange = m_connection->declareExchange(*m_channel, exchangeName, "direct");
-  m_responseQueue = m_connection->declareQueue(*m_channel, responseQueueName);
   m_requestQueue = m_connection->declareQueue(*m_channel, requestQueueName);
-
-  m_responseBinding = m_connection->bind(*m_channel, *m_responseQueue, *m_exchange, responseQueueName);
   m_requestBinding = m_connection->bind(*m_channel, *m_requestQueue, *m_exchange, requestQueueName);
 
   const bool noAsk = false;
-  const bool exclusive = false;
-  m_connection->basicConsume(*m_channel, *m_responseQueue, noAsk, exclusive);
+  if (m_replyMode == ReplyMode::DirectReplyTo)
+  {
+    m_connection->consumeDirectReplyTo(*m_channel);
+  }
+  else if (m_replyMode == ReplyMode::ExclusiveQueue)
+  {
+    m_responseQueue = m_connection->declareExclusiveQueue(*m_channel);
+
+    const bool exclusive = true;
+    m_connection->basicConsume(*m_channel, *m_responseQueue, noAsk, exclusive);
+  }
+  else
+  {
+    m_responseQueue = m_connection->declareQueue(*m_channel, responseQueueName);
+    m_responseBinding = m_connection->bind(*m_channel, *m_responseQueue, *m_exchange, responseQueueName);
+
+    const bool exclusive = false;
+    m_connection->basicConsume(*m_channel, *m_responseQueue, noAsk, exclusive);
+  }
+}
+
+ReplyMode Client::replyModeFromString(const std::string &string)
+{
+  QString mode = QString::fromStdString(string).toLower();
+  if (mode == "shared")
+    return ReplyMode::SharedQueue;
+  else if (mode == "exclusive")
+    return ReplyMode::ExclusiveQueue;
+  else if (mode == "direct")
+    return ReplyMode::DirectReplyTo;
+  throw std::invalid_argument("Invalid reply mode: " + string);
 }
 
 void Client::sendRequest(int req)
+{
+  const uint64_t createdAtUs = m_latencyTracing ? wallClockMicroseconds() : 0;
+  const auto sentAt = std::chrono::steady_clock::now().time_since_epoch();
+  m_syncRequestSentAt = std::chrono::duration_cast<std::chrono::nanoseconds>(sentAt).count();
+  publishRequest(req, "", createdAtUs);
+}
+
+std::future<int> Client::sendRequestAsync(int req)
+{
+  const uint64_t createdAtUs = m_latencyTracing ? wallClockMicroseconds() : 0;
+  std::string correlationId = std::to_string(++m_lastCorrelationId);
+
+  std::future<int> result;
+  {
+    std::lock_guard<std::mutex> lock(m_inFlightMutex);
+    PendingRequest& pending = m_inFlight[correlationId];
+    pending.sentAt = std::chrono::steady_clock::now();
+    pending.deadline = pending.sentAt + m_requestTimeout.load();
+    m_nextExpiry = std::min(m_nextExpiry, pending.deadline);
+    result = pending.result.get_future();
+  }
+
+  try
+  {
+    publishRequest(req, correlationId, createdAtUs);
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lock(m_inFlightMutex);
+    m_inFlight.erase(correlationId);
+    throw;
+  }
+  return result;
+}
+
+size_t Client::getInFlightCount() const
+{
+  std::lock_guard<std::mutex> lock(m_inFlightMutex);
+  return m_inFlight.size();
+}
+
+size_t Client::expireRequests()
+{
+  std::vector<std::pair<std::string, PendingRequest>> expired;
+  {
+    std::lock_guard<std::mutex> lock(m_inFlightMutex);
+    const auto now = std::chrono::steady_clock::now();
+    // таблица обходится, только когда срок хотя бы одного запроса мог истечь
+    if (now < m_nextExpiry)
+      return 0;
+    m_nextExpiry = std::chrono::steady_clock::time_point::max();
+    for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
+    {
+      if (it->second.deadline > now)
+      {
+        m_nextExpiry = std::min(m_nextExpiry, it->second.deadline);
+        ++it;
+        continue;
+      }
+      expired.emplace_back(it->first, std::move(it->second));
+      it = m_inFlight.erase(it);
+    }
+  }
+
+  // продолжения future могут обращаться к клиенту, поэтому исключения выставляются без мьютекса
+  for (auto& request : expired)
+  {
+    const std::string errorMsg = "Client error: Request " + request.first + " timed out";
+    qCWarning(lcClient) << QString::fromStdString(errorMsg);
+    metrics().requestTimeouts.increment();
+    request.second.result.set_exception(std::make_exception_ptr(std::runtime_error(errorMsg)));
+  }
+  return expired.size();
+}
+
+void Client::publishRequest(int req, const std::string &correlationId, uint64_t createdAtUs)
 {
   TestTask::Messages::Request request;
   request.set_id(m_id.toString().toStdString());
   request.set_req(req);
-
-  std::string requestStr;
-  if (!request.SerializeToString(&requestStr))
+  if (!correlationId.empty())
+    request.set_correlation_id(correlationId);
+  if (createdAtUs != 0)
   {
-    std::string errorMsg = "Client error: Failed to serialize request message";
-    qCritical() << QString::fromStdString(errorMsg);
-    throw std::runtime_error(errorMsg);
+    request.set_client_create_time_us(createdAtUs);
+    request.set_client_send_time_us(wallClockMicroseconds());
   }
+
+  qCInfo(lcClient) << "Client sending request with ID:" << QString::fromStdString(request.id()) << "and value:" << request.req();
+
+  RabbitmqMessageProperties properties;
+  properties.correlationId = correlationId;
+  if (m_replyMode == ReplyMode::DirectReplyTo)
+    properties.replyTo = directReplyToQueue;
+  // адрес передается в свойстве, а не в теле запроса: после переподключения у эксклюзивной очереди новое имя,
+  // и соединение подставляет его при публикации
+  else if (m_replyMode == ReplyMode::ExclusiveQueue)
+    properties.replyTo = m_responseQueue->getName();
+
+  const BytesView body = serializeToBuffer(request, m_requestBuffer);
+  if (!properties.replyTo.empty() || !properties.correlationId.empty())
+    m_connection->publishMessage(*m_channel, *m_exchange, *m_requestBinding, body, properties);
   else
-    qInfo() << "Client sending request with ID:" << QString::fromStdString(request.id()) << "and value:" << request.req();
+    m_connection->publishMessage(*m_channel, *m_exchange, *m_requestBinding, body);
+  qCInfo(lcClient) << "Client request with ID:" << QString::fromStdString(request.id()) << "successfully published.";
+  metrics().requests.increment();
+}
 
-  m_connection->publishMessage(*m_channel, *m_exchange, *m_requestBinding, requestStr);
-  qInfo() << "Client request with ID:" << QString::fromStdString(request.id()) << "successfully published.";
+void Client::completeRequest(const std::string &correlationId, int res)
+{
+  metrics().responses.increment();
+  if (correlationId.empty())
+  {
+    recordSyncRequestLatency();
+    return;
+  }
+
+  PendingRequest completed;
+  {
+    std::lock_guard<std::mutex> lock(m_inFlightMutex);
+    auto it = m_inFlight.find(correlationId);
+    if (it == m_inFlight.end())
+    {
+      qCWarning(lcClient) << "Client received response for unknown correlation ID:" << QString::fromStdString(correlationId);
+      return;
+    }
+    completed = std::move(it->second);
+    m_inFlight.erase(it);
+  }
+
+  // как и в expireRequests, результат выставляется без мьютекса
+  metrics().rpcLatency.record(elapsedMicroseconds(completed.sentAt));
+  completed.result.set_value(res);
+}
+
+void Client::recordSyncRequestLatency()
+{
+  // ответ на синхронный запрос учитывается один раз, повторные ответы не искажают задержку
+  const int64_t sentAt = m_syncRequestSentAt.exchange(0);
+  if (sentAt == 0)
+    return;
+  const auto sentTime = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(sentAt));
+  metrics().rpcLatency.record(elapsedMicroseconds(sentTime));
 }
 
 std::pair<bool, int> Client::getResponse(std::chrono::milliseconds timeoutMillis)
 {
   auto envelope = m_connection->timedConsumeMessage(timeoutMillis);
   if (!envelope)
+  {
+    expireRequests();
     return {false, 0};
+  }
+  return processResponse(std::move(envelope));
+}
+
+std::pair<bool, int> Client::processResponse(std::unique_ptr<IRabbitmqEnvelope> envelope)
+{
+  const uint64_t receivedAtUs = wallClockMicroseconds();
+  // ответ, пришедший после срока, уже не завершит свой запрос
+  expireRequests();
 
   TestTask::Messages::Response response;
-  if (!response.ParseFromString(envelope->getMessage()))
+  BytesView message = envelope->getMessageView();
+  if (!response.ParseFromArray(message.data, static_cast<int>(message.size)))
   {
     std::string errorMsg = "Client error: Failed to parse response message";
-    qCritical() << QString::fromStdString(errorMsg);
+    qCCritical(lcClient) << QString::fromStdString(errorMsg);
     throw std::runtime_error(errorMsg);
   }
   else
-    qInfo() << "Client received response for ID:" << QString::fromStdString(response.id()) << "with result:" << response.res();
+    qCInfo(lcClient) << "Client received response for ID:" << QString::fromStdString(response.id()) << "with result:" << response.res();
+
+  std::string correlationId = envelope->getCorrelationId();
+  if (correlationId.empty() && response.has_correlation_id())
+    correlationId = response.correlation_id();
+
+  if (m_replyMode == ReplyMode::DirectReplyTo)
+  {
+    // прямые ответы приходят без подтверждения, вернуть их брокеру нельзя
+    if (response.id() == m_id.toString().toStdString())
+    {
+      recordStageLatencies(response, receivedAtUs);
+      completeRequest(correlationId, response.res());
+      return {true, response.res()};
+    }
 
-  if (response.id() == m_id.toString().toStdString())
+    metrics().foreignResponses.increment();
+    qCWarning(lcClient) << "Client dropped foreign response for request ID:" << QString::fromStdString(response.id());
+  }
+  else if (response.id() == m_id.toString().toStdString())
   {
     m_connection->ack(*envelope);
-    qInfo() << "Client acknowledged response for request ID:" << QString::fromStdString(response.id());
+    qCInfo(lcClient) << "Client acknowledged response for request ID:" << QString::fromStdString(response.id());
+    recordStageLatencies(response, receivedAtUs);
+    completeRequest(correlationId, response.res());
     return {true, response.res()};
   }
+  else if (m_replyMode == ReplyMode::ExclusiveQueue)
+  {
+    // в собственную очередь чужой ответ попасть не должен, возвращать его брокеру бессмысленно
+    m_connection->ack(*envelope);
+    metrics().foreignResponses.increment();
+    qCWarning(lcClient) << "Client dropped foreign response for request ID:" << QString::fromStdString(response.id());
+  }
   else
   {
-    m_connection->reject(*envelope);
-    qInfo() << "Client rejected response for request ID:" << QString::fromStdString(response.id());
+    const bool requeue = true; // ответ предназначен другому клиенту общей очереди
+    m_connection->reject(*envelope, requeue);
+    metrics().foreignResponses.increment();
+    qCInfo(lcClient) << "Client rejected response for request ID:" << QString::fromStdString(response.id());
   }
   return {false, 0};
 }
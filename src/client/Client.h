@@ -4,8 +4,32 @@
 #include "RabbitMQClient/IRabbitmqConnection.h"
 #include "RabbitMQClient/rabbitmqEntities.h"
 
+#include <QLoggingCategory>
 #include <QUuid>
 
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+Q_DECLARE_LOGGING_CATEGORY(lcClient)
+
+/**
+ * /brief Способ доставки ответов клиенту
+ *
+ * SharedQueue - все клиенты читают общую очередь ответов, чужие ответы возвращаются брокеру.
+ * ExclusiveQueue - клиент объявляет собственную эксклюзивную очередь и передает её имя в свойстве reply_to
+ *                  сообщения, сервер отвечает прямо в неё.
+ * DirectReplyTo - ответы приходят через псевдо-очередь amq.rabbitmq.reply-to без объявления очередей,
+ *                 адрес ответа передается в свойстве reply_to сообщения.
+ */
+enum class ReplyMode
+{
+  SharedQueue,
+  ExclusiveQueue,
+  DirectReplyTo
+};
+
 class Client
 {
 public:
@@ -14,14 +38,66 @@ public:
          const std::string& login, const std::string& password,
          int heartbeat, const std::string& vhost,
          const std::string& exchangeName,
-         const std::string& responseQueueName, const std::string& requestQueueName);
+         const std::string& responseQueueName, const std::string& requestQueueName,
+         ReplyMode replyMode = ReplyMode::SharedQueue);
   ~Client() = default;
 
   QUuid getId() const {return m_id;}
+  ReplyMode getReplyMode() const {return m_replyMode;}
+
+  static ReplyMode replyModeFromString(const std::string& string);
 
   void sendRequest(int req);
   std::pair<bool, int> getResponse(std::chrono::milliseconds timeoutMillis);
+  // Разбирает уже полученный ответ, например доставленный QtConsumerNotifier
+  std::pair<bool, int> processResponse(std::unique_ptr<IRabbitmqEnvelope> envelope);
+
+  std::shared_ptr<IRabbitmqConnection> getConnection() const {return m_connection;}
+
+  /**
+   * /brief Отправляет запрос, не дожидаясь ответов на предыдущие
+   *
+   * Запросу назначается собственный correlation_id, по которому ответ сопоставляется с вызовом.
+   * Ответы разбираются в getResponse, который нужно вызывать, пока есть незавершенные запросы.
+   * Если ответ не пришел за время setRequestTimeout, future получает исключение std::runtime_error.
+   *
+   * /return future, в котором появится результат запроса.
+   */
+  std::future<int> sendRequestAsync(int req);
+  size_t getInFlightCount() const;
+
+  // Время ожидания ответа на асинхронный запрос, по умолчанию defaultRequestTimeout
+  void setRequestTimeout(std::chrono::milliseconds timeout) {m_requestTimeout = timeout;}
+  std::chrono::milliseconds getRequestTimeout() const {return m_requestTimeout;}
+  static const std::chrono::milliseconds defaultRequestTimeout;
+
+  /**
+   * /brief Завершает ошибкой запросы, ответ на которые не пришел вовремя
+   *
+   * Вызывается из getResponse и processResponse; при чтении ответов через QtConsumerNotifier
+   * её нужно вызывать и по таймеру, иначе без входящих сообщений просроченные запросы не завершатся.
+   * Опоздавший ответ на завершенный запрос считается ответом с неизвестным correlation_id.
+   *
+   * /return количество завершенных запросов.
+   */
+  size_t expireRequests();
+
+  /**
+   * /brief Включает трассировку задержек запросов
+   *
+   * Запрос несет время создания и отправки, сервер добавляет в ответ время получения и отправки.
+   * По ответу клиент записывает гистограммы этапов: rpc_client_queue_microseconds (формирование запроса),
+   * rpc_broker_transit_microseconds (брокер и ожидание в очереди сервера), rpc_server_processing_microseconds
+   * и rpc_return_trip_microseconds (обратный путь, включая возвраты чужих ответов общей очереди).
+   * Этапы между процессами считаются по системным часам, поэтому на разных машинах часы должны быть синхронизированы.
+   */
+  void setLatencyTracingEnabled(bool enabled) {m_latencyTracing = enabled;}
+  bool isLatencyTracingEnabled() const {return m_latencyTracing;}
 private:
+  void publishRequest(int req, const std::string& correlationId, uint64_t createdAtUs);
+  void completeRequest(const std::string& correlationId, int res);
+  void recordSyncRequestLatency();
+
   std::shared_ptr<IRabbitmqConnection> m_connection;
   std::unique_ptr<RabbitmqSocket> m_socket;
   std::unique_ptr<RabbitmqChannel> m_channel;
@@ -33,6 +109,26 @@ private:
   std::unique_ptr<RabbitmqBind> m_requestBinding;
 
   QUuid m_id;
+  ReplyMode m_replyMode;
+  std::atomic<bool> m_latencyTracing{false};
+  // запросы сериализуются в один буфер: клиент публикует из одного потока за раз
+  std::string m_requestBuffer;
+
+  struct PendingRequest
+  {
+    std::promise<int> result;
+    std::chrono::steady_clock::time_point sentAt;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  std::atomic<uint64_t> m_lastCorrelationId{0};
+  mutable std::mutex m_inFlightMutex;
+  std::unordered_map<std::string, PendingRequest> m_inFlight;
+  // ближайший срок среди незавершенных запросов, раньше него expireRequests не обходит таблицу
+  std::chrono::steady_clock::time_point m_nextExpiry = std::chrono::steady_clock::time_point::max();
+  std::atomic<std::chrono::milliseconds> m_requestTimeout{defaultRequestTimeout};
+  // время отправки последнего запроса без correlation_id, в наносекундах steady_clock; 0 - ответ уже получен
+  std::atomic<int64_t> m_syncRequestSentAt{0};
 };
 
 #endif
@@ -0,0 +1,389 @@
+#include "ClientSession.h"
+
+#include "protocol/Messages.pb.h"
+
+#include <QDebug>
+
+#include <sys/time.h>
+
+#include <stdexcept>
+
+namespace
+{
+  std::logic_error unsupported(const std::string& operation)
+  {
+    return std::logic_error("Client session channel is shared by all its clients: " + operation + " is not supported");
+  }
+}
+
+/**
+ * /brief Логическое соединение клиента сессии
+ *
+ * Сокета, логина и собственного канала нет: openChannel выдает общий канал сессии, а объявления
+ * возвращают уже объявленные сессией обменник, очереди и привязки, не обращаясь к брокеру.
+ * Публикации, ack и reject выполняются на соединении сессии под ее мьютексом, ответы клиенту
+ * сессия кладет в его очередь.
+ */
+class SessionEndpoint : public IRabbitmqConnection
+{
+public:
+  SessionEndpoint(std::shared_ptr<ClientSession> session, std::shared_ptr<ClientSession::EndpointState> state)
+    : m_session(std::move(session)), m_state(std::move(state))
+  {
+  }
+
+  ~SessionEndpoint() override
+  {
+    m_session->release(m_state);
+  }
+
+  std::unique_ptr<RabbitmqSocket> openSocket(const std::string&, int) override
+  {
+    return nullptr;
+  }
+
+  void login(const std::string&, const std::string&, int, const std::string&) override
+  {
+  }
+
+  std::unique_ptr<RabbitmqChannel> openChannel() override
+  {
+    // канал закрывает сессия
+    return std::make_unique<RabbitmqChannel>(shared_from_this(), sessionChannel().getId());
+  }
+
+  std::unique_ptr<RabbitmqExchange> declareExchange(const RabbitmqChannel& channel, const std::string& exchangeName,
+                                                    const std::string&) override
+  {
+    checkChannel(channel);
+    if (exchangeName != m_session->m_exchange->getName())
+      throw std::invalid_argument("Exchange " + exchangeName + " is not declared by the client session");
+    return std::make_unique<RabbitmqExchange>(shared_from_this(), channel.getId(), exchangeName);
+  }
+
+  std::unique_ptr<RabbitmqQueue> declareQueue(const RabbitmqChannel& channel, const std::string& queueName) override
+  {
+    checkChannel(channel);
+    const bool responseQueue = m_session->m_responseBinding && queueName == m_session->m_responseQueue->getName();
+    if (queueName != m_session->m_requestQueue->getName() && !responseQueue)
+      throw std::invalid_argument("Queue " + queueName + " is not declared by the client session");
+    return std::make_unique<RabbitmqQueue>(shared_from_this(), channel.getId(), queueName);
+  }
+
+  // Клиенты делят эксклюзивную очередь сессии, ответы в ней различаются по идентификатору клиента
+  std::unique_ptr<RabbitmqQueue> declareExclusiveQueue(const RabbitmqChannel& channel) override
+  {
+    checkChannel(channel);
+    if (m_session->m_settings.replyMode != ReplyMode::ExclusiveQueue)
+      throw std::logic_error("Client session does not use an exclusive reply queue");
+    return std::make_unique<RabbitmqQueue>(shared_from_this(), channel.getId(), m_session->m_responseQueue->getName());
+  }
+
+  std::unique_ptr<RabbitmqBind> bind(const RabbitmqChannel& channel, const RabbitmqQueue& queue,
+                                     const RabbitmqExchange& exchange, const std::string& bindingKey) override
+  {
+    checkChannel(channel);
+    const bool responseBinding = m_session->m_responseBinding && bindingKey == m_session->m_responseBinding->getBindingKey();
+    if (bindingKey != m_session->m_requestBinding->getBindingKey() && !responseBinding)
+      throw std::invalid_argument("Binding " + bindingKey + " is not created by the client session");
+    return std::make_unique<RabbitmqBind>(shared_from_this(), channel.getId(), queue.getName(), exchange.getName(),
+                                          bindingKey);
+  }
+
+  void basicQos(const RabbitmqChannel&, uint16_t) override
+  {
+    throw unsupported("basic.qos");
+  }
+
+  // Очередь ответов читает подписчик сессии
+  void basicConsume(const RabbitmqChannel& channel, const RabbitmqQueue& queue, bool, bool) override
+  {
+    checkChannel(channel);
+    if (!m_session->m_responseQueue || queue.getName() != m_session->m_responseQueue->getName())
+      throw std::invalid_argument("Client session does not consume queue " + queue.getName());
+  }
+
+  void consumeDirectReplyTo(const RabbitmqChannel& channel) override
+  {
+    checkChannel(channel);
+    if (m_session->m_settings.replyMode != ReplyMode::DirectReplyTo)
+      throw std::logic_error("Client session does not consume direct replies");
+  }
+
+  void confirmSelect(const RabbitmqChannel&) override
+  {
+    throw unsupported("confirm.select");
+  }
+
+  size_t getUnconfirmedCount() const override
+  {
+    return 0;
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message) override
+  {
+    auto lock = lockSession(channel);
+    connection().publishMessage(sessionChannel(), exchange, binding, message);
+  }
+
+  void publishMessage(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                      const RabbitmqBind& binding, BytesView message,
+                      const RabbitmqMessageProperties& properties) override
+  {
+    auto lock = lockSession(channel);
+    connection().publishMessage(sessionChannel(), exchange, binding, message, properties);
+  }
+
+  void publishToQueue(const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+                      const RabbitmqMessageProperties& properties) override
+  {
+    auto lock = lockSession(channel);
+    connection().publishToQueue(sessionChannel(), queueName, message, properties);
+  }
+
+  void publishBatch(const RabbitmqChannel& channel, const RabbitmqExchange& exchange,
+                    const RabbitmqBind& binding, const std::vector<BatchMessage>& messages) override
+  {
+    auto lock = lockSession(channel);
+    connection().publishBatch(sessionChannel(), exchange, binding, messages);
+  }
+
+  void publishMessage(const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&, BytesView,
+                      const RabbitmqMessageProperties&, PublishConfirmCallback) override
+  {
+    throw unsupported("publishing with confirms");
+  }
+
+  void publishToQueue(const RabbitmqChannel&, const std::string&, BytesView,
+                      const RabbitmqMessageProperties&, PublishConfirmCallback) override
+  {
+    throw unsupported("publishing with confirms");
+  }
+
+  void ack(const IRabbitmqEnvelope& envelope) override
+  {
+    std::lock_guard<std::mutex> lock(m_session->m_mutex);
+    connection().ack(envelope);
+  }
+
+  void reject(const IRabbitmqEnvelope& envelope, bool requeue) override
+  {
+    std::lock_guard<std::mutex> lock(m_session->m_mutex);
+    connection().reject(envelope, requeue);
+  }
+
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessage() override
+  {
+    return consumeMessageInternal(nullptr);
+  }
+
+  std::unique_ptr<IRabbitmqEnvelope> timedConsumeMessage(std::chrono::milliseconds timeoutMillis) override
+  {
+    struct timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeoutMillis.count() / 1000);
+    timeout.tv_usec = static_cast<suseconds_t>((timeoutMillis.count() % 1000) * 1000);
+    return consumeMessageInternal(&timeout);
+  }
+
+  // дескриптора у клиента нет: кадры соединения читает тот клиент сессии, который сейчас ждет ответов
+  bool hasBufferedFrames() const override
+  {
+    std::lock_guard<std::mutex> lock(m_session->m_mutex);
+    return !m_state->inbox.empty();
+  }
+
+protected:
+  std::unique_ptr<IRabbitmqEnvelope> consumeMessageInternal(struct timeval* timeout) override
+  {
+    const auto deadline = timeout ? std::chrono::steady_clock::now() + std::chrono::seconds(timeout->tv_sec) +
+                                    std::chrono::microseconds(timeout->tv_usec)
+                                  : std::chrono::steady_clock::time_point::max();
+    return m_session->receive(*m_state, deadline);
+  }
+
+private:
+  void checkChannel(const RabbitmqChannel& channel) const
+  {
+    if (channel.getId() != sessionChannel().getId())
+      throw std::invalid_argument("Channel " + std::to_string(channel.getId()) + " does not belong to the client session");
+  }
+
+  std::unique_lock<std::mutex> lockSession(const RabbitmqChannel& channel) const
+  {
+    checkChannel(channel);
+    return std::unique_lock<std::mutex>(m_session->m_mutex);
+  }
+
+  IRabbitmqConnection& connection() const {return *m_session->m_connection;}
+  const RabbitmqChannel& sessionChannel() const {return *m_session->m_channel;}
+
+  std::shared_ptr<ClientSession> m_session;
+  std::shared_ptr<ClientSession::EndpointState> m_state;
+};
+
+ClientSession::ClientSession(Private, std::shared_ptr<IRabbitmqConnection> connection,
+                             const ClientSessionSettings& settings)
+  : m_settings(settings), m_connection(std::move(connection))
+{
+}
+
+ClientSession::~ClientSession() = default;
+
+std::shared_ptr<ClientSession> ClientSession::create(std::shared_ptr<IRabbitmqConnection> connection,
+                                                     const ClientSessionSettings& settings)
+{
+  auto session = std::make_shared<ClientSession>(Private(), std::move(connection), settings);
+  session->declareTopology();
+  return session;
+}
+
+void ClientSession::declareTopology()
+{
+  m_socket = m_connection->openSocket(m_settings.host, m_settings.port);
+  m_connection->login(m_settings.login, m_settings.password, m_settings.heartbeat, m_settings.vhost);
+  m_channel = m_connection->openChannel();
+
+  m_exchange = m_connection->declareExchange(*m_channel, m_settings.exchangeName, "direct");
+  m_requestQueue = m_connection->declareQueue(*m_channel, m_settings.requestQueueName);
+  m_requestBinding = m_connection->bind(*m_channel, *m_requestQueue, *m_exchange, m_settings.requestQueueName);
+
+  const bool noAsk = false;
+  if (m_settings.replyMode == ReplyMode::DirectReplyTo)
+  {
+    m_connection->consumeDirectReplyTo(*m_channel);
+  }
+  else if (m_settings.replyMode == ReplyMode::ExclusiveQueue)
+  {
+    m_responseQueue = m_connection->declareExclusiveQueue(*m_channel);
+
+    const bool exclusive = true;
+    m_connection->basicConsume(*m_channel, *m_responseQueue, noAsk, exclusive);
+  }
+  else
+  {
+    m_responseQueue = m_connection->declareQueue(*m_channel, m_settings.responseQueueName);
+    m_responseBinding = m_connection->bind(*m_channel, *m_responseQueue, *m_exchange, m_settings.responseQueueName);
+
+    const bool exclusive = false;
+    m_connection->basicConsume(*m_channel, *m_responseQueue, noAsk, exclusive);
+  }
+  qCInfo(lcClient) << "Client session declared topology on channel" << m_channel->getId();
+}
+
+std::unique_ptr<Client> ClientSession::createClient()
+{
+  auto state = std::make_shared<EndpointState>();
+  auto endpoint = std::make_shared<SessionEndpoint>(shared_from_this(), state);
+  auto client = std::make_unique<Client>(endpoint,
+                                         m_settings.host, m_settings.port,
+                                         m_settings.login, m_settings.password,
+                                         m_settings.heartbeat, m_settings.vhost,
+                                         m_settings.exchangeName,
+                                         m_settings.responseQueueName, m_settings.requestQueueName,
+                                         m_settings.replyMode);
+
+  // ответов клиенту еще нет: запросы он отправит после регистрации
+  state->clientId = client->getId().toString().toStdString();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_endpoints[state->clientId] = state;
+  return client;
+}
+
+size_t ClientSession::getClientCount() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_endpoints.size();
+}
+
+std::unique_ptr<IRabbitmqEnvelope> ClientSession::receive(EndpointState& state,
+                                                          std::chrono::steady_clock::time_point deadline)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  bool attempted = false;
+  while (true)
+  {
+    if (!state.inbox.empty())
+    {
+      auto envelope = std::move(state.inbox.front());
+      state.inbox.pop_front();
+      return envelope;
+    }
+    if (attempted && std::chrono::steady_clock::now() >= deadline)
+      return nullptr;
+
+    m_reader.waitForFrames(*m_connection, lock, deadline,
+                           [this](std::unique_ptr<IRabbitmqEnvelope> envelope) { route(std::move(envelope)); });
+    attempted = true;
+  }
+}
+
+void ClientSession::route(std::unique_ptr<IRabbitmqEnvelope> envelope)
+{
+  // клиент разберет ответ еще раз, но сообщения короткие, а отдельный адрес ответа на клиента
+  // потребовал бы своей очереди или подписки, от которых сессия и избавляет
+  TestTask::Messages::Response response;
+  BytesView message = envelope->getMessageView();
+  if (!response.ParseFromArray(message.data, static_cast<int>(message.size)))
+  {
+    dropUnrouted(*envelope, false);
+    return;
+  }
+
+  auto it = m_endpoints.find(response.id());
+  if (it == m_endpoints.end())
+  {
+    dropUnrouted(*envelope, true);
+    return;
+  }
+  it->second->inbox.push_back(std::move(envelope));
+}
+
+void ClientSession::dropUnrouted(const IRabbitmqEnvelope& envelope, bool parsed)
+{
+  if (!parsed)
+    qCCritical(lcClient) << "Client session failed to parse response" << envelope.getDeliveryTag();
+
+  // прямые ответы приходят без подтверждения, вернуть их брокеру нельзя
+  if (m_settings.replyMode == ReplyMode::DirectReplyTo)
+  {
+    qCWarning(lcClient) << "Client session dropped response" << envelope.getDeliveryTag() << "for unknown client";
+  }
+  else if (m_settings.replyMode == ReplyMode::SharedQueue && parsed)
+  {
+    const bool requeue = true; // ответ предназначен клиенту другого процесса
+    m_connection->reject(envelope, requeue);
+    qCInfo(lcClient) << "Client session rejected response" << envelope.getDeliveryTag() << "for unknown client";
+  }
+  else
+  {
+    const bool requeue = false;
+    m_connection->reject(envelope, requeue);
+    qCWarning(lcClient) << "Client session dropped response" << envelope.getDeliveryTag() << "for unknown client";
+  }
+}
+
+void ClientSession::release(const std::shared_ptr<EndpointState>& state)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_endpoints.find(state->clientId);
+  if (it != m_endpoints.end() && it->second == state)
+    m_endpoints.erase(it);
+
+  // неразобранные ответы удаленного клиента никому не нужны: возвращенные брокеру, они ходили бы по кругу
+  if (m_settings.replyMode != ReplyMode::DirectReplyTo)
+  {
+    for (const auto& envelope : state->inbox)
+    {
+      try
+      {
+        m_connection->ack(*envelope);
+      }
+      catch (const std::exception& e)
+      {
+        qCWarning(lcClient) << "Client session failed to ack response of released client:" << e.what();
+      }
+    }
+  }
+  state->inbox.clear();
+}
@@ -0,0 +1,104 @@
+#ifndef CLIENTSESSION_H
+#define CLIENTSESSION_H
+
+#include "Client.h"
+#include "RabbitMQClient/SharedReader.h"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class SessionEndpoint;
+
+struct ClientSessionSettings
+{
+  std::string host = "localhost";
+  int port = 5672;
+  std::string login = "guest";
+  std::string password = "guest";
+  int heartbeat = 0;
+  std::string vhost = "/";
+  std::string exchangeName;
+  std::string responseQueueName;
+  std::string requestQueueName;
+  // Все клиенты сессии получают ответы одним способом через одного подписчика
+  ReplyMode replyMode = ReplyMode::SharedQueue;
+};
+
+/**
+ * /brief Общие соединение, канал и топология для множества клиентов одного процесса
+ *
+ * Конструктор Client открывает сокет, выполняет логин, открывает канал, объявляет обменник, очереди и привязки
+ * и подписывается на ответы: около семи синхронных обращений к брокеру на каждого клиента. Сессия делает это один раз
+ * при создании, а createClient() выдает клиента, который работает через легковесное логическое соединение сессии
+ * и к брокеру при создании не обращается. Так можно быстро поднять тысячи клиентов для нагрузочного теста
+ * или множество виджетов в одном интерфейсе.
+ *
+ * Клиенты публикуют запросы в общий канал, ответы приходят одному подписчику сессии (общая очередь, эксклюзивная
+ * очередь сессии или amq.rabbitmq.reply-to) и раскладываются по клиентам по идентификатору в ответе. Ответ клиенту,
+ * которого нет в сессии, обрабатывается так же, как чужой ответ в Client: из общей очереди возвращается брокеру,
+ * из эксклюзивной очереди и прямой ответ отбрасываются.
+ *
+ * Соединение librabbitmq не потокобезопасно, поэтому обращения клиентов к нему выполняются под мьютексом сессии.
+ * Кадры соединения читает один поток за раз, остальные клиенты ждут своих ответов, не занимая соединение.
+ * Клиенты можно использовать из разных потоков, но каждого клиента - из одного потока за раз.
+ * Соединение передается в сессию до openSocket и login и дальше используется только через нее.
+ */
+class ClientSession : public std::enable_shared_from_this<ClientSession>
+{
+  class Private;
+public:
+  ClientSession(Private, std::shared_ptr<IRabbitmqConnection> connection, const ClientSessionSettings& settings);
+  ~ClientSession();
+
+  ClientSession(const ClientSession&) = delete;
+  ClientSession& operator=(const ClientSession&) = delete;
+
+  // Подключается к брокеру и объявляет топологию клиентов
+  static std::shared_ptr<ClientSession> create(std::shared_ptr<IRabbitmqConnection> connection,
+                                               const ClientSessionSettings& settings);
+
+  // Клиент на соединении сессии. Сессия живет, пока жив хотя бы один ее клиент
+  std::unique_ptr<Client> createClient();
+
+  const ClientSessionSettings& getSettings() const {return m_settings;}
+  size_t getClientCount() const;
+private:
+  friend class SessionEndpoint;
+
+  struct EndpointState
+  {
+    std::string clientId;
+    std::deque<std::unique_ptr<IRabbitmqEnvelope>> inbox;
+  };
+
+  void declareTopology();
+  std::unique_ptr<IRabbitmqEnvelope> receive(EndpointState& state, std::chrono::steady_clock::time_point deadline);
+  // Раскладывает ответ, прочитанный с соединения, по клиентам
+  void route(std::unique_ptr<IRabbitmqEnvelope> envelope);
+  void dropUnrouted(const IRabbitmqEnvelope& envelope, bool parsed);
+  void release(const std::shared_ptr<EndpointState>& state);
+
+  const ClientSessionSettings m_settings;
+  std::shared_ptr<IRabbitmqConnection> m_connection;
+  std::unique_ptr<RabbitmqSocket> m_socket;
+  std::unique_ptr<RabbitmqChannel> m_channel;
+
+  std::unique_ptr<RabbitmqExchange> m_exchange;
+  std::unique_ptr<RabbitmqQueue> m_requestQueue;
+  std::unique_ptr<RabbitmqBind> m_requestBinding;
+  // очередь ответов сессии: общая или эксклюзивная, при DirectReplyTo не объявляется
+  std::unique_ptr<RabbitmqQueue> m_responseQueue;
+  std::unique_ptr<RabbitmqBind> m_responseBinding;
+
+  mutable std::mutex m_mutex;
+  SharedReader m_reader;
+  std::unordered_map<std::string, std::shared_ptr<EndpointState>> m_endpoints;
+
+  struct Private{ explicit Private() = default; };
+};
+
+#endif
@@ -20,6 +20,7 @@ ConfigDialog::ConfigDialog(std::shared_ptr<ConfigManager> configManager, QWidget
   m_requestQueueEdit = new QLineEdit(m_configManager->getRequestQueueName(), this);
   m_responseQueueEdit = new QLineEdit(m_configManager->getResponseQueueName(), this);
   m_heartbeatEdit = new QLineEdit(QString::number(m_configManager->getHeartbeat()), this);
+  m_replyModeEdit = new QLineEdit(m_configManager->getReplyMode(), this);
 
   m_loggingEnabledCheckbox = new QCheckBox("Включить логирование", this);
   m_loggingEnabledCheckbox->setChecked(m_configManager->isLoggingEnabled());
@@ -45,14 +46,16 @@ ConfigDialog::ConfigDialog(std::shared_ptr<ConfigManager> configManager, QWidget
   layout->addWidget(m_responseQueueEdit, 7, 1);
   layout->addWidget(new QLabel("Heartbeat:"), 8, 0);
   layout->addWidget(m_heartbeatEdit, 8, 1);
-  layout->addWidget(m_loggingEnabledCheckbox, 9, 0, 1, 2);
-  layout->addWidget(new QLabel("Путь к лог-файлу:"), 10, 0);
-  layout->addWidget(m_logFilePathEdit, 10, 1);
-  layout->addWidget(new QLabel("Уровень логирования:"), 11, 0);
-  layout->addWidget(m_logLevelEdit, 11, 1);
+  layout->addWidget(new QLabel("Режим ответов (shared/exclusive/direct):"), 9, 0);
+  layout->addWidget(m_replyModeEdit, 9, 1);
+  layout->addWidget(m_loggingEnabledCheckbox, 10, 0, 1, 2);
+  layout->addWidget(new QLabel("Путь к лог-файлу:"), 11, 0);
+  layout->addWidget(m_logFilePathEdit, 11, 1);
+  layout->addWidget(new QLabel("Уровень логирования:"), 12, 0);
+  layout->addWidget(m_logLevelEdit, 12, 1);
 
   QPushButton *saveButton = new QPushButton("Сохранить", this);
-  layout->addWidget(saveButton, 12, 0, 1, 2);
+  layout->addWidget(saveButton, 13, 0, 1, 2);
 
   connect(saveButton, &QPushButton::clicked, this, &ConfigDialog::onSave);
 }
@@ -67,6 +70,7 @@ void ConfigDialog::onSave() {
   auto oldRequestQueueName = m_configManager->getRequestQueueName();
   auto oldResponseQueueName = m_configManager->getResponseQueueName();
   auto oldHeartbeat = m_configManager->getHeartbeat();
+  auto oldReplyMode = m_configManager->getReplyMode();
 
 
   m_configManager->setHost(m_hostEdit->text());
@@ -78,6 +82,7 @@ void ConfigDialog::onSave() {
   m_configManager->setRequestQueueName(m_requestQueueEdit->text());
   m_configManager->setResponseQueueName(m_responseQueueEdit->text());
   m_configManager->setHeartbeat(m_heartbeatEdit->text().toInt());
+  m_configManager->setReplyMode(m_replyModeEdit->text());
   m_configManager->setLoggingEnabled(m_loggingEnabledCheckbox->isChecked());
   m_configManager->setLogFilePath(m_logFilePathEdit->text());
   m_configManager->setLogLevel(ConfigManager::QStringToQtMsgType(m_logLevelEdit->text()));
@@ -90,7 +95,8 @@ void ConfigDialog::onSave() {
     m_configManager->getVhost() != oldVhost ||
     m_configManager->getRequestQueueName() != oldRequestQueueName ||
     m_configManager->getResponseQueueName() != oldResponseQueueName ||
-    m_configManager->getHeartbeat() != oldHeartbeat)
+    m_configManager->getHeartbeat() != oldHeartbeat ||
+    m_configManager->getReplyMode() != oldReplyMode)
   {
     m_connectionSettingsChanged = true;
   }
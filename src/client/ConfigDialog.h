@@ -28,6 +28,7 @@ private:
   QLineEdit *m_requestQueueEdit = nullptr;
   QLineEdit *m_responseQueueEdit = nullptr;
   QLineEdit *m_heartbeatEdit = nullptr;
+  QLineEdit *m_replyModeEdit = nullptr;
 
   QCheckBox *m_loggingEnabledCheckbox = nullptr;
   QLineEdit *m_logFilePathEdit = nullptr;
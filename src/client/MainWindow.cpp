@@ -7,11 +7,39 @@
 #include <QMessageBox>
 #include <QVBoxLayout>
 
+#include <algorithm>
+
 MainWindow::MainWindow(const QString &configFile, QWidget *parent)
   : QMainWindow(parent), m_configManager(std::make_shared<ConfigManager>(configFile))
 {
   if (m_configManager->isLoggingEnabled())
-    Logger::setupLogging(m_configManager->getLogFilePath(), m_configManager->getLogLevel());
+  {
+    LogRotationSettings rotation;
+    rotation.maxFileSize = static_cast<qint64>(std::max(0, m_configManager->getLogMaxFileSizeKb())) * 1024;
+    rotation.maxAge = std::chrono::hours(std::max(0, m_configManager->getLogRotationIntervalHours()));
+    rotation.maxArchivedFiles = std::max(0, m_configManager->getLogMaxArchivedFiles());
+    rotation.compressArchives = m_configManager->isLogArchiveCompressionEnabled();
+    const LogFormat format = Logger::formatFromString(m_configManager->getLogFormat());
+    if (m_configManager->isAsyncLoggingEnabled())
+    {
+      Logger::AsyncSettings settings;
+      settings.queueCapacity = static_cast<size_t>(std::max(1, m_configManager->getLogQueueCapacity()));
+      settings.flushInterval = std::chrono::milliseconds(std::max(1, m_configManager->getLogFlushIntervalMs()));
+      settings.overflowPolicy = Logger::overflowPolicyFromString(m_configManager->getLogOverflowPolicy());
+      Logger::setupAsyncLogging(m_configManager->getLogFilePath(), m_configManager->getLogLevel(), settings, rotation, format);
+    }
+    else
+      Logger::setupLogging(m_configManager->getLogFilePath(), m_configManager->getLogLevel(), rotation, format);
+    if (m_configManager->isConsoleLoggingEnabled())
+    {
+      if (format == LogFormat::Text)
+        Logger::instance()->addSink(std::make_unique<ConsoleSink>());
+      else
+        qWarning() << "Console logging is not available with the binary log format";
+    }
+    if (m_configManager->isPayloadTraceEnabled())
+      Logger::enableDebugCategory("rabbitmq.trace");
+  }
 
   setWindowTitle("RabbitMQ Client");
 
@@ -52,24 +80,29 @@ void MainWindow::onSendRequest()
   try
   {
     if (!m_client)
-      m_client = std::make_shared<Client>(RabbitmqConnection::create(),
+    {
+      ConnectionRecoverySettings recovery;
+      recovery.enabled = m_configManager->isAutoRecoveryEnabled();
+      recovery.initialDelay = std::chrono::milliseconds(std::max(1, m_configManager->getRecoveryInitialDelayMs()));
+      recovery.maxDelay = std::chrono::milliseconds(std::max(1, m_configManager->getRecoveryMaxDelayMs()));
+      recovery.maxAttempts = static_cast<unsigned>(std::max(0, m_configManager->getRecoveryMaxAttempts()));
+      recovery.publishBufferCapacity = static_cast<size_t>(std::max(0, m_configManager->getPublishBufferSize()));
+      m_client = std::make_shared<Client>(RabbitmqConnection::create(recovery),
                                           m_configManager->getHost().toStdString(), m_configManager->getPort(),
                                           m_configManager->getLogin().toStdString(), m_configManager->getPassword().toStdString(),
                                           m_configManager->getHeartbeat(), m_configManager->getVhost().toStdString(),
                                           m_configManager->getExchangeName().toStdString(),
                                           m_configManager->getResponseQueueName().toStdString(),
-                                          m_configManager->getRequestQueueName().toStdString());
+                                          m_configManager->getRequestQueueName().toStdString(),
+                                          Client::replyModeFromString(m_configManager->getReplyMode().toStdString()));
+    }
+    m_client->setLatencyTracingEnabled(m_configManager->isLatencyTracingEnabled());
 
     m_client->sendRequest(requestValue);
 
-    if (m_receiver)
-      deleteMessageReceiverThread();
-
-    std::chrono::milliseconds timeout(500);
-    m_receiver = std::make_unique<MessageReceiverThread>(m_client, timeout, this);
-    connect(m_receiver.get(), &MessageReceiverThread::responseReceived, this, &MainWindow::updateResponseField);
-    connect(m_receiver.get(), &MessageReceiverThread::errorOccurred, this, &MainWindow::showError);
-    m_receiver->start();
+    // после ошибки соединения получение ответов останавливается, следующий запрос его возобновляет
+    if (!m_responseNotifier || !m_responseNotifier->isActive())
+      startReceivingResponses();
   } catch (const std::exception& e)
   {
     qCritical() << "Error in onSendRequest: " + QString::fromStdString(e.what());
@@ -80,26 +113,32 @@ void MainWindow::onSendRequest()
 
 void MainWindow::onEditConfig()
 {
-  if (m_receiver)
-    deleteMessageReceiverThread();
-
   ConfigDialog configDialog(m_configManager, this);
   if (configDialog.exec() == QDialog::Accepted)
   {
     if (configDialog.connectionSettingsChanged())
     {
+      m_responseNotifier = nullptr;
       m_client = nullptr;
     }
   }
 }
 
-void MainWindow::deleteMessageReceiverThread()
+void MainWindow::startReceivingResponses()
 {
-  m_receiver->stop();
-  m_receiver->wait();
-  disconnect(m_receiver.get(), &MessageReceiverThread::responseReceived, this, &MainWindow::updateResponseField);
-  disconnect(m_receiver.get(), &MessageReceiverThread::errorOccurred, this, &MainWindow::showError);
-  m_receiver = nullptr;
+  m_responseNotifier = nullptr;
+  m_responseNotifier = std::make_unique<QtConsumerNotifier>(
+    m_client->getConnection(),
+    [this](std::unique_ptr<IRabbitmqEnvelope> envelope)
+    {
+      auto result = m_client->processResponse(std::move(envelope));
+      if (result.first)
+        updateResponseField(QString::number(result.second));
+    },
+    [this](const std::string& error)
+    {
+      showError(QString::fromStdString(error));
+    });
 }
 
 void MainWindow::updateResponseField(const QString &response)
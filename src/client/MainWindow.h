@@ -1,10 +1,10 @@
 #ifndef CLIENT_MAINWINDOW__H
 #define CLIENT_MAINWINDOW__H
 
-#include "MessageReceiverThread.h"
 #include "Client.h"
 
 #include "ConfigManager/ConfigManager.h"
+#include "RabbitMQClient/QtConsumerNotifier.h"
 
 #include <QMainWindow>
 #include <QLineEdit>
@@ -27,8 +27,8 @@ private slots:
   void onEditConfig();
 
 private:
-  void deleteMessageReceiverThread();
-
+  // Ответы разбираются в потоке интерфейса по готовности сокета соединения
+  void startReceivingResponses();
 
   QLineEdit *m_inputField = nullptr;
   QTextEdit *m_responseField = nullptr;
@@ -36,6 +36,6 @@ private:
   QPushButton *m_configButton = nullptr;
   std::shared_ptr<ConfigManager> m_configManager;
   std::shared_ptr<Client> m_client;
-  std::unique_ptr<MessageReceiverThread> m_receiver;
+  std::unique_ptr<QtConsumerNotifier> m_responseNotifier;
 };
 #endif
@@ -0,0 +1,241 @@
+#include "MetricsEndpoint.h"
+#include "Server.h"
+
+#include <QDebug>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+  const size_t maxRequestSize = 8192;
+  const int acceptPollIntervalMs = 200;
+  const int clientTimeoutSeconds = 2;
+  // квантиль для вывода и соответствующий ему процентиль
+  const std::pair<const char*, double> summaryQuantiles[] = {{"0.5", 50.0}, {"0.99", 99.0}, {"0.999", 99.9}};
+
+  void sendAll(int socket, const std::string& data)
+  {
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+      ssize_t result = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (result < 0 && errno == EINTR)
+        continue;
+      if (result <= 0)
+        return;
+      sent += static_cast<size_t>(result);
+    }
+  }
+
+  std::string httpResponse(const std::string& status, const std::string& contentType, const std::string& body)
+  {
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: " << contentType << "\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    return response.str();
+  }
+
+  std::string rateName(const std::string& counterName)
+  {
+    const std::string suffix = "_total";
+    if (counterName.size() > suffix.size() &&
+        counterName.compare(counterName.size() - suffix.size(), suffix.size(), suffix) == 0)
+      return counterName.substr(0, counterName.size() - suffix.size()) + "_per_second";
+    return counterName + "_per_second";
+  }
+}
+
+const std::chrono::milliseconds MetricsEndpoint::defaultRateWindow(10000);
+
+MetricsEndpoint::MetricsEndpoint(MetricsRegistry &registry, const std::string &address, uint16_t port,
+                                 GaugeProvider gauges)
+  : m_registry(registry), m_address(address), m_port(port), m_gauges(std::move(gauges))
+{
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+  stop();
+}
+
+void MetricsEndpoint::start()
+{
+  if (m_running)
+    return;
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(m_port);
+  if (inet_pton(AF_INET, m_address.c_str(), &address.sin_addr) != 1)
+    throw std::runtime_error("Metrics endpoint: invalid address " + m_address);
+
+  m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (m_listenSocket < 0)
+    throw std::runtime_error(std::string("Metrics endpoint: failed to create socket: ") + strerror(errno));
+
+  int reuse = 1;
+  setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (bind(m_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(m_listenSocket, 16) != 0)
+  {
+    std::string errorMsg = "Metrics endpoint: failed to listen on " + m_address + ":" + std::to_string(m_port) +
+                           ": " + strerror(errno);
+    close(m_listenSocket);
+    m_listenSocket = -1;
+    qCCritical(lcServer) << QString::fromStdString(errorMsg);
+    throw std::runtime_error(errorMsg);
+  }
+
+  socklen_t length = sizeof(address);
+  if (getsockname(m_listenSocket, reinterpret_cast<sockaddr*>(&address), &length) == 0)
+    m_port = ntohs(address.sin_port);
+
+  {
+    // первое окно начинается с запуска, до его завершения скорость нулевая
+    std::lock_guard<std::mutex> lock(m_rateMutex);
+    m_windowCounters = m_registry.snapshot().counters;
+    m_windowStart = std::chrono::steady_clock::now();
+    m_rates.clear();
+  }
+
+  m_running = true;
+  m_thread = std::thread(&MetricsEndpoint::run, this);
+  qCInfo(lcServer) << "Metrics endpoint listening on" << QString::fromStdString(m_address) << "port" << m_port;
+}
+
+void MetricsEndpoint::stop()
+{
+  if (!m_running.exchange(false))
+    return;
+  if (m_thread.joinable())
+    m_thread.join();
+  close(m_listenSocket);
+  m_listenSocket = -1;
+}
+
+void MetricsEndpoint::run()
+{
+  while (m_running)
+  {
+    updateRates();
+
+    // ожидание ограничено, чтобы поток заметил остановку и вовремя закрыл окно скорости
+    pollfd listenFd{m_listenSocket, POLLIN, 0};
+    int ready = poll(&listenFd, 1, acceptPollIntervalMs);
+    if (ready <= 0)
+      continue;
+
+    int client = accept(m_listenSocket, nullptr, nullptr);
+    if (client < 0)
+      continue;
+    handleClient(client);
+    close(client);
+  }
+}
+
+void MetricsEndpoint::updateRates()
+{
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_rateMutex);
+  if (now - m_windowStart < m_rateWindow)
+    return;
+
+  // окно может закрыться позже срока, пока обрабатывается запрос, поэтому делится на фактическую длительность
+  const double seconds = std::chrono::duration<double>(now - m_windowStart).count();
+  std::map<std::string, uint64_t> counters = m_registry.snapshot().counters;
+  m_rates.clear();
+  for (const auto& counter : counters)
+  {
+    auto previous = m_windowCounters.find(counter.first);
+    const uint64_t previousValue = previous != m_windowCounters.end() ? previous->second : 0;
+    m_rates[counter.first] = static_cast<double>(counter.second - previousValue) / seconds;
+  }
+  m_windowCounters = std::move(counters);
+  m_windowStart = now;
+}
+
+void MetricsEndpoint::handleClient(int socket)
+{
+  timeval timeout{clientTimeoutSeconds, 0};
+  setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  // тело запроса не нужно, читаем только заголовки
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < maxRequestSize)
+  {
+    ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      break;
+    request.append(buffer, static_cast<size_t>(received));
+  }
+
+  const std::string requestLine = request.substr(0, request.find("\r\n"));
+  std::istringstream parser(requestLine);
+  std::string method;
+  std::string path;
+  parser >> method >> path;
+
+  if (method != "GET")
+    sendAll(socket, httpResponse("405 Method Not Allowed", "text/plain", "Only GET is supported\n"));
+  else if (path != "/metrics")
+    sendAll(socket, httpResponse("404 Not Found", "text/plain", "Metrics are available at /metrics\n"));
+  else
+    sendAll(socket, httpResponse("200 OK", "text/plain; version=0.0.4; charset=utf-8", renderMetrics()));
+}
+
+std::string MetricsEndpoint::renderMetrics()
+{
+  MetricsRegistry::Snapshot snapshot = m_registry.snapshot();
+  std::ostringstream out;
+
+  // запрос метрик только читает скорость, окна закрывает поток точки
+  std::map<std::string, double> rates;
+  {
+    std::lock_guard<std::mutex> lock(m_rateMutex);
+    rates = m_rates;
+  }
+
+  for (const auto& counter : snapshot.counters)
+  {
+    out << "# TYPE " << counter.first << " counter\n"
+        << counter.first << " " << counter.second << "\n";
+    const std::string rate = rateName(counter.first);
+    out << "# TYPE " << rate << " gauge\n"
+        << rate << " " << rates[counter.first] << "\n";
+  }
+
+  for (const auto& histogram : snapshot.histograms)
+  {
+    const HistogramSnapshot& values = histogram.second;
+    out << "# TYPE " << histogram.first << " summary\n";
+    for (const auto& quantile : summaryQuantiles)
+      out << histogram.first << "{quantile=\"" << quantile.first << "\"} "
+          << values.valueAtPercentile(quantile.second) << "\n";
+    out << histogram.first << "_sum " << values.sum << "\n"
+        << histogram.first << "_count " << values.count << "\n";
+  }
+
+  if (m_gauges)
+  {
+    for (const auto& gauge : m_gauges())
+      out << "# TYPE " << gauge.first << " gauge\n"
+          << gauge.first << " " << gauge.second << "\n";
+  }
+  return out.str();
+}
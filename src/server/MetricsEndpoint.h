@@ -0,0 +1,72 @@
+#ifndef METRICSENDPOINT_H
+#define METRICSENDPOINT_H
+
+#include "RabbitMQClient/Metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * /brief HTTP-точка /metrics с метриками процесса в текстовом формате Prometheus
+ *
+ * Отдельный поток принимает соединения и отвечает на GET /metrics, запросы обрабатываются по одному.
+ * Счетчики выводятся как counter и дополнительно как gauge <имя>_per_second - скорость за последнее
+ * завершенное окно (setRateWindow). Окна отсчитывает поток точки, а не запросы метрик, поэтому
+ * несколько сборщиков видят одну и ту же скорость. Гистограммы выводятся как summary с квантилями
+ * 0.5, 0.99 и 0.999.
+ */
+class MetricsEndpoint
+{
+public:
+  // Значения, которые не хранятся в реестре и вычисляются в момент запроса
+  using GaugeProvider = std::function<std::map<std::string, double>()>;
+
+  MetricsEndpoint(MetricsRegistry& registry, const std::string& address, uint16_t port,
+                  GaugeProvider gauges = GaugeProvider());
+  ~MetricsEndpoint();
+
+  MetricsEndpoint(const MetricsEndpoint&) = delete;
+  MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+  static const std::chrono::milliseconds defaultRateWindow;
+  // Окно, за которое считается скорость счетчиков; задается до start
+  void setRateWindow(std::chrono::milliseconds window) {m_rateWindow = window;}
+
+  // Открывает сокет и запускает поток; бросает std::runtime_error, если адрес занят
+  void start();
+  void stop();
+
+  // Фактический порт, если при создании был передан 0
+  uint16_t getPort() const {return m_port;}
+
+  std::string renderMetrics();
+
+private:
+  void run();
+  void handleClient(int socket);
+  // Закрывает окно скорости, если оно истекло
+  void updateRates();
+
+  MetricsRegistry& m_registry;
+  const std::string m_address;
+  uint16_t m_port;
+  GaugeProvider m_gauges;
+
+  int m_listenSocket = -1;
+  std::atomic<bool> m_running{false};
+  std::thread m_thread;
+
+  std::chrono::milliseconds m_rateWindow = defaultRateWindow;
+  std::mutex m_rateMutex;
+  // значения счетчиков в начале текущего окна и скорость за последнее завершенное окно
+  std::map<std::string, uint64_t> m_windowCounters;
+  std::chrono::steady_clock::time_point m_windowStart;
+  std::map<std::string, double> m_rates;
+};
+
+#endif
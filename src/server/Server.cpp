@@ -1,17 +1,44 @@
 #include "Server.h"
 
 #include "protocol/Messages.pb.h"
+#include "RabbitMQClient/Metrics.h"
 
 #include <QDebug>
 
+#include <algorithm>
+#include <exception>
 #include <stdexcept>
+#include <vector>
+
+Q_LOGGING_CATEGORY(lcServer, "server")
+
+const uint16_t Server::defaultPrefetchCount;
+
+namespace
+{
+  struct ServerMetrics
+  {
+    MetricCounter& requests = MetricsRegistry::instance().counter("server_requests_total");
+    MetricCounter& malformedRequests = MetricsRegistry::instance().counter("server_malformed_requests_total");
+    MetricCounter& responses = MetricsRegistry::instance().counter("server_responses_total");
+    // от получения запроса до публикации ответа
+    LatencyHistogram& requestDuration = MetricsRegistry::instance().histogram("server_request_duration_microseconds");
+  };
+
+  ServerMetrics& metrics()
+  {
+    static ServerMetrics serverMetrics;
+    return serverMetrics;
+  }
+}
 
 Server::Server(std::shared_ptr<IRabbitmqConnection> connection, const std::string& host, int port,
                const std::string& login, const std::string& password,
                int heartbeat, const std::string& vhost,
                const std::string& exchangeName,
-               const std::string& responseQueueName, const std::string& requestQueueName)
-  : m_connection(connection)
+               const std::string& responseQueueName, const std::string& requestQueueName,
+               uint16_t prefetchCount, bool publisherConfirms)
+  : m_connection(connection), m_publisherConfirms(publisherConfirms)
 {
   m_socket = m_connection->openSocket(host, port);
   m_connection->login(login, password, heartbeat, vhost);
@@ -24,46 +51,237 @@ Server::Server(std::shared_ptr<IRabbitmqConnection> connection, const std::strin
   m_responseBinding = m_connection->bind(*m_channel, *m_responseQueue, *m_exchange, responseQueueName);
   m_requestBinding = m_connection->bind(*m_channel, *m_requestQueue, *m_exchange, requestQueueName);
 
-  const bool noAsk = true;
-  const bool exclusive = true;
+  // Запрос подтверждается только после публикации ответа: если сервер упадет, брокер
+  // вернет неподтвержденные запросы в очередь и их обработают другие серверы.
+  // prefetch не дает одному серверу забрать себе всю очередь
+  m_connection->basicQos(*m_channel, prefetchCount);
+  if (m_publisherConfirms)
+    m_connection->confirmSelect(*m_channel);
+
+  const bool noAsk = false;
+  const bool exclusive = false; // очередь запросов разделяют несколько серверов и рабочих потоков
   m_connection->basicConsume(*m_channel, *m_requestQueue, noAsk, exclusive);
 }
 
 void Server::processRequestResponseCycle(std::chrono::milliseconds timeoutMillis)
 {
   auto envelope = m_connection->timedConsumeMessage(timeoutMillis);
-  if (!envelope)
+  if (envelope)
+    processRequest(std::move(envelope));
+}
+
+void Server::processRequest(std::unique_ptr<IRabbitmqEnvelope> envelope)
+{
+  PreparedResponse response;
+  // испорченный запрос prepareResponse уже отклонил и записал в лог, как и в processRequestBatch,
+  // рабочий поток продолжает обработку
+  if (!prepareResponse(std::move(envelope), response, m_responseBuffer))
     return;
+  publishResponse(response);
+}
+
+size_t Server::processRequestBatch(std::chrono::milliseconds timeoutMillis, size_t maxBatchSize)
+{
+  std::vector<PreparedResponse> batch;
+  size_t processed = 0;
+
+  try
+  {
+    // первого запроса ждем, остальные забираем только если они уже пришли
+    auto envelope = m_connection->timedConsumeMessage(timeoutMillis);
+    while (envelope)
+    {
+      ++processed;
+      // ответ сериализуется в буфер следующего места пачки; если он публикуется сразу, место остается свободным
+      if (m_batchBuffers.size() <= batch.size())
+        m_batchBuffers.emplace_back();
+      PreparedResponse response;
+      if (prepareResponse(std::move(envelope), response, m_batchBuffers[batch.size()]))
+      {
+        // пачкой публикуются только ответы в общую очередь ответов: у остальных свой адрес,
+        // а в режиме подтверждений каждому ответу нужен свой обработчик
+        if (response.replyTo.empty() && !m_publisherConfirms)
+          batch.push_back(std::move(response));
+        else
+          publishResponse(response);
+      }
+
+      if (processed >= maxBatchSize)
+        break;
+      envelope = m_connection->timedConsumeMessage(std::chrono::milliseconds(0));
+    }
+  }
+  catch (const std::exception&)
+  {
+    // ответы собранной пачки еще не отправлены
+    for (const auto& response : batch)
+      requeueRequest(*response.request);
+    throw;
+  }
+
+  if (batch.empty())
+    return processed;
+
+  std::vector<BatchMessage> messages;
+  messages.reserve(batch.size());
+  for (const auto& response : batch)
+    messages.emplace_back(response.body, response.properties.correlationId.empty() ? nullptr : &response.properties);
+
+  size_t published = batch.size();
+  std::exception_ptr error;
+  try
+  {
+    m_connection->publishBatch(*m_channel, *m_exchange, *m_responseBinding, messages);
+  }
+  catch (const BatchPublishError& e)
+  {
+    published = std::min(e.getPublishedCount(), batch.size());
+    error = std::current_exception();
+  }
+  catch (const std::exception&)
+  {
+    published = 0;
+    error = std::current_exception();
+  }
+
+  // отправленные ответы подтверждаются, иначе повторная обработка запросов дала бы клиентам повторные ответы
+  if (!error)
+    qCInfo(lcServer) << "Server successfully published batch of" << published << "responses";
+  metrics().responses.increment(published);
+  for (size_t i = 0; i < published; ++i)
+    metrics().requestDuration.record(elapsedMicroseconds(batch[i].receivedAt));
+  for (size_t i = 0; i < published; ++i)
+    m_connection->ack(*batch[i].request);
+
+  if (error)
+  {
+    for (size_t i = published; i < batch.size(); ++i)
+      requeueRequest(*batch[i].request);
+    std::rethrow_exception(error);
+  }
+  return processed;
+}
+
+bool Server::prepareResponse(std::unique_ptr<IRabbitmqEnvelope> envelope, PreparedResponse& prepared,
+                             std::string& buffer)
+{
+  prepared.receivedAt = std::chrono::steady_clock::now();
+  const uint64_t receivedAtUs = wallClockMicroseconds();
+  metrics().requests.increment();
 
   TestTask::Messages::Request request;
-  if (!request.ParseFromString(envelope->getMessage()))
+  BytesView message = envelope->getMessageView();
+  if (!request.ParseFromArray(message.data, static_cast<int>(message.size)))
   {
-    std::string errorMsg = "Server error: Failed to parse request message";
-    qCritical() << QString::fromStdString(errorMsg);
-    throw std::runtime_error(errorMsg);
+    metrics().malformedRequests.increment();
+    // повторная доставка испорченного сообщения ничего не исправит
+    const bool requeue = false;
+    m_connection->reject(*envelope, requeue);
+    qCCritical(lcServer) << "Server rejected malformed request";
+    return false;
   }
   else
-    qInfo() << "Server received request with ID:" << QString::fromStdString(request.id()) << "and value:" << request.req();
+    qCInfo(lcServer) << "Server received request with ID:" << QString::fromStdString(request.id()) << "and value:" << request.req();
+
+  prepared.request = std::move(envelope);
+  prepared.requestId = request.id();
+
+  prepared.properties.correlationId = prepared.request->getCorrelationId();
+  if (prepared.properties.correlationId.empty() && request.has_correlation_id())
+    prepared.properties.correlationId = request.correlation_id();
 
   TestTask::Messages::Response response;
   response.set_id(request.id());
   response.set_res(generateResponseValue(request.req()));
+  if (!prepared.properties.correlationId.empty())
+    response.set_correlation_id(prepared.properties.correlationId);
+  // отметки времени добавляются, только если клиент включил трассировку задержек
+  if (request.has_client_send_time_us())
+  {
+    response.set_client_create_time_us(request.client_create_time_us());
+    response.set_client_send_time_us(request.client_send_time_us());
+    response.set_server_receive_time_us(receivedAtUs);
+    response.set_server_send_time_us(wallClockMicroseconds());
+  }
 
-  std::string responseStr;
-  if (!response.SerializeToString(&responseStr))
+  try
+  {
+    prepared.body = serializeToBuffer(response, buffer);
+  }
+  catch (const std::runtime_error&)
   {
     std::string errorMsg = "Server error: Failed to serialize response message";
-    qCritical() << QString::fromStdString(errorMsg);
+    qCCritical(lcServer) << QString::fromStdString(errorMsg);
     throw std::runtime_error(errorMsg);
   }
-  else
-    qInfo() << "Server prepared response for request ID:" << QString::fromStdString(response.id()) << "with result:" << response.res();
+  qCInfo(lcServer) << "Server prepared response for request ID:" << QString::fromStdString(response.id()) << "with result:" << response.res();
 
-  m_connection->publishMessage(*m_channel, *m_exchange, *m_responseBinding, responseStr);
-  qInfo() << "Server successfully published response for request ID:" << QString::fromStdString(request.id());
+  // адрес ответа из свойств сообщения (direct reply-to) приоритетнее адреса из тела запроса
+  prepared.replyTo = prepared.request->getReplyTo();
+  if (prepared.replyTo.empty() && request.has_reply_to())
+    prepared.replyTo = request.reply_to();
+  return true;
+}
+
+void Server::publishResponse(PreparedResponse& response)
+{
+  IRabbitmqEnvelope& envelope = *response.request;
+  // в режиме подтверждений запросом владеет обработчик подтверждения, пока брокер не ответит
+  std::shared_ptr<IRabbitmqEnvelope> pendingRequest;
+  try
+  {
+    if (m_publisherConfirms)
+    {
+      // запрос подтверждается только после того, как брокер принял ответ
+      pendingRequest = std::move(response.request);
+      auto onConfirm = [this, pendingRequest](bool acked)
+      {
+        if (acked)
+          m_connection->ack(*pendingRequest);
+        else
+          requeueRequest(*pendingRequest);
+      };
+      if (!response.replyTo.empty())
+        m_connection->publishToQueue(*m_channel, response.replyTo, response.body, response.properties, onConfirm);
+      else
+        m_connection->publishMessage(*m_channel, *m_exchange, *m_responseBinding, response.body, response.properties, onConfirm);
+    }
+    else if (!response.replyTo.empty())
+      m_connection->publishToQueue(*m_channel, response.replyTo, response.body, response.properties);
+    else if (!response.properties.correlationId.empty())
+      m_connection->publishMessage(*m_channel, *m_exchange, *m_responseBinding, response.body, response.properties);
+    else
+      m_connection->publishMessage(*m_channel, *m_exchange, *m_responseBinding, response.body);
+  }
+  catch (const std::exception&)
+  {
+    requeueRequest(envelope);
+    throw;
+  }
+  qCInfo(lcServer) << "Server successfully published response for request ID:" << QString::fromStdString(response.requestId);
+  metrics().responses.increment();
+  metrics().requestDuration.record(elapsedMicroseconds(response.receivedAt));
+
+  if (!m_publisherConfirms)
+    m_connection->ack(envelope);
 }
 
 int Server::generateResponseValue(int reqValue)
 {
   return reqValue * 2;
 }
+
+void Server::requeueRequest(const IRabbitmqEnvelope &envelope)
+{
+  // запрос возвращается в очередь, чтобы его обработал другой сервер. Ошибка здесь означает,
+  // что канал уже закрыт, и брокер вернет неподтвержденный запрос в очередь сам
+  try
+  {
+    const bool requeue = true;
+    m_connection->reject(envelope, requeue);
+  }
+  catch (const std::exception& e)
+  {
+    qCCritical(lcServer) << "Server failed to requeue request:" << e.what();
+  }
+}
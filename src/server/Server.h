@@ -4,21 +4,66 @@
 #include "RabbitMQClient/IRabbitmqConnection.h"
 #include "RabbitMQClient/rabbitmqEntities.h"
 
+#include <QLoggingCategory>
+
+#include <deque>
+#include <string>
+
+Q_DECLARE_LOGGING_CATEGORY(lcServer)
+
 class Server
 {
 public:
+  // Сколько неподтвержденных запросов брокер отдает одному серверу
+  static const uint16_t defaultPrefetchCount = 10;
+
   Server(std::shared_ptr<IRabbitmqConnection> connection,
          const std::string& host, int port,
          const std::string& login, const std::string& password,
          int heartbeat, const std::string& vhost,
          const std::string& exchangeName,
-         const std::string& responseQueueName, const std::string& requestQueueName);
+         const std::string& responseQueueName, const std::string& requestQueueName,
+         uint16_t prefetchCount = defaultPrefetchCount, bool publisherConfirms = false);
   ~Server() = default;
 
   void processRequestResponseCycle(std::chrono::milliseconds timeoutMillis);
+  // Отвечает на уже полученный запрос, например доставленный ConsumerEventLoop.
+  // Испорченный запрос отклоняется без возврата в очередь, исключение не бросается
+  void processRequest(std::unique_ptr<IRabbitmqEnvelope> envelope);
+  /**
+   * /brief Обрабатывает до maxBatchSize запросов за один вызов
+   *
+   * Ждет первый запрос не дольше timeoutMillis, затем забирает уже пришедшие запросы без ожидания.
+   * Ответы в общую очередь ответов публикуются одной пачкой, испорченные запросы отбрасываются.
+   * При ошибке уже отправленные ответы подтверждаются, остальные запросы возвращаются в очередь.
+   *
+   * /return Число полученных запросов
+   */
+  size_t processRequestBatch(std::chrono::milliseconds timeoutMillis, size_t maxBatchSize);
   static int generateResponseValue(int reqValue);
+
+  std::shared_ptr<IRabbitmqConnection> getConnection() const {return m_connection;}
 private:
+  struct PreparedResponse
+  {
+    std::unique_ptr<IRabbitmqEnvelope> request;
+    std::string requestId;
+    std::string replyTo;
+    // сериализованный ответ в одном из буферов сервера
+    BytesView body;
+    RabbitmqMessageProperties properties;
+    std::chrono::steady_clock::time_point receivedAt;
+  };
+
+  // false, если запрос испорчен: он уже отклонен без возврата в очередь. Ответ сериализуется в buffer
+  bool prepareResponse(std::unique_ptr<IRabbitmqEnvelope> envelope, PreparedResponse& prepared, std::string& buffer);
+  // Публикует ответ и подтверждает запрос, при ошибке публикации возвращает запрос в очередь
+  void publishResponse(PreparedResponse& response);
+  void requeueRequest(const IRabbitmqEnvelope& envelope);
+
   std::shared_ptr<IRabbitmqConnection> m_connection;
+  // в режиме подтверждений запрос подтверждается после того, как брокер подтвердит публикацию ответа
+  const bool m_publisherConfirms;
   std::unique_ptr<RabbitmqSocket> m_socket;
   std::unique_ptr<RabbitmqChannel> m_channel;
 
@@ -27,6 +72,12 @@ private:
   std::unique_ptr<RabbitmqQueue> m_requestQueue;
   std::unique_ptr<RabbitmqBind> m_responseBinding;
   std::unique_ptr<RabbitmqBind> m_requestBinding;
+
+  // Буферы ответов переиспользуются между запросами: ответ, который публикуется сразу,
+  // и по одному буферу на каждый ответ пачки. deque не перемещает буферы при росте,
+  // поэтому тела уже собранных ответов остаются действительными
+  std::string m_responseBuffer;
+  std::deque<std::string> m_batchBuffers;
 };
 
 #endif
@@ -0,0 +1,115 @@
+#include "ServerPool.h"
+#include "RabbitMQClient/Metrics.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <stdexcept>
+
+ServerPool::ServerPool(ServerFactory factory, size_t workerCount, std::chrono::milliseconds pollTimeout,
+                       size_t batchSize, bool eventDriven)
+  : m_factory(factory), m_workerCount(workerCount), m_pollTimeout(pollTimeout), m_batchSize(batchSize),
+    m_eventDriven(eventDriven)
+{
+  if (!m_factory)
+    throw std::invalid_argument("ServerPool: empty server factory");
+  if (m_workerCount == 0)
+    throw std::invalid_argument("ServerPool: worker count must be positive");
+  if (m_batchSize == 0)
+    throw std::invalid_argument("ServerPool: batch size must be positive");
+}
+
+ServerPool::~ServerPool()
+{
+  stop();
+  wait();
+}
+
+void ServerPool::start()
+{
+  if (m_running.exchange(true))
+    return;
+
+  qCInfo(lcServer) << "Starting server pool with" << m_workerCount << "workers";
+  m_workers.reserve(m_workerCount);
+  for (size_t i = 0; i < m_workerCount; ++i)
+  {
+    ++m_runningWorkers;
+    m_workers.emplace_back(&ServerPool::runWorker, this, i);
+  }
+}
+
+void ServerPool::stop()
+{
+  m_running = false;
+  std::lock_guard<std::mutex> lock(m_loopsMutex);
+  for (ConsumerEventLoop* loop : m_loops)
+    loop->stop();
+}
+
+void ServerPool::wait()
+{
+  for (auto& worker : m_workers)
+    if (worker.joinable())
+      worker.join();
+  m_workers.clear();
+}
+
+void ServerPool::runWorker(size_t index)
+{
+  try
+  {
+    auto server = m_factory();
+    qCInfo(lcServer) << "Server worker" << index << "started";
+    if (m_eventDriven && m_batchSize == 1 && server->getConnection()->getReadableFd() >= 0)
+      runEventLoop(*server);
+    while (m_running)
+    {
+      if (m_batchSize > 1)
+        server->processRequestBatch(m_pollTimeout, m_batchSize);
+      else
+        server->processRequestResponseCycle(m_pollTimeout);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    qCCritical(lcServer) << "Error in server worker" << index << ":" << e.what();
+    MetricsRegistry::instance().counter("server_worker_failures_total").increment();
+  }
+  catch (...)
+  {
+    qCCritical(lcServer) << "Unknown error in server worker" << index;
+    MetricsRegistry::instance().counter("server_worker_failures_total").increment();
+  }
+  qCInfo(lcServer) << "Server worker" << index << "stopped";
+  --m_runningWorkers;
+}
+
+void ServerPool::runEventLoop(Server &server)
+{
+  ConsumerEventLoop loop(m_pollTimeout);
+  loop.addConnection(server.getConnection(), [&server](std::unique_ptr<IRabbitmqEnvelope> envelope)
+  {
+    server.processRequest(std::move(envelope));
+  });
+
+  {
+    std::lock_guard<std::mutex> lock(m_loopsMutex);
+    // stop() мог быть вызван до регистрации цикла
+    if (!m_running)
+      return;
+    m_loops.push_back(&loop);
+  }
+  try
+  {
+    loop.run();
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lock(m_loopsMutex);
+    m_loops.erase(std::find(m_loops.begin(), m_loops.end(), &loop));
+    throw;
+  }
+  std::lock_guard<std::mutex> lock(m_loopsMutex);
+  m_loops.erase(std::find(m_loops.begin(), m_loops.end(), &loop));
+}
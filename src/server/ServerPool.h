@@ -0,0 +1,63 @@
+#ifndef SERVERPOOL_H
+#define SERVERPOOL_H
+
+#include "Server.h"
+
+#include "RabbitMQClient/ConsumerEventLoop.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * /brief Набор рабочих потоков, каждый из которых обслуживает свой экземпляр Server
+ *
+ * Соединение с брокером не потокобезопасно, поэтому каждый поток создает собственный Server
+ * (а вместе с ним соединение, канал и подписку) через переданную фабрику. Потоки конкурируют
+ * за сообщения одной очереди запросов, брокер распределяет их между подписчиками.
+ *
+ * При eventDriven рабочий поток ждет запросы в ConsumerEventLoop и отвечает на них сразу после прихода,
+ * а не опрашивает соединение с таймаутом pollTimeout. Пакетная обработка и соединения без дескриптора
+ * (IRabbitmqConnection::getReadableFd() == -1) по-прежнему опрашиваются.
+ */
+class ServerPool
+{
+public:
+  using ServerFactory = std::function<std::unique_ptr<Server>()>;
+
+  // при batchSize > 1 рабочие потоки обрабатывают запросы пачками (Server::processRequestBatch)
+  ServerPool(ServerFactory factory, size_t workerCount, std::chrono::milliseconds pollTimeout, size_t batchSize = 1,
+             bool eventDriven = false);
+  ~ServerPool();
+
+  ServerPool(const ServerPool&) = delete;
+  ServerPool& operator=(const ServerPool&) = delete;
+
+  void start();
+  void stop();
+  // Ожидает завершения всех рабочих потоков
+  void wait();
+
+  size_t getWorkerCount() const {return m_workerCount;}
+  size_t getRunningWorkerCount() const {return m_runningWorkers;}
+private:
+  void runWorker(size_t index);
+  void runEventLoop(Server& server);
+
+  ServerFactory m_factory;
+  const size_t m_workerCount;
+  const std::chrono::milliseconds m_pollTimeout;
+  const size_t m_batchSize;
+  const bool m_eventDriven;
+
+  std::atomic<bool> m_running{false};
+  std::atomic<size_t> m_runningWorkers{0};
+  std::vector<std::thread> m_workers;
+  // циклы событий рабочих потоков, которые stop() должен разбудить
+  std::mutex m_loopsMutex;
+  std::vector<ConsumerEventLoop*> m_loops;
+};
+
+#endif
@@ -1,13 +1,18 @@
-#include "Server.h"
+#include "ServerPool.h"
+#include "MetricsEndpoint.h"
 
 #include "Logger/Logger.h"
 #include "ConfigManager/ConfigManager.h"
+#include "RabbitMQClient/ChannelPool.h"
+#include "RabbitMQClient/IoThreadConnection.h"
 #include "RabbitMQClient/RabbitmqConnection.h"
 
 #include <QDebug>
 #include <QCoreApplication>
 #include <QCommandLineParser>
 
+#include <algorithm>
+
 int main(int argc, char* argv[])
 {
   QCoreApplication app(argc, argv);
@@ -23,16 +28,120 @@ int main(int argc, char* argv[])
 
   ConfigManager config(configFileName);
   if (config.isLoggingEnabled())
-    Logger::setupLogging(config.getLogFilePath(), config.getLogLevel());
+  {
+    LogRotationSettings rotation;
+    rotation.maxFileSize = static_cast<qint64>(std::max(0, config.getLogMaxFileSizeKb())) * 1024;
+    rotation.maxAge = std::chrono::hours(std::max(0, config.getLogRotationIntervalHours()));
+    rotation.maxArchivedFiles = std::max(0, config.getLogMaxArchivedFiles());
+    rotation.compressArchives = config.isLogArchiveCompressionEnabled();
+    const LogFormat format = Logger::formatFromString(config.getLogFormat());
+    if (config.isAsyncLoggingEnabled())
+    {
+      Logger::AsyncSettings settings;
+      settings.queueCapacity = static_cast<size_t>(std::max(1, config.getLogQueueCapacity()));
+      settings.flushInterval = std::chrono::milliseconds(std::max(1, config.getLogFlushIntervalMs()));
+      settings.overflowPolicy = Logger::overflowPolicyFromString(config.getLogOverflowPolicy());
+      Logger::setupAsyncLogging(config.getLogFilePath(), config.getLogLevel(), settings, rotation, format);
+    }
+    else
+      Logger::setupLogging(config.getLogFilePath(), config.getLogLevel(), rotation, format);
+    if (config.isConsoleLoggingEnabled())
+    {
+      if (format == LogFormat::Text)
+        Logger::instance()->addSink(std::make_unique<ConsoleSink>());
+      else
+        qWarning() << "Console logging is not available with the binary log format";
+    }
+    if (config.isPayloadTraceEnabled())
+      Logger::enableDebugCategory("rabbitmq.trace");
+  }
   qInfo() << "LOGGER START";
 
-  Server s(RabbitmqConnection::create(),
-           config.getHost().toStdString(), config.getPort(),
-           config.getLogin().toStdString(), config.getPassword().toStdString(),
-           config.getHeartbeat(), config.getVhost().toStdString(),
-           config.getExchangeName().toStdString(),
-           config.getResponseQueueName().toStdString(),
-           config.getRequestQueueName().toStdString());
-  while (true)
-    s.processRequestResponseCycle(std::chrono::milliseconds(100));
+  // настройки читаются заранее: QSettings нельзя использовать из нескольких потоков одновременно
+  const std::string host = config.getHost().toStdString();
+  const int port = config.getPort();
+  const std::string login = config.getLogin().toStdString();
+  const std::string password = config.getPassword().toStdString();
+  const int heartbeat = config.getHeartbeat();
+  const std::string vhost = config.getVhost().toStdString();
+  const std::string exchangeName = config.getExchangeName().toStdString();
+  const std::string responseQueueName = config.getResponseQueueName().toStdString();
+  const std::string requestQueueName = config.getRequestQueueName().toStdString();
+  const bool publisherConfirms = config.isPublisherConfirmsEnabled();
+  const uint16_t prefetchCount = static_cast<uint16_t>(std::max(1, std::min(config.getPrefetchCount(), 65535)));
+  ConnectionRecoverySettings recovery;
+  recovery.enabled = config.isAutoRecoveryEnabled();
+  recovery.initialDelay = std::chrono::milliseconds(std::max(1, config.getRecoveryInitialDelayMs()));
+  recovery.maxDelay = std::chrono::milliseconds(std::max(1, config.getRecoveryMaxDelayMs()));
+  recovery.maxAttempts = static_cast<unsigned>(std::max(0, config.getRecoveryMaxAttempts()));
+  recovery.publishBufferCapacity = static_cast<size_t>(std::max(0, config.getPublishBufferSize()));
+
+  // каналы общего соединения выдаются рабочим потокам, сокет и логин у них один на всех
+  std::shared_ptr<ChannelPool> channelPool;
+  std::shared_ptr<IoThreadConnection> ioThread;
+  std::unique_ptr<RabbitmqSocket> sharedSocket;
+  if (config.isSharedConnectionEnabled())
+  {
+    auto connection = RabbitmqConnection::create(recovery);
+    sharedSocket = connection->openSocket(host, port);
+    connection->login(login, password, heartbeat, vhost);
+    if (config.isIoThreadEnabled())
+      ioThread = IoThreadConnection::create(connection);
+    else
+    {
+      ChannelPoolSettings channelSettings;
+      channelSettings.maxChannels = static_cast<size_t>(std::max(1, config.getWorkerThreads()));
+      channelSettings.maxUnconfirmedPerChannel = static_cast<size_t>(std::max(0, config.getMaxUnconfirmedPerChannel()));
+      channelPool = ChannelPool::create(connection, channelSettings);
+    }
+  }
+
+  ServerPool pool([&]()
+                  {
+                    // канал общего соединения закрепляется за рабочим потоком, который создает сервер
+                    std::shared_ptr<IRabbitmqConnection> connection;
+                    if (ioThread)
+                      connection = ioThread->attach();
+                    else if (channelPool)
+                      connection = channelPool->checkout();
+                    else
+                      connection = RabbitmqConnection::create(recovery);
+                    return std::make_unique<Server>(connection,
+                                                    host, port,
+                                                    login, password,
+                                                    heartbeat, vhost,
+                                                    exchangeName,
+                                                    responseQueueName,
+                                                    requestQueueName,
+                                                    prefetchCount,
+                                                    publisherConfirms);
+                  },
+                  std::max(1, config.getWorkerThreads()),
+                  std::chrono::milliseconds(100),
+                  std::max(1, config.getBatchSize()),
+                  config.isEventLoopEnabled());
+
+  std::unique_ptr<MetricsEndpoint> metricsEndpoint;
+  if (config.isMetricsEnabled())
+  {
+    auto gauges = [&pool]()
+    {
+      std::map<std::string, double> values;
+      values["server_running_workers"] = static_cast<double>(pool.getRunningWorkerCount());
+      values["server_worker_threads"] = static_cast<double>(pool.getWorkerCount());
+      return values;
+    };
+    metricsEndpoint = std::make_unique<MetricsEndpoint>(MetricsRegistry::instance(),
+                                                        config.getMetricsAddress().toStdString(),
+                                                        static_cast<uint16_t>(std::max(0, std::min(config.getMetricsPort(), 65535))),
+                                                        gauges);
+    metricsEndpoint->start();
+  }
+
+  pool.start();
+  pool.wait();
+
+  qCritical() << "All server workers have stopped";
+  Logger::shutdownLogging();
+  return 1;
 }
@@ -0,0 +1,460 @@
+#include "AmqpBroker/AmqpBroker.h"
+#include "AmqpBroker/AmqpCodec.h"
+#include "RabbitMQClient/IRabbitmqConnection.h"
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <thread>
+
+using namespace AmqpCodec;
+
+namespace
+{
+  struct Frame
+  {
+    uint8_t type = 0;
+    uint16_t channel = 0;
+    std::string payload;
+  };
+
+  // Клиент AMQP на уровне кадров: проверяет брокер так, как его видит librabbitmq
+  class FrameClient
+  {
+  public:
+    explicit FrameClient(uint16_t port)
+    {
+      m_socket = socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_port = htons(port);
+      inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+      m_connected = connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+      timeval timeout{2, 0};
+      setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    ~FrameClient()
+    {
+      close(m_socket);
+    }
+
+    bool isConnected() const {return m_connected;}
+
+    void sendRaw(const std::string& data)
+    {
+      send(m_socket, data.data(), data.size(), MSG_NOSIGNAL);
+    }
+
+    void sendMethod(uint16_t channel, uint16_t classId, uint16_t method, const Writer& arguments = Writer())
+    {
+      sendRaw(methodFrame(channel, classId, method, arguments));
+    }
+
+    std::string readRaw(size_t size)
+    {
+      std::string data(size, '\0');
+      if (!readExact(&data[0], size))
+        return std::string();
+      return data;
+    }
+
+    // Следующий кадр, кроме heartbeat; false - соединение закрыто или кадра нет
+    bool readFrame(Frame& frame)
+    {
+      while (true)
+      {
+        char header[frameHeaderSize];
+        if (!readExact(header, sizeof(header)))
+          return false;
+        Reader reader(header, sizeof(header));
+        frame.type = reader.octet();
+        frame.channel = reader.shortUint();
+        frame.payload.assign(reader.longUint() + 1, '\0');
+        if (!readExact(&frame.payload[0], frame.payload.size()))
+          return false;
+        frame.payload.pop_back();
+        if (frame.type != frameHeartbeat)
+          return true;
+      }
+    }
+
+    // Аргументы метода, если следующий кадр - ожидаемый метод, иначе пустая строка
+    std::string expectMethod(uint16_t classId, uint16_t method)
+    {
+      Frame frame;
+      if (!readFrame(frame))
+      {
+        ADD_FAILURE() << "connection closed while waiting for method " << classId << "." << method;
+        return std::string();
+      }
+      Reader reader(frame.payload);
+      const uint16_t actualClass = frame.type == frameMethod ? reader.shortUint() : 0;
+      const uint16_t actualMethod = frame.type == frameMethod ? reader.shortUint() : 0;
+      EXPECT_EQ(actualClass, classId);
+      EXPECT_EQ(actualMethod, method);
+      return frame.payload.substr(4);
+    }
+
+    // Заголовок и тело сообщения после basic.deliver или basic.return
+    std::string readContent(BasicProperties& properties)
+    {
+      Frame header;
+      if (!readFrame(header) || header.type != frameHeader)
+      {
+        ADD_FAILURE() << "content header expected";
+        return std::string();
+      }
+      uint64_t bodySize = 0;
+      properties = parseContentHeader(header.payload, bodySize);
+      std::string body;
+      while (body.size() < bodySize)
+      {
+        Frame bodyFrame;
+        if (!readFrame(bodyFrame) || bodyFrame.type != frameBody)
+        {
+          ADD_FAILURE() << "content body expected";
+          break;
+        }
+        body += bodyFrame.payload;
+      }
+      return body;
+    }
+
+    void handshake(const std::string& login = "guest", const std::string& password = "guest")
+    {
+      sendRaw(std::string(protocolHeader, protocolHeaderSize));
+      expectMethod(classConnection, 10);
+
+      Writer startOk;
+      startOk.emptyTable().shortString("PLAIN").longString(std::string(1, '\0') + login + std::string(1, '\0') + password)
+             .shortString("en_US");
+      sendMethod(0, classConnection, 11, startOk);
+    }
+
+    void open()
+    {
+      handshake();
+      const std::string tuneArguments = expectMethod(classConnection, 30);
+      Reader tune(tuneArguments);
+      tune.shortUint();
+      const uint32_t frameMax = tune.longUint();
+      EXPECT_EQ(frameMax, defaultFrameMax);
+
+      Writer tuneOk;
+      tuneOk.shortUint(2047).longUint(frameMax).shortUint(0);
+      sendMethod(0, classConnection, 31, tuneOk);
+      Writer open;
+      open.shortString("/").shortString(std::string()).bit(false);
+      sendMethod(0, classConnection, 40, open);
+      expectMethod(classConnection, 41);
+    }
+
+    void openChannel(uint16_t channel)
+    {
+      Writer open;
+      open.shortString(std::string());
+      sendMethod(channel, classChannel, 10, open);
+      expectMethod(classChannel, 11);
+    }
+
+    std::string declareQueue(uint16_t channel, const std::string& queue)
+    {
+      Writer declare;
+      declare.shortUint(0).shortString(queue).bit(false).bit(false).bit(queue.empty()).bit(queue.empty()).bit(false).emptyTable();
+      sendMethod(channel, classQueue, 10, declare);
+      const std::string declareOkArguments = expectMethod(classQueue, 11);
+      Reader declareOk(declareOkArguments);
+      return declareOk.shortString();
+    }
+
+    void consume(uint16_t channel, const std::string& queue, bool noAck)
+    {
+      Writer consume;
+      consume.shortUint(0).shortString(queue).shortString(std::string())
+             .bit(false).bit(noAck).bit(false).bit(false).emptyTable();
+      sendMethod(channel, classBasic, 20, consume);
+    }
+
+    void publish(uint16_t channel, const std::string& exchange, const std::string& routingKey,
+                 const std::string& body, const BasicProperties& properties = BasicProperties(), bool mandatory = false)
+    {
+      Writer publish;
+      publish.shortUint(0).shortString(exchange).shortString(routingKey).bit(mandatory).bit(false);
+      sendRaw(methodFrame(channel, classBasic, 40, publish) +
+              contentHeaderFrame(channel, body.size(), properties) +
+              contentBodyFrames(channel, body, defaultFrameMax));
+    }
+
+  private:
+    bool readExact(char* buffer, size_t size)
+    {
+      size_t received = 0;
+      while (received < size)
+      {
+        ssize_t result = recv(m_socket, buffer + received, size - received, 0);
+        if (result <= 0)
+          return false;
+        received += static_cast<size_t>(result);
+      }
+      return true;
+    }
+
+    int m_socket = -1;
+    bool m_connected = false;
+  };
+
+  template <typename Predicate>
+  bool waitFor(Predicate predicate)
+  {
+    for (int attempt = 0; attempt < 200; ++attempt)
+    {
+      if (predicate())
+        return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+}
+
+TEST(AmqpBrokerTest, HandshakeOpensConnection)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+  ASSERT_NE(broker.getPort(), 0);
+
+  FrameClient client(broker.getPort());
+  ASSERT_TRUE(client.isConnected());
+  client.open();
+  client.openChannel(1);
+  EXPECT_EQ(broker.getConnectionCount(), 1u);
+
+  client.sendMethod(0, classConnection, 50, Writer().shortUint(replySuccess).shortString("OK").shortUint(0).shortUint(0));
+  client.expectMethod(classConnection, 51);
+  EXPECT_TRUE(waitFor([&]() {return broker.getConnectionCount() == 0;}));
+}
+
+TEST(AmqpBrokerTest, WrongProtocolHeader_AnswersSupportedVersion)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.sendRaw(std::string("AMQP\x00\x00\x08\x00", 8));
+  EXPECT_EQ(client.readRaw(protocolHeaderSize), std::string(protocolHeader, protocolHeaderSize));
+  Frame frame;
+  EXPECT_FALSE(client.readFrame(frame));
+}
+
+TEST(AmqpBrokerTest, WrongCredentials_ClosesConnection)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.handshake("guest", "wrong");
+  const std::string closeArguments = client.expectMethod(classConnection, 50);
+  Reader close(closeArguments);
+  EXPECT_EQ(close.shortUint(), replyAccessRefused);
+  Frame frame;
+  EXPECT_FALSE(client.readFrame(frame));
+}
+
+TEST(AmqpBrokerTest, PublishConsumeAck)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.open();
+  client.openChannel(1);
+
+  Writer declareExchange;
+  declareExchange.shortUint(0).shortString("test_exchange").shortString("direct")
+                 .bit(false).bit(false).bit(false).bit(false).bit(false).emptyTable();
+  client.sendMethod(1, classExchange, 10, declareExchange);
+  client.expectMethod(classExchange, 11);
+
+  EXPECT_EQ(client.declareQueue(1, "request_queue"), "request_queue");
+  Writer bind;
+  bind.shortUint(0).shortString("request_queue").shortString("test_exchange").shortString("request")
+      .bit(false).emptyTable();
+  client.sendMethod(1, classQueue, 20, bind);
+  client.expectMethod(classQueue, 21);
+
+  client.sendMethod(1, classBasic, 10, Writer().longUint(0).shortUint(1).bit(false));
+  client.expectMethod(classBasic, 11);
+  client.consume(1, "request_queue", false);
+  const std::string consumeOkArguments = client.expectMethod(classBasic, 21);
+  Reader consumeOk(consumeOkArguments);
+  const std::string consumerTag = consumeOk.shortString();
+  EXPECT_FALSE(consumerTag.empty());
+
+  BasicProperties properties;
+  properties.correlationId = "42";
+  properties.replyTo = "response_queue";
+  // тело больше frame-max приходит несколькими кадрами
+  const std::string body(defaultFrameMax * 2, 'x');
+  client.publish(1, "test_exchange", "request", body, properties);
+
+  const std::string deliverArguments = client.expectMethod(classBasic, 60);
+  Reader deliver(deliverArguments);
+  EXPECT_EQ(deliver.shortString(), consumerTag);
+  const uint64_t deliveryTag = deliver.longLongUint();
+  BasicProperties received;
+  EXPECT_EQ(client.readContent(received), body);
+  EXPECT_EQ(received.correlationId, "42");
+  EXPECT_EQ(received.replyTo, "response_queue");
+  EXPECT_EQ(broker.getBroker()->getUnackedCount("request_queue"), 1u);
+
+  client.sendMethod(1, classBasic, 80, Writer().longLongUint(deliveryTag).bit(false));
+  EXPECT_TRUE(waitFor([&]() {return broker.getBroker()->getUnackedCount("request_queue") == 0;}));
+}
+
+TEST(AmqpBrokerTest, UnknownDeliveryTag_ClosesChannel)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.open();
+  client.openChannel(1);
+  client.sendMethod(1, classBasic, 80, Writer().longLongUint(7).bit(false));
+
+  const std::string closeArguments = client.expectMethod(classChannel, 40);
+  Reader close(closeArguments);
+  EXPECT_EQ(close.shortUint(), replyPreconditionFailed);
+  client.sendMethod(1, classChannel, 41);
+
+  // соединение продолжает работать, канал можно открыть заново
+  client.openChannel(1);
+}
+
+TEST(AmqpBrokerTest, ConsumeMissingQueue_ClosesChannel)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.open();
+  client.openChannel(1);
+  client.consume(1, "missing_queue", false);
+
+  const std::string closeArguments = client.expectMethod(classChannel, 40);
+  Reader close(closeArguments);
+  EXPECT_EQ(close.shortUint(), replyNotFound);
+}
+
+TEST(AmqpBrokerTest, MandatoryUnroutable_ReturnsMessage)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.open();
+  client.openChannel(1);
+  client.sendMethod(1, classConfirm, 10, Writer().bit(false));
+  client.expectMethod(classConfirm, 11);
+
+  client.publish(1, std::string(), "missing_queue", "payload", BasicProperties(), true);
+
+  const std::string basicReturnArguments = client.expectMethod(classBasic, 50);
+  Reader basicReturn(basicReturnArguments);
+  EXPECT_EQ(basicReturn.shortUint(), replyNoRoute);
+  BasicProperties properties;
+  EXPECT_EQ(client.readContent(properties), "payload");
+  // подтверждение приходит после basic.return, как у RabbitMQ
+  const std::string ackArguments = client.expectMethod(classBasic, 80);
+  Reader ack(ackArguments);
+  EXPECT_EQ(ack.longLongUint(), 1u);
+}
+
+TEST(AmqpBrokerTest, NackEveryNthPublish)
+{
+  AmqpBrokerSettings settings;
+  settings.faults.nackEveryNthPublish = 2;
+  AmqpBroker broker("127.0.0.1", 0, settings);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.open();
+  client.openChannel(1);
+  client.declareQueue(1, "request_queue");
+  client.sendMethod(1, classConfirm, 10, Writer().bit(false));
+  client.expectMethod(classConfirm, 11);
+
+  for (int i = 0; i < 4; ++i)
+    client.publish(1, std::string(), "request_queue", "payload");
+
+  for (uint64_t tag = 1; tag <= 4; ++tag)
+  {
+    const std::string confirmArguments = client.expectMethod(classBasic, tag % 2 == 0 ? 120 : 80);
+    Reader confirm(confirmArguments);
+    EXPECT_EQ(confirm.longLongUint(), tag);
+  }
+}
+
+TEST(AmqpBrokerTest, DropConnectionOnPublish)
+{
+  AmqpBrokerSettings settings;
+  settings.faults.dropConnectionOnPublish = 2;
+  AmqpBroker broker("127.0.0.1", 0, settings);
+  broker.start();
+
+  FrameClient client(broker.getPort());
+  client.open();
+  client.openChannel(1);
+  client.declareQueue(1, "request_queue");
+  client.publish(1, std::string(), "request_queue", "first");
+  client.publish(1, std::string(), "request_queue", "second");
+
+  Frame frame;
+  EXPECT_FALSE(client.readFrame(frame));
+  EXPECT_TRUE(waitFor([&]() {return broker.getConnectionCount() == 0;}));
+  // очередь брокера переживает обрыв соединения
+  EXPECT_EQ(broker.getBroker()->getReadyCount("request_queue"), 1u);
+}
+
+TEST(AmqpBrokerTest, DirectReplyTo)
+{
+  AmqpBroker broker("127.0.0.1", 0);
+  broker.start();
+
+  FrameClient server(broker.getPort());
+  server.open();
+  server.openChannel(1);
+  server.declareQueue(1, "request_queue");
+  server.consume(1, "request_queue", true);
+  server.expectMethod(classBasic, 21);
+
+  FrameClient client(broker.getPort());
+  client.open();
+  client.openChannel(1);
+  client.consume(1, directReplyToQueue, true);
+  client.expectMethod(classBasic, 21);
+
+  BasicProperties request;
+  request.replyTo = directReplyToQueue;
+  request.correlationId = "7";
+  client.publish(1, std::string(), "request_queue", "request", request);
+
+  server.expectMethod(classBasic, 60);
+  BasicProperties received;
+  EXPECT_EQ(server.readContent(received), "request");
+  EXPECT_NE(received.replyTo, directReplyToQueue);
+  EXPECT_EQ(received.replyTo.find(directReplyToQueue), 0u);
+
+  BasicProperties response;
+  response.correlationId = received.correlationId;
+  server.publish(1, std::string(), received.replyTo, "response", response);
+
+  client.expectMethod(classBasic, 60);
+  BasicProperties reply;
+  EXPECT_EQ(client.readContent(reply), "response");
+  EXPECT_EQ(reply.correlationId, "7");
+}
@@ -2,15 +2,19 @@
 
 #include "Client.h"
 #include "protocol/Messages.pb.h"
+#include "RabbitMQClient/Metrics.h"
 #include "Logger/Logger.h"
 
 #include <gtest/gtest.h>
 
+#include <thread>
+
 using testing::_;
 using testing::Invoke;
 using testing::Return;
 using testing::Throw;
 using testing::ByMove;
+using testing::Field;
 
 class ClientTest : public ::testing::Test
 {
@@ -70,7 +74,7 @@ TEST_F(ClientTest, SendRequest_Success)
   expectedRequest.SerializeToString(&expectedStr);
 
   // проверка вызова publishMessage
-  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, expectedStr))
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(expectedStr)))
           .Times(1);
 
   client->sendRequest(req);
@@ -94,7 +98,7 @@ TEST_F(ClientTest, SendRequest_Zero)
   expectedRequest.SerializeToString(&expectedStr);
 
   // проверка вызова publishMessage
-  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, expectedStr))
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(expectedStr)))
           .Times(1);
 
   client->sendRequest(req);
@@ -246,7 +250,7 @@ TEST_F(ClientTest, GetResponse_WrongId)
       .WillOnce(Return(ByMove(std::move(mockEnvelope))));
 
   // также ожидаем отклонения
-  EXPECT_CALL(*mockConnection, reject(_))
+  EXPECT_CALL(*mockConnection, reject(_, true))
       .Times(1);
 
   auto result = client->getResponse(timeout);
@@ -309,7 +313,7 @@ TEST_F(ClientTest, GetResponse_MultipleResponses)
         .WillOnce(Return(ByMove(std::move(wrongMockEnvelope))))
         .WillOnce(Return(ByMove(std::move(correctMockEnvelope))));
 
-    EXPECT_CALL(*mockConnection, reject(_))
+    EXPECT_CALL(*mockConnection, reject(_, true))
         .Times(1);
 
     EXPECT_CALL(*mockConnection, ack(_))
@@ -324,3 +328,395 @@ TEST_F(ClientTest, GetResponse_MultipleResponses)
     EXPECT_TRUE(resultCorrect.first);
     EXPECT_EQ(resultCorrect.second, expectedRes);
 }
+
+TEST_F(ClientTest, SendRequestAsync_ResponsesOutOfOrder)
+{
+  auto client = std::make_unique<Client>(mockConnection,
+                                         "localhost", 5672,
+                                         "guest", "guest",
+                                         0, "/",
+                                         "testExchange", "responseQueue", "requestQueue");
+  std::chrono::milliseconds timeout(1000);
+
+  // каждый запрос уходит со своим correlation_id
+  std::vector<std::string> correlationIds;
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&correlationIds](const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&,
+                                               BytesView, const RabbitmqMessageProperties& properties)
+      {
+        correlationIds.push_back(properties.correlationId);
+      }));
+
+  auto first = client->sendRequestAsync(1);
+  auto second = client->sendRequestAsync(2);
+  ASSERT_EQ(correlationIds.size(), 2u);
+  EXPECT_NE(correlationIds[0], correlationIds[1]);
+  EXPECT_EQ(client->getInFlightCount(), 2u);
+
+  // ответы приходят в обратном порядке, correlation_id берется из свойств сообщения
+  auto makeEnvelope = [&client](int res, const std::string& correlationId)
+  {
+    TestTask::Messages::Response response;
+    response.set_id(client->getId().toString().toStdString());
+    response.set_res(res);
+    std::string serializedResponse;
+    response.SerializeToString(&serializedResponse);
+
+    auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+    EXPECT_CALL(*mockEnvelope, getMessage())
+        .WillOnce(Return(serializedResponse));
+    EXPECT_CALL(*mockEnvelope, getCorrelationId())
+        .WillRepeatedly(Return(correlationId));
+    return mockEnvelope;
+  };
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(makeEnvelope(4, correlationIds[1]))))
+      .WillOnce(Return(ByMove(makeEnvelope(2, correlationIds[0]))));
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(2);
+
+  client->getResponse(timeout);
+  ASSERT_EQ(second.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_EQ(first.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+  EXPECT_EQ(second.get(), 4);
+
+  client->getResponse(timeout);
+  ASSERT_EQ(first.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_EQ(first.get(), 2);
+  EXPECT_EQ(client->getInFlightCount(), 0u);
+}
+
+TEST_F(ClientTest, SendRequestAsync_PublishError)
+{
+  auto client = std::make_unique<Client>(mockConnection,
+                                         "localhost", 5672,
+                                         "guest", "guest",
+                                         0, "/",
+                                         "testExchange", "responseQueue", "requestQueue");
+
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _, _))
+          .WillOnce(Throw(std::runtime_error("Publish error")));
+
+  EXPECT_THROW(client->sendRequestAsync(15), std::runtime_error);
+  EXPECT_EQ(client->getInFlightCount(), 0u);
+}
+
+TEST_F(ClientTest, SendRequestAsync_ExpiresAfterTimeout)
+{
+  auto client = std::make_unique<Client>(mockConnection,
+                                         "localhost", 5672,
+                                         "guest", "guest",
+                                         0, "/",
+                                         "testExchange", "responseQueue", "requestQueue");
+  std::chrono::milliseconds timeout(10);
+
+  std::vector<std::string> correlationIds;
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&correlationIds](const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&,
+                                               BytesView, const RabbitmqMessageProperties& properties)
+      {
+        correlationIds.push_back(properties.correlationId);
+      }));
+
+  client->setRequestTimeout(std::chrono::milliseconds(20));
+  auto expiring = client->sendRequestAsync(1);
+  client->setRequestTimeout(std::chrono::hours(1));
+  auto pending = client->sendRequestAsync(2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+
+  // ответ не пришел: просроченный запрос завершается ошибкой, остальные ждут дальше
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(nullptr)));
+  EXPECT_FALSE(client->getResponse(timeout).first);
+  ASSERT_EQ(expiring.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_THROW(expiring.get(), std::runtime_error);
+  EXPECT_EQ(pending.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+  EXPECT_EQ(client->getInFlightCount(), 1u);
+
+  // опоздавший ответ разбирается, но запрос уже не завершает
+  TestTask::Messages::Response response;
+  response.set_id(client->getId().toString().toStdString());
+  response.set_res(2);
+  std::string serializedResponse;
+  response.SerializeToString(&serializedResponse);
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedResponse));
+  EXPECT_CALL(*mockEnvelope, getCorrelationId())
+      .WillRepeatedly(Return(correlationIds[0]));
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(1);
+  EXPECT_TRUE(client->processResponse(std::move(mockEnvelope)).first);
+  EXPECT_EQ(client->getInFlightCount(), 1u);
+  EXPECT_EQ(client->expireRequests(), 0u);
+}
+
+TEST_F(ClientTest, SendRequest_LatencyTracingAddsTimestamps)
+{
+  auto client = std::make_unique<Client>(mockConnection,
+                                         "localhost", 5672,
+                                         "guest", "guest",
+                                         0, "/",
+                                         "testExchange", "responseQueue", "requestQueue");
+  client->setLatencyTracingEnabled(true);
+
+  std::string published;
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _))
+      .WillOnce(Invoke([&published](const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&, BytesView message)
+      {
+        published.assign(message.data, message.size);
+      }));
+
+  const uint64_t before = wallClockMicroseconds();
+  client->sendRequest(42);
+  const uint64_t after = wallClockMicroseconds();
+
+  TestTask::Messages::Request request;
+  ASSERT_TRUE(request.ParseFromString(published));
+  EXPECT_EQ(request.req(), 42);
+  EXPECT_GE(request.client_create_time_us(), before);
+  EXPECT_LE(request.client_create_time_us(), request.client_send_time_us());
+  EXPECT_LE(request.client_send_time_us(), after);
+}
+
+TEST_F(ClientTest, GetResponse_RecordsStageLatencies)
+{
+  auto client = std::make_unique<Client>(mockConnection,
+                                         "localhost", 5672,
+                                         "guest", "guest",
+                                         0, "/",
+                                         "testExchange", "responseQueue", "requestQueue");
+  std::chrono::milliseconds timeout(1000);
+
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  const uint64_t queueBefore = registry.histogram("rpc_client_queue_microseconds").snapshot().count;
+  const uint64_t processingBefore = registry.histogram("rpc_server_processing_microseconds").snapshot().sum;
+  const uint64_t transitBefore = registry.histogram("rpc_broker_transit_microseconds").snapshot().sum;
+
+  // часы сервера отстают: отрицательный этап учитывается как нулевой
+  const uint64_t now = wallClockMicroseconds();
+  TestTask::Messages::Response response;
+  response.set_id(client->getId().toString().toStdString());
+  response.set_res(4);
+  response.set_client_create_time_us(now - 500);
+  response.set_client_send_time_us(now - 400);
+  response.set_server_receive_time_us(now - 450);
+  response.set_server_send_time_us(now - 250);
+  std::string serializedResponse;
+  response.SerializeToString(&serializedResponse);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedResponse));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(1);
+
+  auto result = client->getResponse(timeout);
+  EXPECT_TRUE(result.first);
+  EXPECT_EQ(registry.histogram("rpc_client_queue_microseconds").snapshot().count, queueBefore + 1);
+  EXPECT_EQ(registry.histogram("rpc_server_processing_microseconds").snapshot().sum, processingBefore + 200);
+  EXPECT_EQ(registry.histogram("rpc_broker_transit_microseconds").snapshot().sum, transitBefore);
+}
+
+class ClientExclusiveQueueTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<MockRabbitmqConnection> mockConnection;
+  const std::string replyQueueName = "amq.gen-reply";
+
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+
+  void SetUp() override
+  {
+    mockConnection = std::make_shared<MockRabbitmqConnection>();
+
+    EXPECT_CALL(*mockConnection, openSocket("localhost", 5672))
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, login("guest", "guest", 0, "/"))
+        .Times(1);
+    EXPECT_CALL(*mockConnection, openChannel())
+         .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, declareExchange(_, "testExchange", "direct"))
+         .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, declareQueue(_, "requestQueue"))
+         .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, bind(_, _, _, "requestQueue"))
+         .WillOnce(Return(ByMove(nullptr)));
+    // общая очередь ответов не объявляется
+    EXPECT_CALL(*mockConnection, declareQueue(_, "responseQueue"))
+         .Times(0);
+    EXPECT_CALL(*mockConnection, declareExclusiveQueue(_))
+         .WillOnce(Return(ByMove(std::make_unique<RabbitmqQueue>(nullptr, 1, replyQueueName))));
+    EXPECT_CALL(*mockConnection, basicConsume(_, _, false, true))
+         .Times(1);
+  }
+
+  std::unique_ptr<Client> createClient()
+  {
+    return std::make_unique<Client>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue",
+                                    ReplyMode::ExclusiveQueue);
+  }
+};
+
+TEST_F(ClientExclusiveQueueTest, SendRequest_ContainsReplyQueue)
+{
+  auto client = createClient();
+
+  int req = 7;
+  TestTask::Messages::Request expectedRequest;
+  expectedRequest.set_id(client->getId().toString().toStdString());
+  expectedRequest.set_req(req);
+
+  std::string expectedStr;
+  expectedRequest.SerializeToString(&expectedStr);
+
+  // очередь ответов передается в свойстве reply_to: его соединение переводит в текущее имя после переподключения
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(expectedStr),
+                                              Field(&RabbitmqMessageProperties::replyTo, replyQueueName)))
+          .Times(1);
+
+  client->sendRequest(req);
+}
+
+TEST_F(ClientExclusiveQueueTest, GetResponse_WrongIdIsNotRequeued)
+{
+  auto client = createClient();
+  std::chrono::milliseconds timeout(1000);
+
+  TestTask::Messages::Response response;
+  response.set_id(client->getId().toString().toStdString() + "_other");
+  response.set_res(8080);
+  std::string serializedResponse;
+  response.SerializeToString(&serializedResponse);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedResponse));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  // чужой ответ в собственной очереди подтверждается, а не возвращается брокеру
+  EXPECT_CALL(*mockConnection, reject(_, _))
+      .Times(0);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(1);
+
+  auto result = client->getResponse(timeout);
+  EXPECT_FALSE(result.first);
+  EXPECT_EQ(result.second, 0);
+}
+
+TEST(ClientReplyModeTest, FromString)
+{
+  EXPECT_EQ(Client::replyModeFromString("shared"), ReplyMode::SharedQueue);
+  EXPECT_EQ(Client::replyModeFromString("Exclusive"), ReplyMode::ExclusiveQueue);
+  EXPECT_EQ(Client::replyModeFromString("direct"), ReplyMode::DirectReplyTo);
+  EXPECT_THROW(Client::replyModeFromString("unknown"), std::invalid_argument);
+}
+
+class ClientDirectReplyToTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<MockRabbitmqConnection> mockConnection;
+
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+
+  void SetUp() override
+  {
+    mockConnection = std::make_shared<MockRabbitmqConnection>();
+
+    EXPECT_CALL(*mockConnection, openSocket("localhost", 5672))
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, login("guest", "guest", 0, "/"))
+        .Times(1);
+    EXPECT_CALL(*mockConnection, openChannel())
+         .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, declareExchange(_, "testExchange", "direct"))
+         .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, declareQueue(_, "requestQueue"))
+         .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, bind(_, _, _, "requestQueue"))
+         .WillOnce(Return(ByMove(nullptr)));
+    // очередь ответов не объявляется вовсе
+    EXPECT_CALL(*mockConnection, declareQueue(_, "responseQueue"))
+         .Times(0);
+    EXPECT_CALL(*mockConnection, declareExclusiveQueue(_))
+         .Times(0);
+    EXPECT_CALL(*mockConnection, basicConsume(_, _, _, _))
+         .Times(0);
+    EXPECT_CALL(*mockConnection, consumeDirectReplyTo(_))
+         .Times(1);
+  }
+
+  std::unique_ptr<Client> createClient()
+  {
+    return std::make_unique<Client>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue",
+                                    ReplyMode::DirectReplyTo);
+  }
+};
+
+TEST_F(ClientDirectReplyToTest, SendRequest_SetsReplyToProperty)
+{
+  auto client = createClient();
+
+  int req = 11;
+  TestTask::Messages::Request expectedRequest;
+  expectedRequest.set_id(client->getId().toString().toStdString());
+  expectedRequest.set_req(req);
+
+  std::string expectedStr;
+  expectedRequest.SerializeToString(&expectedStr);
+
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(expectedStr),
+                                              Field(&RabbitmqMessageProperties::replyTo, "amq.rabbitmq.reply-to")))
+          .Times(1);
+
+  client->sendRequest(req);
+}
+
+TEST_F(ClientDirectReplyToTest, GetResponse_NoAck)
+{
+  auto client = createClient();
+  int expectedRes = 22;
+  std::chrono::milliseconds timeout(1000);
+
+  TestTask::Messages::Response response;
+  response.set_id(client->getId().toString().toStdString());
+  response.set_res(expectedRes);
+  std::string serializedResponse;
+  response.SerializeToString(&serializedResponse);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedResponse));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  // подписка без подтверждений: ни ack, ни reject
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
+  EXPECT_CALL(*mockConnection, reject(_, _))
+      .Times(0);
+
+  auto result = client->getResponse(timeout);
+  EXPECT_TRUE(result.first);
+  EXPECT_EQ(result.second, expectedRes);
+}
@@ -0,0 +1,239 @@
+#include "mocks.h"
+
+#include "ClientSession.h"
+#include "protocol/Messages.pb.h"
+#include "Logger/Logger.h"
+
+#include <gtest/gtest.h>
+
+using testing::_;
+using testing::Invoke;
+using testing::Return;
+using testing::ByMove;
+
+namespace
+{
+  const amqp_channel_t sessionChannel = 1;
+
+  std::unique_ptr<IRabbitmqEnvelope> noMessage()
+  {
+    return nullptr;
+  }
+
+  std::unique_ptr<MockRabbitmqEnvelope> responseEnvelope(const std::string& clientId, int res)
+  {
+    TestTask::Messages::Response response;
+    response.set_id(clientId);
+    response.set_res(res);
+    std::string serializedResponse;
+    response.SerializeToString(&serializedResponse);
+
+    auto envelope = std::make_unique<MockRabbitmqEnvelope>();
+    // ответ разбирают сессия при раскладке и клиент
+    EXPECT_CALL(*envelope, getMessage())
+        .WillRepeatedly(Return(serializedResponse));
+    return envelope;
+  }
+}
+
+class ClientSessionTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<MockRabbitmqConnection> mockConnection;
+
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+
+  void SetUp() override
+  {
+    mockConnection = std::make_shared<MockRabbitmqConnection>();
+  }
+
+  // Топология объявляется один раз на сессию, сколько бы клиентов в ней ни было
+  std::shared_ptr<ClientSession> createSession(ReplyMode replyMode)
+  {
+    std::weak_ptr<IRabbitmqConnection> connection = mockConnection;
+    EXPECT_CALL(*mockConnection, openSocket("localhost", 5672))
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*mockConnection, login("guest", "guest", 0, "/"))
+        .Times(1);
+    EXPECT_CALL(*mockConnection, openChannel())
+        .WillOnce(Invoke([connection]()
+        {
+          return std::make_unique<RabbitmqChannel>(connection.lock(), sessionChannel);
+        }));
+    EXPECT_CALL(*mockConnection, declareExchange(_, "testExchange", "direct"))
+        .WillOnce(Invoke([connection](const RabbitmqChannel&, const std::string& name, const std::string&)
+        {
+          return std::make_unique<RabbitmqExchange>(connection.lock(), sessionChannel, name);
+        }));
+    EXPECT_CALL(*mockConnection, declareQueue(_, "requestQueue"))
+        .WillOnce(Invoke([connection](const RabbitmqChannel&, const std::string& name)
+        {
+          return std::make_unique<RabbitmqQueue>(connection.lock(), sessionChannel, name);
+        }));
+    EXPECT_CALL(*mockConnection, bind(_, _, _, "requestQueue"))
+        .WillOnce(Invoke([connection](const RabbitmqChannel&, const RabbitmqQueue& queue,
+                                      const RabbitmqExchange& exchange, const std::string& key)
+        {
+          return std::make_unique<RabbitmqBind>(connection.lock(), sessionChannel, queue.getName(), exchange.getName(), key);
+        }));
+
+    if (replyMode == ReplyMode::DirectReplyTo)
+    {
+      EXPECT_CALL(*mockConnection, consumeDirectReplyTo(_))
+          .Times(1);
+    }
+    else if (replyMode == ReplyMode::ExclusiveQueue)
+    {
+      EXPECT_CALL(*mockConnection, declareExclusiveQueue(_))
+          .WillOnce(Invoke([connection](const RabbitmqChannel&)
+          {
+            return std::make_unique<RabbitmqQueue>(connection.lock(), sessionChannel, "amq.gen-session");
+          }));
+      EXPECT_CALL(*mockConnection, basicConsume(_, _, false, true))
+          .Times(1);
+    }
+    else
+    {
+      EXPECT_CALL(*mockConnection, declareQueue(_, "responseQueue"))
+          .WillOnce(Invoke([connection](const RabbitmqChannel&, const std::string& name)
+          {
+            return std::make_unique<RabbitmqQueue>(connection.lock(), sessionChannel, name);
+          }));
+      EXPECT_CALL(*mockConnection, bind(_, _, _, "responseQueue"))
+          .WillOnce(Invoke([connection](const RabbitmqChannel&, const RabbitmqQueue& queue,
+                                        const RabbitmqExchange& exchange, const std::string& key)
+          {
+            return std::make_unique<RabbitmqBind>(connection.lock(), sessionChannel, queue.getName(), exchange.getName(), key);
+          }));
+      EXPECT_CALL(*mockConnection, basicConsume(_, _, false, false))
+          .Times(1);
+    }
+
+    ClientSessionSettings settings;
+    settings.exchangeName = "testExchange";
+    settings.responseQueueName = "responseQueue";
+    settings.requestQueueName = "requestQueue";
+    settings.replyMode = replyMode;
+    return ClientSession::create(mockConnection, settings);
+  }
+};
+
+TEST_F(ClientSessionTest, ClientsReuseSessionTopology)
+{
+  for (ReplyMode replyMode : {ReplyMode::SharedQueue, ReplyMode::ExclusiveQueue, ReplyMode::DirectReplyTo})
+  {
+    mockConnection = std::make_shared<MockRabbitmqConnection>();
+    auto session = createSession(replyMode);
+
+    // клиенты не обращаются к брокеру: повторные объявления нарушили бы ожидания WillOnce
+    std::vector<std::unique_ptr<Client>> clients;
+    for (int i = 0; i < 100; ++i)
+      clients.push_back(session->createClient());
+
+    EXPECT_EQ(session->getClientCount(), 100u);
+    EXPECT_EQ(clients.front()->getReplyMode(), replyMode);
+    EXPECT_NE(clients.front()->getId(), clients.back()->getId());
+
+    clients.clear();
+    EXPECT_EQ(session->getClientCount(), 0u);
+  }
+}
+
+TEST_F(ClientSessionTest, SendRequest_PublishesOnSessionChannel)
+{
+  auto session = createSession(ReplyMode::SharedQueue);
+  auto client = session->createClient();
+
+  TestTask::Messages::Request expectedRequest;
+  expectedRequest.set_id(client->getId().toString().toStdString());
+  expectedRequest.set_req(42);
+  std::string expectedStr;
+  expectedRequest.SerializeToString(&expectedStr);
+
+  EXPECT_CALL(*mockConnection, publishMessage(testing::Property(&RabbitmqChannel::getId, sessionChannel),
+                                              testing::Property(&RabbitmqExchange::getName, "testExchange"),
+                                              testing::Property(&RabbitmqBind::getBindingKey, "requestQueue"),
+                                              BytesEq(expectedStr)))
+      .Times(1);
+
+  client->sendRequest(42);
+}
+
+TEST_F(ClientSessionTest, GetResponse_RoutesResponsesByClientId)
+{
+  auto session = createSession(ReplyMode::SharedQueue);
+  auto first = session->createClient();
+  auto second = session->createClient();
+
+  // первый клиент читает соединение и раскладывает ответ второго в его очередь
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(_))
+      .WillOnce(Return(ByMove(responseEnvelope(second->getId().toString().toStdString(), 2))))
+      .WillOnce(Return(ByMove(responseEnvelope(first->getId().toString().toStdString(), 1))))
+      .WillRepeatedly(Invoke([](std::chrono::milliseconds) {return noMessage();}));
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(2);
+
+  auto firstResult = first->getResponse(std::chrono::milliseconds(1000));
+  EXPECT_TRUE(firstResult.first);
+  EXPECT_EQ(firstResult.second, 1);
+
+  auto secondResult = second->getResponse(std::chrono::milliseconds(0));
+  EXPECT_TRUE(secondResult.first);
+  EXPECT_EQ(secondResult.second, 2);
+}
+
+TEST_F(ClientSessionTest, GetResponse_UnknownClientInSharedQueue)
+{
+  auto session = createSession(ReplyMode::SharedQueue);
+  auto client = session->createClient();
+
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(_))
+      .WillOnce(Return(ByMove(responseEnvelope("other-process-client", 7))))
+      .WillRepeatedly(Invoke([](std::chrono::milliseconds) {return noMessage();}));
+  // ответ предназначен клиенту другого процесса
+  EXPECT_CALL(*mockConnection, reject(_, true))
+      .Times(1);
+
+  auto result = client->getResponse(std::chrono::milliseconds(30));
+  EXPECT_FALSE(result.first);
+}
+
+TEST_F(ClientSessionTest, GetResponse_UnknownClientInDirectReplyTo)
+{
+  auto session = createSession(ReplyMode::DirectReplyTo);
+  auto client = session->createClient();
+
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(_))
+      .WillOnce(Return(ByMove(responseEnvelope("other-client", 7))))
+      .WillRepeatedly(Invoke([](std::chrono::milliseconds) {return noMessage();}));
+  // прямые ответы приходят без подтверждения
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
+  EXPECT_CALL(*mockConnection, reject(_, _))
+      .Times(0);
+
+  auto result = client->getResponse(std::chrono::milliseconds(30));
+  EXPECT_FALSE(result.first);
+}
+
+TEST_F(ClientSessionTest, ReleasedClientResponsesAreAcked)
+{
+  auto session = createSession(ReplyMode::SharedQueue);
+  auto reader = session->createClient();
+  auto released = session->createClient();
+
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(_))
+      .WillOnce(Return(ByMove(responseEnvelope(released->getId().toString().toStdString(), 3))))
+      .WillRepeatedly(Invoke([](std::chrono::milliseconds) {return noMessage();}));
+  EXPECT_FALSE(reader->getResponse(std::chrono::milliseconds(30)).first);
+
+  // ответ удаленному клиенту не возвращается в общую очередь
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(1);
+  released.reset();
+  EXPECT_EQ(session->getClientCount(), 1u);
+}
@@ -6,12 +6,35 @@
 
 #include <gmock/gmock.h>
 
+// Сравнивает тело публикуемого сообщения с ожидаемой строкой
+MATCHER_P(BytesEq, expected, "")
+{
+  return arg == BytesView(expected);
+}
+
 class MockRabbitmqEnvelope : public IRabbitmqEnvelope {
 public:
+  MockRabbitmqEnvelope()
+  {
+    // по умолчанию тело для getMessageView берется из getMessage, тестам достаточно задать одно из них
+    ON_CALL(*this, getMessageView())
+        .WillByDefault(testing::Invoke([this]()
+        {
+          m_message = getMessage();
+          return BytesView(m_message);
+        }));
+  }
+
   MOCK_METHOD(amqp_envelope_t*, get, (), (override));
   MOCK_METHOD(amqp_channel_t, getChannel, (), (const, override));
   MOCK_METHOD(uint64_t, getDeliveryTag, (), (const, override));
   MOCK_METHOD(std::string, getMessage, (), (const, override));
+  MOCK_METHOD(BytesView, getMessageView, (), (const, override));
+  MOCK_METHOD(std::string, getReplyTo, (), (const, override));
+  MOCK_METHOD(std::string, getCorrelationId, (), (const, override));
+
+private:
+  mutable std::string m_message;
 };
 
 
@@ -42,19 +65,74 @@ public:
               (const RabbitmqChannel &channel, const std::string& queueName),
               (override));
 
+  MOCK_METHOD(std::unique_ptr<RabbitmqQueue>,
+              declareExclusiveQueue,
+              (const RabbitmqChannel &channel),
+              (override));
+
   MOCK_METHOD(std::unique_ptr<RabbitmqBind>,
               bind,
               (const RabbitmqChannel &channel, const RabbitmqQueue &queue, const RabbitmqExchange &exchange, const std::string &bindingKey),
               (override));
 
+  MOCK_METHOD(void,
+              basicQos,
+              (const RabbitmqChannel &channel, uint16_t prefetchCount),
+              (override));
+
   MOCK_METHOD(void,
               basicConsume,
               (const RabbitmqChannel &channel, const RabbitmqQueue &queue, bool noAsk, bool exclusive),
               (override));
 
+  MOCK_METHOD(void,
+              consumeDirectReplyTo,
+              (const RabbitmqChannel &channel),
+              (override));
+
+  MOCK_METHOD(void,
+              confirmSelect,
+              (const RabbitmqChannel& channel),
+              (override));
+
+  MOCK_METHOD(size_t,
+              getUnconfirmedCount,
+              (),
+              (const, override));
+
   MOCK_METHOD(void,
               publishMessage,
-              (const RabbitmqChannel& channel, const RabbitmqExchange& exchange, const RabbitmqBind& binding, std::string message),
+              (const RabbitmqChannel& channel, const RabbitmqExchange& exchange, const RabbitmqBind& binding, BytesView message),
+              (override));
+
+  MOCK_METHOD(void,
+              publishMessage,
+              (const RabbitmqChannel& channel, const RabbitmqExchange& exchange, const RabbitmqBind& binding, BytesView message,
+               const RabbitmqMessageProperties& properties),
+              (override));
+
+  MOCK_METHOD(void,
+              publishToQueue,
+              (const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+               const RabbitmqMessageProperties& properties),
+              (override));
+
+  MOCK_METHOD(void,
+              publishBatch,
+              (const RabbitmqChannel& channel, const RabbitmqExchange& exchange, const RabbitmqBind& binding,
+               const std::vector<BatchMessage>& messages),
+              (override));
+
+  MOCK_METHOD(void,
+              publishMessage,
+              (const RabbitmqChannel& channel, const RabbitmqExchange& exchange, const RabbitmqBind& binding, BytesView message,
+               const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm),
+              (override));
+
+  MOCK_METHOD(void,
+              publishToQueue,
+              (const RabbitmqChannel& channel, const std::string& queueName, BytesView message,
+               const RabbitmqMessageProperties& properties, PublishConfirmCallback onConfirm),
               (override));
 
   MOCK_METHOD(void,
@@ -64,7 +142,7 @@ public:
 
   MOCK_METHOD(void,
               reject,
-              (const IRabbitmqEnvelope &envelope),
+              (const IRabbitmqEnvelope &envelope, bool requeue),
               (override));
 
   MOCK_METHOD(std::unique_ptr<IRabbitmqEnvelope>,
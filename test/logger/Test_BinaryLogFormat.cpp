@@ -0,0 +1,135 @@
+#include "Logger/BinaryLogFormat.h"
+
+#include <QCoreApplication>
+
+#include <gtest/gtest.h>
+
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  QByteArray record(QtMsgType type, const char* file, int line, const QString& message)
+  {
+    return BinaryLogFormat::encodeRecord(type, QMessageLogContext(file, line, "function", "category"), message);
+  }
+
+  std::vector<std::string> decodeLines(const QByteArray& data)
+  {
+    const std::string text = BinaryLogFormat::decode(data).toStdString();
+    std::vector<std::string> lines;
+    size_t start = 0;
+    for (size_t end = text.find('\n'); end != std::string::npos; end = text.find('\n', start))
+    {
+      if (end > start)
+        lines.push_back(text.substr(start, end - start));
+      start = end + 1;
+    }
+    return lines;
+  }
+
+  // строка записи: [Уровень ddMMyyyy hh:mm:ss.zzz приложение:поток:файл:строка] сообщение
+  std::smatch matchRecord(const std::string& line)
+  {
+    static const std::regex format(R"(^\[([DIWCF])\d{8} \d{2}:\d{2}:\d{2}\.\d{3} ([^:]*):(\d+):(.*):(\d+)\] (.*)$)");
+    std::smatch match;
+    std::regex_match(line, match, format);
+    return match;
+  }
+}
+
+TEST(BinaryLogFormatTest, EncodedRecordsDecodeToTextFormat)
+{
+  QByteArray data = BinaryLogFormat::fileHeader();
+  data += record(QtDebugMsg, "src/debug.cpp", 1, "debug message");
+  data += record(QtInfoMsg, "src/info.cpp", 42, QString::fromUtf8("сообщение в UTF-8"));
+  data += record(QtWarningMsg, "src/warning.cpp", 7, "warning: with colon");
+  data += record(QtCriticalMsg, "src/critical.cpp", 65535, "critical message");
+  data += record(QtInfoMsg, nullptr, 0, "message without context");
+
+  const std::vector<std::string> lines = decodeLines(data);
+  ASSERT_EQ(lines.size(), 7u);
+  EXPECT_EQ(lines[0].find("Log started at: "), 0u);
+  EXPECT_EQ(lines[1].find("Log line format: "), 0u);
+
+  const std::string appName = QCoreApplication::applicationName().toStdString();
+  const struct
+  {
+    const char* level;
+    const char* file;
+    const char* line;
+    std::string message;
+  } expected[] = {
+    {"D", "src/debug.cpp", "1", "debug message"},
+    {"I", "src/info.cpp", "42", "сообщение в UTF-8"},
+    {"W", "src/warning.cpp", "7", "warning: with colon"},
+    {"C", "src/critical.cpp", "65535", "critical message"},
+    {"I", "", "0", "message without context"},
+  };
+  std::string threadId;
+  for (size_t i = 0; i < 5; ++i)
+  {
+    const std::smatch match = matchRecord(lines[i + 2]);
+    ASSERT_FALSE(match.empty()) << lines[i + 2];
+    EXPECT_EQ(match[1], expected[i].level);
+    EXPECT_EQ(match[2], appName);
+    EXPECT_EQ(match[4], expected[i].file);
+    EXPECT_EQ(match[5], expected[i].line);
+    EXPECT_EQ(match[6], expected[i].message);
+    // записи одного потока помечены одним идентификатором
+    if (threadId.empty())
+      threadId = match[3];
+    EXPECT_EQ(match[3], threadId);
+  }
+}
+
+TEST(BinaryLogFormatTest, RecordsKeepWritingThread)
+{
+  QByteArray data = BinaryLogFormat::fileHeader();
+  data += record(QtInfoMsg, "main.cpp", 1, "main thread");
+  QByteArray otherRecord;
+  std::thread([&otherRecord]() { otherRecord = record(QtInfoMsg, "worker.cpp", 2, "worker thread"); }).join();
+  data += otherRecord;
+
+  const std::vector<std::string> lines = decodeLines(data);
+  ASSERT_EQ(lines.size(), 4u);
+  const std::smatch mainRecord = matchRecord(lines[2]);
+  const std::smatch workerRecord = matchRecord(lines[3]);
+  ASSERT_FALSE(mainRecord.empty());
+  ASSERT_FALSE(workerRecord.empty());
+  EXPECT_NE(mainRecord[3], workerRecord[3]);
+}
+
+TEST(BinaryLogFormatTest, DecodesEveryFileHeader)
+{
+  // файл открывается заново после ротации или перезапуска и получает новый заголовок
+  QByteArray data = BinaryLogFormat::fileHeader();
+  data += record(QtInfoMsg, "first.cpp", 1, "first");
+  data += BinaryLogFormat::fileHeader();
+  data += record(QtInfoMsg, "second.cpp", 2, "second");
+
+  const std::vector<std::string> lines = decodeLines(data);
+  ASSERT_EQ(lines.size(), 6u);
+  EXPECT_EQ(matchRecord(lines[2])[6], "first");
+  EXPECT_EQ(lines[3].find("Log started at: "), 0u);
+  EXPECT_EQ(matchRecord(lines[5])[6], "second");
+}
+
+TEST(BinaryLogFormatTest, RejectsInvalidData)
+{
+  const QByteArray header = BinaryLogFormat::fileHeader();
+  const QByteArray valid = record(QtInfoMsg, "file.cpp", 1, "message");
+
+  EXPECT_THROW(BinaryLogFormat::decode(valid), std::runtime_error);
+  EXPECT_THROW(BinaryLogFormat::decode(QByteArray("plain text log\n")), std::runtime_error);
+  EXPECT_THROW(BinaryLogFormat::decode(header + valid.left(valid.size() - 1)), std::runtime_error);
+  EXPECT_THROW(BinaryLogFormat::decode(header + valid.left(10)), std::runtime_error);
+
+  // размер записи не сходится с длинами файла и сообщения
+  QByteArray corrupted = valid;
+  corrupted[0] = static_cast<char>(corrupted[0] + 1);
+  EXPECT_THROW(BinaryLogFormat::decode(header + corrupted + "x"), std::runtime_error);
+}
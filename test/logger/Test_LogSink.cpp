@@ -0,0 +1,184 @@
+#include "Logger/LogSink.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+  QByteArray readFile(const QString& path)
+  {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+      return QByteArray();
+    return file.readAll();
+  }
+
+  // строка с номером в начале, чтобы по содержимому файла было видно, какие строки в него попали
+  QByteArray line(int index)
+  {
+    QByteArray data = QString("line-%1 ").arg(index).toUtf8();
+    data += QByteArray(400 - data.size() - 1, 'x');
+    data += '\n';
+    return data;
+  }
+
+  LogRotationSettings sizeRotation(bool compress = false)
+  {
+    LogRotationSettings settings;
+    // заголовок и две строки помещаются в файл, третья строка вызывает ротацию
+    settings.maxFileSize = 1000;
+    settings.maxArchivedFiles = 2;
+    settings.compressArchives = compress;
+    return settings;
+  }
+}
+
+class RotatingFileSinkTest : public ::testing::Test
+{
+protected:
+  QTemporaryDir dir;
+  QString logPath;
+
+  void SetUp() override
+  {
+    ASSERT_TRUE(dir.isValid());
+    logPath = dir.filePath("test.log");
+  }
+};
+
+TEST_F(RotatingFileSinkTest, RotatesBySizeAndKeepsArchiveLimit)
+{
+  {
+    RotatingFileSink sink(logPath, sizeRotation());
+    for (int i = 0; i < 10; ++i)
+      sink.write(line(i));
+    sink.flush();
+  }
+
+  // по две строки в файле: 8-9 в текущем, 6-7 и 4-5 в архивах, более старые архивы удалены
+  EXPECT_TRUE(readFile(logPath).contains("line-9 "));
+  const QByteArray newest = readFile(logPath + ".1");
+  EXPECT_TRUE(newest.contains("line-6 "));
+  EXPECT_TRUE(newest.contains("line-7 "));
+  EXPECT_TRUE(readFile(logPath + ".2").contains("line-5 "));
+  EXPECT_FALSE(QFile::exists(logPath + ".3"));
+  EXPECT_FALSE(QFile::exists(logPath + ".rotating"));
+}
+
+TEST_F(RotatingFileSinkTest, FailedRotationKeepsArchives)
+{
+  {
+    RotatingFileSink sink(logPath, sizeRotation());
+    for (int i = 0; i < 6; ++i)
+      sink.write(line(i));
+  }
+  const QByteArray firstArchive = readFile(logPath + ".1");
+  const QByteArray secondArchive = readFile(logPath + ".2");
+  ASSERT_FALSE(firstArchive.isEmpty());
+  ASSERT_FALSE(secondArchive.isEmpty());
+
+  // каталог на месте промежуточного файла не дает переместить текущий файл
+  ASSERT_TRUE(QDir().mkpath(logPath + ".rotating"));
+  {
+    RotatingFileSink sink(logPath, sizeRotation());
+    for (int i = 6; i < 20; ++i)
+      sink.write(line(i));
+    sink.flush();
+
+    EXPECT_EQ(readFile(logPath + ".1"), firstArchive);
+    EXPECT_EQ(readFile(logPath + ".2"), secondArchive);
+    const QByteArray current = readFile(logPath);
+    EXPECT_TRUE(current.contains("line-6 "));
+    EXPECT_TRUE(current.contains("line-19 "));
+    // повторная попытка ротации не на каждой записи: заголовок пишется при каждом открытии файла
+    EXPECT_LT(current.count("Log started at"), 14);
+
+    // когда перемещение снова возможно, ротация продолжается
+    ASSERT_TRUE(QDir().rmdir(logPath + ".rotating"));
+    for (int i = 20; i < 40; ++i)
+      sink.write(line(i));
+  }
+  EXPECT_TRUE(readFile(logPath).contains("line-39 "));
+  EXPECT_FALSE(QFile::exists(logPath + ".3"));
+}
+
+TEST_F(RotatingFileSinkTest, LeftoverStagingFileBecomesArchive)
+{
+  // промежуточный файл остался после аварийного завершения во время ротации
+  {
+    QFile staging(logPath + ".rotating");
+    ASSERT_TRUE(staging.open(QIODevice::WriteOnly));
+    staging.write("leftover\n");
+  }
+  {
+    RotatingFileSink sink(logPath, sizeRotation());
+    EXPECT_FALSE(QFile::exists(logPath + ".rotating"));
+    EXPECT_EQ(readFile(logPath + ".1"), QByteArray("leftover\n"));
+
+    for (int i = 0; i < 3; ++i)
+      sink.write(line(i));
+    EXPECT_TRUE(readFile(logPath + ".1").contains("line-1 "));
+    EXPECT_EQ(readFile(logPath + ".2"), QByteArray("leftover\n"));
+
+    // файл, оставшийся после неудачного сжатия, не останавливает ротацию работающего приемника
+    {
+      QFile staging(logPath + ".rotating");
+      ASSERT_TRUE(staging.open(QIODevice::WriteOnly));
+      staging.write("failed compression\n");
+    }
+    for (int i = 3; i < 5; ++i)
+      sink.write(line(i));
+  }
+  EXPECT_FALSE(QFile::exists(logPath + ".rotating"));
+  EXPECT_TRUE(readFile(logPath + ".1").contains("line-3 "));
+  EXPECT_EQ(readFile(logPath + ".2"), QByteArray("failed compression\n"));
+  EXPECT_TRUE(readFile(logPath).contains("line-4 "));
+}
+
+TEST_F(RotatingFileSinkTest, LeftoverStagingFileIsCompressed)
+{
+  {
+    QFile staging(logPath + ".rotating");
+    ASSERT_TRUE(staging.open(QIODevice::WriteOnly));
+    staging.write("leftover\n");
+  }
+  {
+    RotatingFileSink sink(logPath, sizeRotation(true));
+  }
+  EXPECT_FALSE(QFile::exists(logPath + ".rotating"));
+  EXPECT_EQ(qUncompress(readFile(logPath + ".1.qz")), QByteArray("leftover\n"));
+}
+
+TEST_F(RotatingFileSinkTest, CompressesArchives)
+{
+  {
+    RotatingFileSink sink(logPath, sizeRotation(true));
+    for (int i = 0; i < 3; ++i)
+      sink.write(line(i));
+    // приемник дожидается сжатия архива при уничтожении
+  }
+
+  const QByteArray archive = qUncompress(readFile(logPath + ".1.qz"));
+  EXPECT_TRUE(archive.contains("line-0 "));
+  EXPECT_TRUE(archive.contains("line-1 "));
+  EXPECT_FALSE(archive.contains("line-2 "));
+  EXPECT_TRUE(readFile(logPath).contains("line-2 "));
+  EXPECT_FALSE(QFile::exists(logPath + ".rotating"));
+}
+
+TEST_F(RotatingFileSinkTest, CompressedRotationsKeepOrder)
+{
+  {
+    RotatingFileSink sink(logPath, sizeRotation(true));
+    for (int i = 0; i < 7; ++i)
+      sink.write(line(i));
+  }
+
+  EXPECT_TRUE(qUncompress(readFile(logPath + ".1.qz")).contains("line-5 "));
+  EXPECT_TRUE(qUncompress(readFile(logPath + ".2.qz")).contains("line-3 "));
+  EXPECT_FALSE(QFile::exists(logPath + ".3.qz"));
+  EXPECT_TRUE(readFile(logPath).contains("line-6 "));
+}
@@ -0,0 +1,236 @@
+#include "Logger/Logger.h"
+#include "Logger/RingBuffer.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  // Содержимое приемника переживает логгер, который им владеет
+  struct MemorySinkData
+  {
+    std::mutex mutex;
+    QByteArray data;
+    int flushes = 0;
+  };
+
+  class MemorySink : public LogSink
+  {
+  public:
+    explicit MemorySink(std::shared_ptr<MemorySinkData> data, std::chrono::milliseconds writeDelay = std::chrono::milliseconds(0))
+      : m_data(std::move(data)), m_writeDelay(writeDelay) {}
+
+    void write(const QByteArray& data) override
+    {
+      if (m_writeDelay.count() > 0)
+        std::this_thread::sleep_for(m_writeDelay);
+      std::lock_guard<std::mutex> lock(m_data->mutex);
+      m_data->data += data;
+    }
+
+    void flush() override
+    {
+      std::lock_guard<std::mutex> lock(m_data->mutex);
+      ++m_data->flushes;
+    }
+
+  private:
+    std::shared_ptr<MemorySinkData> m_data;
+    std::chrono::milliseconds m_writeDelay;
+  };
+
+  std::shared_ptr<MemorySinkData> setupAsyncMemoryLogging(const Logger::AsyncSettings& settings,
+                                                          std::chrono::milliseconds writeDelay = std::chrono::milliseconds(0))
+  {
+    Logger::setupAsyncLogging("logs.txt", QtInfoMsg, settings);
+    auto data = std::make_shared<MemorySinkData>();
+    Logger::instance()->addSink(std::make_unique<MemorySink>(data, writeDelay));
+    return data;
+  }
+
+  QByteArray readFile(const QString& path)
+  {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+      return QByteArray();
+    return file.readAll();
+  }
+}
+
+TEST(RingBufferTest, CapacityRoundsUpToPowerOfTwo)
+{
+  EXPECT_EQ(RingBuffer<int>(1).capacity(), 2u);
+  EXPECT_EQ(RingBuffer<int>(5).capacity(), 8u);
+  EXPECT_EQ(RingBuffer<int>(8).capacity(), 8u);
+}
+
+TEST(RingBufferTest, PopsInOrderAndRejectsWhenFull)
+{
+  RingBuffer<std::string> buffer(4);
+  for (int i = 0; i < 4; ++i)
+  {
+    std::string value = std::to_string(i);
+    EXPECT_TRUE(buffer.tryPush(std::move(value)));
+  }
+
+  // значение, которое не поместилось, остается у вызывающего
+  std::string rejected = "rejected";
+  EXPECT_FALSE(buffer.tryPush(std::move(rejected)));
+  EXPECT_EQ(rejected, "rejected");
+
+  std::string value;
+  for (int i = 0; i < 4; ++i)
+  {
+    ASSERT_TRUE(buffer.tryPop(value));
+    EXPECT_EQ(value, std::to_string(i));
+  }
+  EXPECT_FALSE(buffer.tryPop(value));
+
+  // после разбора ячейки используются повторно
+  std::string reused = "reused";
+  EXPECT_TRUE(buffer.tryPush(std::move(reused)));
+  ASSERT_TRUE(buffer.tryPop(value));
+  EXPECT_EQ(value, "reused");
+}
+
+TEST(RingBufferTest, ManyProducersSingleConsumer)
+{
+  const int producers = 4;
+  const int perProducer = 20000;
+  RingBuffer<std::pair<int, int>> buffer(64);
+
+  std::vector<std::thread> threads;
+  for (int producer = 0; producer < producers; ++producer)
+  {
+    threads.emplace_back([&buffer, producer]()
+    {
+      for (int i = 0; i < perProducer; ++i)
+      {
+        std::pair<int, int> value(producer, i);
+        while (!buffer.tryPush(std::move(value)))
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  // сообщения каждого писателя приходят без потерь и в порядке записи
+  std::vector<int> next(producers, 0);
+  int received = 0;
+  std::pair<int, int> value;
+  while (received < producers * perProducer)
+  {
+    if (!buffer.tryPop(value))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(value.second, next[value.first]);
+    ++next[value.first];
+    ++received;
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_FALSE(buffer.tryPop(value));
+}
+
+TEST(AsyncLoggerTest, WritesQueuedMessagesInOrderOnShutdown)
+{
+  Logger::AsyncSettings settings;
+  settings.queueCapacity = 1024;
+  settings.flushInterval = std::chrono::milliseconds(10000);
+  auto sink = setupAsyncMemoryLogging(settings);
+
+  for (int i = 0; i < 500; ++i)
+    qInfo() << "ordered message" << i;
+  Logger::shutdownLogging();
+
+  // остановка записывает очередь и сбрасывает приемники, не дожидаясь flushInterval
+  std::lock_guard<std::mutex> lock(sink->mutex);
+  int previous = -1;
+  for (int i = 0; i < 500; ++i)
+  {
+    const int position = sink->data.indexOf(QString("ordered message %1\n").arg(i).toUtf8().constData());
+    ASSERT_GT(position, previous) << "message " << i;
+    previous = position;
+  }
+  EXPECT_GT(sink->flushes, 0);
+}
+
+TEST(AsyncLoggerTest, BlockPolicyLosesNoMessages)
+{
+  Logger::AsyncSettings settings;
+  settings.queueCapacity = 2;
+  settings.overflowPolicy = Logger::OverflowPolicy::Block;
+  // приемник медленнее писателей, поэтому они упираются в заполненную очередь
+  auto sink = setupAsyncMemoryLogging(settings, std::chrono::milliseconds(1));
+
+  const int threadCount = 4;
+  const int perThread = 100;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < threadCount; ++t)
+  {
+    threads.emplace_back([t]()
+    {
+      for (int i = 0; i < perThread; ++i)
+        qInfo() << "blocked message" << t << i;
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(Logger::instance()->getDroppedCount(), 0u);
+  Logger::shutdownLogging();
+
+  std::lock_guard<std::mutex> lock(sink->mutex);
+  EXPECT_EQ(sink->data.count("blocked message"), threadCount * perThread);
+}
+
+TEST(AsyncLoggerTest, CountPolicyReportsDroppedMessages)
+{
+  Logger::AsyncSettings settings;
+  settings.queueCapacity = 2;
+  settings.overflowPolicy = Logger::OverflowPolicy::Count;
+  auto sink = setupAsyncMemoryLogging(settings, std::chrono::milliseconds(5));
+
+  for (int i = 0; i < 200; ++i)
+    qInfo() << "dropped message" << i;
+  const uint64_t dropped = Logger::instance()->getDroppedCount();
+  Logger::shutdownLogging();
+
+  EXPECT_GT(dropped, 0u);
+  std::lock_guard<std::mutex> lock(sink->mutex);
+  EXPECT_EQ(sink->data.count("dropped message"), static_cast<int>(200 - dropped));
+  EXPECT_TRUE(sink->data.contains("messages dropped, log queue is full"));
+}
+
+TEST(AsyncLoggerDeathTest, FatalMessageIsWrittenAfterQueuedMessages)
+{
+  // дочерний процесс запускает тест заново, поэтому путь к файлу не должен зависеть от процесса
+  const QString logPath = "fatal_test_logs.txt";
+  QFile::remove(logPath);
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+
+  EXPECT_DEATH(
+  {
+    Logger::AsyncSettings settings;
+    settings.flushInterval = std::chrono::milliseconds(10000);
+    Logger::setupAsyncLogging(logPath, QtInfoMsg, settings);
+    for (int i = 0; i < 1000; ++i)
+      qInfo() << "queued message" << i;
+    qFatal("fatal message");
+  }, "");
+
+  // очередь записана до fatal, а не потеряна вместе с процессом
+  const QByteArray log = readFile(logPath);
+  const int lastQueued = log.indexOf("queued message 999\n");
+  const int fatal = log.indexOf("fatal message");
+  EXPECT_GE(lastQueued, 0);
+  EXPECT_GT(fatal, lastQueued);
+  QFile::remove(logPath);
+}
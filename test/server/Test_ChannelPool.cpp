@@ -0,0 +1,221 @@
+#include "mocks.h"
+
+#include "RabbitMQClient/ChannelPool.h"
+#include "RabbitMQClient/InMemoryConnection.h"
+#include "Logger/Logger.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+using testing::_;
+using testing::Invoke;
+
+class ChannelPoolTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<InMemoryBroker> broker = InMemoryBroker::create();
+
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+
+  // Публикует сообщения в очередь queueName через отдельное соединение
+  void publish(const std::string& queueName, const std::vector<std::string>& messages)
+  {
+    auto producer = InMemoryConnection::create(broker);
+    auto channel = producer->openChannel();
+    auto exchange = producer->declareExchange(*channel, "exchange", "direct");
+    auto queue = producer->declareQueue(*channel, queueName);
+    auto binding = producer->bind(*channel, *queue, *exchange, queueName);
+    for (const auto& message : messages)
+      producer->publishMessage(*channel, *exchange, *binding, BytesView(message));
+  }
+};
+
+TEST_F(ChannelPoolTest, ReusesReleasedChannelWithoutSubscriptions)
+{
+  auto pool = ChannelPool::create(InMemoryConnection::create(broker));
+
+  amqp_channel_t firstId = 0;
+  {
+    auto connection = pool->checkout();
+    EXPECT_EQ(pool->checkout(), connection);
+    firstId = connection->openChannel()->getId();
+  }
+  EXPECT_EQ(pool->getOpenChannelCount(), 1u);
+  EXPECT_EQ(pool->getIdleChannelCount(), 1u);
+
+  auto connection = pool->checkout();
+  EXPECT_EQ(connection->openChannel()->getId(), firstId);
+  EXPECT_EQ(pool->getIdleChannelCount(), 0u);
+}
+
+TEST_F(ChannelPoolTest, ClosesReleasedChannelWithSubscriptionOnBroker)
+{
+  auto pool = ChannelPool::create(InMemoryConnection::create(broker));
+  publish("requests", {"1", "2"});
+  {
+    auto connection = pool->checkout();
+    auto channel = connection->openChannel();
+    auto queue = connection->declareQueue(*channel, "requests");
+    connection->basicConsume(*channel, *queue, false, false);
+    auto envelope = connection->timedConsumeMessage(std::chrono::milliseconds(100));
+    ASSERT_NE(envelope, nullptr);
+    EXPECT_EQ(broker->getUnackedCount("requests"), 2u);
+  }
+
+  // канал закрыт на брокере, неподтвержденные сообщения вернулись в очередь
+  EXPECT_EQ(pool->getOpenChannelCount(), 0u);
+  EXPECT_EQ(pool->getIdleChannelCount(), 0u);
+  EXPECT_EQ(broker->getUnackedCount("requests"), 0u);
+  EXPECT_EQ(broker->getReadyCount("requests"), 2u);
+}
+
+TEST_F(ChannelPoolTest, ChannelCanBeUsedOnlyFromCheckoutThread)
+{
+  auto pool = ChannelPool::create(InMemoryConnection::create(broker));
+  auto connection = pool->checkout();
+  auto channel = connection->openChannel();
+
+  std::shared_ptr<IRabbitmqConnection> otherConnection;
+  bool rejected = false;
+  std::thread other([&]()
+  {
+    otherConnection = pool->checkout();
+    try
+    {
+      connection->timedConsumeMessage(std::chrono::milliseconds(0));
+    }
+    catch (const std::logic_error&)
+    {
+      rejected = true;
+    }
+  });
+  other.join();
+
+  EXPECT_TRUE(rejected);
+  ASSERT_NE(otherConnection, nullptr);
+  EXPECT_NE(otherConnection, connection);
+  EXPECT_EQ(pool->getOpenChannelCount(), 2u);
+}
+
+TEST_F(ChannelPoolTest, LimitsNumberOfChannels)
+{
+  ChannelPoolSettings settings;
+  settings.maxChannels = 1;
+  auto pool = ChannelPool::create(InMemoryConnection::create(broker), settings);
+  auto connection = pool->checkout();
+
+  bool failed = false;
+  std::thread other([&]()
+  {
+    try
+    {
+      pool->checkout();
+    }
+    catch (const std::runtime_error&)
+    {
+      failed = true;
+    }
+  });
+  other.join();
+  EXPECT_TRUE(failed);
+}
+
+TEST_F(ChannelPoolTest, ThreadsConsumeOwnQueuesOverOneConnection)
+{
+  auto pool = ChannelPool::create(InMemoryConnection::create(broker));
+  const int messageCount = 50;
+  std::atomic<int> subscribed(0);
+  std::vector<std::vector<std::string>> received(2);
+
+  auto consume = [&](size_t index)
+  {
+    auto connection = pool->checkout();
+    auto channel = connection->openChannel();
+    auto exchange = connection->declareExchange(*channel, "exchange", "direct");
+    const std::string queueName = "queue" + std::to_string(index);
+    auto queue = connection->declareQueue(*channel, queueName);
+    auto binding = connection->bind(*channel, *queue, *exchange, queueName);
+    connection->basicConsume(*channel, *queue, false, false);
+    ++subscribed;
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (received[index].size() < messageCount && std::chrono::steady_clock::now() < deadline)
+    {
+      auto envelope = connection->timedConsumeMessage(std::chrono::milliseconds(100));
+      if (!envelope)
+        continue;
+      EXPECT_EQ(envelope->getChannel(), channel->getId());
+      received[index].push_back(envelope->getMessage());
+      connection->ack(*envelope);
+    }
+  };
+  std::thread first(consume, 0);
+  std::thread second(consume, 1);
+  while (subscribed < 2)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  std::vector<std::vector<std::string>> expected(2);
+  for (int i = 0; i < messageCount; ++i)
+    for (size_t index = 0; index < expected.size(); ++index)
+      expected[index].push_back(std::to_string(index) + ":" + std::to_string(i));
+  publish("queue0", expected[0]);
+  publish("queue1", expected[1]);
+  first.join();
+  second.join();
+
+  EXPECT_EQ(received, expected);
+  EXPECT_EQ(pool->getOpenChannelCount(), 0u);
+}
+
+TEST_F(ChannelPoolTest, PublisherWaitsForConfirmsAboveLimit)
+{
+  ChannelPoolSettings settings;
+  settings.maxUnconfirmedPerChannel = 2;
+  auto pool = ChannelPool::create(InMemoryConnection::create(broker), settings);
+  auto connection = pool->checkout();
+  auto channel = connection->openChannel();
+  connection->confirmSelect(*channel);
+
+  int confirmed = 0;
+  for (int i = 0; i < 5; ++i)
+  {
+    connection->publishToQueue(*channel, "others", BytesView("message"), RabbitmqMessageProperties(),
+                               [&confirmed](bool acked) { confirmed += acked ? 1 : 0; });
+    EXPECT_LE(connection->getUnconfirmedCount(), 2u);
+  }
+
+  // подтверждения выполняются в потоке канала при получении сообщений
+  while (connection->hasBufferedFrames() || connection->getUnconfirmedCount() != 0)
+    connection->timedConsumeMessage(std::chrono::milliseconds(10));
+  EXPECT_EQ(confirmed, 5);
+}
+
+TEST_F(ChannelPoolTest, PublishFailsWhenBrokerDoesNotConfirm)
+{
+  auto underlying = std::make_shared<MockRabbitmqConnection>();
+  EXPECT_CALL(*underlying, openChannel())
+      .WillOnce(Invoke([]() { return std::make_unique<RabbitmqChannel>(nullptr, 1); }));
+  EXPECT_CALL(*underlying, confirmSelect(_));
+  EXPECT_CALL(*underlying, publishToQueue(_, "others", _, _, _)).Times(1);
+  EXPECT_CALL(*underlying, timedConsumeMessage(_))
+      .WillRepeatedly(Invoke([](std::chrono::milliseconds) { return std::unique_ptr<IRabbitmqEnvelope>(); }));
+
+  ChannelPoolSettings settings;
+  settings.maxUnconfirmedPerChannel = 1;
+  settings.flowControlTimeout = std::chrono::milliseconds(50);
+  auto pool = ChannelPool::create(underlying, settings);
+  auto connection = pool->checkout();
+  auto channel = connection->openChannel();
+  connection->confirmSelect(*channel);
+
+  connection->publishToQueue(*channel, "others", BytesView("1"), RabbitmqMessageProperties(), [](bool) {});
+  EXPECT_THROW(connection->publishToQueue(*channel, "others", BytesView("2"), RabbitmqMessageProperties(),
+                                          [](bool) {}),
+               std::runtime_error);
+  EXPECT_EQ(connection->getUnconfirmedCount(), 1u);
+}
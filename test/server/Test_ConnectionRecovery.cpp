@@ -0,0 +1,161 @@
+#include "RabbitMQClient/ConnectionRecovery.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+TEST(ConnectionRecoveryTest, BackoffGrowsExponentiallyUpToMaxDelay)
+{
+  ConnectionRecoverySettings settings;
+  settings.initialDelay = std::chrono::milliseconds(100);
+  settings.maxDelay = std::chrono::milliseconds(1000);
+  settings.backoffMultiplier = 2.0;
+  settings.jitter = 0.0;
+  RecoveryBackoff backoff(settings);
+
+  EXPECT_EQ(backoff.nextDelay().count(), 100);
+  EXPECT_EQ(backoff.nextDelay().count(), 200);
+  EXPECT_EQ(backoff.nextDelay().count(), 400);
+  EXPECT_EQ(backoff.nextDelay().count(), 800);
+  EXPECT_EQ(backoff.nextDelay().count(), 1000);
+  EXPECT_EQ(backoff.nextDelay().count(), 1000);
+  EXPECT_EQ(backoff.getFailures(), 6u);
+
+  backoff.reset();
+  EXPECT_EQ(backoff.getFailures(), 0u);
+  EXPECT_EQ(backoff.nextDelay().count(), 100);
+}
+
+TEST(ConnectionRecoveryTest, BackoffJitterShortensDelayWithinBounds)
+{
+  ConnectionRecoverySettings settings;
+  settings.initialDelay = std::chrono::milliseconds(1000);
+  settings.maxDelay = std::chrono::milliseconds(1000);
+  settings.jitter = 0.5;
+  RecoveryBackoff backoff(settings);
+
+  bool varies = false;
+  const auto first = backoff.nextDelay();
+  for (int i = 0; i < 100; ++i)
+  {
+    const auto delay = backoff.nextDelay();
+    EXPECT_GE(delay.count(), 500);
+    EXPECT_LE(delay.count(), 1000);
+    varies = varies || delay != first;
+  }
+  EXPECT_TRUE(varies);
+}
+
+TEST(ConnectionRecoveryTest, TopologyReplaysChannelsFirst)
+{
+  RecordedTopology topology;
+  topology.recordChannel(1);
+  topology.recordExchange(1, "test_exchange", "direct");
+  topology.recordQueue(1, "request_queue");
+  topology.recordChannel(2);
+  topology.recordBind(2, "request_queue", "test_exchange", "request");
+  topology.recordQos(2, 10);
+  topology.recordConsume(2, "request_queue", false, false);
+
+  const auto order = topology.replayOrder();
+  ASSERT_EQ(order.size(), 7u);
+  EXPECT_EQ(order[0].kind, RecordedTopology::Kind::Channel);
+  EXPECT_EQ(order[0].channel, 1);
+  EXPECT_EQ(order[1].kind, RecordedTopology::Kind::Channel);
+  EXPECT_EQ(order[1].channel, 2);
+  EXPECT_EQ(order[2].kind, RecordedTopology::Kind::Exchange);
+  EXPECT_EQ(order[2].argument, "direct");
+  EXPECT_EQ(order[3].kind, RecordedTopology::Kind::Queue);
+  EXPECT_EQ(order[4].kind, RecordedTopology::Kind::Bind);
+  EXPECT_EQ(order[4].bindingKey, "request");
+  EXPECT_EQ(order[5].prefetchCount, 10);
+  EXPECT_EQ(order[6].kind, RecordedTopology::Kind::Consume);
+}
+
+TEST(ConnectionRecoveryTest, ForgetChannelKeepsDeclarations)
+{
+  RecordedTopology topology;
+  topology.recordChannel(1);
+  topology.recordQueue(1, "request_queue");
+  topology.recordQos(1, 10);
+  topology.recordConsume(1, "request_queue", false, false);
+  topology.recordConfirmSelect(1);
+  topology.recordChannel(2);
+
+  topology.forgetChannel(1);
+
+  EXPECT_FALSE(topology.hasChannel(1));
+  EXPECT_TRUE(topology.hasChannel(2));
+  ASSERT_EQ(topology.getEntries().size(), 2u);
+  EXPECT_EQ(topology.getEntries()[0].kind, RecordedTopology::Kind::Queue);
+  EXPECT_EQ(topology.getEntries()[1].kind, RecordedTopology::Kind::Channel);
+}
+
+TEST(ConnectionRecoveryTest, RenamedQueueResolvesToCurrentName)
+{
+  RecordedTopology topology;
+  EXPECT_EQ(topology.resolveQueueName("amq.gen-1"), "amq.gen-1");
+
+  topology.renameQueue("amq.gen-1", "amq.gen-2");
+  EXPECT_EQ(topology.resolveQueueName("amq.gen-1"), "amq.gen-2");
+  EXPECT_EQ(topology.resolveQueueName("request_queue"), "request_queue");
+
+  topology.renameQueue("amq.gen-1", "amq.gen-1");
+  EXPECT_EQ(topology.resolveQueueName("amq.gen-1"), "amq.gen-1");
+}
+
+TEST(ConnectionRecoveryTest, RepeatedDeclarationsAreRecordedOnce)
+{
+  RecordedTopology topology;
+  for (uint16_t channel = 1; channel <= 3; ++channel)
+  {
+    topology.recordChannel(channel);
+    topology.recordExchange(channel, "test_exchange", "direct");
+    topology.recordQueue(channel, "request_queue");
+    topology.recordBind(channel, "request_queue", "test_exchange", "request");
+    topology.recordQos(channel, 10);
+    topology.recordQos(channel, 20);
+  }
+  topology.recordBind(3, "request_queue", "test_exchange", "other");
+
+  const auto& entries = topology.getEntries();
+  const auto count = [&entries](RecordedTopology::Kind kind)
+  {
+    return std::count_if(entries.begin(), entries.end(), [kind](const RecordedTopology::Entry& entry)
+    {
+      return entry.kind == kind;
+    });
+  };
+  EXPECT_EQ(count(RecordedTopology::Kind::Channel), 3);
+  EXPECT_EQ(count(RecordedTopology::Kind::Exchange), 1);
+  EXPECT_EQ(count(RecordedTopology::Kind::Queue), 1);
+  EXPECT_EQ(count(RecordedTopology::Kind::Bind), 2);
+  EXPECT_EQ(count(RecordedTopology::Kind::Qos), 3);
+  EXPECT_EQ(entries[4].kind, RecordedTopology::Kind::Qos);
+  EXPECT_EQ(entries[4].prefetchCount, 20);
+}
+
+TEST(ConnectionRecoveryTest, ForgetChannelDropsItsExclusiveQueues)
+{
+  RecordedTopology topology;
+  topology.recordChannel(1);
+  topology.recordExchange(1, "test_exchange", "direct");
+  topology.recordExclusiveQueue(1, "amq.gen-1");
+  topology.recordBind(1, "amq.gen-1", "test_exchange", "response");
+  topology.recordChannel(2);
+  topology.recordExclusiveQueue(2, "amq.gen-2");
+  topology.recordBind(2, "amq.gen-2", "test_exchange", "response");
+  topology.renameQueue("amq.gen-1", "amq.gen-3");
+
+  topology.forgetChannel(1);
+
+  const auto& entries = topology.getEntries();
+  ASSERT_EQ(entries.size(), 4u);
+  EXPECT_EQ(entries[0].kind, RecordedTopology::Kind::Exchange);
+  EXPECT_EQ(entries[1].kind, RecordedTopology::Kind::Channel);
+  EXPECT_EQ(entries[2].kind, RecordedTopology::Kind::ExclusiveQueue);
+  EXPECT_EQ(entries[2].name, "amq.gen-2");
+  EXPECT_EQ(entries[3].kind, RecordedTopology::Kind::Bind);
+  EXPECT_EQ(entries[3].name, "amq.gen-2");
+  EXPECT_EQ(topology.resolveQueueName("amq.gen-1"), "amq.gen-1");
+}
@@ -0,0 +1,281 @@
+#include "mocks.h"
+
+#include "RabbitMQClient/ConsumerEventLoop.h"
+#include "RabbitMQClient/InMemoryConnection.h"
+#include "Logger/Logger.h"
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+using testing::_;
+using testing::Invoke;
+
+namespace
+{
+  // Соединение, которое сообщает о кадрах через канал (pipe) и может "переподключиться" на новый канал
+  class PipeConnection : public MockRabbitmqConnection
+  {
+  public:
+    PipeConnection()
+    {
+      open();
+      ON_CALL(*this, timedConsumeMessage(_))
+          .WillByDefault(Invoke([this](std::chrono::milliseconds)
+          {
+            char frame = 0;
+            if (read(m_fds[0], &frame, 1) != 1)
+              return std::unique_ptr<IRabbitmqEnvelope>();
+            return std::unique_ptr<IRabbitmqEnvelope>(new MockRabbitmqEnvelope());
+          }));
+    }
+
+    ~PipeConnection() override
+    {
+      close(m_fds[0]);
+      close(m_fds[1]);
+    }
+
+    void reconnect()
+    {
+      close(m_fds[0]);
+      close(m_fds[1]);
+      open();
+      ++m_generation;
+    }
+
+    void deliver()
+    {
+      const char frame = 1;
+      ASSERT_EQ(write(m_fds[1], &frame, 1), 1);
+    }
+
+    int getReadableFd() const override {return m_fds[0];}
+    uint64_t getConnectionGeneration() const override {return m_generation;}
+  private:
+    void open()
+    {
+      ASSERT_EQ(pipe(m_fds), 0);
+      fcntl(m_fds[0], F_SETFL, O_NONBLOCK);
+    }
+
+    int m_fds[2] = {-1, -1};
+    uint64_t m_generation = 0;
+  };
+}
+
+class ConsumerEventLoopTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<InMemoryBroker> broker = InMemoryBroker::create();
+
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+
+  struct Endpoint
+  {
+    std::shared_ptr<InMemoryConnection> connection;
+    std::unique_ptr<RabbitmqChannel> channel;
+    std::unique_ptr<RabbitmqExchange> exchange;
+    std::unique_ptr<RabbitmqQueue> queue;
+    std::unique_ptr<RabbitmqBind> binding;
+  };
+
+  Endpoint connect(bool consume)
+  {
+    Endpoint endpoint;
+    endpoint.connection = InMemoryConnection::create(broker);
+    endpoint.channel = endpoint.connection->openChannel();
+    endpoint.exchange = endpoint.connection->declareExchange(*endpoint.channel, "exchange", "direct");
+    endpoint.queue = endpoint.connection->declareQueue(*endpoint.channel, "requests");
+    endpoint.binding = endpoint.connection->bind(*endpoint.channel, *endpoint.queue, *endpoint.exchange, "requests");
+    if (consume)
+      endpoint.connection->basicConsume(*endpoint.channel, *endpoint.queue, true, false);
+    return endpoint;
+  }
+
+  void publish(Endpoint& endpoint, const std::string& message)
+  {
+    endpoint.connection->publishMessage(*endpoint.channel, *endpoint.exchange, *endpoint.binding, BytesView(message));
+  }
+
+  static bool isReadable(int fd)
+  {
+    pollfd descriptor{fd, POLLIN, 0};
+    return poll(&descriptor, 1, 0) == 1;
+  }
+};
+
+TEST_F(ConsumerEventLoopTest, NotificationFdIsReadableWhileDeliveriesArePending)
+{
+  Endpoint consumer = connect(true);
+  Endpoint producer = connect(false);
+
+  const int fd = consumer.connection->getReadableFd();
+  ASSERT_GE(fd, 0);
+  EXPECT_FALSE(isReadable(fd));
+
+  publish(producer, "1");
+  publish(producer, "2");
+  EXPECT_TRUE(isReadable(fd));
+
+  ASSERT_NE(consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0)), nullptr);
+  EXPECT_TRUE(isReadable(fd));
+  ASSERT_NE(consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0)), nullptr);
+  EXPECT_FALSE(isReadable(fd));
+}
+
+TEST_F(ConsumerEventLoopTest, DispatchesMessageWithoutWaitingForPollInterval)
+{
+  Endpoint consumer = connect(true);
+  Endpoint producer = connect(false);
+
+  // интервал опроса больше ожидания в тесте: сообщение может прийти только по событию epoll
+  ConsumerEventLoop loop(std::chrono::seconds(10));
+  std::atomic<int> received(0);
+  loop.addConnection(consumer.connection, [&received](std::unique_ptr<IRabbitmqEnvelope> envelope)
+  {
+    EXPECT_EQ(envelope->getMessage(), "request");
+    ++received;
+  });
+
+  std::thread loopThread([&loop]() { loop.run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  const auto publishedAt = std::chrono::steady_clock::now();
+  publish(producer, "request");
+  while (received == 0 && std::chrono::steady_clock::now() - publishedAt < std::chrono::seconds(2))
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  const auto deliveredAfter = std::chrono::steady_clock::now() - publishedAt;
+
+  loop.stop();
+  loopThread.join();
+
+  EXPECT_EQ(received, 1);
+  EXPECT_LT(deliveredAfter, std::chrono::milliseconds(500));
+}
+
+TEST_F(ConsumerEventLoopTest, StopWakesIdleLoop)
+{
+  Endpoint consumer = connect(true);
+  ConsumerEventLoop loop(std::chrono::seconds(10));
+  loop.addConnection(consumer.connection, [](std::unique_ptr<IRabbitmqEnvelope>) {});
+
+  std::thread loopThread([&loop]() { loop.run(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const auto stoppedAt = std::chrono::steady_clock::now();
+  loop.stop();
+  loopThread.join();
+
+  EXPECT_LT(std::chrono::steady_clock::now() - stoppedAt, std::chrono::seconds(1));
+  EXPECT_TRUE(loop.isStopped());
+}
+
+TEST_F(ConsumerEventLoopTest, DrainsAllPendingMessagesInOneWakeup)
+{
+  Endpoint consumer = connect(true);
+  Endpoint producer = connect(false);
+  for (const char* message : {"1", "2", "3"})
+    publish(producer, message);
+
+  ConsumerEventLoop loop;
+  std::vector<std::string> received;
+  loop.addConnection(consumer.connection, [&received](std::unique_ptr<IRabbitmqEnvelope> envelope)
+  {
+    received.push_back(envelope->getMessage());
+  });
+
+  EXPECT_EQ(loop.runOnce(std::chrono::milliseconds(100)), 3u);
+  EXPECT_EQ(received, (std::vector<std::string>{"1", "2", "3"}));
+  EXPECT_EQ(loop.runOnce(std::chrono::milliseconds(0)), 0u);
+}
+
+TEST_F(ConsumerEventLoopTest, DeliversBufferedPublishConfirms)
+{
+  Endpoint consumer = connect(true);
+  consumer.connection->confirmSelect(*consumer.channel);
+
+  bool confirmed = false;
+  consumer.connection->publishToQueue(*consumer.channel, "others", BytesView("message"), RabbitmqMessageProperties(),
+                                      [&confirmed](bool acked) { confirmed = acked; });
+  ASSERT_TRUE(consumer.connection->hasBufferedFrames());
+
+  ConsumerEventLoop loop;
+  loop.addConnection(consumer.connection, [](std::unique_ptr<IRabbitmqEnvelope>) {});
+  // подтверждения не делают дескриптор читаемым, цикл не должен уснуть, пока они не выданы
+  loop.runOnce(std::chrono::seconds(10));
+  EXPECT_TRUE(confirmed);
+  EXPECT_FALSE(consumer.connection->hasBufferedFrames());
+}
+
+TEST_F(ConsumerEventLoopTest, HandlerCanRemoveItsConnection)
+{
+  Endpoint consumer = connect(true);
+  Endpoint producer = connect(false);
+  publish(producer, "1");
+  publish(producer, "2");
+
+  ConsumerEventLoop loop;
+  int received = 0;
+  loop.addConnection(consumer.connection, [&](std::unique_ptr<IRabbitmqEnvelope>)
+  {
+    ++received;
+    loop.removeConnection(*consumer.connection);
+  });
+
+  loop.runOnce(std::chrono::milliseconds(100));
+  EXPECT_GE(received, 1);
+  const int receivedBeforeRemoval = received;
+  publish(producer, "3");
+  EXPECT_EQ(loop.runOnce(std::chrono::milliseconds(20)), 0u);
+  EXPECT_EQ(received, receivedBeforeRemoval);
+}
+
+TEST_F(ConsumerEventLoopTest, PollsConnectionWithoutDescriptor)
+{
+  auto connection = std::make_shared<MockRabbitmqConnection>();
+  std::atomic<int> polls(0);
+  EXPECT_CALL(*connection, timedConsumeMessage(std::chrono::milliseconds(0)))
+      .WillRepeatedly(Invoke([&polls](std::chrono::milliseconds)
+      {
+        if (++polls == 1)
+          return std::unique_ptr<IRabbitmqEnvelope>(new MockRabbitmqEnvelope());
+        return std::unique_ptr<IRabbitmqEnvelope>();
+      }));
+
+  ConsumerEventLoop loop(std::chrono::milliseconds(10));
+  int received = 0;
+  loop.addConnection(connection, [&received](std::unique_ptr<IRabbitmqEnvelope>) { ++received; });
+
+  const auto startedAt = std::chrono::steady_clock::now();
+  EXPECT_EQ(loop.runOnce(std::chrono::seconds(10)), 1u);
+  EXPECT_LT(std::chrono::steady_clock::now() - startedAt, std::chrono::seconds(1));
+  EXPECT_EQ(received, 1);
+}
+
+TEST_F(ConsumerEventLoopTest, WatchesDescriptorReusedAfterReconnect)
+{
+  auto connection = std::make_shared<testing::NiceMock<PipeConnection>>();
+  // интервал опроса больше ожидания в тесте: сообщение может прийти только по событию epoll
+  ConsumerEventLoop loop(std::chrono::seconds(10));
+  int received = 0;
+  loop.addConnection(connection, [&received](std::unique_ptr<IRabbitmqEnvelope>) { ++received; });
+
+  connection->deliver();
+  EXPECT_EQ(loop.runOnce(std::chrono::milliseconds(500)), 1u);
+
+  // новый сокет обычно получает номер закрытого, epoll же забыл прежний при закрытии
+  const int previousFd = connection->getReadableFd();
+  connection->reconnect();
+  EXPECT_EQ(connection->getReadableFd(), previousFd);
+  connection->deliver();
+  EXPECT_EQ(loop.runOnce(std::chrono::milliseconds(500)), 1u);
+  EXPECT_EQ(received, 2);
+}
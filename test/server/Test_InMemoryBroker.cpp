@@ -0,0 +1,212 @@
+#include "Server.h"
+#include "protocol/Messages.pb.h"
+#include "RabbitMQClient/InMemoryConnection.h"
+#include "Logger/Logger.h"
+
+#include <gtest/gtest.h>
+
+class InMemoryBrokerTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<InMemoryBroker> broker = InMemoryBroker::create();
+
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+
+  // Соединение, подписанное на очередь queueName, привязанную к обменнику exchange
+  struct Consumer
+  {
+    std::shared_ptr<InMemoryConnection> connection;
+    std::unique_ptr<RabbitmqChannel> channel;
+    std::unique_ptr<RabbitmqExchange> exchange;
+    std::unique_ptr<RabbitmqQueue> queue;
+    std::unique_ptr<RabbitmqBind> binding;
+  };
+
+  Consumer subscribe(const std::string& queueName, uint16_t prefetchCount = 0, bool noAck = false)
+  {
+    Consumer consumer;
+    consumer.connection = InMemoryConnection::create(broker);
+    consumer.channel = consumer.connection->openChannel();
+    consumer.exchange = consumer.connection->declareExchange(*consumer.channel, "exchange", "direct");
+    consumer.queue = consumer.connection->declareQueue(*consumer.channel, queueName);
+    consumer.binding = consumer.connection->bind(*consumer.channel, *consumer.queue, *consumer.exchange, queueName);
+    if (prefetchCount != 0)
+      consumer.connection->basicQos(*consumer.channel, prefetchCount);
+    consumer.connection->basicConsume(*consumer.channel, *consumer.queue, noAck, false);
+    return consumer;
+  }
+
+  std::string receive(Consumer& consumer)
+  {
+    auto envelope = consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+    return envelope ? envelope->getMessage() : std::string();
+  }
+};
+
+TEST_F(InMemoryBrokerTest, RoutesByBindingKeyAndDistributesRoundRobin)
+{
+  Consumer first = subscribe("requests");
+  Consumer second = subscribe("requests");
+  Consumer other = subscribe("others");
+
+  for (const char* message : {"1", "2", "3", "4"})
+    first.connection->publishMessage(*first.channel, *first.exchange, *first.binding, BytesView(message, 1));
+
+  EXPECT_EQ(receive(first), "1");
+  EXPECT_EQ(receive(first), "3");
+  EXPECT_EQ(receive(second), "2");
+  EXPECT_EQ(receive(second), "4");
+  EXPECT_EQ(other.connection->timedConsumeMessage(std::chrono::milliseconds(0)), nullptr);
+}
+
+TEST_F(InMemoryBrokerTest, PrefetchLimitsUnackedMessages)
+{
+  Consumer consumer = subscribe("requests", 1);
+  for (const char* message : {"1", "2"})
+    consumer.connection->publishMessage(*consumer.channel, *consumer.exchange, *consumer.binding, BytesView(message, 1));
+
+  auto envelope = consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(envelope, nullptr);
+  EXPECT_EQ(consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0)), nullptr);
+  EXPECT_EQ(broker->getReadyCount("requests"), 1u);
+
+  consumer.connection->ack(*envelope);
+  EXPECT_EQ(receive(consumer), "2");
+}
+
+TEST_F(InMemoryBrokerTest, RejectWithRequeueRedeliversToNextConsumer)
+{
+  Consumer first = subscribe("requests");
+  Consumer second = subscribe("requests");
+  first.connection->publishMessage(*first.channel, *first.exchange, *first.binding, BytesView("1", 1));
+
+  auto envelope = first.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(envelope, nullptr);
+  first.connection->reject(*envelope, true);
+  auto redelivered = second.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(redelivered, nullptr);
+  EXPECT_EQ(redelivered->getMessage(), "1");
+  second.connection->ack(*redelivered);
+
+  // без возврата в очередь сообщение отбрасывается
+  first.connection->publishMessage(*first.channel, *first.exchange, *first.binding, BytesView("2", 1));
+  envelope = first.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(envelope, nullptr);
+  first.connection->reject(*envelope, false);
+  EXPECT_EQ(broker->getReadyCount("requests"), 0u);
+  EXPECT_EQ(broker->getUnackedCount("requests"), 0u);
+}
+
+TEST_F(InMemoryBrokerTest, ClosedConnectionReturnsUnackedMessages)
+{
+  Consumer survivor = subscribe("requests", 1);
+  {
+    Consumer failed = subscribe("requests");
+    for (const char* message : {"1", "2"})
+      failed.connection->publishMessage(*failed.channel, *failed.exchange, *failed.binding, BytesView(message, 1));
+    ASSERT_NE(failed.connection->timedConsumeMessage(std::chrono::milliseconds(0)), nullptr);
+  }
+
+  // "1" получил первый подписчик, "2" - упавший, после закрытия соединения "2" возвращается в очередь
+  EXPECT_EQ(broker->getUnackedCount("requests"), 1u);
+  auto envelope = survivor.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(envelope, nullptr);
+  EXPECT_EQ(envelope->getMessage(), "1");
+  survivor.connection->ack(*envelope);
+  EXPECT_EQ(receive(survivor), "2");
+}
+
+TEST_F(InMemoryBrokerTest, ClosedChannelReturnsUnackedMessagesToOtherChannel)
+{
+  Consumer consumer = subscribe("requests");
+  auto closing = consumer.connection->openChannel();
+  ASSERT_NE(closing->getId(), consumer.channel->getId());
+  consumer.connection->basicConsume(*closing, *consumer.queue, false, false);
+
+  for (const char* message : {"1", "2"})
+    consumer.connection->publishMessage(*consumer.channel, *consumer.exchange, *consumer.binding, BytesView(message, 1));
+  auto first = consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  auto second = consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(first->getChannel(), consumer.channel->getId());
+  EXPECT_EQ(second->getChannel(), closing->getId());
+
+  // подписка закрытого канала отменяется, а его сообщение получает оставшийся канал того же соединения
+  closing.reset();
+  consumer.connection->ack(*first);
+  auto redelivered = consumer.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(redelivered, nullptr);
+  EXPECT_EQ(redelivered->getMessage(), "2");
+  EXPECT_EQ(redelivered->getChannel(), consumer.channel->getId());
+}
+
+TEST_F(InMemoryBrokerTest, DirectReplyToDeliversToRequester)
+{
+  Consumer server = subscribe("requests");
+  auto client = InMemoryConnection::create(broker);
+  auto channel = client->openChannel();
+  client->consumeDirectReplyTo(*channel);
+
+  RabbitmqMessageProperties properties;
+  properties.replyTo = directReplyToQueue;
+  properties.correlationId = "7";
+  client->publishMessage(*channel, *server.exchange, *server.binding, BytesView("request", 7), properties);
+
+  auto request = server.connection->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(request, nullptr);
+  EXPECT_NE(request->getReplyTo(), directReplyToQueue);
+  EXPECT_EQ(request->getCorrelationId(), "7");
+
+  RabbitmqMessageProperties replyProperties;
+  replyProperties.correlationId = request->getCorrelationId();
+  server.connection->publishToQueue(*server.channel, request->getReplyTo(), BytesView("reply", 5), replyProperties);
+
+  auto reply = client->timedConsumeMessage(std::chrono::milliseconds(0));
+  ASSERT_NE(reply, nullptr);
+  EXPECT_EQ(reply->getMessage(), "reply");
+  EXPECT_EQ(reply->getCorrelationId(), "7");
+}
+
+TEST_F(InMemoryBrokerTest, ConfirmsArriveOnNextConsume)
+{
+  Consumer consumer = subscribe("requests");
+  consumer.connection->confirmSelect(*consumer.channel);
+
+  bool confirmed = false;
+  consumer.connection->publishMessage(*consumer.channel, *consumer.exchange, *consumer.binding, BytesView("1", 1),
+                                      RabbitmqMessageProperties(), [&confirmed](bool acked) { confirmed = acked; });
+  EXPECT_FALSE(confirmed);
+  EXPECT_EQ(consumer.connection->getUnconfirmedCount(), 1u);
+
+  EXPECT_EQ(receive(consumer), "1");
+  EXPECT_TRUE(confirmed);
+  EXPECT_EQ(consumer.connection->getUnconfirmedCount(), 0u);
+}
+
+TEST_F(InMemoryBrokerTest, ServerAnswersRequestThroughBroker)
+{
+  auto server = std::make_unique<Server>(InMemoryConnection::create(broker),
+                                         "localhost", 5672, "guest", "guest", 0, "/",
+                                         "exchange", "responses", "requests");
+  Consumer client = subscribe("responses");
+
+  TestTask::Messages::Request request;
+  request.set_id("client");
+  request.set_req(21);
+  auto requestQueue = client.connection->declareQueue(*client.channel, "requests");
+  auto requestBinding = client.connection->bind(*client.channel, *requestQueue, *client.exchange, "requests");
+  std::string buffer;
+  client.connection->publishMessage(*client.channel, *client.exchange, *requestBinding, serializeToBuffer(request, buffer));
+
+  server->processRequestResponseCycle(std::chrono::milliseconds(0));
+
+  TestTask::Messages::Response response;
+  ASSERT_TRUE(response.ParseFromString(receive(client)));
+  EXPECT_EQ(response.id(), "client");
+  EXPECT_EQ(response.res(), Server::generateResponseValue(21));
+  EXPECT_EQ(broker->getUnackedCount("requests"), 0u);
+}
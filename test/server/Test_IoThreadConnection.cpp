@@ -0,0 +1,314 @@
+#include "mocks.h"
+
+#include "RabbitMQClient/ConsumerEventLoop.h"
+#include "RabbitMQClient/InMemoryConnection.h"
+#include "RabbitMQClient/IoThreadConnection.h"
+#include "Logger/Logger.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <ctime>
+#include <functional>
+#include <future>
+#include <thread>
+
+using testing::_;
+using testing::Invoke;
+
+class IoThreadConnectionTest : public ::testing::Test
+{
+protected:
+  std::shared_ptr<InMemoryBroker> broker = InMemoryBroker::create();
+  std::shared_ptr<IoThreadConnection> io = IoThreadConnection::create(InMemoryConnection::create(broker));
+
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+
+  struct Endpoint
+  {
+    std::shared_ptr<IRabbitmqConnection> connection;
+    std::unique_ptr<RabbitmqChannel> channel;
+    std::unique_ptr<RabbitmqExchange> exchange;
+    std::unique_ptr<RabbitmqQueue> queue;
+    std::unique_ptr<RabbitmqBind> binding;
+  };
+
+  Endpoint connect(const std::string& queueName, bool consume)
+  {
+    Endpoint endpoint;
+    endpoint.connection = io->attach();
+    endpoint.channel = endpoint.connection->openChannel();
+    endpoint.exchange = endpoint.connection->declareExchange(*endpoint.channel, "exchange", "direct");
+    endpoint.queue = endpoint.connection->declareQueue(*endpoint.channel, queueName);
+    endpoint.binding = endpoint.connection->bind(*endpoint.channel, *endpoint.queue, *endpoint.exchange, queueName);
+    if (consume)
+      endpoint.connection->basicConsume(*endpoint.channel, *endpoint.queue, false, false);
+    return endpoint;
+  }
+
+  // Получает сообщения, пока не выполнится условие: ошибки команд и остановки приходят раньше отклонений публикаций
+  static void consumeUntil(IRabbitmqConnection& connection, const std::function<bool()>& done)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done() && std::chrono::steady_clock::now() < deadline)
+    {
+      try
+      {
+        connection.timedConsumeMessage(std::chrono::milliseconds(100));
+      }
+      catch (const std::runtime_error&)
+      {
+      }
+    }
+  }
+};
+
+TEST_F(IoThreadConnectionTest, ThreadsShareOneConnection)
+{
+  const size_t threadCount = 8;
+  const size_t messageCount = 50;
+  std::vector<std::vector<std::string>> received(threadCount);
+  std::vector<Endpoint> consumers;
+  for (size_t i = 0; i < threadCount; ++i)
+    consumers.push_back(connect("queue" + std::to_string(i), true));
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < threadCount; ++i)
+    threads.emplace_back([&, i]()
+    {
+      Endpoint& consumer = consumers[i];
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while (received[i].size() < messageCount && std::chrono::steady_clock::now() < deadline)
+      {
+        auto envelope = consumer.connection->timedConsumeMessage(std::chrono::milliseconds(100));
+        if (!envelope)
+          continue;
+        EXPECT_EQ(envelope->getChannel(), consumer.channel->getId());
+        received[i].push_back(envelope->getMessage());
+        consumer.connection->ack(*envelope);
+      }
+    });
+
+  std::vector<std::vector<std::string>> expected(threadCount);
+  std::vector<std::thread> producers;
+  for (size_t i = 0; i < threadCount; ++i)
+  {
+    for (size_t j = 0; j < messageCount; ++j)
+      expected[i].push_back(std::to_string(i) + ":" + std::to_string(j));
+    producers.emplace_back([&, i]()
+    {
+      Endpoint producer = connect("queue" + std::to_string(i), false);
+      for (const auto& message : expected[i])
+        producer.connection->publishMessage(*producer.channel, *producer.exchange, *producer.binding,
+                                            BytesView(message));
+    });
+  }
+  for (auto& producer : producers)
+    producer.join();
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(received, expected);
+  // ack выполняются без ожидания, синхронный вызов проходит через очередь команд после них
+  consumers[0].connection->basicQos(*consumers[0].channel, 10);
+  for (size_t i = 0; i < threadCount; ++i)
+    EXPECT_EQ(broker->getUnackedCount("queue" + std::to_string(i)), 0u);
+}
+
+TEST_F(IoThreadConnectionTest, ConfirmCallbacksRunOnEndpointThread)
+{
+  Endpoint endpoint = connect("requests", false);
+  endpoint.connection->confirmSelect(*endpoint.channel);
+
+  const auto owner = std::this_thread::get_id();
+  int confirmed = 0;
+  for (int i = 0; i < 3; ++i)
+    endpoint.connection->publishToQueue(*endpoint.channel, "requests", BytesView("message"),
+                                        RabbitmqMessageProperties(), [&](bool acked)
+    {
+      EXPECT_EQ(std::this_thread::get_id(), owner);
+      confirmed += acked ? 1 : 0;
+    });
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (confirmed < 3 && std::chrono::steady_clock::now() < deadline)
+    endpoint.connection->timedConsumeMessage(std::chrono::milliseconds(100));
+  EXPECT_EQ(confirmed, 3);
+  EXPECT_EQ(endpoint.connection->getUnconfirmedCount(), 0u);
+}
+
+TEST_F(IoThreadConnectionTest, FailedPublishIsReportedOnNextConsume)
+{
+  Endpoint endpoint = connect("requests", false);
+  // канал без confirm.select: публикация с подтверждением отклоняется в потоке ввода-вывода
+  bool rejected = false;
+  endpoint.connection->publishToQueue(*endpoint.channel, "requests", BytesView("message"),
+                                      RabbitmqMessageProperties(), [&rejected](bool acked) { rejected = !acked; });
+  EXPECT_THROW(endpoint.connection->timedConsumeMessage(std::chrono::seconds(5)), std::runtime_error);
+  EXPECT_EQ(endpoint.connection->getUnconfirmedCount(), 0u);
+  // обработчик неотправленной публикации выполняется при одном из следующих получений
+  consumeUntil(*endpoint.connection, [&rejected]() { return rejected; });
+  EXPECT_TRUE(rejected);
+}
+
+TEST_F(IoThreadConnectionTest, EndpointWorksWithConsumerEventLoop)
+{
+  Endpoint consumer = connect("requests", true);
+  Endpoint producer = connect("requests", false);
+  ASSERT_GE(consumer.connection->getReadableFd(), 0);
+
+  ConsumerEventLoop loop(std::chrono::seconds(10));
+  std::vector<std::string> received;
+  loop.addConnection(consumer.connection, [&](std::unique_ptr<IRabbitmqEnvelope> envelope)
+  {
+    received.push_back(envelope->getMessage());
+    consumer.connection->ack(*envelope);
+  });
+
+  producer.connection->publishMessage(*producer.channel, *producer.exchange, *producer.binding, BytesView("request"));
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (received.empty() && std::chrono::steady_clock::now() < deadline)
+    loop.runOnce(std::chrono::milliseconds(100));
+  EXPECT_EQ(received, std::vector<std::string>{"request"});
+}
+
+TEST_F(IoThreadConnectionTest, ClosingEndpointReturnsUnackedMessages)
+{
+  Endpoint producer = connect("requests", false);
+  {
+    Endpoint consumer = connect("requests", true);
+    producer.connection->publishMessage(*producer.channel, *producer.exchange, *producer.binding, BytesView("1"));
+    ASSERT_NE(consumer.connection->timedConsumeMessage(std::chrono::seconds(5)), nullptr);
+  }
+  producer.connection->basicQos(*producer.channel, 10);
+  EXPECT_EQ(broker->getUnackedCount("requests"), 0u);
+  EXPECT_EQ(broker->getReadyCount("requests"), 1u);
+}
+
+TEST_F(IoThreadConnectionTest, StoppedConnectionRejectsCalls)
+{
+  Endpoint endpoint = connect("requests", true);
+  io->stop();
+
+  EXPECT_THROW(endpoint.connection->timedConsumeMessage(std::chrono::seconds(5)), std::runtime_error);
+  EXPECT_THROW(endpoint.connection->openChannel(), std::runtime_error);
+  EXPECT_THROW(io->attach(), std::runtime_error);
+  EXPECT_FALSE(io->isRunning());
+}
+
+TEST_F(IoThreadConnectionTest, CancelledPublishIsRejected)
+{
+  auto connection = std::make_shared<testing::NiceMock<MockRabbitmqConnection>>();
+  std::weak_ptr<IRabbitmqConnection> weakConnection = connection;
+  ON_CALL(*connection, openChannel())
+      .WillByDefault(Invoke([weakConnection]() { return std::make_unique<RabbitmqChannel>(weakConnection.lock(), 1); }));
+  // поток ввода-вывода ждет в чтении кадров, пока в очередь добавляется публикация, а затем теряет соединение
+  std::atomic<bool> armed(false);
+  std::promise<void> started;
+  std::promise<void> released;
+  auto releasedFuture = released.get_future().share();
+  ON_CALL(*connection, timedConsumeMessage(_))
+      .WillByDefault(Invoke([&armed, &started, releasedFuture](std::chrono::milliseconds)
+      {
+        if (!armed.exchange(false))
+          return std::unique_ptr<IRabbitmqEnvelope>();
+        started.set_value();
+        releasedFuture.wait();
+        throw std::runtime_error("connection lost");
+      }));
+  EXPECT_CALL(*connection, publishToQueue(_, _, _, _, _))
+      .Times(0);
+
+  auto failingIo = IoThreadConnection::create(connection);
+  auto endpoint = failingIo->attach();
+  auto channel = endpoint->openChannel();
+  armed = true;
+  started.get_future().wait();
+
+  int rejected = 0;
+  endpoint->publishToQueue(*channel, "requests", BytesView("message"), RabbitmqMessageProperties(),
+                           [&rejected](bool acked) { rejected += acked ? 0 : 1; });
+  EXPECT_EQ(endpoint->getUnconfirmedCount(), 1u);
+  released.set_value();
+
+  // сначала приходит ошибка соединения, затем отклонение невыполненной публикации
+  EXPECT_THROW(endpoint->timedConsumeMessage(std::chrono::seconds(5)), std::runtime_error);
+  consumeUntil(*endpoint, [&rejected]() { return rejected != 0; });
+  EXPECT_EQ(rejected, 1);
+  EXPECT_EQ(endpoint->getUnconfirmedCount(), 0u);
+
+  // публикация в остановленное соединение не принимается и не остается в счетчике
+  EXPECT_THROW(endpoint->publishToQueue(*channel, "requests", BytesView("message"), RabbitmqMessageProperties(),
+                                        [](bool) {}), std::runtime_error);
+  EXPECT_EQ(endpoint->getUnconfirmedCount(), 0u);
+  EXPECT_EQ(rejected, 1);
+}
+
+TEST_F(IoThreadConnectionTest, SendersSleepWhileCommandQueueIsFull)
+{
+  auto connection = std::make_shared<testing::NiceMock<MockRabbitmqConnection>>();
+  std::weak_ptr<IRabbitmqConnection> weakConnection = connection;
+  amqp_channel_t lastChannel = 0;
+  ON_CALL(*connection, openChannel())
+      .WillByDefault(Invoke([weakConnection, &lastChannel]()
+      {
+        return std::make_unique<RabbitmqChannel>(weakConnection.lock(), ++lastChannel);
+      }));
+  // поток ввода-вывода занят чтением кадров, пока отправители заполняют очередь команд
+  std::atomic<bool> armed(false);
+  std::promise<void> started;
+  std::promise<void> released;
+  auto releasedFuture = released.get_future().share();
+  ON_CALL(*connection, timedConsumeMessage(_))
+      .WillByDefault(Invoke([&armed, &started, releasedFuture](std::chrono::milliseconds)
+      {
+        if (armed.exchange(false))
+        {
+          started.set_value();
+          releasedFuture.wait();
+        }
+        return std::unique_ptr<IRabbitmqEnvelope>();
+      }));
+  const size_t senderCount = 4;
+  const size_t messageCount = 20;
+  EXPECT_CALL(*connection, publishToQueue(_, _, _, _, _))
+      .Times(senderCount * messageCount);
+
+  IoThreadSettings settings;
+  settings.commandQueueCapacity = 2;
+  auto blockedIo = IoThreadConnection::create(connection, settings);
+  std::vector<std::shared_ptr<IRabbitmqConnection>> endpoints;
+  std::vector<std::unique_ptr<RabbitmqChannel>> channels;
+  for (size_t i = 0; i < senderCount; ++i)
+  {
+    endpoints.push_back(blockedIo->attach());
+    channels.push_back(endpoints.back()->openChannel());
+  }
+  armed = true;
+  started.get_future().wait();
+
+  std::vector<std::thread> senders;
+  for (size_t i = 0; i < senderCount; ++i)
+    senders.emplace_back([&, i]()
+    {
+      for (size_t j = 0; j < messageCount; ++j)
+        endpoints[i]->publishToQueue(*channels[i], "requests", BytesView("message"), RabbitmqMessageProperties(),
+                                     [](bool) {});
+    });
+
+  // отправители, которым не хватило места, спят, а не занимают процессор
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  const std::clock_t cpuBefore = std::clock();
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  const double cpuSeconds = static_cast<double>(std::clock() - cpuBefore) / CLOCKS_PER_SEC;
+  EXPECT_LT(cpuSeconds, 0.15);
+
+  released.set_value();
+  for (auto& sender : senders)
+    sender.join();
+  // синхронный вызов выполняется после всех публикаций, добавленных в очередь раньше него
+  endpoints[0]->basicQos(*channels[0], 1);
+}
@@ -0,0 +1,82 @@
+#include "RabbitMQClient/Metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+TEST(MetricsTest, CounterSumsIncrementsFromAllThreads)
+{
+  MetricCounter counter;
+  const int threadCount = 8;
+  const int incrementsPerThread = 10000;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < threadCount; ++i)
+    threads.emplace_back([&counter]()
+                         {
+                           for (int j = 0; j < incrementsPerThread; ++j)
+                             counter.increment();
+                         });
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(counter.value(), static_cast<uint64_t>(threadCount * incrementsPerThread));
+}
+
+TEST(MetricsTest, HistogramBucketsCoverValuesWithBoundedError)
+{
+  for (uint64_t value : {0ull, 1ull, 31ull, 32ull, 33ull, 1000ull, 123456ull, 987654321ull})
+  {
+    const size_t index = LatencyHistogram::bucketIndex(value);
+    ASSERT_LT(index, LatencyHistogram::bucketCount());
+    EXPECT_LE(LatencyHistogram::bucketLowerBound(index), value);
+    EXPECT_GE(LatencyHistogram::bucketUpperBound(index), value);
+    // ширина интервала не больше 1/32 его нижней границы
+    EXPECT_LE(LatencyHistogram::bucketUpperBound(index) - LatencyHistogram::bucketLowerBound(index),
+              LatencyHistogram::bucketLowerBound(index) / 32);
+  }
+
+  // соседние интервалы идут без пропусков
+  for (size_t index = 1; index < LatencyHistogram::bucketCount(); ++index)
+    ASSERT_EQ(LatencyHistogram::bucketLowerBound(index), LatencyHistogram::bucketUpperBound(index - 1) + 1);
+}
+
+TEST(MetricsTest, HistogramPercentiles)
+{
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 1000; ++value)
+    histogram.record(value);
+
+  HistogramSnapshot snapshot = histogram.snapshot();
+  EXPECT_EQ(snapshot.count, 1000u);
+  EXPECT_EQ(snapshot.sum, 500500u);
+  EXPECT_EQ(snapshot.max, 1000u);
+  EXPECT_NEAR(static_cast<double>(snapshot.valueAtPercentile(50)), 500.0, 500.0 / 32);
+  EXPECT_NEAR(static_cast<double>(snapshot.valueAtPercentile(99)), 990.0, 990.0 / 32);
+  EXPECT_EQ(snapshot.valueAtPercentile(100), 1000u);
+  EXPECT_EQ(snapshot.countAtOrBelow(31), 31u);
+}
+
+TEST(MetricsTest, HistogramClampsLargeValues)
+{
+  LatencyHistogram histogram;
+  histogram.record(LatencyHistogram::maxTrackableValue * 4);
+
+  HistogramSnapshot snapshot = histogram.snapshot();
+  EXPECT_EQ(snapshot.count, 1u);
+  EXPECT_EQ(snapshot.buckets.back(), 1u);
+}
+
+TEST(MetricsTest, RegistryReturnsSameMetricForName)
+{
+  MetricsRegistry registry;
+  MetricCounter& counter = registry.counter("test_events_total");
+  EXPECT_EQ(&counter, &registry.counter("test_events_total"));
+  counter.increment(3);
+  registry.histogram("test_duration_microseconds").record(42);
+
+  MetricsRegistry::Snapshot snapshot = registry.snapshot();
+  EXPECT_EQ(snapshot.counters.at("test_events_total"), 3u);
+  EXPECT_EQ(snapshot.histograms.at("test_duration_microseconds").count, 1u);
+}
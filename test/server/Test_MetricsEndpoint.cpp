@@ -0,0 +1,116 @@
+#include "MetricsEndpoint.h"
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+namespace
+{
+  std::string httpGet(uint16_t port, const std::string& path)
+  {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+      close(client);
+      return std::string();
+    }
+
+    const std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    send(client, request.data(), request.size(), 0);
+
+    std::string response;
+    char buffer[1024];
+    ssize_t received;
+    while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0)
+      response.append(buffer, static_cast<size_t>(received));
+    close(client);
+    return response;
+  }
+
+  double renderedValue(const std::string& text, const std::string& name)
+  {
+    const std::string prefix = "\n" + name + " ";
+    const size_t position = text.find(prefix);
+    if (position == std::string::npos)
+      return -1;
+    return std::stod(text.substr(position + prefix.size()));
+  }
+}
+
+TEST(MetricsEndpointTest, RendersPrometheusText)
+{
+  MetricsRegistry registry;
+  registry.counter("test_requests_total").increment(5);
+  LatencyHistogram& latency = registry.histogram("test_latency_microseconds");
+  for (uint64_t value = 1; value <= 100; ++value)
+    latency.record(value);
+
+  MetricsEndpoint endpoint(registry, "127.0.0.1", 0, []()
+  {
+    return std::map<std::string, double>{{"test_workers", 2}};
+  });
+  const std::string text = endpoint.renderMetrics();
+
+  EXPECT_NE(text.find("# TYPE test_requests_total counter\ntest_requests_total 5\n"), std::string::npos);
+  EXPECT_NE(text.find("# TYPE test_requests_per_second gauge\n"), std::string::npos);
+  EXPECT_NE(text.find("# TYPE test_latency_microseconds summary\n"), std::string::npos);
+  EXPECT_NE(text.find("test_latency_microseconds{quantile=\"0.5\"} 50\n"), std::string::npos);
+  EXPECT_NE(text.find("test_latency_microseconds{quantile=\"0.999\"} 100\n"), std::string::npos);
+  EXPECT_NE(text.find("test_latency_microseconds_sum 5050\n"), std::string::npos);
+  EXPECT_NE(text.find("test_latency_microseconds_count 100\n"), std::string::npos);
+  EXPECT_NE(text.find("test_workers 2\n"), std::string::npos);
+}
+
+TEST(MetricsEndpointTest, ServesMetricsOverHttp)
+{
+  MetricsRegistry registry;
+  registry.counter("test_requests_total").increment();
+
+  MetricsEndpoint endpoint(registry, "127.0.0.1", 0);
+  endpoint.start();
+  ASSERT_NE(endpoint.getPort(), 0);
+
+  const std::string metrics = httpGet(endpoint.getPort(), "/metrics");
+  EXPECT_EQ(metrics.compare(0, 15, "HTTP/1.1 200 OK"), 0);
+  EXPECT_NE(metrics.find("test_requests_total 1\n"), std::string::npos);
+
+  const std::string missing = httpGet(endpoint.getPort(), "/other");
+  EXPECT_EQ(missing.compare(0, 22, "HTTP/1.1 404 Not Found"), 0);
+
+  endpoint.stop();
+}
+
+TEST(MetricsEndpointTest, RatesDoNotDependOnScrapes)
+{
+  MetricsRegistry registry;
+  MetricCounter& requests = registry.counter("test_requests_total");
+
+  MetricsEndpoint endpoint(registry, "127.0.0.1", 0);
+  endpoint.setRateWindow(std::chrono::milliseconds(200));
+  endpoint.start();
+  requests.increment(100);
+
+  // скорость появляется после закрытия окна, запросы метрик между окнами её не сбрасывают
+  double rate = 0;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (rate == 0 && std::chrono::steady_clock::now() < deadline)
+  {
+    rate = renderedValue(endpoint.renderMetrics(), "test_requests_per_second");
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_GT(rate, 0);
+  EXPECT_EQ(renderedValue(endpoint.renderMetrics(), "test_requests_per_second"), rate);
+  EXPECT_EQ(renderedValue(endpoint.renderMetrics(), "test_requests_per_second"), rate);
+
+  endpoint.stop();
+}
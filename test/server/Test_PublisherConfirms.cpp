@@ -0,0 +1,127 @@
+#include "RabbitMQClient/PublisherConfirms.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+class PublisherConfirmsTest : public ::testing::Test
+{
+protected:
+  PublisherConfirms confirms;
+  // результат подтверждения по номеру публикации, номера каналов не пересекаются в тестах
+  std::map<uint64_t, bool> results;
+
+  uint64_t publish(amqp_channel_t channel, uint64_t key)
+  {
+    return confirms.registerPublish(channel, [this, key](bool acked) {results[key] = acked;});
+  }
+};
+
+TEST_F(PublisherConfirmsTest, NumbersPublishesPerChannel)
+{
+  confirms.enable(1);
+  confirms.enable(2);
+  EXPECT_TRUE(confirms.isEnabled(1));
+  EXPECT_FALSE(confirms.isEnabled(3));
+
+  EXPECT_EQ(publish(1, 11), 1u);
+  EXPECT_EQ(publish(1, 12), 2u);
+  EXPECT_EQ(publish(2, 21), 1u);
+  EXPECT_EQ(confirms.getUnconfirmedCount(), 3u);
+}
+
+TEST_F(PublisherConfirmsTest, AckAndNackCompleteSinglePublish)
+{
+  confirms.enable(1);
+  publish(1, 1);
+  publish(1, 2);
+  publish(1, 3);
+
+  confirms.handleAck(1, 1, false);
+  confirms.handleNack(1, 3, false);
+
+  EXPECT_EQ(results.size(), 2u);
+  EXPECT_TRUE(results.at(1));
+  EXPECT_FALSE(results.at(3));
+  EXPECT_EQ(confirms.getUnconfirmedCount(), 1u);
+}
+
+TEST_F(PublisherConfirmsTest, MultipleAckCompletesAllUpToTag)
+{
+  confirms.enable(1);
+  for (uint64_t i = 1; i <= 5; ++i)
+    publish(1, i);
+
+  confirms.handleAck(1, 3, true);
+  EXPECT_EQ(results.size(), 3u);
+  EXPECT_TRUE(results.at(1));
+  EXPECT_TRUE(results.at(3));
+  EXPECT_EQ(results.count(4), 0u);
+
+  confirms.handleNack(1, 5, true);
+  EXPECT_FALSE(results.at(4));
+  EXPECT_FALSE(results.at(5));
+  EXPECT_EQ(confirms.getUnconfirmedCount(), 0u);
+}
+
+TEST_F(PublisherConfirmsTest, OutOfOrderAndRepeatedConfirmations)
+{
+  confirms.enable(1);
+  for (uint64_t i = 1; i <= 4; ++i)
+    publish(1, i);
+
+  // брокер может подтвердить более позднюю публикацию раньше
+  confirms.handleAck(1, 3, false);
+  EXPECT_EQ(results.size(), 1u);
+  EXPECT_TRUE(results.at(3));
+
+  // multiple не затрагивает уже подтвержденные публикации, повторное подтверждение игнорируется
+  confirms.handleNack(1, 4, true);
+  confirms.handleAck(1, 3, false);
+  EXPECT_FALSE(results.at(1));
+  EXPECT_FALSE(results.at(2));
+  EXPECT_TRUE(results.at(3));
+  EXPECT_FALSE(results.at(4));
+  EXPECT_EQ(confirms.getUnconfirmedCount(), 0u);
+}
+
+TEST_F(PublisherConfirmsTest, ConfirmationForUnknownChannelIsIgnored)
+{
+  confirms.enable(1);
+  publish(1, 1);
+
+  confirms.handleAck(2, 1, true);
+  EXPECT_TRUE(results.empty());
+  EXPECT_EQ(confirms.getUnconfirmedCount(), 1u);
+}
+
+TEST_F(PublisherConfirmsTest, ForgetChannelFailsOnlyItsPublishes)
+{
+  confirms.enable(1);
+  confirms.enable(2);
+  publish(1, 11);
+  publish(2, 21);
+
+  confirms.forgetChannel(1);
+  EXPECT_FALSE(results.at(11));
+  EXPECT_EQ(results.count(21), 0u);
+  EXPECT_FALSE(confirms.isEnabled(1));
+
+  // публикации другого канала подтверждаются как обычно
+  confirms.handleAck(2, 1, false);
+  EXPECT_TRUE(results.at(21));
+}
+
+TEST_F(PublisherConfirmsTest, FailAllFailsEveryChannelAndKeepsConfirmMode)
+{
+  confirms.enable(1);
+  confirms.enable(2);
+  publish(1, 11);
+  publish(2, 21);
+
+  confirms.failAll();
+  EXPECT_FALSE(results.at(11));
+  EXPECT_FALSE(results.at(21));
+  EXPECT_EQ(confirms.getUnconfirmedCount(), 0u);
+  EXPECT_TRUE(confirms.isEnabled(1));
+}
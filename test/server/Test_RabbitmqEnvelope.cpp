@@ -0,0 +1,67 @@
+#include "RabbitMQClient/rabbitmqEntities.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  std::vector<std::unique_ptr<RabbitmqEnvelope>> allocateEnvelopes(size_t count)
+  {
+    std::vector<std::unique_ptr<RabbitmqEnvelope>> envelopes;
+    for (size_t i = 0; i < count; ++i)
+      envelopes.push_back(std::make_unique<RabbitmqEnvelope>());
+    return envelopes;
+  }
+
+  // Удаляет конверты при завершении потока, после списка свободных блоков этого потока
+  struct LateEnvelopeHolder
+  {
+    std::vector<std::unique_ptr<RabbitmqEnvelope>> envelopes;
+
+    ~LateEnvelopeHolder()
+    {
+      envelopes.clear();
+      // список потока уже уничтожен: память берется из кучи, а не из освобожденного списка
+      auto envelope = std::make_unique<RabbitmqEnvelope>();
+      EXPECT_EQ(envelope->getDeliveryTag(), 0u);
+    }
+  };
+}
+
+TEST(RabbitmqEnvelopeTest, EnvelopesFreedOnAnotherThreadAreReused)
+{
+  const size_t count = 256;
+  std::vector<std::unique_ptr<RabbitmqEnvelope>> envelopes;
+  std::thread([&envelopes, count]() {envelopes = allocateEnvelopes(count);}).join();
+
+  // конверты созданы потоком чтения, а удаляются потоком обработки
+  std::set<const void*> freed;
+  for (const auto& envelope : envelopes)
+    freed.insert(envelope.get());
+  envelopes.clear();
+
+  // блоки, не поместившиеся в список потока обработки, достаются новому потоку чтения
+  size_t reused = 0;
+  std::thread([&reused, &freed, count]()
+  {
+    auto again = allocateEnvelopes(count / 2);
+    for (const auto& envelope : again)
+      reused += freed.count(envelope.get());
+  }).join();
+  EXPECT_GT(reused, count / 4);
+}
+
+TEST(RabbitmqEnvelopeTest, EnvelopeDeletedAfterThreadFreeListIsDestroyed)
+{
+  std::thread([]()
+  {
+    // объект создается раньше списка свободных блоков потока, поэтому уничтожается после него
+    thread_local LateEnvelopeHolder holder;
+    holder.envelopes = allocateEnvelopes(8);
+    allocateEnvelopes(8);
+  }).join();
+}
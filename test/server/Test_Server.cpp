@@ -2,6 +2,7 @@
 
 #include "Server.h"
 #include "protocol/Messages.pb.h"
+#include "RabbitMQClient/Metrics.h"
 #include "Logger/Logger.h"
 
 #include <gtest/gtest.h>
@@ -46,7 +47,10 @@ protected:
          .WillOnce(Return(ByMove(nullptr)));
     EXPECT_CALL(*mockConnection, bind(_, _, _, "requestQueue"))
          .WillOnce(Return(ByMove(nullptr)));
-    EXPECT_CALL(*mockConnection, basicConsume(_, _, true, true))
+    EXPECT_CALL(*mockConnection, basicQos(_, Server::defaultPrefetchCount))
+         .Times(1);
+    // подписка с подтверждениями, чтобы запросы упавшего сервера вернулись в очередь
+    EXPECT_CALL(*mockConnection, basicConsume(_, _, false, false))
          .Times(1);
    }
 
@@ -77,8 +81,11 @@ TEST_F(ServerTest, ProcessRequestResponseCycle_Success)
   EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
       .WillOnce(Return(ByMove(std::move(mockEnvelope))));
 
-  // должен быть вызван publishMessage с сообщением expected
-  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, expected))
+  // должен быть вызван publishMessage с сообщением expected, после чего запрос подтверждается
+  testing::InSequence sequence;
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(expected)))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
       .Times(1);
 
   auto server = std::make_unique<Server>(mockConnection,
@@ -113,8 +120,11 @@ TEST_F(ServerTest, ProcessRequestResponseCycle_Zero)
   EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
       .WillOnce(Return(ByMove(std::move(mockEnvelope))));
 
-  // должен быть вызван publishMessage с сообщением expected
-  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, expected))
+  // должен быть вызван publishMessage с сообщением expected, после чего запрос подтверждается
+  testing::InSequence sequence;
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(expected)))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
       .Times(1);
 
   auto server = std::make_unique<Server>(mockConnection,
@@ -143,12 +153,22 @@ TEST_F(ServerTest, ProcessRequestResponseCycle_WrongMsg)
   EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
       .WillOnce(Return(ByMove(std::move(mockEnvelope))));
 
+  // испорченный запрос отбрасывается без возврата в очередь
+  EXPECT_CALL(*mockConnection, reject(_, false))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
+
   auto server = std::make_unique<Server>(mockConnection,
                                     "localhost", 5672,
                                     "guest", "guest",
                                     0, "/",
                                     "testExchange", "responseQueue", "requestQueue");
-  EXPECT_THROW(server->processRequestResponseCycle(timeout), std::runtime_error);
+  MetricCounter& malformed = MetricsRegistry::instance().counter("server_malformed_requests_total");
+  const uint64_t malformedBefore = malformed.value();
+  // испорченный запрос не останавливает рабочий поток
+  EXPECT_NO_THROW(server->processRequestResponseCycle(timeout));
+  EXPECT_EQ(malformed.value(), malformedBefore + 1);
 }
 
 TEST_F(ServerTest, ProcessRequestResponseCycle_EmptyMsg)
@@ -164,12 +184,21 @@ TEST_F(ServerTest, ProcessRequestResponseCycle_EmptyMsg)
   EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
       .WillOnce(Return(ByMove(std::move(mockEnvelope))));
 
+  // испорченный запрос отбрасывается без возврата в очередь
+  EXPECT_CALL(*mockConnection, reject(_, false))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
+
   auto server = std::make_unique<Server>(mockConnection,
                                     "localhost", 5672,
                                     "guest", "guest",
                                     0, "/",
                                     "testExchange", "responseQueue", "requestQueue");
-  EXPECT_THROW(server->processRequestResponseCycle(timeout), std::runtime_error);
+  MetricCounter& malformed = MetricsRegistry::instance().counter("server_malformed_requests_total");
+  const uint64_t malformedBefore = malformed.value();
+  EXPECT_NO_THROW(server->processRequestResponseCycle(timeout));
+  EXPECT_EQ(malformed.value(), malformedBefore + 1);
 }
 
 TEST_F(ServerTest, ProcessRequestResponseCycle_PublishError)
@@ -192,6 +221,11 @@ TEST_F(ServerTest, ProcessRequestResponseCycle_PublishError)
   // метод publishMessage кинет исключение
   EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _))
       .WillOnce(Throw(std::runtime_error("")));
+  // без ответа запрос не подтверждается, а возвращается в очередь
+  EXPECT_CALL(*mockConnection, reject(_, true))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
 
   auto server = std::make_unique<Server>(mockConnection,
                                     "localhost", 5672,
@@ -215,3 +249,491 @@ TEST_F(ServerTest, ProcessRequestResponseCycle_Timeout)
                                     "testExchange", "responseQueue", "requestQueue");
   server->processRequestResponseCycle(timeout);
 }
+
+TEST_F(ServerTest, ProcessRequestResponseCycle_ReplyToQueue)
+{
+  std::chrono::milliseconds timeout(200);
+  // запрос от клиента с собственной очередью ответов
+  TestTask::Messages::Request request;
+  request.set_id("req-1");
+  request.set_req(21);
+  request.set_reply_to("amq.gen-reply");
+  std::string serializedRequest;
+  request.SerializeToString(&serializedRequest);
+
+  // ожидаемый ответ
+  TestTask::Messages::Response expectedResponse;
+  expectedResponse.set_id("req-1");
+  expectedResponse.set_res(42);
+  std::string expected;
+  expectedResponse.SerializeToString(&expected);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedRequest));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  // ответ уходит напрямую в очередь клиента, минуя общую очередь ответов
+  EXPECT_CALL(*mockConnection, publishToQueue(_, "amq.gen-reply", BytesEq(expected), _))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _))
+      .Times(0);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  server->processRequestResponseCycle(timeout);
+}
+
+TEST_F(ServerTest, ProcessRequestResponseCycle_DirectReplyTo)
+{
+  std::chrono::milliseconds timeout(200);
+  // запрос с очередью в теле, но адрес из свойства reply_to приоритетнее
+  TestTask::Messages::Request request;
+  request.set_id("req-1");
+  request.set_req(3);
+  request.set_reply_to("amq.gen-reply");
+  std::string serializedRequest;
+  request.SerializeToString(&serializedRequest);
+
+  TestTask::Messages::Response expectedResponse;
+  expectedResponse.set_id("req-1");
+  expectedResponse.set_res(6);
+  std::string expected;
+  expectedResponse.SerializeToString(&expected);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedRequest));
+  EXPECT_CALL(*mockEnvelope, getReplyTo())
+      .WillRepeatedly(Return("amq.rabbitmq.reply-to.g1hkABA"));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  EXPECT_CALL(*mockConnection, publishToQueue(_, "amq.rabbitmq.reply-to.g1hkABA", BytesEq(expected), _))
+      .Times(1);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  server->processRequestResponseCycle(timeout);
+}
+
+TEST_F(ServerTest, ProcessRequestResponseCycle_EchoesCorrelationId)
+{
+  std::chrono::milliseconds timeout(200);
+  TestTask::Messages::Request request;
+  request.set_id("req-1");
+  request.set_req(8);
+  request.set_correlation_id("17");
+  std::string serializedRequest;
+  request.SerializeToString(&serializedRequest);
+
+  // correlation_id возвращается и в теле ответа, и в свойствах сообщения
+  TestTask::Messages::Response expectedResponse;
+  expectedResponse.set_id("req-1");
+  expectedResponse.set_res(16);
+  expectedResponse.set_correlation_id("17");
+  std::string expected;
+  expectedResponse.SerializeToString(&expected);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedRequest));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(expected),
+                                              testing::Field(&RabbitmqMessageProperties::correlationId, "17")))
+      .Times(1);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  server->processRequestResponseCycle(timeout);
+}
+
+TEST_F(ServerTest, ProcessRequestResponseCycle_EchoesLatencyTimestamps)
+{
+  std::chrono::milliseconds timeout(200);
+  TestTask::Messages::Request request;
+  request.set_id("req-1");
+  request.set_req(8);
+  request.set_client_create_time_us(1000);
+  request.set_client_send_time_us(1500);
+  std::string serializedRequest;
+  request.SerializeToString(&serializedRequest);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedRequest));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  std::string published;
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _))
+      .WillOnce(Invoke([&published](const RabbitmqChannel&, const RabbitmqExchange&, const RabbitmqBind&, BytesView message)
+      {
+        published.assign(message.data, message.size);
+      }));
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  const uint64_t before = wallClockMicroseconds();
+  server->processRequestResponseCycle(timeout);
+  const uint64_t after = wallClockMicroseconds();
+
+  // отметки клиента копируются в ответ, отметки сервера укладываются во время обработки
+  TestTask::Messages::Response response;
+  ASSERT_TRUE(response.ParseFromString(published));
+  EXPECT_EQ(response.res(), 16);
+  EXPECT_EQ(response.client_create_time_us(), 1000u);
+  EXPECT_EQ(response.client_send_time_us(), 1500u);
+  EXPECT_GE(response.server_receive_time_us(), before);
+  EXPECT_LE(response.server_receive_time_us(), response.server_send_time_us());
+  EXPECT_LE(response.server_send_time_us(), after);
+}
+
+TEST_F(ServerTest, ProcessRequestResponseCycle_PublisherConfirmsAck)
+{
+  std::chrono::milliseconds timeout(200);
+  TestTask::Messages::Request request;
+  request.set_id("req-1");
+  request.set_req(5);
+  std::string serializedRequest;
+  request.SerializeToString(&serializedRequest);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedRequest));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  EXPECT_CALL(*mockConnection, confirmSelect(_))
+      .Times(1);
+  PublishConfirmCallback onConfirm;
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _, _, _))
+      .WillOnce(testing::SaveArg<5>(&onConfirm));
+
+  // запрос подтверждается только после подтверждения ответа брокером
+  bool confirmed = false;
+  EXPECT_CALL(*mockConnection, ack(_))
+      .WillOnce(Invoke([&confirmed](const IRabbitmqEnvelope&) { EXPECT_TRUE(confirmed); }));
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue",
+                                    Server::defaultPrefetchCount, true);
+  server->processRequestResponseCycle(timeout);
+
+  ASSERT_TRUE(onConfirm);
+  confirmed = true;
+  onConfirm(true);
+}
+
+TEST_F(ServerTest, ProcessRequestResponseCycle_PublisherConfirmsNack)
+{
+  std::chrono::milliseconds timeout(200);
+  TestTask::Messages::Request request;
+  request.set_id("req-1");
+  request.set_req(5);
+  request.set_reply_to("amq.gen-reply");
+  std::string serializedRequest;
+  request.SerializeToString(&serializedRequest);
+
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .WillOnce(Return(serializedRequest));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  EXPECT_CALL(*mockConnection, confirmSelect(_))
+      .Times(1);
+  PublishConfirmCallback onConfirm;
+  EXPECT_CALL(*mockConnection, publishToQueue(_, "amq.gen-reply", _, _, _))
+      .WillOnce(testing::SaveArg<4>(&onConfirm));
+
+  // брокер не принял ответ: запрос возвращается в очередь
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
+  EXPECT_CALL(*mockConnection, reject(_, true))
+      .Times(1);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue",
+                                    Server::defaultPrefetchCount, true);
+  server->processRequestResponseCycle(timeout);
+
+  ASSERT_TRUE(onConfirm);
+  onConfirm(false);
+}
+
+namespace
+{
+  std::string serializeRequest(const std::string& id, int value, const std::string& replyTo = "")
+  {
+    TestTask::Messages::Request request;
+    request.set_id(id);
+    request.set_req(value);
+    if (!replyTo.empty())
+      request.set_reply_to(replyTo);
+    std::string serialized;
+    request.SerializeToString(&serialized);
+    return serialized;
+  }
+
+  std::string serializeResponse(const std::string& id, int value)
+  {
+    TestTask::Messages::Response response;
+    response.set_id(id);
+    response.set_res(value);
+    std::string serialized;
+    response.SerializeToString(&serialized);
+    return serialized;
+  }
+
+  testing::Matcher<const BatchMessage&> batchBody(const std::string& body)
+  {
+    return testing::Field(&BatchMessage::body, BytesEq(body));
+  }
+
+  std::unique_ptr<IRabbitmqEnvelope> createEnvelope(const std::string& message)
+  {
+    auto envelope = std::make_unique<MockRabbitmqEnvelope>();
+    EXPECT_CALL(*envelope, getMessage())
+        .WillOnce(Return(message));
+    return envelope;
+  }
+}
+
+TEST_F(ServerTest, ProcessRequestBatch_PublishesTogether)
+{
+  std::chrono::milliseconds timeout(200);
+
+  // первого запроса ждем, остальные забираем без ожидания
+  testing::Sequence consume;
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-1", 1)))));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(std::chrono::milliseconds(0)))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-2", 2)))))
+      .WillOnce(Return(ByMove(nullptr)));
+
+  EXPECT_CALL(*mockConnection, publishBatch(_, _, _, testing::ElementsAre(batchBody(serializeResponse("req-1", 2)),
+                                                                           batchBody(serializeResponse("req-2", 4)))))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, _))
+      .Times(0);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(2);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  EXPECT_EQ(server->processRequestBatch(timeout, 10), 2u);
+}
+
+TEST_F(ServerTest, ProcessRequestBatch_MixedRequests)
+{
+  std::chrono::milliseconds timeout(200);
+  std::string malformed = serializeRequest("req-2", 2);
+  malformed[0] = 0; // портим запрос
+
+  testing::Sequence consume;
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-1", 1)))));
+  // пачка ограничена тремя запросами, четвертый раз за сообщением сервер не обращается
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(std::chrono::milliseconds(0)))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(malformed))))
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-3", 3, "amq.gen-reply")))));
+
+  // испорченный запрос отбрасывается, ответ с собственным адресом уходит отдельно
+  EXPECT_CALL(*mockConnection, reject(_, false))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, publishToQueue(_, "amq.gen-reply", BytesEq(serializeResponse("req-3", 6)), _))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, publishBatch(_, _, _, testing::ElementsAre(batchBody(serializeResponse("req-1", 2)))))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(2);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  EXPECT_EQ(server->processRequestBatch(timeout, 3), 3u);
+}
+
+TEST_F(ServerTest, ProcessRequestBatch_PublishError)
+{
+  std::chrono::milliseconds timeout(200);
+
+  testing::Sequence consume;
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-1", 1)))));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(std::chrono::milliseconds(0)))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-2", 2)))))
+      .WillOnce(Return(ByMove(nullptr)));
+
+  // вся пачка возвращается в очередь
+  EXPECT_CALL(*mockConnection, publishBatch(_, _, _, _))
+      .WillOnce(Throw(std::runtime_error("")));
+  EXPECT_CALL(*mockConnection, reject(_, true))
+      .Times(2);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  EXPECT_THROW(server->processRequestBatch(timeout, 10), std::runtime_error);
+}
+
+TEST_F(ServerTest, ProcessRequestBatch_PartialPublishError)
+{
+  std::chrono::milliseconds timeout(200);
+
+  testing::Sequence consume;
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-1", 1)))));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(std::chrono::milliseconds(0)))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-2", 2)))))
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-3", 3)))))
+      .WillOnce(Return(ByMove(nullptr)));
+
+  // первый ответ уже ушел брокеру: его запрос подтверждается, остальные возвращаются в очередь
+  EXPECT_CALL(*mockConnection, publishBatch(_, _, _, testing::SizeIs(3)))
+      .WillOnce(Throw(BatchPublishError("", 1)));
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, reject(_, true))
+      .Times(2);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  EXPECT_THROW(server->processRequestBatch(timeout, 10), BatchPublishError);
+}
+
+TEST_F(ServerTest, ProcessRequestBatch_SingleResponseErrorRequeuesBatch)
+{
+  std::chrono::milliseconds timeout(200);
+
+  testing::Sequence consume;
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-1", 1)))));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(std::chrono::milliseconds(0)))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-2", 2, "amq.gen-reply")))));
+
+  // ответ с собственным адресом не отправлен: возвращаются в очередь и он, и уже собранная пачка
+  EXPECT_CALL(*mockConnection, publishToQueue(_, "amq.gen-reply", _, _))
+      .WillOnce(Throw(std::runtime_error("")));
+  EXPECT_CALL(*mockConnection, publishBatch(_, _, _, _))
+      .Times(0);
+  EXPECT_CALL(*mockConnection, reject(_, true))
+      .Times(2);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(0);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  EXPECT_THROW(server->processRequestBatch(timeout, 10), std::runtime_error);
+}
+
+TEST_F(ServerTest, ProcessRequestBatch_PassesCorrelationId)
+{
+  std::chrono::milliseconds timeout(200);
+
+  TestTask::Messages::Request request;
+  request.set_id("req-1");
+  request.set_req(1);
+  request.set_correlation_id("17");
+  std::string serializedRequest;
+  request.SerializeToString(&serializedRequest);
+
+  testing::Sequence consume;
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializedRequest))));
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(std::chrono::milliseconds(0)))
+      .InSequence(consume)
+      .WillOnce(Return(ByMove(createEnvelope(serializeRequest("req-2", 2)))))
+      .WillOnce(Return(ByMove(nullptr)));
+
+  // свойства передаются для каждого сообщения пачки, ответ без correlation_id уходит без свойств
+  EXPECT_CALL(*mockConnection, publishBatch(_, _, _, testing::ElementsAre(
+      testing::Field(&BatchMessage::properties,
+                     testing::Pointee(testing::Field(&RabbitmqMessageProperties::correlationId, "17"))),
+      testing::Field(&BatchMessage::properties, testing::IsNull()))))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(2);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  EXPECT_EQ(server->processRequestBatch(timeout, 10), 2u);
+}
+
+TEST_F(ServerTest, ProcessRequestResponseCycle_ParsesMessageView)
+{
+  std::chrono::milliseconds timeout(200);
+  std::string serializedRequest = serializeRequest("req-1", 7);
+
+  // тело запроса разбирается прямо из конверта, без копии в std::string
+  auto mockEnvelope = std::make_unique<MockRabbitmqEnvelope>();
+  EXPECT_CALL(*mockEnvelope, getMessageView())
+      .WillOnce(Return(BytesView(serializedRequest)));
+  EXPECT_CALL(*mockEnvelope, getMessage())
+      .Times(0);
+  EXPECT_CALL(*mockConnection, timedConsumeMessage(timeout))
+      .WillOnce(Return(ByMove(std::move(mockEnvelope))));
+
+  EXPECT_CALL(*mockConnection, publishMessage(_, _, _, BytesEq(serializeResponse("req-1", 14))))
+      .Times(1);
+  EXPECT_CALL(*mockConnection, ack(_))
+      .Times(1);
+
+  auto server = std::make_unique<Server>(mockConnection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  server->processRequestResponseCycle(timeout);
+}
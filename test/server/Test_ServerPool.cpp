@@ -0,0 +1,191 @@
+#include "mocks.h"
+
+#include "ServerPool.h"
+#include "protocol/Messages.pb.h"
+#include "RabbitMQClient/InMemoryConnection.h"
+#include "Logger/Logger.h"
+
+#include <gtest/gtest.h>
+
+using testing::_;
+using testing::AtLeast;
+using testing::Invoke;
+using testing::Return;
+using testing::ByMove;
+
+namespace
+{
+  std::shared_ptr<MockRabbitmqConnection> createIdleConnection()
+  {
+    auto connection = std::make_shared<MockRabbitmqConnection>();
+    EXPECT_CALL(*connection, openSocket(_, _))
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*connection, login(_, _, _, _))
+        .Times(1);
+    EXPECT_CALL(*connection, openChannel())
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*connection, declareExchange(_, _, _))
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*connection, declareQueue(_, _))
+        .WillOnce(Return(ByMove(nullptr)))
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*connection, bind(_, _, _, _))
+        .WillOnce(Return(ByMove(nullptr)))
+        .WillOnce(Return(ByMove(nullptr)));
+    EXPECT_CALL(*connection, basicQos(_, _))
+        .Times(1);
+    // несколько рабочих потоков могут подписаться на одну очередь только без эксклюзивности
+    EXPECT_CALL(*connection, basicConsume(_, _, _, false))
+        .Times(1);
+    // сообщений нет, каждый цикл заканчивается таймаутом
+    EXPECT_CALL(*connection, timedConsumeMessage(_))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Invoke([](std::chrono::milliseconds timeout)
+        {
+          std::this_thread::sleep_for(timeout);
+          return std::unique_ptr<IRabbitmqEnvelope>();
+        }));
+    return connection;
+  }
+
+  std::unique_ptr<Server> createServer(std::shared_ptr<IRabbitmqConnection> connection)
+  {
+    return std::make_unique<Server>(connection,
+                                    "localhost", 5672,
+                                    "guest", "guest",
+                                    0, "/",
+                                    "testExchange", "responseQueue", "requestQueue");
+  }
+}
+
+class ServerPoolTest : public ::testing::Test
+{
+protected:
+  static void SetUpTestSuite()
+  {
+    Logger::setupLogging("logs.txt", QtInfoMsg);
+  }
+};
+
+TEST_F(ServerPoolTest, EachWorkerOwnsServer)
+{
+  const size_t workerCount = 4;
+  std::atomic<size_t> createdServers(0);
+
+  ServerPool pool([&createdServers]()
+                  {
+                    ++createdServers;
+                    return createServer(createIdleConnection());
+                  },
+                  workerCount, std::chrono::milliseconds(5));
+  EXPECT_EQ(pool.getWorkerCount(), workerCount);
+
+  pool.start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(pool.getRunningWorkerCount(), workerCount);
+
+  pool.stop();
+  pool.wait();
+  EXPECT_EQ(createdServers, workerCount);
+  EXPECT_EQ(pool.getRunningWorkerCount(), 0u);
+}
+
+TEST_F(ServerPoolTest, EventDrivenWorkersAnswerAndStop)
+{
+  auto broker = InMemoryBroker::create();
+  // таймаут опроса больше ожидания ответа: ответ возможен только по событию
+  ServerPool pool([broker]()
+                  {
+                    return std::make_unique<Server>(InMemoryConnection::create(broker),
+                                                    "localhost", 5672, "guest", "guest", 0, "/",
+                                                    "exchange", "responses", "requests");
+                  },
+                  2, std::chrono::seconds(10), 1, true);
+  pool.start();
+
+  auto client = InMemoryConnection::create(broker);
+  auto channel = client->openChannel();
+  auto exchange = client->declareExchange(*channel, "exchange", "direct");
+  auto responseQueue = client->declareQueue(*channel, "responses");
+  auto requestQueue = client->declareQueue(*channel, "requests");
+  auto requestBinding = client->bind(*channel, *requestQueue, *exchange, "requests");
+  client->basicConsume(*channel, *responseQueue, true, false);
+
+  TestTask::Messages::Request request;
+  request.set_id("client");
+  request.set_req(21);
+  std::string buffer;
+  client->publishMessage(*channel, *exchange, *requestBinding, serializeToBuffer(request, buffer));
+
+  auto envelope = client->timedConsumeMessage(std::chrono::seconds(2));
+  ASSERT_NE(envelope, nullptr);
+  TestTask::Messages::Response response;
+  ASSERT_TRUE(response.ParseFromString(envelope->getMessage()));
+  EXPECT_EQ(response.res(), Server::generateResponseValue(21));
+
+  const auto stoppedAt = std::chrono::steady_clock::now();
+  pool.stop();
+  pool.wait();
+  EXPECT_LT(std::chrono::steady_clock::now() - stoppedAt, std::chrono::seconds(2));
+  EXPECT_EQ(pool.getRunningWorkerCount(), 0u);
+}
+
+TEST_F(ServerPoolTest, MalformedRequestDoesNotStopWorker)
+{
+  auto broker = InMemoryBroker::create();
+  // единственный рабочий поток: если он завершится, на запрос после испорченного никто не ответит
+  ServerPool pool([broker]()
+                  {
+                    return std::make_unique<Server>(InMemoryConnection::create(broker),
+                                                    "localhost", 5672, "guest", "guest", 0, "/",
+                                                    "exchange", "responses", "requests");
+                  },
+                  1, std::chrono::milliseconds(50), 1, true);
+  pool.start();
+
+  auto client = InMemoryConnection::create(broker);
+  auto channel = client->openChannel();
+  auto exchange = client->declareExchange(*channel, "exchange", "direct");
+  auto responseQueue = client->declareQueue(*channel, "responses");
+  auto requestQueue = client->declareQueue(*channel, "requests");
+  auto requestBinding = client->bind(*channel, *requestQueue, *exchange, "requests");
+  client->basicConsume(*channel, *responseQueue, true, false);
+
+  const std::string malformed = "\xff\xff\xff";
+  client->publishMessage(*channel, *exchange, *requestBinding, malformed);
+
+  TestTask::Messages::Request request;
+  request.set_id("client");
+  request.set_req(7);
+  std::string buffer;
+  client->publishMessage(*channel, *exchange, *requestBinding, serializeToBuffer(request, buffer));
+
+  auto envelope = client->timedConsumeMessage(std::chrono::seconds(2));
+  ASSERT_NE(envelope, nullptr);
+  TestTask::Messages::Response response;
+  ASSERT_TRUE(response.ParseFromString(envelope->getMessage()));
+  EXPECT_EQ(response.res(), Server::generateResponseValue(7));
+  EXPECT_EQ(pool.getRunningWorkerCount(), 1u);
+
+  pool.stop();
+  pool.wait();
+}
+
+TEST_F(ServerPoolTest, FailedWorkerStops)
+{
+  ServerPool pool([]() -> std::unique_ptr<Server>
+                  {
+                    throw std::runtime_error("connection refused");
+                  },
+                  2, std::chrono::milliseconds(5));
+  pool.start();
+  pool.wait();
+  EXPECT_EQ(pool.getRunningWorkerCount(), 0u);
+}
+
+TEST_F(ServerPoolTest, InvalidArguments)
+{
+  EXPECT_THROW(ServerPool(nullptr, 1, std::chrono::milliseconds(5)), std::invalid_argument);
+  EXPECT_THROW(ServerPool([]() { return std::unique_ptr<Server>(); }, 0, std::chrono::milliseconds(5)), std::invalid_argument);
+  EXPECT_THROW(ServerPool([]() { return std::unique_ptr<Server>(); }, 1, std::chrono::milliseconds(5), 0), std::invalid_argument);
+}